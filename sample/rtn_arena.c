@@ -0,0 +1,262 @@
+/***
+ *   rtn_arena.c
+ *
+ *   Fixed size element arena.
+ *
+ *    Copyright (c) 2016 Ericsson AB.
+ *    All rights reserved.
+ *
+ ***
+ * Description:
+ *
+ * Each slab is cache line aligned, and starts with a small header that
+ * chains the slabs of an arena. The slab size doubles from
+ * RTN_ARENA_SLAB_MIN up to RTN_ARENA_SLAB_MAX elements, so a small tree
+ * holds little memory, while a large tree has few slabs.
+ *
+ * Free elements are chained through their first word.
+ *
+ * The memory of a slab is first touched by the thread that allocates
+ * it, normally the owner of the arena, so the slab lands on the NUMA
+ * node of that thread.
+ *
+ * A huge page slab is mapped on its own, 2 MB aligned, and unmapped by
+ * rtn_arena_destroy(). Once an explicit huge page fails (none reserved
+ * in /proc/sys/vm/nr_hugepages), the arena stops asking for one, and
+ * goes to a transparent one directly. Whether the kernel backs the
+ * latter with a huge page is up to it (AnonHugePages in /proc/meminfo):
+ * ra_thp_slabs only counts the slabs it was asked for.
+ *
+ ***/
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+
+#include "corelibs/rtn_radix.h"
+#include "corelibs/rtn_arena.h"
+#include "rtn_private.h"
+
+/*
+ * Internal flag of an arena: no explicit huge page to be had.
+ */
+#define RTN_ARENA_F_NO_HUGETLB  0x80000000
+
+/*
+ * How a slab was allocated.
+ */
+#define RTN_ARENA_SLAB_HEAP     0       /* posix_memalign() */
+#define RTN_ARENA_SLAB_HUGETLB  1       /* mmap(), MAP_HUGETLB */
+#define RTN_ARENA_SLAB_THP      2       /* mmap(), MADV_HUGEPAGE */
+#define RTN_ARENA_SLAB_MAP      3       /* mmap(), no huge page */
+
+struct _rtn_arena_slab_t
+{
+    struct _rtn_arena_slab_t *rs_next;    /* next slab */
+    u_int32_t        rs_elems;            /* elements in this slab */
+    u_int32_t        rs_size;             /* bytes in this slab */
+    u_int32_t        rs_kind;             /* RTN_ARENA_SLAB_ */
+} __attribute__((aligned(RTN_ARENA_ALIGN)));
+
+/*
+ * rtn_arena_init
+ *
+ * Initialize an arena.
+ */
+void
+rtn_arena_init (rtn_arena_t *arena, u_int32_t elem_size, u_int32_t flags)
+{
+    memset(arena, 0, sizeof(rtn_arena_t));
+
+    /*
+     * Room for the free chain, and no element across two cache lines
+     * when asked for: round up to a power of two up to the line size.
+     */
+    if (elem_size < sizeof(void *)) {
+        elem_size = sizeof(void *);
+    }
+    elem_size = (elem_size + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+    if ((flags & RTN_ARENA_F_ALIGN) && (elem_size < RTN_ARENA_ALIGN)) {
+        while (RTN_ARENA_ALIGN % elem_size) {
+            elem_size += sizeof(void *);
+        }
+    }
+
+    arena->ra_elem_size = elem_size;
+    arena->ra_next_elems = RTN_ARENA_SLAB_MIN;
+    arena->ra_flags = flags;
+}
+
+/*
+ * rtn_arena_map
+ *
+ * Map a huge page slab, RTN_ARENA_HUGEPAGE bytes, or return NULL.
+ */
+static rtn_arena_slab_t *
+rtn_arena_map (rtn_arena_t *arena, u_int32_t *kind)
+{
+    u_int8_t *map, *slab;
+    size_t head;
+
+#ifdef MAP_HUGETLB
+    if (!(arena->ra_flags & RTN_ARENA_F_NO_HUGETLB)) {
+        map = mmap(NULL, RTN_ARENA_HUGEPAGE, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (map != MAP_FAILED) {
+            *kind = RTN_ARENA_SLAB_HUGETLB;
+            return ((rtn_arena_slab_t *) map);
+        }
+        arena->ra_flags |= RTN_ARENA_F_NO_HUGETLB;
+    }
+#endif
+
+    /*
+     * Twice the size, so that an aligned huge page is in it, and the
+     * rest is unmapped.
+     */
+    map = mmap(NULL, 2 * RTN_ARENA_HUGEPAGE, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (map == MAP_FAILED) {
+        return (NULL);
+    }
+    slab = (u_int8_t *) (((uintptr_t) map + RTN_ARENA_HUGEPAGE - 1) &
+                         ~((uintptr_t) RTN_ARENA_HUGEPAGE - 1));
+    head = slab - map;
+    if (head) {
+        munmap(map, head);
+    }
+    munmap(slab + RTN_ARENA_HUGEPAGE, RTN_ARENA_HUGEPAGE - head);
+
+    *kind = RTN_ARENA_SLAB_MAP;
+#ifdef MADV_HUGEPAGE
+    if (!madvise(slab, RTN_ARENA_HUGEPAGE, MADV_HUGEPAGE)) {
+        *kind = RTN_ARENA_SLAB_THP;
+    }
+#endif
+
+    return ((rtn_arena_slab_t *) slab);
+}
+
+/*
+ * rtn_arena_grow
+ *
+ * Add a slab to an arena, and put its elements on the free chain.
+ */
+static int
+rtn_arena_grow (rtn_arena_t *arena)
+{
+    rtn_arena_slab_t *slab = NULL;
+    u_int8_t *elem;
+    u_int32_t i, size, elems, kind = RTN_ARENA_SLAB_HEAP;
+
+    if (arena->ra_flags & RTN_ARENA_F_HUGEPAGE) {
+        slab = rtn_arena_map(arena, &kind);
+    }
+
+    if (slab) {
+        size = RTN_ARENA_HUGEPAGE;
+        elems = (size - sizeof(rtn_arena_slab_t)) / arena->ra_elem_size;
+        if (kind == RTN_ARENA_SLAB_HUGETLB) {
+            arena->ra_hugetlb_slabs++;
+        } else if (kind == RTN_ARENA_SLAB_THP) {
+            arena->ra_thp_slabs++;
+        }
+    } else {
+        elems = arena->ra_next_elems;
+        size = sizeof(rtn_arena_slab_t) + elems * arena->ra_elem_size;
+        if (posix_memalign((void **) &slab, RTN_ARENA_ALIGN, size)) {
+            return (FALSE);
+        }
+    }
+
+    slab->rs_elems = elems;
+    slab->rs_size = size;
+    slab->rs_kind = kind;
+    slab->rs_next = arena->ra_slabs;
+    arena->ra_slabs = slab;
+
+    /*
+     * Chain the elements so that they are handed out in address order.
+     */
+    elem = (u_int8_t *) (slab + 1);
+    for (i = slab->rs_elems; i > 0; i--) {
+        *(void **) (elem + (i - 1) * arena->ra_elem_size) = arena->ra_free;
+        arena->ra_free = elem + (i - 1) * arena->ra_elem_size;
+    }
+
+    arena->ra_slab_count++;
+    arena->ra_bytes += size;
+    if (arena->ra_next_elems < RTN_ARENA_SLAB_MAX) {
+        arena->ra_next_elems <<= 1;
+    }
+
+    return (TRUE);
+}
+
+/*
+ * rtn_arena_alloc
+ *
+ * Allocate a zero'ed element.
+ */
+void *
+rtn_arena_alloc (rtn_arena_t *arena)
+{
+    void *elem;
+
+    if (!arena->ra_free && !rtn_arena_grow(arena)) {
+        return (NULL);
+    }
+
+    elem = arena->ra_free;
+    arena->ra_free = *(void **) elem;
+    memset(elem, 0, arena->ra_elem_size);
+
+    if (++arena->ra_inuse > arena->ra_peak) {
+        arena->ra_peak = arena->ra_inuse;
+    }
+
+    return (elem);
+}
+
+/*
+ * rtn_arena_free
+ *
+ * Put an element back on the free chain.
+ */
+void
+rtn_arena_free (rtn_arena_t *arena, void *elem)
+{
+    *(void **) elem = arena->ra_free;
+    arena->ra_free = elem;
+    arena->ra_inuse--;
+}
+
+/*
+ * rtn_arena_destroy
+ *
+ * Release all the slabs.
+ */
+void
+rtn_arena_destroy (rtn_arena_t *arena)
+{
+    rtn_arena_slab_t *slab;
+
+    while ((slab = arena->ra_slabs) != NULL) {
+        arena->ra_slabs = slab->rs_next;
+        if (slab->rs_kind == RTN_ARENA_SLAB_HEAP) {
+            free(slab);
+        } else {
+            munmap(slab, slab->rs_size);
+        }
+    }
+
+    arena->ra_free = NULL;
+    arena->ra_slab_count = 0;
+    arena->ra_inuse = 0;
+    arena->ra_bytes = 0;
+    arena->ra_hugetlb_slabs = 0;
+    arena->ra_thp_slabs = 0;
+    arena->ra_next_elems = RTN_ARENA_SLAB_MIN;
+}
@@ -0,0 +1,93 @@
+/**
+ *  @name rtn_arena.h, Fixed size element arena
+ *
+ *  API for rtn_arena.c.
+ *
+ *  An arena hands out fixed size elements from slabs that it owns. It
+ *  has no lock: it belongs to one owner (e.g. the writer of a radix tree)
+ *  so there is no contention between trees, and the elements of a tree
+ *  stay close to each other. All the slabs are released at once by
+ *  rtn_arena_destroy().
+ *
+ *  With RTN_ARENA_F_HUGEPAGE, each slab is one 2 MB huge page, so a
+ *  walk over many elements (e.g. a lookup down a large tree) takes
+ *  fewer TLB misses. An explicit huge page (MAP_HUGETLB) is tried
+ *  first, then a transparent one (MADV_HUGEPAGE), then the slab falls
+ *  back to the heap as without the flag. The flag is meant for large
+ *  pools: the first slab is already 2 MB.
+ *
+ *     Copyright (c) 2016 Ericsson AB.
+ *
+ *     All rights reserved.
+ */
+
+#ifndef __RTN_ARENA_H__
+#define __RTN_ARENA_H__
+
+#include <sys/types.h>
+#include "core-data-types/baseTypes.h"
+
+#define RTN_ARENA_ALIGN          64     /* slab alignment, a cache line */
+#define RTN_ARENA_SLAB_MIN       16     /* elements in the first slab */
+#define RTN_ARENA_SLAB_MAX     4096     /* max. elements in a slab */
+#define RTN_ARENA_HUGEPAGE  (2 << 20)   /* bytes of a huge page slab */
+
+/*
+ * Flags for an arena.
+ */
+#define RTN_ARENA_F_NONE       0x00
+#define RTN_ARENA_F_ALIGN      0x01     /* elements do not straddle lines */
+#define RTN_ARENA_F_HUGEPAGE   0x02     /* slabs of huge pages */
+
+typedef struct _rtn_arena_slab_t rtn_arena_slab_t;
+
+typedef struct _rtn_arena_t
+{
+    void             *ra_free;          /* free elements */
+    rtn_arena_slab_t *ra_slabs;         /* slabs owned */
+    u_int32_t        ra_elem_size;      /* element size */
+    u_int32_t        ra_next_elems;     /* elements in the next slab */
+    u_int32_t        ra_flags;          /* RTN_ARENA_F_ flags */
+
+    /*
+     * Stats.
+     */
+    u_int32_t        ra_slab_count;     /* slabs allocated */
+    u_int32_t        ra_inuse;          /* elements in use */
+    u_int32_t        ra_peak;           /* max. elements in use */
+    u_int64_t        ra_bytes;          /* bytes held in slabs */
+    u_int32_t        ra_hugetlb_slabs;  /* slabs of explicit huge pages */
+    u_int32_t        ra_thp_slabs;      /* slabs of transparent ones */
+} rtn_arena_t;
+
+
+/**
+ * Initialize an arena. No memory is allocated until the first element.
+ *
+ * @param arena      the arena. Must not be NULL.
+ * @param elem_size  size of an element.
+ * @param flags      RTN_ARENA_F_ flags.
+ */
+extern void rtn_arena_init(rtn_arena_t *arena, u_int32_t elem_size,
+                           u_int32_t flags);
+
+/**
+ * Allocate a zero'ed element.
+ *
+ * @return
+ *     the element, or NULL when out of memory.
+ */
+extern void *rtn_arena_alloc(rtn_arena_t *arena);
+
+/**
+ * Return an element to the arena it was allocated from.
+ */
+extern void rtn_arena_free(rtn_arena_t *arena, void *elem);
+
+/**
+ * Release all the slabs of an arena at once. Any element still in use
+ * is gone as well.
+ */
+extern void rtn_arena_destroy(rtn_arena_t *arena);
+
+#endif  /* __RTN_ARENA_H__ */
@@ -0,0 +1,3617 @@
+/***
+ *   rtn_bench.c
+ *
+ *   Benchmark of the radix trie on synthetic routing tables.
+ *
+ *    Copyright (c) 2016 Ericsson AB.
+ *    All rights reserved.
+ *
+ ***
+ * Description:
+ *
+ * A standalone program, with no dependency past libc and the radix
+ * sources:
+ *
+ *   cc -O2 -pthread -o rtn_bench rtn_*.c -lm
+ *
+ * (the -I for corelibs/ and platform-os/ as for the rest of the tree).
+ *
+ * It generates a table, and a trace of addresses, from a seed, so two
+ * runs with the same options see the same keys in the same order:
+ *
+ *   o ipv4: a BGP-like table, with the prefix length distribution of a
+ *     full table (most of it /24, then /22 and /23), and a third of the
+ *     prefixes more specific to one already generated, as in a table of
+ *     aggregates and their deaggregates.
+ *
+ *   o ipv6: a /48-heavy table under 2000::/3, with the /32 and /29 of
+ *     the allocations.
+ *
+ *   o vpn: 96-bit keys, a route distinguisher and an IPv4 prefix, with
+ *     the routes spread over the VRFs with a Zipf law, so a few VRFs are
+ *     large and most are small. Many of the prefixes are host routes.
+ *
+ * The traces are:
+ *
+ *   o uniform: an address under a prefix picked at random.
+ *   o zipf: the same, with the prefix picked by a Zipf law of -z.
+ *   o scan: consecutive /24s (ipv4, vpn) or /48s (ipv6).
+ *
+ * It times rtn_add(), rtn_search(), rtn_lookup() for each trace,
+ * rtn_key_getnext() and a getnext cursor over the whole table,
+ * rtn_walktree() and rtn_delete(), and prints for each one the ops/s
+ * and the ns/op percentiles, then the RSS. Each op is timed, less the
+ * cost of reading the clock; for rtn_search() and rtn_lookup(), which
+ * change nothing, the ops/s come from a second run with no per-op
+ * timing.
+ *
+ * With -m, once the table is deleted, it is spread over 2, 4, ... up to
+ * -m trees, as VRFs, and the best match of an address in all of them
+ * is timed with a loop of rtn_lookup() and with rtn_lookup_multi(), on
+ * a uniform trace cut so that each count of trees does the same count
+ * of lookups.
+ *
+ * With -l, the lookups go through the compiled form of rtn_lctrie.h,
+ * with that fill factor, compiled once the table is added. The result
+ * of each address of a trace is then checked against the tree, and the
+ * run fails on the first trace where they differ.
+ *
+ * With -b, each trace is also resolved with rtn_lookup_batch(), in
+ * bursts of 1, 2, 4, ... up to -b addresses, and each result is checked
+ * against rtn_lookup(). The ops are addresses, and the percentiles are
+ * of a whole burst.
+ *
+ * With -S, the stride engine of rtn_stride.h is built once the table is
+ * added, and rtn_stride_lookup() is timed on each trace after
+ * rtn_lookup(), with its result checked against the one of the tree.
+ * Then a tenth of the table is deleted and added again, so the engine
+ * follows each change, and the last trace is checked once more.
+ *
+ * With -C, the tree also keeps the compact nodes of rtn_compact.h
+ * (RTN_BIT_COMPACT). Their size is printed once the table is added, and
+ * rtn_compact_lookup() is timed on each trace after rtn_lookup(), which
+ * descends the nodes of the tree either way, with each result checked
+ * against the one of the tree.
+ *
+ * With -f, each trace is also looked up through a flow cache of
+ * rtn_flowcache.h of -f entries, 4 ways, with each result checked
+ * against rtn_lookup(), and its hit rate printed. Then a flows trace is
+ * looked up, where each prefix has a single address, picked by the
+ * Zipf law of the zipf trace, as the flows of a link; and again with a
+ * prefix deleted and added back every 10000 lookups, each change making
+ * the whole cache stale.
+ *
+ * With -A, an ACL of -A prefixes is generated near the prefixes of the
+ * table (up to 8 bits shorter or longer than one of them), sorted, and
+ * each of its prefixes is looked up with rtn_lookup_range() and with
+ * rtn_lookup_prefix_overlap(), one call each, then with the batch calls
+ * for the whole ACL. The results of the batch calls are checked against
+ * the single calls.
+ *
+ * With -V, a tenth of the table is deleted and added back, one prefix at
+ * a time, three times: with no view of rtn_view.h held, while a view is
+ * held, and while a thread walks a view again and again. The ops are
+ * the deletes and the adds. Each walk of the view is checked to see the
+ * whole table, as it was when the view was taken.
+ *
+ * With -a, the shape of the tree (rtn_shape.h) is printed once the
+ * table is added, with the subtrees split at that bit.
+ *
+ * With -k, once the table is walked, the infos of a narrow range of
+ * lengths, the shortest ones of the table and the longest one, are
+ * walked with rtn_walktree_keybits(), then through the index of
+ * rtn_lenidx.h, in the calling thread and on -k threads.
+ *
+ * With -W, once the table is walked, it is walked again with a walk
+ * cursor, -W infos per rtn_walk_cursor_resume() (then 1/4, 1/16, ...
+ * of it down to 1), as an event loop would, and the percentiles are of
+ * one resume, i.e., of the gap the walk leaves in the loop. Each walk
+ * is checked against rtn_walktree(). It is done again with a prefix
+ * deleted and added back between two resumes.
+ *
+ * With -p, once the table is walked, it is split into shards at a bit
+ * depth (8 for ipv4, 16 for ipv6, 72 for vpn), and walked with
+ * rtn_walktree_parallel() on 1, 2, 4, ... up to -p threads: in no
+ * order, then merged back in the order of rtn_walktree() and checked
+ * against it. Then a sixteenth of the table gets a new version, and
+ * only those infos are walked with rtn_walktree_version_parallel().
+ *
+ * With -c, the table gets -c new versions, with rtn_bump_version()
+ * and then logged by the change log of rtn_changelog.h, and a quarter
+ * as many prefixes are deleted and added again. The changes are read
+ * from a cursor taken before them, and with a version walk, and both
+ * are checked to return the same infos. Then so many changes are made
+ * that the log overflows, and the read is checked to fall back to the
+ * version walk.
+ *
+ * With -x, the table is copied to another tree through a socket, with
+ * the stream of rtn_wire.h exported on a thread and imported on the
+ * other end, and then with rtn_walktree() and rtn_add(). The export and
+ * the import are also timed on their own, through a file: through the
+ * socket, both ends walk or build a tree, and on one CPU, the time is
+ * that of both.
+ *
+ * With -P, the table is written to a snapshot of rtn_snapshot.h, which
+ * is mapped into another tree, as at a restart. A uniform trace, and
+ * random addresses, are looked up in the mapped snapshot, and then in
+ * the tree it is promoted to, each result checked against rtn_lookup()
+ * on the table, and the prefix found against rtn_search().
+ *
+ * With -H, the internal nodes are on huge pages (RTN_BIT_HUGEPAGE). The
+ * lookups print their dTLB load misses per op either way, from the
+ * counter perf reads as dTLB-load-misses, when the kernel lets the
+ * process count its own events (perf_event_paranoid 2 or less). Then a
+ * pool of elements the size of an xtimer bucket is churned through an
+ * arena, on the heap and on huge pages, the way the buckets of a pool
+ * from xtimer_pool_create_hugepage() are: each element is checked to
+ * come back zeroed and on a cache line of its own.
+ *
+ * With -B, once the table is deleted, it is sorted in the order of a
+ * walk and built again in a new tree with rtn_bulk_load(), as at a cold
+ * start, and with rtn_add() in a random order. Both trees are checked to
+ * hold the same nodes and to walk the same infos in the same order.
+ *
+ * With -r, once the table is deleted, it is added again to a tree with
+ * RTN_BIT_RCU, and 1, 2, 4, ... up to -r threads look up the uniform
+ * trace in it for a second each, one read section per lookup, while the
+ * calling thread churns the table: it deletes 64 prefixes, waits for a
+ * grace period (the infos are the caller's, RTN_BIT_KEEP_INFO) and adds
+ * them again. Each result is checked to cover its address. It prints
+ * the lookups/s of all the readers, and of the writer's changes.
+ *
+ * With -d, the versions of rtn_key_diff() in rtn_key.c are checked
+ * against the table one on -d pairs of random keys of 0 to 1024 bits,
+ * the second key the first one with a bit flipped, or none, and each
+ * key in a block of its own length. Then each version is timed on keys
+ * of 32 to 1024 bits that differ in their last bit, in ns per call.
+ *
+ * Built with RTN_STATS, it prints the counters of rtn_stats.h as well.
+ *
+ * Built with RTN_BENCH_RADIX and rtn_bench_radix.cpp, it takes -R: each
+ * trace is also looked up with RadixTree<KeyBits>::lookup() of
+ * rtn_radix.hpp, on the tree of the bench, with each result checked
+ * against rtn_lookup(). For both, it prints the cycles per lookup (the
+ * TSC on x86, ns elsewhere) of the best of 7 runs of the trace.
+ *
+ ***/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "corelibs/rtn_radix.h"
+#include "corelibs/rtn_stats.h"
+#include "corelibs/rtn_view.h"
+#include "corelibs/rtn_lctrie.h"
+#include "corelibs/rtn_stride.h"
+#include "corelibs/rtn_compact.h"
+#include "corelibs/rtn_flowcache.h"
+#include "corelibs/rtn_epoch.h"
+#include "corelibs/rtn_lenidx.h"
+#include "corelibs/rtn_pwalk.h"
+#include "corelibs/rtn_changelog.h"
+#include "corelibs/rtn_shape.h"
+#include "corelibs/rtn_wire.h"
+#include "corelibs/rtn_snapshot.h"
+#include "rtn_private.h"
+
+#define RTN_BENCH_KEY_MAX     16        /* bytes */
+#define RTN_BENCH_VRFS        500       /* VRFs of the vpn table */
+#define RTN_BENCH_BUCKET      64        /* bytes of an xtimer bucket */
+#define RTN_BENCH_CHURN       64        /* prefixes changed at once, -r */
+#define RTN_BENCH_FLOW_CHURN  10000     /* lookups per change, -f */
+#define RTN_BENCH_RADIX_RUNS  7         /* runs of a trace, -R */
+#define RTN_BENCH_DIFF_BITS   1024      /* longest key of -d */
+#define RTN_BENCH_DIFF_KEYS   1024      /* pairs of keys timed, -d */
+
+#ifdef RTN_BENCH_RADIX
+#define RTN_BENCH_RADIX_OPT   "R"       /* -R, with rtn_bench_radix.cpp */
+#else
+#define RTN_BENCH_RADIX_OPT   ""
+#endif
+
+typedef struct _rtn_bench_route_t
+{
+    RADIX_INFO_HEADER;
+    u_int8_t    br_key[RTN_BENCH_KEY_MAX];
+} rtn_bench_route_t;
+
+/*
+ * Prefix length distribution of a table: a weight per length.
+ */
+typedef struct _rtn_bench_len_t
+{
+    u_int16_t   bl_len;
+    u_int32_t   bl_weight;
+} rtn_bench_len_t;
+
+/*
+ * A full IPv4 table, 2016.
+ */
+static const rtn_bench_len_t rtn_bench_ipv4_lens[] = {
+    {8, 16}, {9, 12}, {10, 30}, {11, 90}, {12, 270}, {13, 500},
+    {14, 1000}, {15, 1700}, {16, 13000}, {17, 7500}, {18, 12500},
+    {19, 24000}, {20, 38000}, {21, 42000}, {22, 85000}, {23, 70000},
+    {24, 350000}, {0, 0}
+};
+
+/*
+ * A full IPv6 table, 2016.
+ */
+static const rtn_bench_len_t rtn_bench_ipv6_lens[] = {
+    {20, 10}, {24, 50}, {28, 200}, {29, 3000}, {30, 300}, {31, 100},
+    {32, 12000}, {33, 600}, {34, 500}, {35, 300}, {36, 1500}, {40, 3000},
+    {44, 2500}, {46, 600}, {47, 500}, {48, 18000}, {56, 300}, {64, 200},
+    {0, 0}
+};
+
+/*
+ * The IPv4 part of the routes of a VRF.
+ */
+static const rtn_bench_len_t rtn_bench_vpn_lens[] = {
+    {16, 20}, {20, 30}, {22, 50}, {23, 50}, {24, 500}, {28, 40},
+    {29, 60}, {30, 100}, {31, 10}, {32, 250}, {0, 0}
+};
+
+typedef enum {
+    RTN_BENCH_IPV4,
+    RTN_BENCH_IPV6,
+    RTN_BENCH_VPN
+} rtn_bench_table_t;
+
+typedef struct _rtn_bench_t
+{
+    rtn_bench_table_t   b_table;
+    u_int32_t           b_count;        /* prefixes asked for */
+    u_int32_t           b_added;        /* prefixes in the tree */
+    u_int32_t           b_trace_len;    /* addresses in a trace */
+    u_int32_t           b_walks;        /* rtn_walktree() runs */
+    double              b_zipf;         /* Zipf exponent of the trace */
+    double              b_lcfill;       /* rtn_lctrie.h fill, 0 for none */
+    u_int32_t           b_tables;       /* most trees for -m, 0 for none */
+    u_int32_t           b_threads;      /* threads for -k, 0 for none */
+    u_int32_t           b_pwalk;        /* most threads of -p, or 0 */
+    u_int32_t           b_resume;       /* most infos per resume, -W */
+    u_int32_t           b_changes;      /* changes of -c, or 0 */
+    u_int32_t           b_version;      /* table version of the infos */
+    int32_t             b_split;        /* split for -a, -1 for none */
+    int8_t              b_wire;         /* -x */
+    int8_t              b_snapshot;     /* -P */
+    int8_t              b_stride;       /* -S */
+    int8_t              b_bulk;         /* -B */
+    int8_t              b_compact;      /* -C */
+    u_int32_t           b_batch;        /* largest burst of -b, or 0 */
+    u_int32_t           b_flows;        /* entries of -f, or 0 */
+    u_int32_t           b_acl;          /* prefixes of -A, or 0 */
+    int8_t              b_views;        /* -V */
+    int8_t              b_radix;        /* -R */
+    u_int32_t           b_readers;      /* most readers of -r, or 0 */
+    u_int32_t           b_diffs;        /* key pairs of -d, or 0 */
+    int8_t              b_hugepage;     /* -H */
+    int                 b_perf_fd;      /* dTLB load misses, or -1 */
+    u_int64_t           b_seed;
+    u_int16_t           b_keybytes;
+    u_int16_t           b_keybits;
+    u_int16_t           b_scan_byte;    /* byte stepped in a scan */
+    u_int64_t           b_rng;
+    u_int64_t           b_clock_cost;   /* ns to read the clock */
+
+    rt_head_t           b_head;
+    rtn_bench_route_t   *b_routes;
+    u_int32_t           *b_order;       /* routes in the tree, shuffled */
+    u_int8_t            *b_trace;       /* b_trace_len keys */
+    rtn_hist_t          b_hist;
+} rtn_bench_t;
+
+/*
+ * rtn_bench_rand
+ *
+ * xorshift64*, from the seed.
+ */
+static inline u_int64_t
+rtn_bench_rand (rtn_bench_t *b)
+{
+    b->b_rng ^= b->b_rng >> 12;
+    b->b_rng ^= b->b_rng << 25;
+    b->b_rng ^= b->b_rng >> 27;
+    return (b->b_rng * 0x2545f4914f6cdd1dULL);
+}
+
+/*
+ * rtn_bench_uniform
+ *
+ * Return a number in [0, n).
+ */
+static inline u_int32_t
+rtn_bench_uniform (rtn_bench_t *b, u_int32_t n)
+{
+    return ((u_int32_t) (((rtn_bench_rand(b) >> 32) * n) >> 32));
+}
+
+/*
+ * rtn_bench_now
+ *
+ * Monotonic time in ns.
+ */
+static inline u_int64_t
+rtn_bench_now (void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((u_int64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+}
+
+/*
+ * rtn_bench_record
+ *
+ * Record the time of one op, less the cost of reading the clock.
+ */
+static inline void
+rtn_bench_record (rtn_bench_t *b, u_int64_t start, u_int64_t end)
+{
+    u_int64_t ns;
+
+    ns = end - start;
+    ns = (ns > b->b_clock_cost) ? ns - b->b_clock_cost : 0;
+
+    b->b_hist.h_buckets[rtn_hist_bucket(ns)]++;
+    b->b_hist.h_count++;
+    b->b_hist.h_sum += ns;
+    b->b_hist.h_max = MAX(b->b_hist.h_max, ns);
+}
+
+/*
+ * rtn_bench_clock_cost
+ *
+ * The least time between two reads of the clock.
+ */
+static u_int64_t
+rtn_bench_clock_cost (void)
+{
+    u_int64_t t1, t2, cost = ~0ULL;
+    u_int32_t i;
+
+    for (i = 0; i < 10000; i++) {
+        t1 = rtn_bench_now();
+        t2 = rtn_bench_now();
+        cost = MIN(cost, t2 - t1);
+    }
+
+    return (cost);
+}
+
+/*
+ * rtn_bench_rss_kb
+ *
+ * Return a field of /proc/self/status in KB, e.g. "VmRSS:", or 0.
+ */
+static u_int64_t
+rtn_bench_rss_kb (const char *field)
+{
+    char line[256];
+    unsigned long long kb = 0;
+    FILE *fp;
+
+    fp = fopen("/proc/self/status", "r");
+    if (!fp) {
+        return (0);
+    }
+    while (fgets(line, sizeof(line), fp)) {
+        if (!strncmp(line, field, strlen(field))) {
+            sscanf(line + strlen(field), "%llu", &kb);
+            break;
+        }
+    }
+    fclose(fp);
+
+    return (kb);
+}
+
+/*
+ * rtn_bench_report
+ *
+ * Print a line for an operation, and clear the histogram.
+ */
+static void
+rtn_bench_report (rtn_bench_t *b, const char *name, u_int64_t ops,
+                  u_int64_t ns)
+{
+    rtn_hist_t *hist = &b->b_hist;
+
+    printf("%-18s %12.0f ops/s   ns/op p50 %5llu p90 %5llu p99 %6llu "
+           "p99.9 %6llu max %8llu\n",
+           name, ns ? (double) ops * 1e9 / ns : 0.0,
+           (unsigned long long) rtn_hist_percentile(hist, 50),
+           (unsigned long long) rtn_hist_percentile(hist, 90),
+           (unsigned long long) rtn_hist_percentile(hist, 99),
+           (unsigned long long) rtn_hist_percentile(hist, 99.9),
+           (unsigned long long) hist->h_max);
+
+    memset(hist, 0, sizeof(rtn_hist_t));
+}
+
+/*
+ * rtn_bench_perf_open
+ *
+ * Open the counter of the dTLB load misses of the calling thread, in
+ * user space, as perf's dTLB-load-misses.
+ *
+ * Return the fd, or -1 when the kernel or the CPU has none.
+ */
+static int
+rtn_bench_perf_open (void)
+{
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.config = PERF_COUNT_HW_CACHE_DTLB |
+                  (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                  (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+
+    return (syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+}
+
+/*
+ * rtn_bench_perf_read
+ */
+static u_int64_t
+rtn_bench_perf_read (rtn_bench_t *b)
+{
+    u_int64_t value = 0;
+
+    if ((b->b_perf_fd < 0) ||
+        (read(b->b_perf_fd, &value, sizeof(value)) != sizeof(value))) {
+        return (0);
+    }
+
+    return (value);
+}
+
+/*
+ * rtn_bench_mask
+ *
+ * Clear the bits of a key past a bit length.
+ */
+static void
+rtn_bench_mask (u_int8_t *key, u_int16_t bitlen, u_int16_t keybytes)
+{
+    u_int16_t i;
+
+    if (bitlen & 0x7) {
+        key[RNBYTE(bitlen)] &= ~(0xff >> (bitlen & 0x7));
+        bitlen = (bitlen | 0x7) + 1;
+    }
+    for (i = RNBYTE(bitlen); i < keybytes; i++) {
+        key[i] = 0;
+    }
+}
+
+/*
+ * rtn_bench_pick_len
+ *
+ * Pick a prefix length by its weight.
+ */
+static u_int16_t
+rtn_bench_pick_len (rtn_bench_t *b, const rtn_bench_len_t *lens)
+{
+    u_int64_t total = 0, pick;
+    u_int32_t i;
+
+    for (i = 0; lens[i].bl_len; i++) {
+        total += lens[i].bl_weight;
+    }
+
+    pick = rtn_bench_rand(b) % total;
+    for (i = 0; pick >= lens[i].bl_weight; i++) {
+        pick -= lens[i].bl_weight;
+    }
+
+    return (lens[i].bl_len);
+}
+
+/*
+ * rtn_bench_zipf_cdf
+ *
+ * Return the cumulative distribution of a Zipf law over n ranks.
+ */
+static double *
+rtn_bench_zipf_cdf (u_int32_t n, double s)
+{
+    double *cdf, sum = 0;
+    u_int32_t i;
+
+    cdf = malloc(n * sizeof(double));
+    if (!cdf) {
+        return (NULL);
+    }
+    for (i = 0; i < n; i++) {
+        sum += 1.0 / pow(i + 1, s);
+        cdf[i] = sum;
+    }
+    for (i = 0; i < n; i++) {
+        cdf[i] /= sum;
+    }
+
+    return (cdf);
+}
+
+/*
+ * rtn_bench_zipf
+ *
+ * Pick a rank from the cumulative distribution of rtn_bench_zipf_cdf().
+ */
+static u_int32_t
+rtn_bench_zipf (rtn_bench_t *b, double *cdf, u_int32_t n)
+{
+    double u;
+    u_int32_t lo = 0, hi = n - 1, mid;
+
+    u = (rtn_bench_rand(b) >> 11) * (1.0 / 9007199254740992.0);
+    while (lo < hi) {
+        mid = (lo + hi) / 2;
+        if (cdf[mid] < u) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return (lo);
+}
+
+/*
+ * rtn_bench_gen_prefix
+ *
+ * Generate the key and the length of the i'th prefix of the table.
+ */
+static void
+rtn_bench_gen_prefix (rtn_bench_t *b, u_int32_t i, double *vrf_cdf)
+{
+    rtn_bench_route_t *br = &b->b_routes[i], *parent;
+    u_int16_t bitlen, j, tries;
+    u_int32_t vrf;
+
+    switch (b->b_table) {
+      case RTN_BENCH_IPV4:
+        bitlen = rtn_bench_pick_len(b, rtn_bench_ipv4_lens);
+        for (j = 0; j < 4; j++) {
+            br->br_key[j] = rtn_bench_rand(b);
+        }
+        br->br_key[0] = 1 + rtn_bench_uniform(b, 223);
+
+        /*
+         * A more specific of an aggregate generated before.
+         */
+        for (tries = 0; i && (tries < 4) && (rtn_bench_uniform(b, 3) == 0);
+             tries++) {
+            parent = &b->b_routes[rtn_bench_uniform(b, i)];
+            if (parent->rnode_bit < bitlen) {
+                memcpy(br->br_key, parent->br_key, RNBYTE(parent->rnode_bit));
+                br->br_key[RNBYTE(parent->rnode_bit)] =
+                    (parent->br_key[RNBYTE(parent->rnode_bit)] &
+                     ~(0xff >> (parent->rnode_bit & 0x7))) |
+                    (br->br_key[RNBYTE(parent->rnode_bit)] &
+                     (0xff >> (parent->rnode_bit & 0x7)));
+                break;
+            }
+        }
+        break;
+
+      case RTN_BENCH_IPV6:
+        bitlen = rtn_bench_pick_len(b, rtn_bench_ipv6_lens);
+        for (j = 0; j < 16; j++) {
+            br->br_key[j] = rtn_bench_rand(b);
+        }
+        br->br_key[0] = 0x20 | (br->br_key[0] & 0x1f);
+        break;
+
+      default:
+        vrf = rtn_bench_zipf(b, vrf_cdf, RTN_BENCH_VRFS);
+        bitlen = 64 + rtn_bench_pick_len(b, rtn_bench_vpn_lens);
+
+        /*
+         * Type 0 RD, ASN:assigned number.
+         */
+        memset(br->br_key, 0, 8);
+        br->br_key[2] = 0xfd;
+        br->br_key[3] = 0xe8;
+        br->br_key[4] = vrf >> 24;
+        br->br_key[5] = vrf >> 16;
+        br->br_key[6] = vrf >> 8;
+        br->br_key[7] = vrf;
+        br->br_key[8] = 10;
+        for (j = 9; j < 12; j++) {
+            br->br_key[j] = rtn_bench_rand(b);
+        }
+        break;
+    }
+
+    rtn_bench_mask(br->br_key, bitlen, b->b_keybytes);
+    br->rninfo_key = br->br_key;
+    br->rnode_bit = bitlen;
+}
+
+/*
+ * rtn_bench_gen_table
+ */
+static int
+rtn_bench_gen_table (rtn_bench_t *b)
+{
+    double *vrf_cdf = NULL;
+    u_int32_t i;
+
+    b->b_routes = calloc(b->b_count, sizeof(rtn_bench_route_t));
+    b->b_order = calloc(b->b_count, sizeof(u_int32_t));
+    if (!b->b_routes || !b->b_order) {
+        return (FALSE);
+    }
+
+    if (b->b_table == RTN_BENCH_VPN) {
+        vrf_cdf = rtn_bench_zipf_cdf(RTN_BENCH_VRFS, 1.0);
+        if (!vrf_cdf) {
+            return (FALSE);
+        }
+    }
+
+    for (i = 0; i < b->b_count; i++) {
+        rtn_bench_gen_prefix(b, i, vrf_cdf);
+    }
+
+    free(vrf_cdf);
+    return (TRUE);
+}
+
+/*
+ * rtn_bench_shuffle
+ */
+static void
+rtn_bench_shuffle (rtn_bench_t *b, u_int32_t *v, u_int32_t n)
+{
+    u_int32_t i, j, tmp;
+
+    for (i = n; i > 1; i--) {
+        j = rtn_bench_uniform(b, i);
+        tmp = v[i - 1];
+        v[i - 1] = v[j];
+        v[j] = tmp;
+    }
+}
+
+/*
+ * rtn_bench_gen_trace
+ *
+ * Fill the trace with addresses: "uniform", "zipf", "scan" or "flows".
+ */
+static void
+rtn_bench_gen_trace (rtn_bench_t *b, const char *kind, double *cdf,
+                     u_int32_t *rank)
+{
+    rtn_bench_route_t *br;
+    u_int8_t *addr, scan[RTN_BENCH_KEY_MAX];
+    u_int64_t flow;
+    u_int32_t i, pick;
+    int16_t j;
+
+    memcpy(scan, b->b_routes[b->b_order[0]].br_key, b->b_keybytes);
+
+    for (i = 0; i < b->b_trace_len; i++) {
+        addr = &b->b_trace[(size_t) i * b->b_keybytes];
+
+        if (!strcmp(kind, "scan")) {
+            memcpy(addr, scan, b->b_keybytes);
+            for (j = b->b_scan_byte; (j >= 0) && !++scan[j]; j--) {
+                ;
+            }
+            continue;
+        }
+
+        pick = strcmp(kind, "uniform") ?
+            rank[rtn_bench_zipf(b, cdf, b->b_added)] :
+            rtn_bench_uniform(b, b->b_added);
+        br = &b->b_routes[b->b_order[pick]];
+
+        /*
+         * The prefix, and random bits past it: for a flow, the same
+         * bits each time the prefix is picked.
+         */
+        flow = pick * 0x9e3779b97f4a7c15ULL + 1;
+        for (j = 0; j < b->b_keybytes; j++) {
+            if (strcmp(kind, "flows")) {
+                addr[j] = rtn_bench_rand(b);
+            } else {
+                flow ^= flow >> 12;
+                flow ^= flow << 25;
+                flow ^= flow >> 27;
+                addr[j] = (flow * 0x2545f4914f6cdd1dULL) >> 56;
+            }
+        }
+        for (j = 0; j < RNBYTE(br->rnode_bit); j++) {
+            addr[j] = br->br_key[j];
+        }
+        if (br->rnode_bit & 0x7) {
+            addr[j] = (br->br_key[j] & ~(0xff >> (br->rnode_bit & 0x7))) |
+                      (addr[j] & (0xff >> (br->rnode_bit & 0x7)));
+        }
+    }
+}
+
+/*
+ * rtn_bench_walk_count
+ */
+static int
+rtn_bench_walk_count (rt_info_t *rinfo, va_list ap)
+{
+    u_int64_t *count = va_arg(ap, u_int64_t *);
+
+    (*count)++;
+    return (RTWALK_CONTINUE);
+}
+
+/*
+ * rtn_bench_walk_count_atomic
+ *
+ * rtn_bench_walk_count(), for the walks on many threads.
+ */
+static int
+rtn_bench_walk_count_atomic (rt_info_t *rinfo, va_list ap)
+{
+    u_int64_t *count = va_arg(ap, u_int64_t *);
+
+    __atomic_add_fetch(count, 1, __ATOMIC_RELAXED);
+    return (RTWALK_CONTINUE);
+}
+
+/*
+ * rtn_bench_walk_collect
+ */
+static int
+rtn_bench_walk_collect (rt_info_t *rinfo, va_list ap)
+{
+    rt_info_t ***next = va_arg(ap, rt_info_t ***);
+
+    *(*next)++ = rinfo;
+    return (RTWALK_CONTINUE);
+}
+
+/*
+ * rtn_bench_add
+ */
+static void
+rtn_bench_add (rtn_bench_t *b)
+{
+    rtn_bench_route_t *br;
+    u_int64_t start, t, total;
+    u_int32_t i;
+
+    start = rtn_bench_now();
+    for (i = 0; i < b->b_count; i++) {
+        br = &b->b_routes[i];
+        t = rtn_bench_now();
+        if (rtn_add(&b->b_head, (rt_info_t *) br, br->rnode_bit)) {
+            b->b_order[b->b_added++] = i;
+        }
+        rtn_bench_record(b, t, rtn_bench_now());
+    }
+    total = rtn_bench_now() - start;
+
+    rtn_bench_report(b, "rtn_add", b->b_count, total);
+}
+
+/*
+ * rtn_bench_search
+ */
+static void
+rtn_bench_search (rtn_bench_t *b)
+{
+    rtn_bench_route_t *br;
+    u_int64_t start, t, total;
+    u_int32_t i;
+
+    start = rtn_bench_now();
+    for (i = 0; i < b->b_added; i++) {
+        br = &b->b_routes[b->b_order[i]];
+        rtn_search(&b->b_head, (char *) br->br_key, br->rnode_bit);
+    }
+    total = rtn_bench_now() - start;
+
+    for (i = 0; i < b->b_added; i++) {
+        br = &b->b_routes[b->b_order[i]];
+        t = rtn_bench_now();
+        rtn_search(&b->b_head, (char *) br->br_key, br->rnode_bit);
+        rtn_bench_record(b, t, rtn_bench_now());
+    }
+
+    rtn_bench_report(b, "rtn_search", b->b_added, total);
+}
+
+/*
+ * rtn_bench_lookup
+ */
+static void
+rtn_bench_lookup (rtn_bench_t *b, const char *name)
+{
+    u_int64_t start, t, total, found = 0, misses;
+    u_int32_t i;
+    char *addr;
+
+    misses = rtn_bench_perf_read(b);
+    start = rtn_bench_now();
+    for (i = 0; i < b->b_trace_len; i++) {
+        addr = (char *) &b->b_trace[(size_t) i * b->b_keybytes];
+        found += (rtn_lookup(&b->b_head, addr, b->b_keybits) != NULL);
+    }
+    total = rtn_bench_now() - start;
+    misses = rtn_bench_perf_read(b) - misses;
+
+    for (i = 0; i < b->b_trace_len; i++) {
+        addr = (char *) &b->b_trace[(size_t) i * b->b_keybytes];
+        t = rtn_bench_now();
+        rtn_lookup(&b->b_head, addr, b->b_keybits);
+        rtn_bench_record(b, t, rtn_bench_now());
+    }
+
+    rtn_bench_report(b, name, b->b_trace_len, total);
+    printf("%-18s %11.1f%% found", "",
+           b->b_trace_len ? found * 100.0 / b->b_trace_len : 0.0);
+    if (b->b_perf_fd >= 0) {
+        printf(", %.3f dTLB-load-misses/op",
+               b->b_trace_len ? (double) misses / b->b_trace_len : 0.0);
+    }
+    printf("\n");
+}
+
+/*
+ * rtn_bench_lctrie_check
+ *
+ * Compare the best match of the compiled form with the one of the tree,
+ * for each address of the trace. Nothing changes the tree meanwhile, so
+ * the compiled form must answer each one. Return FALSE when it does not,
+ * or on a mismatch.
+ */
+static int8_t
+rtn_bench_lctrie_check (rtn_bench_t *b)
+{
+    rtn_lc_t *lc = b->b_head.rt_lctrie;
+    rt_info_t **found, *rinfo;
+    u_int64_t answered = 0, mismatches = 0;
+    u_int32_t i;
+    char *addr;
+
+    found = malloc((size_t) b->b_trace_len * sizeof(rt_info_t *));
+    if (!found) {
+        fprintf(stderr, "out of memory\n");
+        return (FALSE);
+    }
+
+    for (i = 0; i < b->b_trace_len; i++) {
+        addr = (char *) &b->b_trace[(size_t) i * b->b_keybytes];
+        if (rtn_lctrie_lookup(lc, (u_int8_t *) addr, b->b_keybits,
+                              &found[i])) {
+            answered++;
+        } else {
+            found[i] = NULL;
+        }
+    }
+
+    /*
+     * rtn_lookup() on the tree itself.
+     */
+    b->b_head.rt_lctrie = NULL;
+    for (i = 0; i < b->b_trace_len; i++) {
+        addr = (char *) &b->b_trace[(size_t) i * b->b_keybytes];
+        rinfo = rtn_lookup(&b->b_head, addr, b->b_keybits);
+        if (found[i] != rinfo) {
+            mismatches++;
+        }
+    }
+    b->b_head.rt_lctrie = lc;
+    free(found);
+
+    printf("%-18s %11.1f%% answered by rtn_lctrie, %llu mismatches\n", "",
+           b->b_trace_len ? answered * 100.0 / b->b_trace_len : 0.0,
+           (unsigned long long) mismatches);
+    return (answered == b->b_trace_len) && !mismatches;
+}
+
+/*
+ * rtn_bench_batch
+ *
+ * rtn_lookup_batch() on the trace, in bursts of a size. Return FALSE
+ * when a result differs from the one of rtn_lookup().
+ */
+static int8_t
+rtn_bench_batch (rtn_bench_t *b, const char *trace, u_int32_t size)
+{
+    rt_info_t **results;
+    char **addrs;
+    u_int64_t start, t, total, mismatches = 0;
+    u_int32_t i, n;
+    char name[32];
+
+    addrs = malloc((size_t) b->b_trace_len * sizeof(char *));
+    results = malloc((size_t) b->b_trace_len * sizeof(rt_info_t *));
+    if (!addrs || !results) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    for (i = 0; i < b->b_trace_len; i++) {
+        addrs[i] = (char *) &b->b_trace[(size_t) i * b->b_keybytes];
+    }
+
+    start = rtn_bench_now();
+    for (i = 0; i < b->b_trace_len; i += n) {
+        n = MIN(size, b->b_trace_len - i);
+        rtn_lookup_batch(&b->b_head, &addrs[i], b->b_keybits, &results[i],
+                         n);
+    }
+    total = rtn_bench_now() - start;
+
+    for (i = 0; i < b->b_trace_len; i += n) {
+        n = MIN(size, b->b_trace_len - i);
+        t = rtn_bench_now();
+        rtn_lookup_batch(&b->b_head, &addrs[i], b->b_keybits, &results[i],
+                         n);
+        rtn_bench_record(b, t, rtn_bench_now());
+    }
+
+    for (i = 0; i < b->b_trace_len; i++) {
+        if (results[i] != rtn_lookup(&b->b_head, addrs[i], b->b_keybits)) {
+            mismatches++;
+        }
+    }
+    free(results);
+    free(addrs);
+
+    snprintf(name, sizeof(name), "batch %s x%u", trace, size);
+    rtn_bench_report(b, name, b->b_trace_len, total);
+    if (mismatches) {
+        printf("%-18s %12llu mismatches\n", "",
+               (unsigned long long) mismatches);
+    }
+
+    return (!mismatches);
+}
+
+/*
+ * rtn_bench_stride_check
+ *
+ * Compare rtn_stride_lookup() with rtn_lookup() for each address of the
+ * trace. Return the count of mismatches.
+ */
+static u_int64_t
+rtn_bench_stride_check (rtn_bench_t *b)
+{
+    u_int64_t mismatches = 0;
+    u_int32_t i;
+    char *addr;
+
+    for (i = 0; i < b->b_trace_len; i++) {
+        addr = (char *) &b->b_trace[(size_t) i * b->b_keybytes];
+        if (rtn_stride_lookup(&b->b_head, addr, b->b_keybits) !=
+            rtn_lookup(&b->b_head, addr, b->b_keybits)) {
+            mismatches++;
+        }
+    }
+
+    return (mismatches);
+}
+
+/*
+ * rtn_bench_stride
+ *
+ * rtn_stride_lookup() on the trace. Return FALSE when a result differs
+ * from the one of rtn_lookup().
+ */
+static int8_t
+rtn_bench_stride (rtn_bench_t *b, const char *name)
+{
+    u_int64_t start, t, total, mismatches;
+    u_int32_t i;
+    char *addr;
+
+    start = rtn_bench_now();
+    for (i = 0; i < b->b_trace_len; i++) {
+        addr = (char *) &b->b_trace[(size_t) i * b->b_keybytes];
+        rtn_stride_lookup(&b->b_head, addr, b->b_keybits);
+    }
+    total = rtn_bench_now() - start;
+
+    for (i = 0; i < b->b_trace_len; i++) {
+        addr = (char *) &b->b_trace[(size_t) i * b->b_keybytes];
+        t = rtn_bench_now();
+        rtn_stride_lookup(&b->b_head, addr, b->b_keybits);
+        rtn_bench_record(b, t, rtn_bench_now());
+    }
+
+    rtn_bench_report(b, name, b->b_trace_len, total);
+    mismatches = rtn_bench_stride_check(b);
+    printf("%-18s %12llu mismatches\n", "",
+           (unsigned long long) mismatches);
+
+    return (!mismatches);
+}
+
+/*
+ * rtn_bench_compact
+ *
+ * rtn_compact_lookup() on the trace. Return FALSE when a result differs
+ * from the one of the tree.
+ */
+static int8_t
+rtn_bench_compact (rtn_bench_t *b, const char *name)
+{
+    rtn_compact_t *rc = b->b_head.rt_compact;
+    u_int64_t start, t, total, mismatches = 0;
+    u_int32_t i;
+    u_int8_t *addr;
+
+    start = rtn_bench_now();
+    for (i = 0; i < b->b_trace_len; i++) {
+        addr = &b->b_trace[(size_t) i * b->b_keybytes];
+        rtn_compact_lookup(rc, addr, b->b_keybits);
+    }
+    total = rtn_bench_now() - start;
+
+    for (i = 0; i < b->b_trace_len; i++) {
+        addr = &b->b_trace[(size_t) i * b->b_keybytes];
+        t = rtn_bench_now();
+        rtn_compact_lookup(rc, addr, b->b_keybits);
+        rtn_bench_record(b, t, rtn_bench_now());
+    }
+
+    /*
+     * rc is invalid for the tree here, so rtn_lookup() uses its nodes.
+     */
+    for (i = 0; i < b->b_trace_len; i++) {
+        addr = &b->b_trace[(size_t) i * b->b_keybytes];
+        if (rtn_compact_lookup(rc, addr, b->b_keybits) !=
+            rtn_lookup(&b->b_head, (char *) addr, b->b_keybits)) {
+            mismatches++;
+        }
+    }
+
+    rtn_bench_report(b, name, b->b_trace_len, total);
+    printf("%-18s %12llu mismatches\n", "",
+           (unsigned long long) mismatches);
+
+    return (!mismatches);
+}
+
+/*
+ * rtn_bench_flowcache_churn
+ *
+ * Delete a prefix and add it back, every churn lookups.
+ */
+static inline void
+rtn_bench_flowcache_churn (rtn_bench_t *b, u_int32_t i, u_int32_t churn)
+{
+    rtn_bench_route_t *br;
+
+    if (churn && !(i % churn)) {
+        br = &b->b_routes[b->b_order[(i / churn) % b->b_added]];
+        rtn_delete((rt_info_t *) br, &b->b_head);
+        rtn_add(&b->b_head, (rt_info_t *) br, br->rnode_bit);
+    }
+}
+
+/*
+ * rtn_bench_flowcache
+ *
+ * The trace through a new flow cache, with a change of the tree every
+ * churn lookups, or none. Return FALSE when a result differs from the
+ * one of rtn_lookup().
+ */
+static int8_t
+rtn_bench_flowcache (rtn_bench_t *b, const char *name, u_int32_t churn)
+{
+    rtn_flowcache_t *fc;
+    u_int64_t start, t, total, mismatches = 0, generations;
+    u_int32_t i, hit_rate;
+    char *addr;
+
+    fc = rtn_flowcache_create(&b->b_head, b->b_keybytes, b->b_flows, 4);
+    if (!fc) {
+        fprintf(stderr, "rtn_flowcache_create failed\n");
+        exit(1);
+    }
+
+    start = rtn_bench_now();
+    for (i = 0; i < b->b_trace_len; i++) {
+        rtn_bench_flowcache_churn(b, i, churn);
+        addr = (char *) &b->b_trace[(size_t) i * b->b_keybytes];
+        rtn_flowcache_lookup(fc, addr);
+    }
+    total = rtn_bench_now() - start;
+    hit_rate = rtn_flowcache_hit_rate(fc);
+    generations = fc->fc_generations;
+
+    for (i = 0; i < b->b_trace_len; i++) {
+        rtn_bench_flowcache_churn(b, i, churn);
+        addr = (char *) &b->b_trace[(size_t) i * b->b_keybytes];
+        t = rtn_bench_now();
+        rtn_flowcache_lookup(fc, addr);
+        rtn_bench_record(b, t, rtn_bench_now());
+    }
+
+    for (i = 0; i < b->b_trace_len; i++) {
+        rtn_bench_flowcache_churn(b, i, churn);
+        addr = (char *) &b->b_trace[(size_t) i * b->b_keybytes];
+        if (rtn_flowcache_lookup(fc, addr) !=
+            rtn_lookup(&b->b_head, addr, b->b_keybits)) {
+            mismatches++;
+        }
+    }
+    rtn_flowcache_destroy(fc);
+
+    rtn_bench_report(b, name, b->b_trace_len, total);
+    printf("%-18s %12u%% hits, %llu generations, %llu mismatches\n", "",
+           hit_rate, (unsigned long long) generations,
+           (unsigned long long) mismatches);
+
+    return (!mismatches);
+}
+
+/*
+ * A prefix of the ACL of -A.
+ */
+typedef struct _rtn_bench_query_t
+{
+    u_int8_t    bq_key[RTN_BENCH_KEY_MAX];
+    u_int16_t   bq_bitlen;
+} rtn_bench_query_t;
+
+/*
+ * rtn_bench_query_cmp
+ *
+ * By key, then by bit length, as rtn_bench_bulk_cmp().
+ */
+static int
+rtn_bench_query_cmp (const void *a, const void *b)
+{
+    const rtn_bench_query_t *qa = a, *qb = b;
+    int cmp;
+
+    cmp = memcmp(qa->bq_key, qb->bq_key, RTN_BENCH_KEY_MAX);
+    if (cmp) {
+        return (cmp);
+    }
+
+    return ((int) qa->bq_bitlen - (int) qb->bq_bitlen);
+}
+
+/*
+ * rtn_bench_acl_run
+ *
+ * A lookup of each prefix of the ACL, one call each, then in a batch.
+ * Return the count of results that differ.
+ */
+static u_int64_t
+rtn_bench_acl_run (rtn_bench_t *b, const char *name, char **addrs,
+                   u_int16_t *bitlens, rt_info_t **results,
+                   rt_info_t *(*single)(rt_head_t *, char *, u_int16_t),
+                   void (*batch)(rt_head_t *, char **, u_int16_t *,
+                                 rt_info_t **, u_int32_t))
+{
+    u_int64_t start, total, mismatches = 0;
+    u_int32_t i;
+    char line[32];
+
+    /*
+     * Once before the timed runs, so that neither of them warms the
+     * cache for the other.
+     */
+    (*batch)(&b->b_head, addrs, bitlens, results, b->b_acl);
+
+    start = rtn_bench_now();
+    for (i = 0; i < b->b_acl; i++) {
+        results[i] = (*single)(&b->b_head, addrs[i], bitlens[i]);
+    }
+    total = rtn_bench_now() - start;
+    snprintf(line, sizeof(line), "%s loop", name);
+    printf("%-18s %12.0f ops/s   %.2f ms\n", line, b->b_acl * 1e9 / total,
+           total / 1e6);
+
+    start = rtn_bench_now();
+    (*batch)(&b->b_head, addrs, bitlens, &results[b->b_acl], b->b_acl);
+    total = rtn_bench_now() - start;
+    snprintf(line, sizeof(line), "%s batch", name);
+    printf("%-18s %12.0f ops/s   %.2f ms\n", line, b->b_acl * 1e9 / total,
+           total / 1e6);
+
+    for (i = 0; i < b->b_acl; i++) {
+        mismatches += (results[i] != results[b->b_acl + i]);
+    }
+
+    return (mismatches);
+}
+
+/*
+ * rtn_bench_acl
+ *
+ * An ACL against the table, by the single and the batch calls. Return
+ * FALSE when they differ.
+ */
+static int8_t
+rtn_bench_acl (rtn_bench_t *b)
+{
+    rtn_bench_query_t *acl;
+    rtn_bench_route_t *br;
+    rt_info_t **results;
+    char **addrs;
+    u_int16_t *bitlens;
+    u_int64_t mismatches;
+    u_int32_t i;
+    int32_t bitlen;
+    u_int16_t j;
+
+    acl = malloc(b->b_acl * sizeof(rtn_bench_query_t));
+    addrs = malloc(b->b_acl * sizeof(char *));
+    bitlens = malloc(b->b_acl * sizeof(u_int16_t));
+    results = malloc(2 * b->b_acl * sizeof(rt_info_t *));
+    if (!acl || !addrs || !bitlens || !results) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+
+    for (i = 0; i < b->b_acl; i++) {
+        br = &b->b_routes[b->b_order[rtn_bench_uniform(b, b->b_added)]];
+        bitlen = (int32_t) br->rnode_bit + (int32_t) rtn_bench_uniform(b, 17)
+                 - 8;
+        bitlen = MAX(1, MIN(bitlen, b->b_keybits));
+        memcpy(acl[i].bq_key, br->br_key, RTN_BENCH_KEY_MAX);
+        for (j = RNBYTE(br->rnode_bit); j < b->b_keybytes; j++) {
+            acl[i].bq_key[j] = rtn_bench_rand(b);
+        }
+        rtn_bench_mask(acl[i].bq_key, bitlen, b->b_keybytes);
+        acl[i].bq_bitlen = bitlen;
+    }
+    qsort(acl, b->b_acl, sizeof(rtn_bench_query_t), rtn_bench_query_cmp);
+    for (i = 0; i < b->b_acl; i++) {
+        addrs[i] = (char *) acl[i].bq_key;
+        bitlens[i] = acl[i].bq_bitlen;
+    }
+
+    mismatches = rtn_bench_acl_run(b, "range", addrs, bitlens, results,
+                                   rtn_lookup_range, rtn_lookup_range_batch);
+    mismatches += rtn_bench_acl_run(b, "overlap", addrs, bitlens, results,
+                                    rtn_lookup_prefix_overlap,
+                                    rtn_lookup_prefix_overlap_batch);
+    printf("%-18s %12llu mismatches\n", "",
+           (unsigned long long) mismatches);
+
+    free(results);
+    free(bitlens);
+    free(addrs);
+    free(acl);
+
+    return (!mismatches);
+}
+
+/*
+ * The walker of a view, for -V.
+ */
+typedef struct _rtn_bench_viewer_t
+{
+    rtn_view_t  *bv_view;
+    u_int32_t   bv_expected;          /* infos in the view */
+    int8_t      bv_stop;              /* set by the writer */
+    u_int64_t   bv_walks;
+    u_int64_t   bv_errors;            /* walks that missed infos */
+} rtn_bench_viewer_t;
+
+/*
+ * rtn_bench_viewer
+ *
+ * Walk the view until stopped.
+ */
+static void *
+rtn_bench_viewer (void *arg)
+{
+    rtn_bench_viewer_t *bv = arg;
+    u_int64_t infos;
+
+    while (!__atomic_load_n(&bv->bv_stop, __ATOMIC_RELAXED)) {
+        infos = 0;
+        rtn_view_walk(bv->bv_view, rtn_bench_walk_count, &infos);
+        bv->bv_walks++;
+        if (infos != bv->bv_expected) {
+            bv->bv_errors++;
+        }
+    }
+
+    return (NULL);
+}
+
+/*
+ * rtn_bench_view_churn
+ *
+ * Delete a tenth of the table and add it back, one prefix at a time.
+ */
+static void
+rtn_bench_view_churn (rtn_bench_t *b, const char *name)
+{
+    rtn_bench_route_t *br;
+    u_int64_t start, t, total;
+    u_int32_t i, count = MAX(b->b_added / 10, 1);
+
+    start = rtn_bench_now();
+    for (i = 0; i < count; i++) {
+        br = &b->b_routes[b->b_order[i]];
+        t = rtn_bench_now();
+        rtn_delete((rt_info_t *) br, &b->b_head);
+        rtn_bench_record(b, t, rtn_bench_now());
+        t = rtn_bench_now();
+        rtn_add(&b->b_head, (rt_info_t *) br, br->rnode_bit);
+        rtn_bench_record(b, t, rtn_bench_now());
+    }
+    total = rtn_bench_now() - start;
+
+    rtn_bench_report(b, name, 2 * count, total);
+}
+
+/*
+ * rtn_bench_view
+ *
+ * The latency of the changes, without and with the views held and
+ * walked. Return FALSE when a walk of a view did not see it whole.
+ */
+static int8_t
+rtn_bench_view (rtn_bench_t *b)
+{
+    rtn_bench_viewer_t bv;
+    rtn_view_t *view;
+    pthread_t thread;
+    u_int64_t t;
+
+    if (!rtn_view_init(&b->b_head)) {
+        fprintf(stderr, "rtn_view_init failed\n");
+        exit(1);
+    }
+    rtn_bench_view_churn(b, "rtn_view none");
+
+    t = rtn_bench_now();
+    view = rtn_view_take(&b->b_head);
+    if (!view) {
+        fprintf(stderr, "rtn_view_take failed\n");
+        exit(1);
+    }
+    printf("%-18s %12.1f ms to take the first view\n", "",
+           (rtn_bench_now() - t) / 1e6);
+    rtn_bench_view_churn(b, "rtn_view held");
+    t = rtn_bench_now();
+    rtn_view_release(view);
+    printf("%-18s %12.1f ms to release it\n", "",
+           (rtn_bench_now() - t) / 1e6);
+
+    memset(&bv, 0, sizeof(bv));
+    bv.bv_view = rtn_view_take(&b->b_head);
+    bv.bv_expected = b->b_head.ri_count;
+    if (!bv.bv_view ||
+        pthread_create(&thread, NULL, rtn_bench_viewer, &bv)) {
+        fprintf(stderr, "rtn_view_take failed\n");
+        exit(1);
+    }
+    rtn_bench_view_churn(b, "rtn_view walked");
+    __atomic_store_n(&bv.bv_stop, TRUE, __ATOMIC_RELAXED);
+    pthread_join(thread, NULL);
+    rtn_view_release(bv.bv_view);
+    printf("%-18s %12llu walks of the view, %llu incomplete\n", "",
+           (unsigned long long) bv.bv_walks,
+           (unsigned long long) bv.bv_errors);
+
+    return (!bv.bv_errors);
+}
+
+#ifdef RTN_BENCH_RADIX
+/*
+ * RadixTree<keybits>::lookup() of a trace, in rtn_bench_radix.cpp.
+ */
+extern u_int32_t rtn_bench_radix(rt_head_t *rt_head, const u_int8_t *trace,
+                                 u_int32_t count, u_int16_t keybits,
+                                 rt_info_t **results);
+
+/*
+ * rtn_bench_cycles
+ *
+ * The TSC, or the time in ns.
+ */
+static inline u_int64_t
+rtn_bench_cycles (void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return (__builtin_ia32_rdtsc());
+#else
+    return (rtn_bench_now());
+#endif
+}
+
+/*
+ * rtn_bench_radix_run
+ *
+ * The best of RTN_BENCH_RADIX_RUNS runs of the trace, by rtn_lookup()
+ * or RadixTree. Set ns to the time of that run.
+ */
+static u_int64_t
+rtn_bench_radix_run (rtn_bench_t *b, int8_t radix, u_int64_t *ns)
+{
+    u_int64_t start, t, cycles, best = ~0ULL;
+    u_int32_t i, run;
+
+    for (run = 0; run < RTN_BENCH_RADIX_RUNS; run++) {
+        t = rtn_bench_now();
+        start = rtn_bench_cycles();
+        if (radix) {
+            rtn_bench_radix(&b->b_head, b->b_trace, b->b_trace_len,
+                            b->b_keybits, NULL);
+        } else {
+            for (i = 0; i < b->b_trace_len; i++) {
+                rtn_lookup(&b->b_head,
+                           (char *) &b->b_trace[(size_t) i * b->b_keybytes],
+                           b->b_keybits);
+            }
+        }
+        cycles = rtn_bench_cycles() - start;
+        t = rtn_bench_now() - t;
+        if (cycles < best) {
+            best = cycles;
+            *ns = t;
+        }
+    }
+
+    return (best);
+}
+
+/*
+ * rtn_bench_radix_trace
+ *
+ * RadixTree against rtn_lookup() on the trace. Return FALSE when a
+ * result differs.
+ */
+static int8_t
+rtn_bench_radix_trace (rtn_bench_t *b, const char *name)
+{
+    rt_info_t **results;
+    u_int64_t c_cycles, cycles, c_ns, ns, mismatches = 0;
+    u_int32_t i;
+
+    results = malloc(b->b_trace_len * sizeof(rt_info_t *));
+    if (!results) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    if (rtn_bench_radix(&b->b_head, b->b_trace, b->b_trace_len,
+                        b->b_keybits, results) == ~0U) {
+        free(results);
+        return (FALSE);
+    }
+    for (i = 0; i < b->b_trace_len; i++) {
+        if (results[i] !=
+            rtn_lookup(&b->b_head,
+                       (char *) &b->b_trace[(size_t) i * b->b_keybytes],
+                       b->b_keybits)) {
+            mismatches++;
+        }
+    }
+    free(results);
+
+    c_cycles = rtn_bench_radix_run(b, FALSE, &c_ns);
+    cycles = rtn_bench_radix_run(b, TRUE, &ns);
+    printf("%-18s %12.0f ops/s   %.0f cycles/lookup, rtn_lookup %.0f "
+           "(%.0f ops/s)\n", name, b->b_trace_len * 1e9 / ns,
+           (double) cycles / b->b_trace_len,
+           (double) c_cycles / b->b_trace_len,
+           b->b_trace_len * 1e9 / c_ns);
+    printf("%-18s %12llu mismatches\n", "",
+           (unsigned long long) mismatches);
+
+    return (!mismatches);
+}
+#endif
+
+/*
+ * rtn_bench_stride_update
+ *
+ * Delete a tenth of the table and add it again, with the stride engine
+ * attached. The ops are the deletes and the adds. Return FALSE when the
+ * engine then differs from the tree on the trace.
+ */
+static int8_t
+rtn_bench_stride_update (rtn_bench_t *b)
+{
+    rtn_bench_route_t *br;
+    u_int64_t start, t, total;
+    u_int32_t i, count;
+
+    count = b->b_added / 10;
+    start = rtn_bench_now();
+    for (i = 0; i < count; i++) {
+        t = rtn_bench_now();
+        rtn_delete((rt_info_t *) &b->b_routes[b->b_order[i]], &b->b_head);
+        rtn_bench_record(b, t, rtn_bench_now());
+    }
+    for (i = 0; i < count; i++) {
+        br = &b->b_routes[b->b_order[i]];
+        t = rtn_bench_now();
+        rtn_add(&b->b_head, (rt_info_t *) br, br->rnode_bit);
+        rtn_bench_record(b, t, rtn_bench_now());
+    }
+    total = rtn_bench_now() - start;
+
+    rtn_bench_report(b, "rtn_stride update", 2 * count, total);
+
+    return (!rtn_bench_stride_check(b));
+}
+
+/*
+ * rtn_bench_getnext
+ *
+ * Go over the table with rtn_key_getnext(), from the default route.
+ */
+static void
+rtn_bench_getnext (rtn_bench_t *b)
+{
+    rtn_getnext_cursor_t gc;
+    u_int8_t key[RTN_BENCH_KEY_MAX];
+    rt_info_t *rinfo;
+    u_int16_t bitlen;
+    u_int64_t start, t, total, ops = 0;
+
+    memset(key, 0, sizeof(key));
+    bitlen = 0;
+
+    start = rtn_bench_now();
+    for (;;) {
+        t = rtn_bench_now();
+        rinfo = rtn_key_getnext(&b->b_head, (char *) key, bitlen, FALSE);
+        rtn_bench_record(b, t, rtn_bench_now());
+        ops++;
+        if (!rinfo) {
+            break;
+        }
+        memcpy(key, rinfo->rninfo_key, b->b_keybytes);
+        bitlen = rinfo->rnode_bit;
+    }
+    total = rtn_bench_now() - start;
+
+    rtn_bench_report(b, "rtn_key_getnext", ops, total);
+
+    /*
+     * The same sweep with a cursor, on a tree that does not change.
+     */
+    rtn_getnext_cursor_init(&gc, &b->b_head);
+    ops = 0;
+    start = rtn_bench_now();
+    for (;;) {
+        t = rtn_bench_now();
+        rinfo = rtn_getnext_cursor_next(&gc);
+        rtn_bench_record(b, t, rtn_bench_now());
+        ops++;
+        if (!rinfo) {
+            break;
+        }
+    }
+    total = rtn_bench_now() - start;
+    rtn_getnext_cursor_free(&gc);
+
+    rtn_bench_report(b, "rtn_getnext_cursor", ops, total);
+}
+
+/*
+ * rtn_bench_walk
+ *
+ * The ops are infos walked, and the percentiles are of a whole walk.
+ */
+static void
+rtn_bench_walk (rtn_bench_t *b)
+{
+    u_int64_t t, total = 0, infos = 0;
+    u_int32_t i;
+
+    for (i = 0; i < b->b_walks; i++) {
+        t = rtn_bench_now();
+        rtn_walktree(NULL, rtn_bench_walk_count, &b->b_head, 0, FALSE,
+                     &infos);
+        rtn_bench_record(b, t, rtn_bench_now());
+        total += rtn_bench_now() - t;
+    }
+
+    rtn_bench_report(b, "rtn_walktree", infos, total);
+}
+
+/*
+ * rtn_bench_keybits_range
+ *
+ * Walk the infos of a range of lengths, by the tree and by the index.
+ * The ops are infos walked, and the percentiles are of a whole walk.
+ */
+static void
+rtn_bench_keybits_range (rtn_bench_t *b, u_int16_t min_len,
+                         u_int16_t max_len)
+{
+    u_int64_t t, total, infos;
+    u_int32_t i, run;
+    char name[32];
+
+    for (run = 0; run < 3; run++) {
+        total = infos = 0;
+        for (i = 0; i < b->b_walks; i++) {
+            t = rtn_bench_now();
+            switch (run) {
+              case 0:
+                rtn_walktree_keybits(NULL, rtn_bench_walk_count, &b->b_head,
+                                     min_len, max_len, 0, FALSE, &infos);
+                break;
+              case 1:
+                rtn_walktree_keybits_indexed(&b->b_head, rtn_bench_walk_count,
+                                             min_len, max_len, &infos);
+                break;
+              default:
+                rtn_walktree_keybits_parallel(&b->b_head,
+                                              rtn_bench_walk_count_atomic,
+                                              min_len, max_len, b->b_threads,
+                                              &infos);
+            }
+            rtn_bench_record(b, t, rtn_bench_now());
+            total += rtn_bench_now() - t;
+        }
+
+        snprintf(name, sizeof(name), "%s /%u-/%u",
+                 run == 0 ? "keybits" : run == 1 ? "indexed" : "parallel",
+                 min_len, max_len);
+        rtn_bench_report(b, name, infos, total);
+    }
+}
+
+/*
+ * rtn_bench_keybits
+ *
+ * Walk the shortest lengths of the table, i.e., the aggregates, and its
+ * longest length.
+ */
+static void
+rtn_bench_keybits (rtn_bench_t *b)
+{
+    const rtn_bench_len_t *lens;
+    u_int64_t t;
+    u_int16_t base = 0, last;
+
+    switch (b->b_table) {
+      case RTN_BENCH_IPV4:
+        lens = rtn_bench_ipv4_lens;
+        break;
+      case RTN_BENCH_IPV6:
+        lens = rtn_bench_ipv6_lens;
+        break;
+      default:
+        lens = rtn_bench_vpn_lens;
+        base = 64;
+    }
+    for (last = 0; lens[last + 1].bl_weight; last++) {
+        ;
+    }
+
+    t = rtn_bench_now();
+    if (!rtn_lenidx_init(&b->b_head)) {
+        fprintf(stderr, "rtn_lenidx_init failed\n");
+        return;
+    }
+    printf("%-18s %12.1f ms to index %u prefixes\n", "rtn_lenidx",
+           (rtn_bench_now() - t) / 1e6, b->b_head.rt_lenidx->li_count);
+
+    rtn_bench_keybits_range(b, base + lens[0].bl_len,
+                            base + lens[0].bl_len + 8);
+    rtn_bench_keybits_range(b, base + lens[last].bl_len,
+                            base + lens[last].bl_len);
+
+    rtn_lenidx_free(&b->b_head);
+}
+
+/*
+ * rtn_bench_cursor_run
+ *
+ * A walk with a cursor, count infos per resume, with a prefix deleted
+ * and added back between two resumes when churn. The prefix is never
+ * the one the cursor is parked on: deleted, it stays in the tree with
+ * the lock of the cursor, and adding it back would relink a node still
+ * linked. Return the count of
+ * infos walked; without churn, set mismatches to the count of them out
+ * of the order of walk.
+ */
+static u_int64_t
+rtn_bench_cursor_run (rtn_bench_t *b, rt_info_t **walk, u_int32_t count,
+                      int8_t churn, u_int64_t *mismatches)
+{
+    rtn_walk_cursor_t wc;
+    rtn_bench_route_t *br;
+    rt_info_t **infos, **next;
+    u_int64_t start, t, total = 0;
+    u_int32_t i, resumes = 0;
+    char name[32];
+    int8_t more;
+
+    infos = malloc(2 * b->b_added * sizeof(rt_info_t *));
+    if (!infos) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    next = infos;
+
+    rtn_walk_cursor_init(&wc, &b->b_head, NULL);
+    do {
+        br = &b->b_routes[b->b_order[resumes % b->b_added]];
+        if (churn && (RADIX_INFO2NODE((rt_info_t *) br) != wc.wc_node)) {
+            rtn_delete((rt_info_t *) br, &b->b_head);
+            rtn_add(&b->b_head, (rt_info_t *) br, br->rnode_bit);
+        }
+        start = rtn_bench_now();
+        more = rtn_walk_cursor_resume(&wc, count, rtn_bench_walk_collect,
+                                      &next);
+        t = rtn_bench_now();
+        rtn_bench_record(b, start, t);
+        total += t - start;
+        resumes++;
+    } while ((more > 0) && (next - infos < 2 * b->b_added - count));
+    if (more > 0) {
+        rtn_walk_cursor_stop(&wc);
+    }
+
+    *mismatches = 0;
+    if (!churn) {
+        for (i = 0; i < MIN(next - infos, b->b_added); i++) {
+            *mismatches += (infos[i] != walk[i]);
+        }
+    }
+    free(infos);
+
+    snprintf(name, sizeof(name), "cursor x%u%s", count, churn ? " chg" : "");
+    rtn_bench_report(b, name, next - infos, total);
+
+    return (next - infos);
+}
+
+/*
+ * rtn_bench_cursor
+ *
+ * Walks with a cursor, -W down to 1 infos per resume. Return FALSE when
+ * one is not the walk of rtn_walktree().
+ */
+static int8_t
+rtn_bench_cursor (rtn_bench_t *b)
+{
+    rt_info_t **walk, **next;
+    u_int64_t infos, mismatches;
+    u_int32_t count;
+    int8_t ok = TRUE;
+
+    walk = malloc(b->b_added * sizeof(rt_info_t *));
+    if (!walk) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    next = walk;
+    rtn_walktree(NULL, rtn_bench_walk_collect, &b->b_head, 0, FALSE, &next);
+
+    for (count = b->b_resume; ok && count;
+         count = (count > 1) ? MAX(count >> 2, 1) : 0) {
+        infos = rtn_bench_cursor_run(b, walk, count, FALSE, &mismatches);
+        ok = (infos == b->b_added) && !mismatches;
+
+        /*
+         * A change between two resumes adds or skips at most the info
+         * it moves.
+         */
+        infos = rtn_bench_cursor_run(b, walk, count, TRUE, &mismatches);
+        ok = ok && (infos + b->b_added / count + 1 >= b->b_added) &&
+             (infos <= b->b_added + b->b_added / count + 1);
+    }
+    free(walk);
+
+    return (ok);
+}
+
+/*
+ * The shards of an ordered walk of -p, and the walk to match.
+ */
+typedef struct _rtn_bench_pwalk_t
+{
+    rt_info_t   ***pw_shard;          /* infos of each shard */
+    u_int32_t   *pw_count;            /* infos in pw_shard[] */
+    u_int32_t   *pw_size;             /* room in pw_shard[] */
+    rt_info_t   **pw_walk;            /* infos of rtn_walktree() */
+    u_int32_t   pw_next;              /* next info of pw_walk to match */
+    u_int64_t   pw_mismatches;
+} rtn_bench_pwalk_t;
+
+/*
+ * rtn_bench_pwalk_keep
+ *
+ * Keep an info in its shard, for the merge.
+ */
+static int
+rtn_bench_pwalk_keep (rt_info_t *rinfo, va_list ap)
+{
+    rtn_bench_pwalk_t *pw = va_arg(ap, rtn_bench_pwalk_t *);
+    u_int32_t shard = rtn_walk_shard();
+    rt_info_t **infos;
+
+    if (pw->pw_count[shard] == pw->pw_size[shard]) {
+        infos = realloc(pw->pw_shard[shard],
+                        (pw->pw_size[shard] * 2 + 16) * sizeof(rt_info_t *));
+        if (!infos) {
+            return (RTWALK_ABORT);
+        }
+        pw->pw_shard[shard] = infos;
+        pw->pw_size[shard] = pw->pw_size[shard] * 2 + 16;
+    }
+    pw->pw_shard[shard][pw->pw_count[shard]++] = rinfo;
+
+    return (RTWALK_CONTINUE);
+}
+
+/*
+ * rtn_bench_pwalk_merge
+ *
+ * Match the infos of a shard with the next ones of rtn_walktree().
+ */
+static int
+rtn_bench_pwalk_merge (u_int32_t shard, va_list ap)
+{
+    rtn_bench_pwalk_t *pw = va_arg(ap, rtn_bench_pwalk_t *);
+    u_int32_t i;
+
+    for (i = 0; i < pw->pw_count[shard]; i++) {
+        if (pw->pw_shard[shard][i] != pw->pw_walk[pw->pw_next++]) {
+            pw->pw_mismatches++;
+        }
+    }
+    pw->pw_count[shard] = 0;
+
+    return (RTWALK_CONTINUE);
+}
+
+/*
+ * rtn_bench_pwalk_run
+ *
+ * The walks on a count of threads. Return FALSE when one of them does
+ * not return the infos of the tree.
+ */
+static int8_t
+rtn_bench_pwalk_run (rtn_bench_t *b, rtn_bench_pwalk_t *pw, u_int16_t depth,
+                     u_int32_t threads, u_int32_t min_version,
+                     u_int32_t bumped)
+{
+    u_int64_t t, total = 0, infos = 0;
+    u_int32_t i;
+    char name[32];
+    int8_t ok;
+
+    for (i = 0; i < b->b_walks; i++) {
+        t = rtn_bench_now();
+        rtn_walktree_parallel(&b->b_head, rtn_bench_walk_count_atomic, NULL,
+                              depth, threads, &infos);
+        rtn_bench_record(b, t, rtn_bench_now());
+        total += rtn_bench_now() - t;
+    }
+    snprintf(name, sizeof(name), "pwalk x%u", threads);
+    rtn_bench_report(b, name, infos, total);
+    ok = (infos == (u_int64_t) b->b_walks * b->b_added);
+
+    pw->pw_next = 0;
+    pw->pw_mismatches = 0;
+    t = rtn_bench_now();
+    if (rtn_walktree_parallel(&b->b_head, rtn_bench_pwalk_keep,
+                              rtn_bench_pwalk_merge, depth, threads, pw)) {
+        pw->pw_mismatches++;
+    }
+    total = rtn_bench_now() - t;
+    rtn_bench_record(b, t, t + total);
+    snprintf(name, sizeof(name), "pwalk merged x%u", threads);
+    rtn_bench_report(b, name, b->b_added, total);
+    ok = ok && !pw->pw_mismatches && (pw->pw_next == b->b_added);
+
+    infos = 0;
+    total = 0;
+    for (i = 0; i < b->b_walks; i++) {
+        t = rtn_bench_now();
+        rtn_walktree_version_parallel(&b->b_head,
+                                      rtn_bench_walk_count_atomic, NULL,
+                                      depth, threads, min_version,
+                                      min_version + bumped, &infos);
+        rtn_bench_record(b, t, rtn_bench_now());
+        total += rtn_bench_now() - t;
+    }
+    snprintf(name, sizeof(name), "pwalk version x%u", threads);
+    rtn_bench_report(b, name, infos, total);
+    ok = ok && (infos == (u_int64_t) b->b_walks * bumped);
+
+    if (!ok) {
+        printf("%-18s %12s infos differ from rtn_walktree()\n", "", "");
+    }
+
+    return (ok);
+}
+
+/*
+ * rtn_bench_pwalk
+ *
+ * Parallel walks on 1, 2, 4, ... up to -p threads.
+ */
+static int8_t
+rtn_bench_pwalk (rtn_bench_t *b)
+{
+    rtn_bench_pwalk_t pw;
+    rt_info_t **next;
+    u_int32_t i, shards, threads, min_version, bumped = 0;
+    u_int16_t depth;
+    int8_t ok = TRUE;
+
+    switch (b->b_table) {
+      case RTN_BENCH_IPV4:
+        depth = 8;
+        break;
+      case RTN_BENCH_IPV6:
+        depth = 16;
+        break;
+      default:
+        depth = 72;
+    }
+    shards = rtn_walktree_shards(&b->b_head, depth);
+    printf("%-18s %12u shards at bit %u\n", "rtn_pwalk", shards, depth);
+
+    memset(&pw, 0, sizeof(pw));
+    pw.pw_shard = calloc(shards, sizeof(rt_info_t **));
+    pw.pw_count = calloc(shards, sizeof(u_int32_t));
+    pw.pw_size = calloc(shards, sizeof(u_int32_t));
+    pw.pw_walk = malloc(b->b_added * sizeof(rt_info_t *));
+    if (!pw.pw_shard || !pw.pw_count || !pw.pw_size || !pw.pw_walk) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    next = pw.pw_walk;
+    rtn_walktree(NULL, rtn_bench_walk_collect, &b->b_head, 0, FALSE, &next);
+
+    min_version = b->b_version;
+    for (i = 0; i < b->b_added; i += 16) {
+        rtn_bump_version((rt_info_t *) &b->b_routes[b->b_order[i]],
+                         &b->b_version);
+        bumped++;
+    }
+
+    for (threads = 1; ok && threads && (threads <= b->b_pwalk);
+         threads <<= 1) {
+        ok = rtn_bench_pwalk_run(b, &pw, depth, threads, min_version,
+                                 bumped);
+    }
+
+    for (i = 0; i < shards; i++) {
+        free(pw.pw_shard[i]);
+    }
+    free(pw.pw_walk);
+    free(pw.pw_size);
+    free(pw.pw_count);
+    free(pw.pw_shard);
+
+    return (ok);
+}
+
+/*
+ * What a read of the change log delivered, for -c.
+ */
+typedef struct _rtn_bench_changes_t
+{
+    u_int64_t   bc_updates;
+    u_int64_t   bc_deletes;
+    u_int64_t   bc_stale;             /* update not of the info's version */
+} rtn_bench_changes_t;
+
+/*
+ * rtn_bench_changelog_count
+ */
+static int
+rtn_bench_changelog_count (rtn_change_t *changes, u_int32_t count,
+                           va_list ap)
+{
+    rtn_bench_changes_t *bc = va_arg(ap, rtn_bench_changes_t *);
+    u_int32_t i;
+
+    for (i = 0; i < count; i++) {
+        if (changes[i].rc_kind == RTN_CHANGE_DELETE) {
+            bc->bc_deletes++;
+            continue;
+        }
+        bc->bc_updates++;
+        if (changes[i].rc_info->version != changes[i].rc_version) {
+            bc->bc_stale++;
+        }
+    }
+
+    return (RTWALK_CONTINUE);
+}
+
+/*
+ * rtn_bench_changelog_bump
+ *
+ * New versions for a count of infos picked at random, timed.
+ */
+static void
+rtn_bench_changelog_bump (rtn_bench_t *b, const char *name, u_int32_t count)
+{
+    rt_info_t *rinfo;
+    u_int64_t start, t, total;
+    u_int32_t i;
+
+    start = rtn_bench_now();
+    for (i = 0; i < count; i++) {
+        rinfo = (rt_info_t *)
+                &b->b_routes[b->b_order[rtn_bench_uniform(b, b->b_added)]];
+        t = rtn_bench_now();
+        rtn_head_bump_version(&b->b_head, rinfo, &b->b_version);
+        rtn_bench_record(b, t, rtn_bench_now());
+    }
+    total = rtn_bench_now() - start;
+
+    rtn_bench_report(b, name, count, total);
+}
+
+/*
+ * rtn_bench_changelog_read
+ *
+ * Read the changes since a cursor, and walk the infos of a newer
+ * version than min_version. Return FALSE when they differ, or when the
+ * read was not done the way expected.
+ */
+static int8_t
+rtn_bench_changelog_read (rtn_bench_t *b, rtn_changelog_cursor_t *cursor,
+                          u_int32_t min_version, u_int8_t expected,
+                          u_int64_t deletes)
+{
+    rtn_bench_changes_t bc;
+    u_int64_t t, total, infos = 0;
+    u_int8_t status = RTN_CHANGELOG_RESYNC;
+
+    memset(&bc, 0, sizeof(bc));
+    t = rtn_bench_now();
+    rtn_changelog_read(&b->b_head, cursor, rtn_bench_changelog_count, 64,
+                       &status, &bc);
+    total = rtn_bench_now() - t;
+    rtn_bench_record(b, t, t + total);
+    rtn_bench_report(b, expected == RTN_CHANGELOG_DELTA ?
+                     "changelog delta" : "changelog walk",
+                     bc.bc_updates + bc.bc_deletes, total);
+
+    t = rtn_bench_now();
+    rtn_walktree_version(NULL, rtn_bench_walk_count, &b->b_head,
+                         min_version, b->b_version, 0, FALSE, &infos);
+    total = rtn_bench_now() - t;
+    rtn_bench_record(b, t, t + total);
+    rtn_bench_report(b, "  version walk", infos, total);
+
+    printf("%-18s %12llu updates, %llu deletes, %llu by the walk\n", "",
+           (unsigned long long) bc.bc_updates,
+           (unsigned long long) bc.bc_deletes, (unsigned long long) infos);
+
+    return ((status == expected) && (bc.bc_updates == infos) &&
+            (bc.bc_deletes == deletes) && !bc.bc_stale);
+}
+
+/*
+ * rtn_bench_changelog
+ *
+ * The cost of logging the changes of the tree, and of reading them
+ * back from a cursor.
+ */
+static int8_t
+rtn_bench_changelog (rtn_bench_t *b)
+{
+    rtn_changelog_cursor_t cursor;
+    rtn_bench_route_t *br;
+    u_int32_t i, min_version, size = b->b_changes * 2;
+    int8_t ok;
+
+    rtn_bench_changelog_bump(b, "rtn_bump_version", b->b_changes);
+
+    if (!rtn_changelog_init(&b->b_head, &b->b_version, b->b_keybytes,
+                            size)) {
+        fprintf(stderr, "rtn_changelog_init failed\n");
+        return (FALSE);
+    }
+    rtn_changelog_cursor(&b->b_head, &cursor);
+    min_version = b->b_version;
+
+    rtn_bench_changelog_bump(b, "changelog bump", b->b_changes);
+    for (i = 0; i < b->b_changes / 4; i++) {
+        br = &b->b_routes[b->b_order[i]];
+        rtn_delete((rt_info_t *) br, &b->b_head);
+        rtn_add(&b->b_head, (rt_info_t *) br, br->rnode_bit);
+        rtn_head_bump_version(&b->b_head, (rt_info_t *) br, &b->b_version);
+    }
+    ok = rtn_bench_changelog_read(b, &cursor, min_version,
+                                  RTN_CHANGELOG_DELTA, b->b_changes / 4);
+
+    /*
+     * Past the end of the ring: the deletes are lost.
+     */
+    min_version = b->b_version;
+    for (i = 0; i < b->b_changes / 4; i++) {
+        br = &b->b_routes[b->b_order[i]];
+        rtn_delete((rt_info_t *) br, &b->b_head);
+        rtn_add(&b->b_head, (rt_info_t *) br, br->rnode_bit);
+    }
+    rtn_bench_changelog_bump(b, "changelog bump", size * 2);
+    ok = ok && rtn_bench_changelog_read(b, &cursor, min_version,
+                                        RTN_CHANGELOG_WALK, 0);
+
+    rtn_changelog_free(&b->b_head);
+
+    return (ok);
+}
+
+/*
+ * The export end of -x, on a thread of its own.
+ */
+typedef struct _rtn_bench_wire_t
+{
+    rt_head_t   *bw_head;
+    int         bw_fd;
+    int8_t      bw_ok;
+    u_int64_t   bw_bytes;             /* written */
+} rtn_bench_wire_t;
+
+/*
+ * rtn_bench_wire_write
+ */
+static int8_t
+rtn_bench_wire_write (void *ctx, const u_int8_t *buf, u_int32_t len)
+{
+    rtn_bench_wire_t *bw = ctx;
+    ssize_t n;
+
+    bw->bw_bytes += len;
+    while (len) {
+        n = write(bw->bw_fd, buf, len);
+        if (n <= 0) {
+            return (FALSE);
+        }
+        buf += n;
+        len -= n;
+    }
+
+    return (TRUE);
+}
+
+/*
+ * rtn_bench_wire_export
+ */
+static void *
+rtn_bench_wire_export (void *arg)
+{
+    rtn_bench_wire_t *bw = arg;
+
+    bw->bw_ok = rtn_wire_export(bw->bw_head, NULL, NULL,
+                                rtn_bench_wire_write, bw, NULL);
+    close(bw->bw_fd);
+    return (NULL);
+}
+
+/*
+ * rtn_bench_wire_decode
+ */
+static rt_info_t *
+rtn_bench_wire_decode (void *ctx, const u_int8_t *key, u_int16_t bitlen,
+                       const u_int8_t *payload, u_int32_t len)
+{
+    rtn_bench_route_t *br;
+
+    br = calloc(1, sizeof(rtn_bench_route_t));
+    if (br) {
+        memcpy(br->br_key, key, (bitlen + 7) >> RNSHIFT);
+        br->rninfo_key = br->br_key;
+    }
+
+    return ((rt_info_t *) br);
+}
+
+/*
+ * rtn_bench_wire_copy
+ *
+ * Walk function of the copy -x compares to: add a copy of each info to
+ * another tree.
+ */
+static int
+rtn_bench_wire_copy (rt_info_t *rinfo, va_list ap)
+{
+    rt_head_t *to = va_arg(ap, rt_head_t *);
+    rtn_bench_route_t *br;
+
+    br = calloc(1, sizeof(rtn_bench_route_t));
+    if (!br) {
+        return (RTWALK_ABORT);
+    }
+    memcpy(br->br_key, ((rtn_bench_route_t *) rinfo)->br_key,
+           RTN_BENCH_KEY_MAX);
+    br->rninfo_key = br->br_key;
+    if (!rtn_add(to, (rt_info_t *) br, rinfo->rnode_bit)) {
+        free(br);
+    }
+
+    return (RTWALK_CONTINUE);
+}
+
+/*
+ * rtn_bench_wire_file
+ *
+ * The export and the import of rtn_bench_wire(), one after the other,
+ * through a temporary file.
+ */
+static void
+rtn_bench_wire_file (rtn_bench_t *b, rt_head_t *to)
+{
+    u_int8_t zero[RTN_BENCH_KEY_MAX];
+    u_int64_t t;
+    u_int32_t count;
+    FILE *file;
+    int fd;
+
+    file = tmpfile();
+    if (!file) {
+        perror("tmpfile");
+        return;
+    }
+    fd = fileno(file);
+
+    t = rtn_bench_now();
+    if (!rtn_wire_export_fd(&b->b_head, fd, NULL, NULL, &count)) {
+        fprintf(stderr, "rtn_wire_export failed\n");
+        fclose(file);
+        return;
+    }
+    printf("%-18s %12.1f ms for %u prefixes\n", "rtn_wire export",
+           (rtn_bench_now() - t) / 1e6, count);
+
+    lseek(fd, 0, SEEK_SET);
+    t = rtn_bench_now();
+    if (!rtn_wire_import_fd(to, fd, rtn_bench_wire_decode, NULL, &count)) {
+        fprintf(stderr, "rtn_wire_import failed\n");
+    }
+    printf("%-18s %12.1f ms for %u prefixes\n", "rtn_wire import",
+           (rtn_bench_now() - t) / 1e6, count);
+    fclose(file);
+
+    memset(zero, 0, sizeof(zero));
+    rtn_purge_subtree(to, (char *) zero, 0, 0);
+}
+
+/*
+ * rtn_bench_wire
+ *
+ * Copy the tree to another one, through a socket and rtn_wire.h, then
+ * with rtn_walktree() and rtn_add(). The percentiles are of no use for
+ * a single run, so only the time is printed.
+ */
+static void
+rtn_bench_wire (rtn_bench_t *b)
+{
+    rtn_bench_wire_t bw;
+    rt_head_t to;
+    pthread_t thread;
+    u_int8_t zero[RTN_BENCH_KEY_MAX];
+    u_int64_t t;
+    u_int32_t count;
+    int8_t ok;
+    int sv[2];
+
+    memset(zero, 0, sizeof(zero));
+    memset(&bw, 0, sizeof(bw));
+    rtn_root_init(&to, 0, NULL);
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv)) {
+        perror("socketpair");
+        return;
+    }
+    bw.bw_head = &b->b_head;
+    bw.bw_fd = sv[0];
+
+    t = rtn_bench_now();
+    if (pthread_create(&thread, NULL, rtn_bench_wire_export, &bw)) {
+        fprintf(stderr, "pthread_create failed\n");
+        close(sv[0]);
+        close(sv[1]);
+        return;
+    }
+    ok = rtn_wire_import_fd(&to, sv[1], rtn_bench_wire_decode, NULL,
+                            &count);
+    close(sv[1]);
+    pthread_join(thread, NULL);
+    t = rtn_bench_now() - t;
+    if (!ok || !bw.bw_ok) {
+        fprintf(stderr, "rtn_wire failed\n");
+    }
+    printf("%-18s %12.1f ms for %u prefixes, %llu bytes "
+           "(%.2f bytes/prefix)\n", "rtn_wire",
+           t / 1e6, count, (unsigned long long) bw.bw_bytes,
+           count ? (double) bw.bw_bytes / count : 0.0);
+    rtn_purge_subtree(&to, (char *) zero, 0, 0);
+
+    rtn_bench_wire_file(b, &to);
+
+    t = rtn_bench_now();
+    rtn_walktree(NULL, rtn_bench_wire_copy, &b->b_head, 0, FALSE, &to);
+    t = rtn_bench_now() - t;
+    printf("%-18s %12.1f ms for %u prefixes\n", "rtn_walktree+add",
+           t / 1e6, to.ri_count);
+    rtn_purge_subtree(&to, (char *) zero, 0, 0);
+    rtn_root_free(&to);
+}
+
+/*
+ * rtn_bench_arena_take
+ *
+ * Allocate an element, and check that it is zeroed and on one line.
+ */
+static u_int8_t *
+rtn_bench_arena_take (rtn_arena_t *arena)
+{
+    u_int8_t *elem;
+    u_int32_t i;
+
+    elem = rtn_arena_alloc(arena);
+    if (!elem) {
+        fprintf(stderr, "rtn_arena_alloc failed\n");
+        exit(1);
+    }
+    for (i = 0; i < RTN_BENCH_BUCKET; i++) {
+        if (elem[i]) {
+            fprintf(stderr, "rtn_arena_alloc: element not zeroed\n");
+            exit(1);
+        }
+    }
+    if ((uintptr_t) elem % RTN_ARENA_ALIGN) {
+        fprintf(stderr, "rtn_arena_alloc: element across lines\n");
+        exit(1);
+    }
+    memset(elem, 0xa5, RTN_BENCH_BUCKET);
+
+    return (elem);
+}
+
+/*
+ * rtn_bench_arena
+ *
+ * As many elements as prefixes, then a free and an alloc at random, as
+ * timers come and go in a large pool.
+ */
+static void
+rtn_bench_arena (rtn_bench_t *b, const char *name, u_int32_t flags)
+{
+    rtn_arena_t arena;
+    u_int8_t **elems;
+    u_int64_t start, t, total;
+    u_int32_t i, j;
+
+    elems = malloc(b->b_count * sizeof(u_int8_t *));
+    if (!elems) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    rtn_arena_init(&arena, RTN_BENCH_BUCKET, RTN_ARENA_F_ALIGN | flags);
+    for (i = 0; i < b->b_count; i++) {
+        elems[i] = rtn_bench_arena_take(&arena);
+    }
+
+    start = rtn_bench_now();
+    for (i = 0; i < b->b_count; i++) {
+        j = rtn_bench_uniform(b, b->b_count);
+        t = rtn_bench_now();
+        rtn_arena_free(&arena, elems[j]);
+        elems[j] = rtn_bench_arena_take(&arena);
+        rtn_bench_record(b, t, rtn_bench_now());
+    }
+    total = rtn_bench_now() - start;
+
+    for (i = 0; i < b->b_count; i++) {
+        rtn_arena_free(&arena, elems[i]);
+    }
+    if (arena.ra_inuse) {
+        fprintf(stderr, "rtn_arena: %u elements left\n", arena.ra_inuse);
+        exit(1);
+    }
+
+    rtn_bench_report(b, name, b->b_count, total);
+    printf("%-18s %12u slabs, %u hugetlb, %u thp, %llu KB\n", "",
+           arena.ra_slab_count, arena.ra_hugetlb_slabs, arena.ra_thp_slabs,
+           (unsigned long long) (arena.ra_bytes >> 10));
+    rtn_arena_destroy(&arena);
+    free(elems);
+}
+
+/*
+ * rtn_bench_snapshot_same
+ *
+ * Whether the info found in a tree with a snapshot, mapped or promoted,
+ * is the same prefix as the one found in the table.
+ */
+static int8_t
+rtn_bench_snapshot_same (rt_head_t *rt_head, rt_info_t *rinfo,
+                         rt_info_t *live)
+{
+    u_int8_t *key;
+
+    if (!rinfo || !live) {
+        return (rinfo == live);
+    }
+    key = rt_head->rt_snapshot ? rtn_snapshot_key(rt_head, rinfo) :
+                                 rinfo->rninfo_key;
+
+    return ((rinfo->rnode_bit == live->rnode_bit) &&
+            !memcmp(key, live->rninfo_key, (live->rnode_bit + 7) >> RNSHIFT));
+}
+
+/*
+ * rtn_bench_snapshot_check
+ *
+ * Look up the trace in a tree with a snapshot, and the prefix found in
+ * the table with rtn_search(), each result compared with the table. The
+ * lookups are timed when name is not NULL. Return the count of results
+ * that differ.
+ */
+static u_int64_t
+rtn_bench_snapshot_check (rtn_bench_t *b, rt_head_t *rt_head,
+                          const char *name)
+{
+    rt_info_t *rinfo, *live;
+    u_int64_t start, t, total = 0, mismatches = 0;
+    u_int32_t i;
+    char *addr;
+
+    for (i = 0; i < b->b_trace_len; i++) {
+        addr = (char *) &b->b_trace[(size_t) i * b->b_keybytes];
+        start = rtn_bench_now();
+        rinfo = rtn_lookup(rt_head, addr, b->b_keybits);
+        t = rtn_bench_now();
+        rtn_bench_record(b, start, t);
+        total += t - start;
+
+        live = rtn_lookup(&b->b_head, addr, b->b_keybits);
+        mismatches += !rtn_bench_snapshot_same(rt_head, rinfo, live);
+        if (live) {
+            rinfo = rtn_search(rt_head, live->rninfo_key, live->rnode_bit);
+            mismatches += !rtn_bench_snapshot_same(rt_head, rinfo, live);
+        }
+    }
+
+    if (name) {
+        rtn_bench_report(b, name, b->b_trace_len, total);
+    } else {
+        memset(&b->b_hist, 0, sizeof(rtn_hist_t));
+    }
+
+    return (mismatches);
+}
+
+/*
+ * rtn_bench_snapshot_random
+ *
+ * Fill the trace with random addresses, most of them under no prefix of
+ * the table.
+ */
+static void
+rtn_bench_snapshot_random (rtn_bench_t *b)
+{
+    size_t i;
+
+    for (i = 0; i < (size_t) b->b_trace_len * b->b_keybytes; i++) {
+        b->b_trace[i] = rtn_bench_rand(b);
+    }
+}
+
+/*
+ * rtn_bench_snapshot
+ *
+ * Write the table to a snapshot, map it into another tree, and compare
+ * the lookups in the mapped snapshot, and then in the tree it is
+ * promoted to, with the ones in the table. Return FALSE when they
+ * differ, or when the snapshot cannot be written or mapped.
+ */
+static int8_t
+rtn_bench_snapshot (rtn_bench_t *b)
+{
+    char path[] = "/tmp/rtn_bench.XXXXXX";
+    u_int8_t zero[RTN_BENCH_KEY_MAX];
+    rt_head_t rt_head;
+    u_int64_t t, mismatches;
+    u_int32_t mapped;
+    int fd;
+
+    fd = mkstemp(path);
+    if (fd < 0) {
+        perror("mkstemp");
+        return (FALSE);
+    }
+    close(fd);
+
+    t = rtn_bench_now();
+    if (!rtn_snapshot_write(&b->b_head, path, sizeof(rtn_bench_route_t))) {
+        perror("rtn_snapshot_write");
+        unlink(path);
+        return (FALSE);
+    }
+    printf("%-18s %12.1f ms for %u prefixes\n", "rtn_snapshot write",
+           (rtn_bench_now() - t) / 1e6, b->b_added);
+
+    t = rtn_bench_now();
+    if (!rtn_snapshot_map(&rt_head, path, RTN_BIT_CHUNK_NONE, NULL)) {
+        perror("rtn_snapshot_map");
+        unlink(path);
+        return (FALSE);
+    }
+    printf("%-18s %12.1f ms\n", "rtn_snapshot map",
+           (rtn_bench_now() - t) / 1e6);
+    unlink(path);
+    mapped = rt_head.ri_count;
+
+    rtn_bench_gen_trace(b, "uniform", NULL, NULL);
+    mismatches = rtn_bench_snapshot_check(b, &rt_head, "snapshot uniform");
+    rtn_bench_snapshot_random(b);
+    mismatches += rtn_bench_snapshot_check(b, &rt_head, "snapshot random");
+
+    t = rtn_bench_now();
+    if (!rtn_snapshot_promote(&rt_head, NULL)) {
+        fprintf(stderr, "rtn_snapshot_promote failed\n");
+        rtn_root_free(&rt_head);
+        return (FALSE);
+    }
+    printf("%-18s %12.1f ms\n", "rtn_snapshot promote",
+           (rtn_bench_now() - t) / 1e6);
+
+    mismatches += rtn_bench_snapshot_check(b, &rt_head, NULL);
+    rtn_bench_gen_trace(b, "uniform", NULL, NULL);
+    mismatches += rtn_bench_snapshot_check(b, &rt_head, NULL);
+
+    printf("%-18s %12llu mismatches, %u infos mapped, %u promoted\n", "",
+           (unsigned long long) mismatches, mapped, rt_head.ri_count);
+    if ((mapped != b->b_added) || (rt_head.ri_count != b->b_added)) {
+        mismatches++;
+    }
+    memset(zero, 0, sizeof(zero));
+    rtn_purge_subtree(&rt_head, (char *) zero, 0, 0);
+    rtn_root_free(&rt_head);
+
+    return (!mismatches);
+}
+
+/*
+ * rtn_bench_delete
+ */
+static void
+rtn_bench_delete (rtn_bench_t *b)
+{
+    u_int64_t start, t, total;
+    u_int32_t i;
+
+    rtn_bench_shuffle(b, b->b_order, b->b_added);
+
+    start = rtn_bench_now();
+    for (i = 0; i < b->b_added; i++) {
+        t = rtn_bench_now();
+        rtn_delete((rt_info_t *) &b->b_routes[b->b_order[i]], &b->b_head);
+        rtn_bench_record(b, t, rtn_bench_now());
+    }
+    total = rtn_bench_now() - start;
+
+    rtn_bench_report(b, "rtn_delete", b->b_added, total);
+}
+
+/*
+ * rtn_bench_bulk_cmp
+ *
+ * The order of rtn_bulk_load(): by key, then by bit length. The keys
+ * are masked to their length, and zero past the key size.
+ */
+static int
+rtn_bench_bulk_cmp (const void *a, const void *b)
+{
+    const rtn_bench_route_t *ra = (const rtn_bench_route_t *)
+                                  ((const rtn_bulk_entry_t *) a)->rinfo;
+    const rtn_bench_route_t *rb = (const rtn_bench_route_t *)
+                                  ((const rtn_bulk_entry_t *) b)->rinfo;
+    int cmp;
+
+    cmp = memcmp(ra->br_key, rb->br_key, RTN_BENCH_KEY_MAX);
+    if (cmp) {
+        return (cmp);
+    }
+
+    return ((int) ra->rnode_bit - (int) rb->rnode_bit);
+}
+
+/*
+ * rtn_bench_bulk_tree
+ *
+ * Walk a tree into infos, then delete its infos and free it.
+ */
+static void
+rtn_bench_bulk_tree (rtn_bench_t *b, rt_head_t *rt_head, rt_info_t **infos)
+{
+    rt_info_t **next = infos;
+    u_int32_t i;
+
+    rtn_walktree(NULL, rtn_bench_walk_collect, rt_head, 0, FALSE, &next);
+    for (i = 0; i < b->b_added; i++) {
+        rtn_delete((rt_info_t *) &b->b_routes[b->b_order[i]], rt_head);
+    }
+    rtn_root_free(rt_head);
+}
+
+/*
+ * rtn_bench_bulk
+ *
+ * Build the table at once with rtn_bulk_load(), and one prefix at a
+ * time with rtn_add(), each in a new tree. Return FALSE when the trees
+ * differ.
+ */
+static int8_t
+rtn_bench_bulk (rtn_bench_t *b)
+{
+    rtn_bulk_entry_t *entries;
+    rtn_bench_route_t *br;
+    rt_info_t **add_infos, **bulk_infos;
+    rt_head_t rt_head;
+    u_int64_t start, total;
+    u_int32_t i, add_nodes, bulk_nodes, loaded;
+    u_int8_t flags;
+    int8_t ok;
+
+    entries = malloc(b->b_added * sizeof(rtn_bulk_entry_t));
+    add_infos = malloc(b->b_added * sizeof(rt_info_t *));
+    bulk_infos = malloc(b->b_added * sizeof(rt_info_t *));
+    if (!entries || !add_infos || !bulk_infos) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    flags = RTN_BIT_KEEP_INFO | (b->b_hugepage ? RTN_BIT_HUGEPAGE : 0);
+
+    rtn_bench_shuffle(b, b->b_order, b->b_added);
+    rtn_root_init(&rt_head, flags, NULL);
+    start = rtn_bench_now();
+    for (i = 0; i < b->b_added; i++) {
+        br = &b->b_routes[b->b_order[i]];
+        rtn_add(&rt_head, (rt_info_t *) br, br->rnode_bit);
+    }
+    total = rtn_bench_now() - start;
+    printf("%-18s %12.0f ops/s   %.1f ms\n", "cold rtn_add",
+           b->b_added * 1e9 / total, total / 1e6);
+    add_nodes = rt_head.rn_count;
+    rtn_bench_bulk_tree(b, &rt_head, add_infos);
+
+    start = rtn_bench_now();
+    for (i = 0; i < b->b_added; i++) {
+        br = &b->b_routes[b->b_order[i]];
+        entries[i].rinfo = (rt_info_t *) br;
+        entries[i].bitlen = br->rnode_bit;
+    }
+    qsort(entries, b->b_added, sizeof(rtn_bulk_entry_t), rtn_bench_bulk_cmp);
+    printf("%-18s %12.1f ms to sort\n", "", (rtn_bench_now() - start) / 1e6);
+
+    rtn_root_init(&rt_head, flags, NULL);
+    start = rtn_bench_now();
+    loaded = rtn_bulk_load(&rt_head, entries, b->b_added);
+    total = rtn_bench_now() - start;
+    printf("%-18s %12.0f ops/s   %.1f ms\n", "cold rtn_bulk_load",
+           b->b_added * 1e9 / total, total / 1e6);
+    bulk_nodes = rt_head.rn_count;
+    rtn_bench_bulk_tree(b, &rt_head, bulk_infos);
+
+    ok = (loaded == b->b_added) && (bulk_nodes == add_nodes) &&
+         !memcmp(add_infos, bulk_infos, b->b_added * sizeof(rt_info_t *));
+    printf("%-18s %12u internal nodes, %u with rtn_add(), %s\n", "",
+           bulk_nodes, add_nodes, ok ? "same walk" : "trees differ");
+
+    free(bulk_infos);
+    free(add_infos);
+    free(entries);
+
+    return (ok);
+}
+
+/*
+ * A reader of -r.
+ */
+typedef struct _rtn_bench_reader_t
+{
+    rtn_bench_t *br_bench;
+    rt_head_t   *br_head;
+    u_int32_t   br_start;             /* first address of the trace */
+    int8_t      *br_stop;             /* set by the writer */
+    u_int64_t   br_lookups;
+    u_int64_t   br_errors;            /* results not covering the address */
+    pthread_t   br_thread;
+} rtn_bench_reader_t;
+
+/*
+ * rtn_bench_covers
+ *
+ * Whether a prefix covers an address.
+ */
+static int8_t
+rtn_bench_covers (const u_int8_t *key, u_int16_t bitlen, const u_int8_t *addr)
+{
+    u_int16_t i;
+
+    for (i = 0; i < RNBYTE(bitlen); i++) {
+        if (key[i] != addr[i]) {
+            return (FALSE);
+        }
+    }
+    if (bitlen & 0x7) {
+        return (!((key[i] ^ addr[i]) & ~(0xff >> (bitlen & 0x7))));
+    }
+
+    return (TRUE);
+}
+
+/*
+ * rtn_bench_reader
+ *
+ * Look up the trace, from br_start on, until stopped.
+ */
+static void *
+rtn_bench_reader (void *arg)
+{
+    rtn_bench_reader_t *br = arg;
+    rtn_bench_t *b = br->br_bench;
+    rt_info_t *rinfo;
+    u_int8_t *addr;
+    u_int32_t i = br->br_start;
+
+    while (!__atomic_load_n(br->br_stop, __ATOMIC_RELAXED)) {
+        addr = &b->b_trace[(size_t) i * b->b_keybytes];
+        if (rtn_rcu_read_lock()) {
+            br->br_errors++;
+            break;
+        }
+        rinfo = rtn_lookup(br->br_head, (char *) addr, b->b_keybits);
+        if (rinfo && !rtn_bench_covers(rinfo->rninfo_key, rinfo->rnode_bit,
+                                       addr)) {
+            br->br_errors++;
+        }
+        rtn_rcu_read_unlock();
+
+        br->br_lookups++;
+        if (++i == b->b_trace_len) {
+            i = 0;
+        }
+    }
+    rtn_rcu_thread_offline();
+
+    return (NULL);
+}
+
+/*
+ * rtn_bench_rcu_run
+ *
+ * A second of readers against the writer. Return FALSE on an error.
+ */
+static int8_t
+rtn_bench_rcu_run (rtn_bench_t *b, rt_head_t *rt_head, u_int32_t readers)
+{
+    rtn_bench_reader_t *rd;
+    rtn_bench_route_t *br;
+    u_int64_t start, t, lookups = 0, errors = 0, changes = 0;
+    u_int32_t i, j, next = 0;
+    int8_t stop = FALSE;
+
+    rd = calloc(readers, sizeof(rtn_bench_reader_t));
+    if (!rd) {
+        fprintf(stderr, "out of memory\n");
+        return (FALSE);
+    }
+    for (i = 0; i < readers; i++) {
+        rd[i].br_bench = b;
+        rd[i].br_head = rt_head;
+        rd[i].br_start = (u_int32_t) ((u_int64_t) b->b_trace_len * i /
+                                      readers);
+        rd[i].br_stop = &stop;
+        if (pthread_create(&rd[i].br_thread, NULL, rtn_bench_reader,
+                           &rd[i])) {
+            fprintf(stderr, "pthread_create failed\n");
+            exit(1);
+        }
+    }
+
+    start = rtn_bench_now();
+    do {
+        t = rtn_bench_now();
+        for (j = 0; j < RTN_BENCH_CHURN; j++) {
+            br = &b->b_routes[b->b_order[(next + j) % b->b_added]];
+            rtn_delete((rt_info_t *) br, rt_head);
+        }
+        rtn_rcu_quiesce();
+        for (j = 0; j < RTN_BENCH_CHURN; j++) {
+            br = &b->b_routes[b->b_order[(next + j) % b->b_added]];
+            rtn_add(rt_head, (rt_info_t *) br, br->rnode_bit);
+        }
+        rtn_rcu_reclaim(rt_head);
+        rtn_bench_record(b, t, rtn_bench_now());
+        next = (next + RTN_BENCH_CHURN) % b->b_added;
+        changes += 2 * RTN_BENCH_CHURN;
+    } while (rtn_bench_now() - start < 1000000000ULL);
+
+    __atomic_store_n(&stop, TRUE, __ATOMIC_RELAXED);
+    for (i = 0; i < readers; i++) {
+        pthread_join(rd[i].br_thread, NULL);
+        lookups += rd[i].br_lookups;
+        errors += rd[i].br_errors;
+    }
+    t = rtn_bench_now() - start;
+    free(rd);
+
+    printf("%-18s %12.0f lookups/s, %.0f per reader, %llu errors\n", "",
+           lookups * 1e9 / t, lookups * 1e9 / t / readers,
+           (unsigned long long) errors);
+    rtn_bench_report(b, "  writer", changes, t);
+
+    return (!errors);
+}
+
+/*
+ * rtn_bench_rcu
+ *
+ * The table in a tree with RTN_BIT_RCU, read by 1, 2, 4, ... up to -r
+ * threads while it changes.
+ */
+static int8_t
+rtn_bench_rcu (rtn_bench_t *b)
+{
+    rtn_bench_route_t *br;
+    rt_head_t rt_head;
+    u_int32_t i, readers;
+    int8_t ok = TRUE;
+
+    rtn_root_init(&rt_head, RTN_BIT_RCU | RTN_BIT_KEEP_INFO, NULL);
+    for (i = 0; i < b->b_added; i++) {
+        br = &b->b_routes[b->b_order[i]];
+        rtn_add(&rt_head, (rt_info_t *) br, br->rnode_bit);
+    }
+
+    for (readers = 1; ok && readers && (readers <= b->b_readers);
+         readers <<= 1) {
+        printf("rtn_rcu %u reader%s:\n", readers, readers > 1 ? "s" : "");
+        ok = rtn_bench_rcu_run(b, &rt_head, readers);
+    }
+
+    for (i = 0; i < b->b_added; i++) {
+        rtn_delete((rt_info_t *) &b->b_routes[b->b_order[i]], &rt_head);
+    }
+    rtn_rcu_synchronize(&rt_head);
+    rtn_root_free(&rt_head);
+
+    return (ok);
+}
+
+/*
+ * rtn_bench_multi
+ *
+ * Spread the table over a count of trees, then look up each address of
+ * the trace in all of them.
+ */
+static void
+rtn_bench_multi (rtn_bench_t *b, u_int32_t tables)
+{
+    rtn_bench_route_t *br;
+    rt_head_t *heads, **rt_heads;
+    rt_info_t **results;
+    u_int64_t start, t, total, found = 0;
+    u_int32_t addrs, i, j;
+    char name[32], *addr;
+
+    heads = calloc(tables, sizeof(rt_head_t));
+    rt_heads = calloc(tables, sizeof(rt_head_t *));
+    results = calloc(tables, sizeof(rt_info_t *));
+    if (!heads || !rt_heads || !results) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    for (j = 0; j < tables; j++) {
+        rtn_root_init(&heads[j], RTN_BIT_KEEP_INFO, NULL);
+        rt_heads[j] = &heads[j];
+    }
+    for (i = 0; i < b->b_added; i++) {
+        br = &b->b_routes[b->b_order[i]];
+        rtn_add(&heads[i % tables], (rt_info_t *) br, br->rnode_bit);
+    }
+
+    addrs = MAX(b->b_trace_len / tables, 1);
+
+    start = rtn_bench_now();
+    for (i = 0; i < addrs; i++) {
+        addr = (char *) &b->b_trace[(size_t) i * b->b_keybytes];
+        for (j = 0; j < tables; j++) {
+            found += (rtn_lookup(&heads[j], addr, b->b_keybits) != NULL);
+        }
+    }
+    total = rtn_bench_now() - start;
+    for (i = 0; i < addrs; i++) {
+        addr = (char *) &b->b_trace[(size_t) i * b->b_keybytes];
+        t = rtn_bench_now();
+        for (j = 0; j < tables; j++) {
+            rtn_lookup(&heads[j], addr, b->b_keybits);
+        }
+        rtn_bench_record(b, t, rtn_bench_now());
+    }
+    snprintf(name, sizeof(name), "rtn_lookup x%u", tables);
+    rtn_bench_report(b, name, addrs, total);
+
+    start = rtn_bench_now();
+    for (i = 0; i < addrs; i++) {
+        addr = (char *) &b->b_trace[(size_t) i * b->b_keybytes];
+        rtn_lookup_multi(rt_heads, addr, b->b_keybits, results, tables);
+        for (j = 0; j < tables; j++) {
+            found -= (results[j] != NULL);
+        }
+    }
+    total = rtn_bench_now() - start;
+    for (i = 0; i < addrs; i++) {
+        addr = (char *) &b->b_trace[(size_t) i * b->b_keybytes];
+        t = rtn_bench_now();
+        rtn_lookup_multi(rt_heads, addr, b->b_keybits, results, tables);
+        rtn_bench_record(b, t, rtn_bench_now());
+    }
+    snprintf(name, sizeof(name), "rtn_lookup_multi x%u", tables);
+    rtn_bench_report(b, name, addrs, total);
+    if (found) {
+        printf("%-18s results differ\n", "");
+    }
+
+    for (j = 0; j < tables; j++) {
+        for (i = j; i < b->b_added; i += tables) {
+            rtn_delete((rt_info_t *) &b->b_routes[b->b_order[i]], &heads[j]);
+        }
+        rtn_root_free(&heads[j]);
+    }
+    free(results);
+    free(rt_heads);
+    free(heads);
+}
+
+/*
+ * A version of rtn_key_diff(), for -d.
+ */
+typedef struct _rtn_bench_diff_t
+{
+    const char          *bd_name;
+    rtn_key_diff_func   bd_func;
+} rtn_bench_diff_t;
+
+/*
+ * rtn_bench_diff_versions
+ *
+ * Fill in the versions that the CPU can run. Return their count.
+ */
+static u_int32_t
+rtn_bench_diff_versions (rtn_bench_diff_t *bd)
+{
+    u_int32_t count = 0;
+
+    bd[count].bd_name = "table";
+    bd[count++].bd_func = rtn_key_diff_table;
+    bd[count].bd_name = "word";
+    bd[count++].bd_func = rtn_key_diff_word;
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2")) {
+        bd[count].bd_name = "sse2";
+        bd[count++].bd_func = rtn_key_diff_sse2;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        bd[count].bd_name = "avx2";
+        bd[count++].bd_func = rtn_key_diff_avx2;
+    }
+#endif
+
+    return (count);
+}
+
+/*
+ * rtn_bench_diff_check
+ *
+ * Each version, and rtn_key_diff() and rtn_key_cmp(), against the table
+ * version. Return the count of pairs where one differs.
+ */
+static u_int64_t
+rtn_bench_diff_check (rtn_bench_t *b, rtn_bench_diff_t *bd,
+                      u_int32_t versions)
+{
+    u_int64_t mismatches = 0;
+    u_int32_t i, j;
+    u_int16_t bitlen, bytes, flip, expected;
+    u_int8_t *key1, *key2;
+
+    for (i = 0; i < b->b_diffs; i++) {
+        bitlen = rtn_bench_uniform(b, RTN_BENCH_DIFF_BITS + 1);
+        bytes = RNBYTE(bitlen + 7);
+        key1 = malloc(MAX(bytes, 1));
+        key2 = malloc(MAX(bytes, 1));
+        if (!key1 || !key2) {
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+        for (j = 0; j < bytes; j++) {
+            key1[j] = key2[j] = rtn_bench_rand(b);
+        }
+
+        /*
+         * A bit flipped before the bit length, in the last byte past
+         * it, or none.
+         */
+        switch (rtn_bench_uniform(b, 4)) {
+          case 0:
+            break;
+          case 1:
+            if (bytes && (bitlen & 0x7)) {
+                flip = bitlen + rtn_bench_uniform(b, 8 - (bitlen & 0x7));
+                key2[flip >> RNSHIFT] ^= 0x80 >> (flip & 0x7);
+            }
+            break;
+          default:
+            if (bitlen) {
+                flip = rtn_bench_uniform(b, bitlen);
+                key2[flip >> RNSHIFT] ^= 0x80 >> (flip & 0x7);
+            }
+        }
+
+        expected = rtn_key_diff_table(key1, key2, bitlen);
+        for (j = 1; j < versions; j++) {
+            if ((*bd[j].bd_func)(key1, key2, bitlen) != expected) {
+                break;
+            }
+        }
+        if ((j < versions) ||
+            (rtn_key_diff(key1, key2, bitlen) != expected) ||
+            (!rtn_key_cmp(key1, key2, bitlen) != (expected != bitlen))) {
+            mismatches++;
+        }
+        free(key2);
+        free(key1);
+    }
+
+    return (mismatches);
+}
+
+/*
+ * rtn_bench_diff_time
+ *
+ * Return the ns per call of a version on the pairs of keys, or of
+ * rtn_key_diff() for a NULL func.
+ */
+static double
+rtn_bench_diff_time (u_int8_t *keys, size_t stride, u_int16_t bitlen,
+                     u_int32_t rounds, rtn_key_diff_func func,
+                     u_int64_t *sum)
+{
+    u_int64_t start;
+    u_int32_t i, j;
+    u_int8_t *key1, *key2;
+
+    start = rtn_bench_now();
+    for (j = 0; j < rounds; j++) {
+        for (i = 0; i < RTN_BENCH_DIFF_KEYS; i++) {
+            key1 = &keys[2 * i * stride];
+            key2 = key1 + stride;
+            *sum += func ? (*func)(key1, key2, bitlen) :
+                           rtn_key_diff(key1, key2, bitlen);
+        }
+    }
+
+    return ((double) (rtn_bench_now() - start) /
+            ((u_int64_t) rounds * RTN_BENCH_DIFF_KEYS));
+}
+
+/*
+ * rtn_bench_diff
+ *
+ * Check the versions of rtn_key_diff(), then time them per key length.
+ */
+static int8_t
+rtn_bench_diff (rtn_bench_t *b)
+{
+    rtn_bench_diff_t bd[4];
+    u_int64_t mismatches, sum = 0;
+    u_int32_t versions, bitlen, i, rounds;
+    u_int8_t *keys;
+    size_t stride = RNBYTE(RTN_BENCH_DIFF_BITS);
+    char line[128];
+    int len;
+
+    versions = rtn_bench_diff_versions(bd);
+    mismatches = rtn_bench_diff_check(b, bd, versions);
+    printf("%-18s %12u pairs, %llu mismatches\n", "rtn_key_diff",
+           b->b_diffs, (unsigned long long) mismatches);
+
+    keys = malloc(2 * RTN_BENCH_DIFF_KEYS * stride);
+    if (!keys) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    for (i = 0; i < 2 * RTN_BENCH_DIFF_KEYS * stride; i++) {
+        keys[i] = rtn_bench_rand(b);
+    }
+
+    /*
+     * The pairs differ in their last bit, so each call reads the whole
+     * key.
+     */
+    for (bitlen = 32; bitlen <= RTN_BENCH_DIFF_BITS; bitlen <<= 1) {
+        for (i = 0; i < RTN_BENCH_DIFF_KEYS; i++) {
+            memcpy(&keys[(2 * i + 1) * stride], &keys[2 * i * stride],
+                   stride);
+            keys[(2 * i + 1) * stride + RNBYTE(bitlen - 1)] ^= 0x01;
+        }
+        rounds = MAX(1, (1 << 20) / RTN_BENCH_DIFF_KEYS * 32 / bitlen);
+
+        len = snprintf(line, sizeof(line), "%4u bits, ns/call: "
+                       "rtn_key_diff %.1f", bitlen,
+                       rtn_bench_diff_time(keys, stride, bitlen, rounds,
+                                           NULL, &sum));
+        for (i = 0; i < versions; i++) {
+            len += snprintf(line + len, sizeof(line) - len, ", %s %.1f",
+                            bd[i].bd_name,
+                            rtn_bench_diff_time(keys, stride, bitlen, rounds,
+                                                bd[i].bd_func, &sum));
+        }
+        printf("%-18s %s\n", "", line);
+    }
+    free(keys);
+
+    /*
+     * Each call found the last bit.
+     */
+    return (!mismatches && sum);
+}
+
+/*
+ * rtn_bench_print_line
+ */
+static void
+rtn_bench_print_line (void *ctx, const char *line)
+{
+    printf("  %s\n", line);
+}
+
+/*
+ * rtn_bench_shape
+ */
+static void
+rtn_bench_shape (rtn_bench_t *b)
+{
+    rtn_shape_t *shape;
+
+    shape = malloc(sizeof(rtn_shape_t));
+    if (!shape || !rtn_shape_analyze(&b->b_head, b->b_split,
+                                     sizeof(rtn_bench_route_t), shape)) {
+        fprintf(stderr, "rtn_shape_analyze failed\n");
+        free(shape);
+        return;
+    }
+
+    printf("rtn_shape:\n");
+    rtn_shape_dump(shape, rtn_bench_print_line, NULL);
+    free(shape);
+}
+
+/*
+ * rtn_bench_usage
+ */
+static void
+rtn_bench_usage (const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [-t ipv4|ipv6|vpn] [-n prefixes] [-q addresses]\n"
+            "       [-z zipf] [-w walks] [-s seed] [-l fill] [-m tables]\n"
+            "       [-k threads] [-a split] [-b burst] [-r readers]\n"
+            "       [-p threads] [-c changes] [-d pairs] [-f entries]\n"
+            "       [-A prefixes] [-W infos] [-x] [-P] [-H] [-S] [-B] [-C]\n"
+            "       [-V]"
+#ifdef RTN_BENCH_RADIX
+            " [-R]"
+#endif
+            "\n", prog);
+    exit(1);
+}
+
+int
+main (int argc, char *argv[])
+{
+    static const char *traces[] = {"uniform", "zipf", "scan"};
+    rtn_bench_t *b;
+    rtn_lctrie_t *lt;
+    rtn_stride_t *rs;
+    u_int64_t rss_base, rss_tree, t;
+    u_int32_t *rank, i, size;
+    double *cdf;
+    char name[32];
+    int opt;
+
+    b = calloc(1, sizeof(rtn_bench_t));
+    if (!b) {
+        return (1);
+    }
+    b->b_table = RTN_BENCH_IPV4;
+    b->b_count = 600000;
+    b->b_trace_len = 1000000;
+    b->b_walks = 10;
+    b->b_zipf = 1.0;
+    b->b_seed = 1;
+    b->b_split = -1;
+
+    while ((opt = getopt(argc, argv,
+                         "t:n:q:z:w:s:l:m:k:a:b:r:p:c:d:f:A:W:"
+                         "xPHSBCV" RTN_BENCH_RADIX_OPT)) != -1) {
+        switch (opt) {
+          case 't':
+            if (!strcmp(optarg, "ipv4")) {
+                b->b_table = RTN_BENCH_IPV4;
+            } else if (!strcmp(optarg, "ipv6")) {
+                b->b_table = RTN_BENCH_IPV6;
+            } else if (!strcmp(optarg, "vpn")) {
+                b->b_table = RTN_BENCH_VPN;
+            } else {
+                rtn_bench_usage(argv[0]);
+            }
+            break;
+          case 'n':
+            b->b_count = strtoul(optarg, NULL, 0);
+            break;
+          case 'q':
+            b->b_trace_len = strtoul(optarg, NULL, 0);
+            break;
+          case 'z':
+            b->b_zipf = strtod(optarg, NULL);
+            break;
+          case 'w':
+            b->b_walks = strtoul(optarg, NULL, 0);
+            break;
+          case 's':
+            b->b_seed = strtoull(optarg, NULL, 0);
+            break;
+          case 'l':
+            b->b_lcfill = strtod(optarg, NULL);
+            break;
+          case 'm':
+            b->b_tables = strtoul(optarg, NULL, 0);
+            break;
+          case 'k':
+            b->b_threads = strtoul(optarg, NULL, 0);
+            break;
+          case 'a':
+            b->b_split = strtoul(optarg, NULL, 0);
+            break;
+          case 'b':
+            b->b_batch = strtoul(optarg, NULL, 0);
+            break;
+          case 'r':
+            b->b_readers = strtoul(optarg, NULL, 0);
+            break;
+          case 'p':
+            b->b_pwalk = strtoul(optarg, NULL, 0);
+            break;
+          case 'c':
+            b->b_changes = strtoul(optarg, NULL, 0);
+            break;
+          case 'd':
+            b->b_diffs = strtoul(optarg, NULL, 0);
+            break;
+          case 'f':
+            b->b_flows = strtoul(optarg, NULL, 0);
+            break;
+          case 'A':
+            b->b_acl = strtoul(optarg, NULL, 0);
+            break;
+          case 'W':
+            b->b_resume = strtoul(optarg, NULL, 0);
+            break;
+          case 'x':
+            b->b_wire = TRUE;
+            break;
+          case 'P':
+            b->b_snapshot = TRUE;
+            break;
+          case 'H':
+            b->b_hugepage = TRUE;
+            break;
+          case 'S':
+            b->b_stride = TRUE;
+            break;
+          case 'B':
+            b->b_bulk = TRUE;
+            break;
+          case 'C':
+            b->b_compact = TRUE;
+            break;
+          case 'V':
+            b->b_views = TRUE;
+            break;
+#ifdef RTN_BENCH_RADIX
+          case 'R':
+            b->b_radix = TRUE;
+            break;
+#endif
+          default:
+            rtn_bench_usage(argv[0]);
+        }
+    }
+    if (!b->b_count || !b->b_trace_len) {
+        rtn_bench_usage(argv[0]);
+    }
+
+    switch (b->b_table) {
+      case RTN_BENCH_IPV4:
+        b->b_keybytes = 4;
+        b->b_scan_byte = 2;
+        break;
+      case RTN_BENCH_IPV6:
+        b->b_keybytes = 16;
+        b->b_scan_byte = 5;
+        break;
+      default:
+        b->b_keybytes = 12;
+        b->b_scan_byte = 10;
+    }
+    b->b_keybits = b->b_keybytes << RNSHIFT;
+    b->b_rng = b->b_seed * 0x9e3779b97f4a7c15ULL + 1;
+    b->b_clock_cost = rtn_bench_clock_cost();
+
+    b->b_trace = malloc((size_t) b->b_trace_len * b->b_keybytes);
+    rank = malloc(b->b_count * sizeof(u_int32_t));
+    if (!b->b_trace || !rank || !rtn_bench_gen_table(b)) {
+        fprintf(stderr, "out of memory\n");
+        return (1);
+    }
+
+    printf("table %s, %u prefixes, %u addresses per trace, zipf %.2f, "
+           "seed %llu, clock %llu ns\n",
+           b->b_table == RTN_BENCH_IPV4 ? "ipv4" :
+           b->b_table == RTN_BENCH_IPV6 ? "ipv6" : "vpn",
+           b->b_count, b->b_trace_len, b->b_zipf,
+           (unsigned long long) b->b_seed,
+           (unsigned long long) b->b_clock_cost);
+
+    /*
+     * The routes are one array, kept by the benchmark.
+     */
+    rss_base = rtn_bench_rss_kb("VmRSS:");
+    rtn_root_init(&b->b_head, RTN_BIT_KEEP_INFO |
+                  (b->b_hugepage ? RTN_BIT_HUGEPAGE : 0) |
+                  (b->b_compact ? RTN_BIT_COMPACT : 0), NULL);
+    b->b_perf_fd = rtn_bench_perf_open();
+
+    rtn_bench_add(b);
+    rss_tree = rtn_bench_rss_kb("VmRSS:");
+    printf("%-18s %12u prefixes, %u internal nodes\n", "",
+           b->b_head.ri_count, b->b_head.rn_count);
+    printf("%-18s %12u slabs, %u hugetlb, %u thp, %llu KB\n", "rtn_arena",
+           b->b_head.rn_arena.ra_slab_count,
+           b->b_head.rn_arena.ra_hugetlb_slabs,
+           b->b_head.rn_arena.ra_thp_slabs,
+           (unsigned long long) (b->b_head.rn_arena.ra_bytes >> 10));
+    if (b->b_compact) {
+        if (!b->b_head.rt_compact || b->b_head.rt_compact->cc_invalid) {
+            fprintf(stderr, "rtn_compact_init failed\n");
+            return (1);
+        }
+        t = rtn_compact_bytes(b->b_head.rt_compact);
+        printf("%-18s %12u pairs, %llu KB (%.1f bytes/prefix)\n",
+               "rtn_compact", b->b_head.rt_compact->cc_pair_count,
+               (unsigned long long) (t >> 10),
+               b->b_added ? (double) t / b->b_added : 0.0);
+    }
+    if (b->b_split >= 0) {
+        rtn_bench_shape(b);
+    }
+
+    rtn_bench_search(b);
+
+    if (b->b_stride) {
+        t = rtn_bench_now();
+        rs = rtn_stride_init(&b->b_head, b->b_keybits);
+        if (!rs) {
+            fprintf(stderr, "rtn_stride_init failed\n");
+            return (1);
+        }
+        printf("%-18s %12u nodes, built in %.1f ms\n", "rtn_stride",
+               rs->rs_node_count, (rtn_bench_now() - t) / 1e6);
+    }
+
+    if (b->b_lcfill > 0) {
+        if (!rtn_view_init(&b->b_head) ||
+            !rtn_lctrie_init(&b->b_head, b->b_lcfill, 0)) {
+            fprintf(stderr, "rtn_lctrie_init failed\n");
+            return (1);
+        }
+        lt = b->b_head.rt_lctrie->lc_current;
+        printf("%-18s %12u nodes, %u direct, depth %u, %llu KB, "
+               "compiled in %.1f ms\n", "rtn_lctrie",
+               lt->lt_node_count, lt->lt_direct_count, lt->lt_depth,
+               (unsigned long long) (lt->lt_bytes >> 10),
+               b->b_head.rt_lctrie->lc_compile_ns / 1e6);
+    }
+
+    /*
+     * The Zipf ranks go to the prefixes in a random order, so that the
+     * popular ones are spread over the tree.
+     */
+    cdf = rtn_bench_zipf_cdf(b->b_added, b->b_zipf);
+    if (!cdf) {
+        fprintf(stderr, "out of memory\n");
+        return (1);
+    }
+    for (i = 0; i < b->b_added; i++) {
+        rank[i] = i;
+    }
+    rtn_bench_shuffle(b, rank, b->b_added);
+    for (i = 0; i < sizeof(traces) / sizeof(traces[0]); i++) {
+        rtn_bench_gen_trace(b, traces[i], cdf, rank);
+        snprintf(name, sizeof(name), "rtn_lookup %s", traces[i]);
+        rtn_bench_lookup(b, name);
+        if (b->b_head.rt_lctrie && !rtn_bench_lctrie_check(b)) {
+            fprintf(stderr, "rtn_lctrie and rtn_lookup() differ\n");
+            return (1);
+        }
+        for (size = 1; size && (size <= b->b_batch); size <<= 1) {
+            if (!rtn_bench_batch(b, traces[i], size)) {
+                fprintf(stderr, "rtn_lookup_batch and rtn_lookup() "
+                        "differ\n");
+                return (1);
+            }
+        }
+        snprintf(name, sizeof(name), "rtn_compact %s", traces[i]);
+        if (b->b_compact && !rtn_bench_compact(b, name)) {
+            fprintf(stderr, "rtn_compact and rtn_lookup() differ\n");
+            return (1);
+        }
+        snprintf(name, sizeof(name), "flowcache %s", traces[i]);
+        if (b->b_flows && !rtn_bench_flowcache(b, name, 0)) {
+            fprintf(stderr, "rtn_flowcache and rtn_lookup() differ\n");
+            return (1);
+        }
+#ifdef RTN_BENCH_RADIX
+        snprintf(name, sizeof(name), "RadixTree %s", traces[i]);
+        if (b->b_radix && !rtn_bench_radix_trace(b, name)) {
+            fprintf(stderr, "RadixTree and rtn_lookup() differ\n");
+            return (1);
+        }
+#endif
+        snprintf(name, sizeof(name), "rtn_stride %s", traces[i]);
+        if (b->b_stride && !rtn_bench_stride(b, name)) {
+            fprintf(stderr, "rtn_stride and rtn_lookup() differ\n");
+            return (1);
+        }
+    }
+    rtn_lctrie_free(&b->b_head);
+    if (b->b_stride) {
+        if (!rtn_bench_stride_update(b)) {
+            fprintf(stderr, "rtn_stride and rtn_lookup() differ\n");
+            return (1);
+        }
+        rtn_stride_free(&b->b_head);
+    }
+    if (b->b_acl && !rtn_bench_acl(b)) {
+        fprintf(stderr, "the batch and single range lookups differ\n");
+        return (1);
+    }
+    if (b->b_views && !rtn_bench_view(b)) {
+        fprintf(stderr, "a view changed with the tree\n");
+        return (1);
+    }
+    if (b->b_flows) {
+        rtn_bench_gen_trace(b, "flows", cdf, rank);
+        rtn_bench_lookup(b, "rtn_lookup flows");
+        if (!rtn_bench_flowcache(b, "flowcache flows", 0) ||
+            !rtn_bench_flowcache(b, "flowcache churn",
+                                 RTN_BENCH_FLOW_CHURN)) {
+            fprintf(stderr, "rtn_flowcache and rtn_lookup() differ\n");
+            return (1);
+        }
+    }
+
+    rtn_bench_getnext(b);
+    rtn_bench_walk(b);
+    if (b->b_resume && !rtn_bench_cursor(b)) {
+        fprintf(stderr, "rtn_walk_cursor_resume and rtn_walktree() "
+                "differ\n");
+        return (1);
+    }
+    if (b->b_pwalk && !rtn_bench_pwalk(b)) {
+        fprintf(stderr, "rtn_walktree_parallel and rtn_walktree() "
+                "differ\n");
+        return (1);
+    }
+    if (b->b_changes && !rtn_bench_changelog(b)) {
+        fprintf(stderr, "rtn_changelog_read and rtn_walktree_version() "
+                "differ\n");
+        return (1);
+    }
+    if (b->b_threads) {
+        rtn_bench_keybits(b);
+    }
+    if (b->b_wire) {
+        signal(SIGPIPE, SIG_IGN);
+        rtn_bench_wire(b);
+    }
+    if (b->b_snapshot && !rtn_bench_snapshot(b)) {
+        fprintf(stderr, "rtn_snapshot and the table differ\n");
+        return (1);
+    }
+    rtn_bench_delete(b);
+    if (b->b_hugepage) {
+        rtn_bench_arena(b, "rtn_arena heap", RTN_ARENA_F_NONE);
+        rtn_bench_arena(b, "rtn_arena huge", RTN_ARENA_F_HUGEPAGE);
+    }
+
+    if (b->b_bulk && !rtn_bench_bulk(b)) {
+        fprintf(stderr, "rtn_bulk_load and rtn_add() differ\n");
+        return (1);
+    }
+
+    if (b->b_readers) {
+        rtn_bench_gen_trace(b, traces[0], cdf, rank);
+        if (!rtn_bench_rcu(b)) {
+            fprintf(stderr, "rtn_rcu readers failed\n");
+            return (1);
+        }
+    }
+
+    if (b->b_tables > 1) {
+        rtn_bench_gen_trace(b, traces[0], cdf, rank);
+        for (i = 2; i <= b->b_tables; i <<= 1) {
+            rtn_bench_multi(b, i);
+        }
+    }
+
+    if (b->b_diffs && !rtn_bench_diff(b)) {
+        fprintf(stderr, "rtn_key_diff versions differ\n");
+        return (1);
+    }
+
+    printf("rss %llu KB, %llu KB for the nodes (%.1f bytes/prefix), "
+           "peak %llu KB\n",
+           (unsigned long long) rss_tree,
+           (unsigned long long) (rss_tree - rss_base),
+           b->b_added ? (rss_tree - rss_base) * 1024.0 / b->b_added : 0.0,
+           (unsigned long long) rtn_bench_rss_kb("VmHWM:"));
+
+#ifdef RTN_STATS
+    {
+        rtn_stats_t *stats = malloc(sizeof(rtn_stats_t));
+
+        if (stats && rtn_stats_collect(stats)) {
+            printf("rtn_stats:\n");
+            rtn_stats_dump(stats, rtn_bench_print_line, NULL);
+        }
+        free(stats);
+    }
+#endif
+
+    rtn_root_free(&b->b_head);
+    free(cdf);
+    free(rank);
+    free(b->b_trace);
+    free(b->b_order);
+    free(b->b_routes);
+    free(b);
+
+    return (0);
+}
@@ -0,0 +1,82 @@
+/***
+ *   rtn_bench_radix.cpp
+ *
+ *   RadixTree<KeyBits> lookups for rtn_bench.
+ *
+ *    Copyright (c) 2016 Ericsson AB.
+ *    All rights reserved.
+ *
+ ***
+ * Description:
+ *
+ * rtn_bench is C, and RadixTree<KeyBits> of rtn_radix.hpp is a template,
+ * so its lookups are run from here, a whole trace per call, so that the
+ * call costs nothing per lookup. The tree is the one of the bench: a
+ * RadixTree looks up a tree of the C code with its static lookup().
+ *
+ * It is built into rtn_bench with RTN_BENCH_RADIX:
+ *
+ *   c++ -O2 -c rtn_bench_radix.cpp
+ *   cc -O2 -pthread -DRTN_BENCH_RADIX -o rtn_bench rtn_*.c \
+ *      rtn_bench_radix.o -lm
+ *
+ ***/
+
+#include <sys/types.h>
+
+#include "corelibs/rtn_radix.h"
+#include "corelibs/rtn_radix.hpp"
+
+/*
+ * rtn_bench_radix_trace
+ *
+ * Look up count addresses of keybytes each.
+ */
+template <unsigned KeyBits>
+static u_int32_t
+rtn_bench_radix_trace (rt_head_t *rt_head, const u_int8_t *trace,
+                       u_int32_t count, rt_info_t **results)
+{
+    typedef rtn::RadixTree<KeyBits> tree_t;
+    rt_info_t *rinfo;
+    u_int32_t i, found = 0;
+
+    for (i = 0; i < count; i++) {
+        rinfo = tree_t::lookup(rt_head,
+                               tree_t::key_ops::load(trace +
+                                                     i * tree_t::key_ops::
+                                                         KEY_BYTES),
+                               KeyBits);
+        found += (rinfo != NULL);
+        if (results) {
+            results[i] = rinfo;
+        }
+    }
+
+    return (found);
+}
+
+/*
+ * rtn_bench_radix
+ *
+ * Look up a trace with RadixTree<keybits>::lookup(), and set results,
+ * when not NULL, to the info found for each address. The keys are of
+ * 32, 96 or 128 bits, as the tables of rtn_bench.
+ *
+ * Return the count of addresses found, or ~0 for another width.
+ */
+extern "C" u_int32_t
+rtn_bench_radix (rt_head_t *rt_head, const u_int8_t *trace, u_int32_t count,
+                 u_int16_t keybits, rt_info_t **results)
+{
+    switch (keybits) {
+      case 32:
+        return (rtn_bench_radix_trace<32>(rt_head, trace, count, results));
+      case 96:
+        return (rtn_bench_radix_trace<96>(rt_head, trace, count, results));
+      case 128:
+        return (rtn_bench_radix_trace<128>(rt_head, trace, count, results));
+      default:
+        return (~0U);
+    }
+}
@@ -0,0 +1,387 @@
+/***
+ *   rtn_changelog.c
+ *
+ *   Change logs of the radix trie.
+ *
+ *    Copyright (c) 2016 Ericsson AB.
+ *    All rights reserved.
+ *
+ ***
+ * Description:
+ *
+ * The log is a ring of fixed size records, addressed by a 64-bit
+ * sequence number that never wraps: record "seq" is kept in slot
+ * (seq & mask) until it is overwritten by record (seq + size). A cursor
+ * before the oldest record left has lost some changes.
+ *
+ * The log hangs off its tree (rt_head_t.rt_changelog), and is only
+ * touched by the writer of that tree: rtn_head_bump_version() passes the
+ * tree, and rtn_delete() and rtn_detach_subtree() already have it. There
+ * is no state shared between the trees, so the writers of different
+ * trees need no lock, and trees that share a table version each log
+ * their own infos.
+ *
+ * The log also remembers the record that follows the latest wrap of the
+ * table version. The records themselves are correct across a wrap; only
+ * the fallback to a version walk is not, and must walk the whole tree
+ * when the wrap happened after the cursor.
+ *
+ ***/
+
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include "corelibs/rtn_radix.h"
+#include "corelibs/rtn_changelog.h"
+#include "rtn_private.h"
+
+#define RTN_CHANGELOG_BATCH     64     /* default batch */
+
+typedef struct _rtn_change_rec_t
+{
+    u_int32_t   cr_version;           /* table version of the change */
+    u_int16_t   cr_bitlen;            /* prefix length */
+    u_int8_t    cr_kind;              /* RTN_CHANGE_ kind */
+    u_int8_t    pad;                  /* for alignment */
+    u_int8_t    cr_key[0];            /* key, cl_keybytes */
+} rtn_change_rec_t;
+
+typedef struct _rtn_changelog_t
+{
+    rt_head_t   *cl_head;             /* tree */
+    u_int32_t   *cl_version;          /* table version */
+    u_int8_t    *cl_recs;             /* the ring */
+    u_int64_t   cl_seq;               /* next record */
+    u_int64_t   cl_wrap_seq;          /* record after the last wrap, or 0 */
+    u_int32_t   cl_mask;              /* records - 1 */
+    u_int32_t   cl_last_version;      /* version of the last update */
+    u_int16_t   cl_keybytes;          /* max. key length */
+    u_int16_t   cl_recsize;           /* bytes per record */
+    u_int32_t   pad;                  /* for alignment */
+} rtn_changelog_t;
+
+/*
+ * State of a read.
+ */
+typedef struct _rtn_changelog_batch_t
+{
+    rtn_changelog_func cb_func;
+    rtn_change_t *cb_changes;
+    u_int32_t   cb_count;             /* changes in the batch */
+    u_int32_t   cb_size;              /* max. changes in the batch */
+    int         cb_errnum;
+    va_list     cb_ap;                /* arguments of cb_func */
+} rtn_changelog_batch_t;
+
+/*
+ * rtn_changelog_rec
+ *
+ * Return the slot of a record.
+ */
+static inline rtn_change_rec_t *
+rtn_changelog_rec (rtn_changelog_t *cl, u_int64_t seq)
+{
+    return ((rtn_change_rec_t *) (cl->cl_recs +
+                                  (size_t) (seq & cl->cl_mask) *
+                                  cl->cl_recsize));
+}
+
+/*
+ * rtn_changelog_append
+ *
+ * Append a record for an info.
+ */
+static void
+rtn_changelog_append (rtn_changelog_t *cl, rt_info_t *rinfo, u_int8_t kind,
+                      u_int32_t version)
+{
+    rtn_change_rec_t *rec;
+    u_int16_t bitlen, bytes;
+
+    bitlen = rinfo->rnode_bit;
+    bytes = (bitlen + 7) >> 3;
+    if (bytes > cl->cl_keybytes) {
+        bytes = cl->cl_keybytes;
+        bitlen = bytes << 3;
+    }
+
+    rec = rtn_changelog_rec(cl, cl->cl_seq++);
+    rec->cr_version = version;
+    rec->cr_bitlen  = bitlen;
+    rec->cr_kind    = kind;
+    memcpy(rec->cr_key, rinfo->rninfo_key, bytes);
+    memset(rec->cr_key + bytes, 0, cl->cl_keybytes - bytes);
+}
+
+/*
+ * rtn_changelog_init
+ */
+int8_t
+rtn_changelog_init (rt_head_t *rt_head, u_int32_t *table_version,
+                    u_int16_t keybytes, u_int32_t size)
+{
+    rtn_changelog_t *cl;
+    u_int32_t count;
+
+    if (rt_head->rt_changelog || !table_version || !keybytes) {
+        return (FALSE);
+    }
+
+    for (count = 1; (count < size) && (count < (1U << 31)); count <<= 1) {
+        ;
+    }
+
+    cl = calloc(1, sizeof(rtn_changelog_t));
+    if (!cl) {
+        return (FALSE);
+    }
+    cl->cl_head     = rt_head;
+    cl->cl_version  = table_version;
+    cl->cl_mask     = count - 1;
+    cl->cl_keybytes = keybytes;
+    cl->cl_recsize  = (sizeof(rtn_change_rec_t) + keybytes + 7) & ~7;
+    cl->cl_last_version = *table_version;
+
+    cl->cl_recs = malloc((size_t) count * cl->cl_recsize);
+    if (!cl->cl_recs) {
+        free(cl);
+        return (FALSE);
+    }
+
+    rt_head->rt_changelog = cl;
+    return (TRUE);
+}
+
+/*
+ * rtn_changelog_free
+ */
+void
+rtn_changelog_free (rt_head_t *rt_head)
+{
+    rtn_changelog_t *cl = rt_head->rt_changelog;
+
+    if (!cl) {
+        return;
+    }
+
+    free(cl->cl_recs);
+    free(cl);
+    rt_head->rt_changelog = NULL;
+}
+
+/*
+ * rtn_changelog_bump
+ *
+ * Log a new version of an info, if the log of its tree is on this table
+ * version.
+ */
+void
+rtn_changelog_bump (rt_head_t *rt_head, u_int32_t *table_version,
+                    rt_info_t *rinfo)
+{
+    rtn_changelog_t *cl = rt_head->rt_changelog;
+
+    if (cl->cl_version != table_version) {
+        return;
+    }
+
+    if (rinfo->version < cl->cl_last_version) {
+        cl->cl_wrap_seq = cl->cl_seq + 1;
+    }
+    cl->cl_last_version = rinfo->version;
+    rtn_changelog_append(cl, rinfo, RTN_CHANGE_UPDATE, rinfo->version);
+}
+
+/*
+ * rtn_changelog_delete
+ *
+ * Log an info that leaves the tree.
+ */
+void
+rtn_changelog_delete (rt_head_t *rt_head, rt_info_t *rinfo)
+{
+    rtn_changelog_t *cl = rt_head->rt_changelog;
+
+    rtn_changelog_append(cl, rinfo, RTN_CHANGE_DELETE, *cl->cl_version);
+}
+
+/*
+ * rtn_changelog_cursor
+ */
+void
+rtn_changelog_cursor (rt_head_t *rt_head, rtn_changelog_cursor_t *cursor)
+{
+    rtn_changelog_t *cl = rt_head->rt_changelog;
+
+    memset(cursor, 0, sizeof(rtn_changelog_cursor_t));
+    if (cl) {
+        cursor->cc_seq     = cl->cl_seq;
+        cursor->cc_version = *cl->cl_version;
+    }
+}
+
+/*
+ * rtn_changelog_flush
+ *
+ * Deliver the batch. Return FALSE on abort.
+ */
+static int8_t
+rtn_changelog_flush (rtn_changelog_batch_t *cb)
+{
+    va_list ap;
+
+    if (cb->cb_count) {
+        va_copy(ap, cb->cb_ap);
+        cb->cb_errnum = (*cb->cb_func)(cb->cb_changes, cb->cb_count, ap);
+        va_end(ap);
+        cb->cb_count = 0;
+    }
+
+    return (cb->cb_errnum != RTWALK_ABORT);
+}
+
+/*
+ * rtn_changelog_walk
+ *
+ * Walk function of the fallback: add an info to the batch.
+ */
+static int
+rtn_changelog_walk (rt_info_t *rinfo, va_list ap)
+{
+    rtn_changelog_batch_t *cb = va_arg(ap, rtn_changelog_batch_t *);
+    rtn_change_t *change;
+
+    change = &cb->cb_changes[cb->cb_count++];
+    change->rc_info    = rinfo;
+    change->rc_key     = rinfo->rninfo_key;
+    change->rc_version = rinfo->version;
+    change->rc_bitlen  = rinfo->rnode_bit;
+    change->rc_kind    = RTN_CHANGE_UPDATE;
+
+    if (cb->cb_count == cb->cb_size) {
+        rtn_changelog_flush(cb);
+    }
+    return (cb->cb_errnum);
+}
+
+/*
+ * rtn_changelog_replay
+ *
+ * Deliver the records since a cursor. Return FALSE on abort, with the
+ * cursor past the batches delivered.
+ */
+static int8_t
+rtn_changelog_replay (rtn_changelog_t *cl, rtn_changelog_cursor_t *cursor,
+                      rtn_changelog_batch_t *cb)
+{
+    rtn_change_rec_t *rec;
+    rtn_change_t *change;
+    rt_info_t *rinfo;
+    u_int64_t seq, end;
+
+    end = cl->cl_seq;
+    for (seq = cursor->cc_seq; seq < end; seq++) {
+        rec = rtn_changelog_rec(cl, seq);
+
+        /*
+         * An update that is not the latest one of its info is skipped,
+         * and so is the update of an info deleted since.
+         */
+        rinfo = NULL;
+        if (rec->cr_kind == RTN_CHANGE_UPDATE) {
+            rinfo = rtn_search(cl->cl_head, (char *) rec->cr_key,
+                               rec->cr_bitlen);
+            if (!rinfo || (rinfo->version != rec->cr_version)) {
+                continue;
+            }
+        }
+
+        change = &cb->cb_changes[cb->cb_count++];
+        change->rc_info    = rinfo;
+        change->rc_key     = rec->cr_key;
+        change->rc_version = rec->cr_version;
+        change->rc_bitlen  = rec->cr_bitlen;
+        change->rc_kind    = rec->cr_kind;
+
+        if (cb->cb_count == cb->cb_size) {
+            if (!rtn_changelog_flush(cb)) {
+                return (FALSE);
+            }
+            cursor->cc_seq = seq + 1;
+        }
+    }
+
+    return (rtn_changelog_flush(cb));
+}
+
+/*
+ * rtn_changelog_read
+ */
+int8_t
+rtn_changelog_read (rt_head_t *rt_head, rtn_changelog_cursor_t *cursor,
+                    rtn_changelog_func f, u_int32_t batch, u_int8_t *status,
+                    ...)
+{
+    rtn_changelog_t *cl = rt_head->rt_changelog;
+    rtn_changelog_batch_t cb;
+    u_int64_t oldest;
+    u_int32_t version;
+    u_int8_t how;
+    int8_t done;
+
+    if (!cl) {
+        return (RTWALK_ABORT);
+    }
+
+    memset(&cb, 0, sizeof(cb));
+    cb.cb_func = f;
+    cb.cb_size = batch ? batch : RTN_CHANGELOG_BATCH;
+    cb.cb_changes = malloc(cb.cb_size * sizeof(rtn_change_t));
+    if (!cb.cb_changes) {
+        return (RTWALK_ABORT);
+    }
+
+    version = *cl->cl_version;
+    oldest = (cl->cl_seq > cl->cl_mask) ? (cl->cl_seq - cl->cl_mask - 1) : 0;
+
+    if ((cursor->cc_seq >= oldest) && (cursor->cc_seq <= cl->cl_seq)) {
+        how = RTN_CHANGELOG_DELTA;
+    } else if ((cursor->cc_seq <= cl->cl_seq) &&
+               (cl->cl_wrap_seq <= cursor->cc_seq) &&
+               (cursor->cc_version <= version)) {
+        how = RTN_CHANGELOG_WALK;
+    } else {
+        how = RTN_CHANGELOG_RESYNC;
+    }
+
+    va_start(cb.cb_ap, status);
+    switch (how) {
+      case RTN_CHANGELOG_DELTA:
+        done = rtn_changelog_replay(cl, cursor, &cb);
+        break;
+      case RTN_CHANGELOG_WALK:
+        rtn_walktree_version(NULL, rtn_changelog_walk, rt_head,
+                             cursor->cc_version, version, 0, 0, &cb);
+        done = rtn_changelog_flush(&cb);
+        break;
+      default:
+        rtn_walktree(NULL, rtn_changelog_walk, rt_head, 0, 0, &cb);
+        done = rtn_changelog_flush(&cb);
+    }
+    va_end(cb.cb_ap);
+
+    free(cb.cb_changes);
+
+    if (status) {
+        *status = how;
+    }
+    if (!done) {
+        return (RTWALK_ABORT);
+    }
+
+    cursor->cc_seq     = cl->cl_seq;
+    cursor->cc_version = version;
+    return (RTWALK_CONTINUE);
+}
@@ -0,0 +1,139 @@
+/**
+ *  @name rtn_changelog.h, Change logs of radix trees
+ *
+ *  API for rtn_changelog.c.
+ *
+ *  A change log is an optional ring of the latest changes of a tree: one
+ *  record for each rtn_head_bump_version() (or
+ *  rtn_head_bump_version_max_limit()) of the tree on the table version it
+ *  was created with, and one for each info that leaves the tree, by
+ *  rtn_delete() or rtn_detach_subtree(). rtn_bump_version() does not know
+ *  the tree, and is not logged. A consumer
+ *  keeps a cursor, and rtn_changelog_read() hands it the changes made
+ *  since, in batches, in O(changes) rather than with a version walk.
+ *
+ *  The log keeps a copy of the key of each change, so a record of a
+ *  deleted info stays valid. A change record is delivered with the info
+ *  found in the tree for its key, and only when that info still has the
+ *  version of the record; otherwise a later record will deliver it.
+ *
+ *  When the changes since a cursor have been overwritten in the ring,
+ *  rtn_changelog_read() falls back to rtn_walktree_version() from the
+ *  version of the cursor, which cannot report the deletes. If the table
+ *  version has wrapped since the cursor, the fallback is a walk of the
+ *  whole tree.
+ *
+ *  The log belongs to its tree, and is updated by the writer of the tree
+ *  only; the logs of different trees share nothing.
+ *
+ *     Copyright (c) 2016 Ericsson AB.
+ *
+ *     All rights reserved.
+ */
+
+#ifndef __RTN_CHANGELOG_H__
+#define __RTN_CHANGELOG_H__
+
+#include "corelibs/rtn_radix.h"
+
+/*
+ * Kinds of change.
+ */
+#define RTN_CHANGE_UPDATE       1    /* added, or new version */
+#define RTN_CHANGE_DELETE       2    /* left the tree */
+
+/*
+ * How rtn_changelog_read() found the changes.
+ */
+#define RTN_CHANGELOG_DELTA     0    /* from the log, complete */
+#define RTN_CHANGELOG_WALK      1    /* version walk, no delete */
+#define RTN_CHANGELOG_RESYNC    2    /* version wrap, whole tree */
+
+typedef struct _rtn_change_t
+{
+    rt_info_t   *rc_info;             /* info in the tree, NULL on delete */
+    u_int8_t    *rc_key;              /* key, valid during the call */
+    u_int32_t   rc_version;           /* table version of the change */
+    u_int16_t   rc_bitlen;            /* prefix length */
+    u_int8_t    rc_kind;              /* RTN_CHANGE_ kind */
+    u_int8_t    pad;                  /* for alignment */
+} rtn_change_t;
+
+/*
+ * Position of a consumer in the log.
+ */
+typedef struct _rtn_changelog_cursor_t
+{
+    u_int64_t   cc_seq;               /* next record to read */
+    u_int32_t   cc_version;           /* table version when last read */
+    u_int32_t   pad;                  /* for alignment */
+} rtn_changelog_cursor_t;
+
+/**
+ * Function to process a batch of changes.
+ *
+ * @return
+ *     RTWALK_ABORT    - run into error, or need to abort.
+ *     RTWALK_CONTINUE - no error and continue to next batch.
+ */
+typedef int (*rtn_changelog_func)(rtn_change_t *changes, u_int32_t count,
+                                  va_list ap);
+
+/**
+ * Create the change log of a tree.
+ *
+ * @param rt_head        head structure. Must not be NULL.
+ * @param table_version  the table version passed to
+ *                       rtn_head_bump_version() for the infos of this
+ *                       tree.
+ * @param keybytes       max. key length in bytes, e.g. 4 for IPv4.
+ * @param size           number of records kept, rounded up to a power
+ *                       of 2.
+ *
+ * @return
+ *     TRUE: succeed; FALSE: out of memory, or the tree has a log.
+ */
+extern int8_t rtn_changelog_init(rt_head_t *rt_head, u_int32_t *table_version,
+                                 u_int16_t keybytes, u_int32_t size);
+
+/**
+ * Free the change log of a tree, if any. Called by rtn_root_free().
+ */
+extern void rtn_changelog_free(rt_head_t *rt_head);
+
+/**
+ * Set a cursor to the current end of the log, e.g. after a full walk.
+ */
+extern void rtn_changelog_cursor(rt_head_t *rt_head,
+                                 rtn_changelog_cursor_t *cursor);
+
+/**
+ * Deliver the changes since a cursor, and move the cursor past them.
+ *
+ * @param rt_head  head structure. Must not be NULL.
+ * @param cursor   position of the consumer.
+ * @param f        function to process a batch of changes.
+ * @param batch    max. number of changes per call of f.
+ * @param status   when not NULL, set to a RTN_CHANGELOG_ value.
+ * @param ...      arguments passed to f.
+ *
+ * @return
+ *      0: successful.
+ *     -1: aborted. The cursor is moved past the batches delivered before
+ *         the aborted one, which is delivered again by the next read. A
+ *         version walk (RTN_CHANGELOG_WALK or RTN_CHANGELOG_RESYNC) does
+ *         not move the cursor, and starts over.
+ */
+extern int8_t rtn_changelog_read(rt_head_t *rt_head,
+                                 rtn_changelog_cursor_t *cursor,
+                                 rtn_changelog_func f, u_int32_t batch,
+                                 u_int8_t *status, ...);
+
+/*
+ * Hooks, called by rtn_radix.c.
+ */
+extern void rtn_changelog_bump(rt_head_t *rt_head, u_int32_t *table_version,
+                               rt_info_t *rinfo);
+extern void rtn_changelog_delete(rt_head_t *rt_head, rt_info_t *rinfo);
+
+#endif  /* __RTN_CHANGELOG_H__ */
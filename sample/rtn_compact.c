@@ -0,0 +1,450 @@
+/***
+ *   rtn_compact.c
+ *
+ *   Compact node layout for radix tree lookups.
+ *
+ *    Copyright (c) 2016 Ericsson AB.
+ *    All rights reserved.
+ *
+ ***
+ * Description:
+ *
+ * The compact nodes form the same Patricia trie as the tree, built by
+ * the same rules as rtn_add(), except that an entry is removed at once
+ * instead of being left for a walk to clean up.
+ *
+ * A node is found by (pair index, side), packed in a u_int32_t as a
+ * "ref", with 0 for the root. The pair array may move when it grows, so
+ * the code holds refs rather than pointers across an allocation.
+ *
+ * The lookup descends without looking at any key, remembering the last
+ * info on the way. Every info above it on the path has a key that agrees
+ * with its key up to its own bit length, so one compare of the address
+ * with the key of that last info tells which of them all match.
+ *
+ ***/
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <sys/types.h>
+
+#include "corelibs/rtn_radix.h"
+#include "corelibs/rtn_compact.h"
+#include "rtn_private.h"
+
+#define RTN_COMPACT_PAIRS_MIN   64
+
+#define RTN_COMPACT_SIDE(key, bit) \
+    (((key)[RNBYTE(bit)] & RNBIT(bit)) ? 1 : 0)
+
+/*
+ * rtn_compact_slot
+ *
+ * Return the node of a ref.
+ */
+static inline rtn_cnode_t *
+rtn_compact_slot (rtn_compact_t *rc, u_int32_t ref)
+{
+    return (ref ? &rc->cc_pairs[ref >> 1].cp_node[ref & 1] : &rc->cc_root);
+}
+
+/*
+ * rtn_compact_child
+ *
+ * Return the child of a node on the side of an address, or NULL.
+ */
+static inline rtn_cnode_t *
+rtn_compact_child (rtn_compact_t *rc, rtn_cnode_t *cn, u_int8_t *addr)
+{
+    rtn_cnode_t *child;
+
+    if (!cn->cn_child) {
+        return (NULL);
+    }
+
+    child = &rc->cc_pairs[cn->cn_child].cp_node[RTN_COMPACT_SIDE(addr,
+                                                                 cn->cn_bit)];
+    return (child->cn_used ? child : NULL);
+}
+
+/*
+ * rtn_compact_unlink
+ *
+ * Take a pair off the free list.
+ */
+static void
+rtn_compact_unlink (rtn_compact_t *rc, u_int32_t idx)
+{
+    rtn_cnode_t *node = rc->cc_pairs[idx].cp_node;
+
+    if (node[1].cn_child) {
+        rc->cc_pairs[node[1].cn_child].cp_node[0].cn_child = node[0].cn_child;
+    } else {
+        rc->cc_free = node[0].cn_child;
+    }
+    if (node[0].cn_child) {
+        rc->cc_pairs[node[0].cn_child].cp_node[1].cn_child = node[1].cn_child;
+    }
+}
+
+/*
+ * rtn_compact_pair_alloc
+ *
+ * Allocate a zero'ed pair for the children of a node in pair "near" (0
+ * for the root). The pair that shares a cache line with "near" is taken
+ * when it is free, so that a descent gets two levels from one line.
+ * Return the index of the pair, or 0 when out of memory.
+ */
+static u_int32_t
+rtn_compact_pair_alloc (rtn_compact_t *rc, u_int32_t near)
+{
+    rtn_cpair_t *pairs;
+    u_int32_t idx, size;
+
+    idx = near ? (near ^ 1) : 0;
+    if (idx && (idx < rc->cc_next) && rc->cc_pairs[idx].cp_node[0].cn_pad) {
+        rtn_compact_unlink(rc, idx);
+    } else if (idx && (idx == rc->cc_next)) {
+        rc->cc_next++;
+    } else if (rc->cc_free) {
+        idx = rc->cc_free;
+        rtn_compact_unlink(rc, idx);
+    } else {
+        idx = rc->cc_next++;
+    }
+
+    if (rc->cc_next > rc->cc_size) {
+        size = rc->cc_size ? rc->cc_size << 1 : RTN_COMPACT_PAIRS_MIN;
+        if ((size <= rc->cc_size) ||
+            posix_memalign((void **) &pairs, RTN_CACHE_LINE,
+                           (size_t) size * sizeof(rtn_cpair_t))) {
+            rc->cc_next--;
+            return (0);
+        }
+        if (rc->cc_pairs) {
+            memcpy(pairs, rc->cc_pairs,
+                   (size_t) rc->cc_size * sizeof(rtn_cpair_t));
+            free(rc->cc_pairs);
+        }
+        rc->cc_pairs = pairs;
+        rc->cc_size = size;
+    }
+
+    memset(&rc->cc_pairs[idx], 0, sizeof(rtn_cpair_t));
+    rc->cc_pair_count++;
+    return (idx);
+}
+
+/*
+ * rtn_compact_pair_free
+ *
+ * Put a pair on the free list, which is doubly linked through cn_child,
+ * with cn_pad of the first node set.
+ */
+static void
+rtn_compact_pair_free (rtn_compact_t *rc, u_int32_t idx)
+{
+    rtn_cnode_t *node = rc->cc_pairs[idx].cp_node;
+
+    node[0].cn_child = rc->cc_free;
+    node[0].cn_pad = TRUE;
+    node[1].cn_child = 0;
+    if (rc->cc_free) {
+        rc->cc_pairs[rc->cc_free].cp_node[1].cn_child = idx;
+    }
+    rc->cc_free = idx;
+    rc->cc_pair_count--;
+}
+
+/*
+ * rtn_compact_init
+ *
+ * Create the compact nodes of an empty tree.
+ */
+rtn_compact_t *
+rtn_compact_init (rt_head_t *rt_head)
+{
+    rtn_compact_t *rc;
+
+    rc = calloc(1, sizeof(rtn_compact_t));
+    if (!rc) {
+        return (NULL);
+    }
+
+    rc->cc_root.cn_used = TRUE;
+    rc->cc_next = 1;
+
+    rt_head->rt_compact = rc;
+    return (rc);
+}
+
+/*
+ * rtn_compact_free
+ *
+ * Free the compact nodes of a tree.
+ */
+void
+rtn_compact_free (rt_head_t *rt_head)
+{
+    rtn_compact_t *rc = rt_head->rt_compact;
+
+    if (rc) {
+        rt_head->rt_compact = NULL;
+        free(rc->cc_pairs);
+        free(rc);
+    }
+}
+
+/*
+ * rtn_compact_bytes
+ */
+u_int64_t
+rtn_compact_bytes (rtn_compact_t *rc)
+{
+    return (sizeof(rtn_compact_t) + (u_int64_t) rc->cc_size *
+            sizeof(rtn_cpair_t));
+}
+
+/*
+ * rtn_compact_lookup
+ *
+ * Best match through the compact nodes.
+ */
+rt_info_t *
+rtn_compact_lookup (rtn_compact_t *rc, u_int8_t *addr, u_int16_t maxbitlen)
+{
+    rtn_cnode_t *cn, *last = NULL;
+    rt_info_t *best = NULL;
+    u_int16_t dbit;
+
+    for (cn = &rc->cc_root; cn && (cn->cn_bit <= maxbitlen);
+         cn = rtn_compact_child(rc, cn, addr)) {
+        if (cn->cn_info) {
+            last = cn;
+        }
+        if (cn->cn_bit == maxbitlen) {
+            break;
+        }
+    }
+
+    if (!last) {
+        return (NULL);
+    }
+
+    dbit = rtn_key_diff(addr, last->cn_info->rninfo_key, last->cn_bit);
+    if (dbit == last->cn_bit) {
+        return (last->cn_info);
+    }
+
+    /*
+     * The infos at or above the first different bit match. The nodes
+     * are still in the cache.
+     */
+    for (cn = &rc->cc_root; cn && (cn->cn_bit <= dbit);
+         cn = rtn_compact_child(rc, cn, addr)) {
+        if (cn->cn_info) {
+            best = cn->cn_info;
+        }
+    }
+
+    return (best);
+}
+
+/*
+ * rtn_compact_add
+ *
+ * Insert an info, as rtn_add_node() does in the tree.
+ */
+void
+rtn_compact_add (rtn_compact_t *rc, rt_info_t *rinfo)
+{
+    rtn_cnode_t *cn, *child, old;
+    u_int8_t *addr, *his_addr;
+    u_int16_t bitlen, dbit;
+    u_int32_t ref, pair;
+    u_int8_t side;
+
+    if (rc->cc_invalid) {
+        return;
+    }
+
+    addr = rinfo->rninfo_key;
+    bitlen = rinfo->rnode_bit;
+
+    /*
+     * Search down as far as we can, stopping at a node with a bit number
+     * >= ours which has info attached, and find the first bit in our
+     * address which differs from his address.
+     */
+    cn = &rc->cc_root;
+    while ((cn->cn_bit < bitlen) || !cn->cn_info) {
+        child = rtn_compact_child(rc, cn, addr);
+        if (!child) {
+            break;
+        }
+        cn = child;
+    }
+
+    his_addr = cn->cn_info ? cn->cn_info->rninfo_key : NULL;
+    assert(his_addr || (cn->cn_bit == 0));
+    dbit = his_addr ? rtn_key_diff(addr, his_addr,
+                                   MIN(cn->cn_bit, bitlen)) : 0;
+
+    /*
+     * Find the highest node with a bit number >= dbit on our path.
+     */
+    ref = 0;
+    cn = &rc->cc_root;
+    while (cn->cn_bit < dbit) {
+        ref = (cn->cn_child << 1) | RTN_COMPACT_SIDE(addr, cn->cn_bit);
+        cn = rtn_compact_slot(rc, ref);
+        assert(cn->cn_used);
+    }
+
+    if ((dbit == bitlen) && (cn->cn_bit == bitlen)) {
+        if (!cn->cn_info) {
+            cn->cn_info = rinfo;
+            rc->cc_info_count++;
+        }
+        return;
+    }
+
+    if (cn->cn_bit == dbit) {
+        /*
+         * Attach below him.
+         */
+        if (!cn->cn_child) {
+            pair = rtn_compact_pair_alloc(rc, ref >> 1);
+            if (!pair) {
+                rc->cc_invalid = TRUE;
+                return;
+            }
+            cn = rtn_compact_slot(rc, ref);
+            cn->cn_child = pair;
+        }
+        child = &rc->cc_pairs[cn->cn_child].cp_node[RTN_COMPACT_SIDE(addr,
+                                                                     dbit)];
+        assert(!child->cn_used);
+    } else {
+        /*
+         * Insert above him: either our node, or a split.
+         */
+        pair = rtn_compact_pair_alloc(rc, ref >> 1);
+        if (!pair) {
+            rc->cc_invalid = TRUE;
+            return;
+        }
+        cn = rtn_compact_slot(rc, ref);
+        old = *cn;
+
+        cn->cn_child = pair;
+        cn->cn_bit = dbit;
+        cn->cn_info = NULL;
+        if (dbit == bitlen) {
+            cn->cn_info = rinfo;
+            rc->cc_pairs[pair].cp_node[RTN_COMPACT_SIDE(his_addr, bitlen)] = old;
+            rc->cc_info_count++;
+            return;
+        }
+
+        side = RTN_COMPACT_SIDE(addr, dbit);
+        rc->cc_pairs[pair].cp_node[!side] = old;
+        child = &rc->cc_pairs[pair].cp_node[side];
+    }
+
+    child->cn_child = 0;
+    child->cn_bit = bitlen;
+    child->cn_used = TRUE;
+    child->cn_info = rinfo;
+    rc->cc_info_count++;
+}
+
+/*
+ * rtn_compact_collapse
+ *
+ * Remove a node without info that is no longer needed, i.e., with less
+ * than two children. The root stays.
+ */
+static void
+rtn_compact_collapse (rtn_compact_t *rc, u_int32_t ref, u_int32_t pref)
+{
+    rtn_cnode_t *cn, *node;
+    u_int32_t pair;
+
+    cn = rtn_compact_slot(rc, ref);
+    if (!ref || cn->cn_info) {
+        return;
+    }
+
+    pair = cn->cn_child;
+    if (pair) {
+        node = rc->cc_pairs[pair].cp_node;
+        if (node[0].cn_used && node[1].cn_used) {
+            return;
+        }
+
+        /*
+         * Pull the only child up.
+         */
+        *cn = node[0].cn_used ? node[0] : node[1];
+        rtn_compact_pair_free(rc, pair);
+        return;
+    }
+
+    /*
+     * A leaf. Drop the pair it is in once it is empty, and see if the
+     * parent is still needed.
+     */
+    memset(cn, 0, sizeof(rtn_cnode_t));
+    node = rc->cc_pairs[ref >> 1].cp_node;
+    if (!node[0].cn_used && !node[1].cn_used) {
+        rtn_compact_pair_free(rc, ref >> 1);
+        rtn_compact_slot(rc, pref)->cn_child = 0;
+    }
+
+    /*
+     * The grand parent is not needed here: a parent that is pulled up
+     * keeps its slot.
+     */
+    rtn_compact_collapse(rc, pref, 0);
+}
+
+/*
+ * rtn_compact_delete
+ *
+ * Remove an info.
+ */
+void
+rtn_compact_delete (rtn_compact_t *rc, rt_info_t *rinfo)
+{
+    rtn_cnode_t *cn;
+    u_int8_t *addr;
+    u_int16_t bitlen;
+    u_int32_t ref = 0, pref = 0;
+
+    if (rc->cc_invalid) {
+        return;
+    }
+
+    addr = rinfo->rninfo_key;
+    bitlen = rinfo->rnode_bit;
+
+    cn = &rc->cc_root;
+    while (cn->cn_bit < bitlen) {
+        if (!rtn_compact_child(rc, cn, addr)) {
+            return;
+        }
+        pref = ref;
+        ref = (cn->cn_child << 1) | RTN_COMPACT_SIDE(addr, cn->cn_bit);
+        cn = rtn_compact_slot(rc, ref);
+    }
+
+    if ((cn->cn_bit != bitlen) || (cn->cn_info != rinfo)) {
+        return;
+    }
+
+    cn->cn_info = NULL;
+    rc->cc_info_count--;
+    rtn_compact_collapse(rc, ref, pref);
+}
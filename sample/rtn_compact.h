@@ -0,0 +1,104 @@
+/**
+ *  @name rtn_compact.h, Compact node layout for radix tree lookups
+ *
+ *  API for rtn_compact.c.
+ *
+ *  A tree created with RTN_BIT_COMPACT keeps, next to its nodes, a copy
+ *  of its shape in compact nodes: 16 bytes each, linked by 32-bit
+ *  indexes into one array instead of pointers, and allocated by sibling
+ *  pairs that share a cache line. rtn_compact_lookup() descends the
+ *  compact nodes, which takes one cache line per level and a single key
+ *  compare at the end, instead of a node and a key per level.
+ *
+ *  It is experimental. The copy comes on top of the tree, about 34 bytes
+ *  per prefix more, and measured no faster than the descent of the tree
+ *  on the hosts it was tried on, so rtn_lookup() and rtn_lookup_batch()
+ *  do not go through it: only rtn_compact_lookup() does.
+ *
+ *  The tree itself is unchanged, so walks and all the other calls work
+ *  as before. The compact nodes are kept current by the update hooks of
+ *  rtn_radix.c. They are not safe for lock-free readers, so the flag is
+ *  ignored together with RTN_BIT_RCU.
+ *
+ *     Copyright (c) 2016 Ericsson AB.
+ *
+ *     All rights reserved.
+ */
+
+#ifndef __RTN_COMPACT_H__
+#define __RTN_COMPACT_H__
+
+#include "corelibs/rtn_radix.h"
+
+typedef struct _rtn_cnode_t
+{
+    u_int32_t   cn_child;             /* pair of children, 0 for none */
+    u_int16_t   cn_bit;               /* bit number for node */
+    u_int8_t    cn_used;              /* slot in use */
+    u_int8_t    cn_pad;               /* pair on the free list */
+    rt_info_t   *cn_info;             /* info, NULL for a split */
+} rtn_cnode_t;
+
+/*
+ * Children of a node, left (bit clear) then right.
+ */
+typedef struct _rtn_cpair_t
+{
+    rtn_cnode_t cp_node[2];
+} __attribute__((aligned(32))) rtn_cpair_t;
+
+typedef struct _rtn_compact_t
+{
+    rtn_cnode_t cc_root;              /* root, bit 0 */
+    rtn_cpair_t *cc_pairs;            /* pair 0 is not used */
+    u_int32_t   cc_size;              /* pairs allocated */
+    u_int32_t   cc_next;              /* first pair never used */
+    u_int32_t   cc_free;              /* free pairs, linked by cn_child */
+    u_int32_t   cc_pair_count;        /* pairs in use */
+    u_int32_t   cc_info_count;        /* infos */
+    u_int8_t    cc_invalid;           /* out of memory, use the tree */
+    u_int8_t    pad[3];               /* for alignment */
+} rtn_compact_t;
+
+
+/**
+ * Create the compact nodes of an empty tree. Called by rtn_root_init()
+ * for RTN_BIT_COMPACT.
+ *
+ * @param rt_head   head structure. Must not be NULL.
+ *
+ * @return
+ *     the compact nodes, or NULL when out of memory.
+ */
+extern rtn_compact_t *rtn_compact_init(rt_head_t *rt_head);
+
+/**
+ * Free the compact nodes of a tree.
+ *
+ * @param rt_head   head structure. Must not be NULL.
+ */
+extern void rtn_compact_free(rt_head_t *rt_head);
+
+/**
+ * Best match through the compact nodes, as rtn_lookup().
+ *
+ * @param rc          compact nodes of the tree, valid.
+ * @param addr        address in the network byte order
+ * @param maxbitlen   the max bit length allowed.
+ */
+extern rt_info_t *rtn_compact_lookup(rtn_compact_t *rc, u_int8_t *addr,
+                                     u_int16_t maxbitlen);
+
+/**
+ * Return the bytes held by the compact nodes of a tree.
+ */
+extern u_int64_t rtn_compact_bytes(rtn_compact_t *rc);
+
+/*
+ * Update hooks, called by rtn_radix.c for an info entry that has been
+ * added to the tree, or that is about to be removed from the tree.
+ */
+extern void rtn_compact_add(rtn_compact_t *rc, rt_info_t *rinfo);
+extern void rtn_compact_delete(rtn_compact_t *rc, rt_info_t *rinfo);
+
+#endif  /* __RTN_COMPACT_H__ */
@@ -0,0 +1,229 @@
+/***
+ *   rtn_epoch.c
+ *
+ *   Epoch based reclamation for the lock-free readers of a radix trie.
+ *
+ *    Copyright (c) 2016 Ericsson AB.
+ *    All rights reserved.
+ *
+ ***
+ * Description:
+ *
+ * There is a single global epoch, and each reader thread owns a slot
+ * (on its own cache line) where it publishes the epoch it saw when it
+ * entered a read section, or zero when it is outside.
+ *
+ * A writer stamps each node it removes from a tree with the global
+ * epoch. The global epoch can only move from E to E + 1 when every
+ * reader inside a read section has seen E. So once the global epoch
+ * is two past the stamp of a node, no reader can still hold the node,
+ * and it is freed.
+ *
+ * Readers never wait. A writer only waits in rtn_rcu_synchronize().
+ *
+ ***/
+
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <sys/types.h>
+#include <pthread.h>
+
+#include "corelibs/rtn_radix.h"
+#include "corelibs/rtn_epoch.h"
+#include "rtn_private.h"
+
+typedef struct _rtn_epoch_slot_t
+{
+    u_int64_t   es_epoch;              /* epoch seen, 0 when outside */
+    u_int32_t   es_nest;               /* nesting of read sections */
+    u_int32_t   es_used;               /* slot owned by a thread */
+} __attribute__((aligned(RTN_CACHE_LINE))) rtn_epoch_slot_t;
+
+static u_int64_t rtn_epoch_global __attribute__((aligned(RTN_CACHE_LINE))) = 1;
+static rtn_epoch_slot_t rtn_epoch_slots[RTN_EPOCH_MAX_THREADS];
+
+static __thread rtn_epoch_slot_t *rtn_epoch_self = NULL;
+static pthread_key_t rtn_epoch_key;
+static pthread_once_t rtn_epoch_once = PTHREAD_ONCE_INIT;
+
+/*
+ * rtn_epoch_thread_exit
+ *
+ * Release the slot of an exiting thread.
+ */
+static void
+rtn_epoch_thread_exit (void *arg)
+{
+    rtn_epoch_slot_t *slot = arg;
+
+    __atomic_store_n(&slot->es_epoch, 0, __ATOMIC_RELEASE);
+    slot->es_nest = 0;
+    __atomic_store_n(&slot->es_used, 0, __ATOMIC_RELEASE);
+}
+
+/*
+ * rtn_epoch_key_init
+ */
+static void
+rtn_epoch_key_init (void)
+{
+    pthread_key_create(&rtn_epoch_key, rtn_epoch_thread_exit);
+}
+
+/*
+ * rtn_epoch_register
+ *
+ * Find a free slot for the calling thread.
+ */
+static rtn_epoch_slot_t *
+rtn_epoch_register (void)
+{
+    u_int32_t i, unused;
+
+    pthread_once(&rtn_epoch_once, rtn_epoch_key_init);
+
+    for (i = 0; i < RTN_EPOCH_MAX_THREADS; i++) {
+        unused = 0;
+        if (__atomic_compare_exchange_n(&rtn_epoch_slots[i].es_used, &unused,
+                                        1, FALSE, __ATOMIC_ACQ_REL,
+                                        __ATOMIC_RELAXED)) {
+            rtn_epoch_self = &rtn_epoch_slots[i];
+            pthread_setspecific(rtn_epoch_key, rtn_epoch_self);
+            return (rtn_epoch_self);
+        }
+    }
+
+    return (NULL);
+}
+
+/*
+ * rtn_rcu_read_lock
+ *
+ * Enter a read section. The full fence makes sure the writer sees our
+ * epoch before we load any pointer from the tree.
+ */
+int
+rtn_rcu_read_lock (void)
+{
+    rtn_epoch_slot_t *slot;
+
+    slot = rtn_epoch_self;
+    if (!slot) {
+        slot = rtn_epoch_register();
+        if (!slot) {
+            return (-1);
+        }
+    }
+
+    if (slot->es_nest++ == 0) {
+        __atomic_store_n(&slot->es_epoch,
+                         __atomic_load_n(&rtn_epoch_global, __ATOMIC_ACQUIRE),
+                         __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    }
+
+    return (0);
+}
+
+/*
+ * rtn_rcu_read_unlock
+ *
+ * Leave a read section.
+ */
+void
+rtn_rcu_read_unlock (void)
+{
+    rtn_epoch_slot_t *slot;
+
+    slot = rtn_epoch_self;
+    if (slot && (--slot->es_nest == 0)) {
+        __atomic_store_n(&slot->es_epoch, 0, __ATOMIC_RELEASE);
+    }
+}
+
+/*
+ * rtn_rcu_thread_offline
+ *
+ * Give up the slot of the calling thread.
+ */
+void
+rtn_rcu_thread_offline (void)
+{
+    if (rtn_epoch_self) {
+        pthread_setspecific(rtn_epoch_key, NULL);
+        rtn_epoch_thread_exit(rtn_epoch_self);
+        rtn_epoch_self = NULL;
+    }
+}
+
+/*
+ * rtn_epoch_get
+ */
+u_int64_t
+rtn_epoch_get (void)
+{
+    return (__atomic_load_n(&rtn_epoch_global, __ATOMIC_ACQUIRE));
+}
+
+/*
+ * rtn_epoch_advance
+ *
+ * Try to move the global epoch forward by one.
+ */
+u_int64_t
+rtn_epoch_advance (void)
+{
+    u_int64_t epoch, seen;
+    u_int32_t i;
+
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    epoch = __atomic_load_n(&rtn_epoch_global, __ATOMIC_ACQUIRE);
+
+    for (i = 0; i < RTN_EPOCH_MAX_THREADS; i++) {
+        if (!__atomic_load_n(&rtn_epoch_slots[i].es_used, __ATOMIC_ACQUIRE)) {
+            continue;
+        }
+        seen = __atomic_load_n(&rtn_epoch_slots[i].es_epoch, __ATOMIC_ACQUIRE);
+        if (seen && (seen != epoch)) {
+            return (epoch);
+        }
+    }
+
+    /*
+     * Another writer may have moved it already, which is just as good.
+     */
+    __atomic_compare_exchange_n(&rtn_epoch_global, &epoch, epoch + 1, FALSE,
+                                __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+
+    return (__atomic_load_n(&rtn_epoch_global, __ATOMIC_ACQUIRE));
+}
+
+/*
+ * rtn_rcu_synchronize
+ *
+ * Wait until all the retired nodes of a tree have been freed.
+ */
+void
+rtn_rcu_synchronize (rt_head_t *rt_head)
+{
+    while (rtn_rcu_reclaim(rt_head)) {
+        sched_yield();
+    }
+}
+
+/*
+ * rtn_rcu_quiesce
+ *
+ * Wait until every reader that was in a read section has left it.
+ */
+void
+rtn_rcu_quiesce (void)
+{
+    u_int64_t epoch;
+
+    epoch = rtn_epoch_get() + 2;
+    while (rtn_epoch_advance() < epoch) {
+        sched_yield();
+    }
+}
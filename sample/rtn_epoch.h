@@ -0,0 +1,92 @@
+/**
+ *  @name rtn_epoch.h, Epoch based reclamation for lock-free readers
+ *
+ *  API for rtn_epoch.c.
+ *
+ *  A tree created with RTN_BIT_RCU can be read by any number of threads
+ *  while a single writer thread updates it. A reader brackets its
+ *  lookups with rtn_rcu_read_lock() and rtn_rcu_read_unlock(), which
+ *  never block or spin. The writer publishes the pointer updates with
+ *  release stores, and a node removed from the tree is only freed once
+ *  every reader that could still see it has left its read section.
+ *
+ *     Copyright (c) 2016 Ericsson AB.
+ *
+ *     All rights reserved.
+ */
+
+#ifndef __RTN_EPOCH_H__
+#define __RTN_EPOCH_H__
+
+#include "corelibs/rtn_radix.h"
+
+/*
+ * Max. number of threads that can be readers at the same time.
+ */
+#define RTN_EPOCH_MAX_THREADS   256
+
+/*
+ * Number of retired nodes that make the writer try to reclaim.
+ */
+#define RTN_RCU_RECLAIM_BATCH   64
+
+/**
+ * Enter a read section. Read sections may be nested.
+ *
+ * @return
+ *     0: success; -1: no reader slot is available for this thread.
+ */
+extern int rtn_rcu_read_lock(void);
+
+/**
+ * Leave a read section.
+ */
+extern void rtn_rcu_read_unlock(void);
+
+/**
+ * Give up the reader slot of the calling thread. This is also done when
+ * the thread exits.
+ */
+extern void rtn_rcu_thread_offline(void);
+
+/**
+ * Return the current global epoch.
+ */
+extern u_int64_t rtn_epoch_get(void);
+
+/**
+ * Move the global epoch forward if every reader in a read section has
+ * seen the current one.
+ *
+ * @return
+ *     the global epoch after the attempt.
+ */
+extern u_int64_t rtn_epoch_advance(void);
+
+/**
+ * Free the nodes retired by the writer of a tree for which the grace
+ * period has passed. Called by the writer only.
+ *
+ * @param rt_head  head structure. Must not be NULL.
+ *
+ * @return
+ *     number of retired nodes still waiting to be freed.
+ */
+extern u_int32_t rtn_rcu_reclaim(rt_head_t *rt_head);
+
+/**
+ * Wait until all the nodes retired by the writer of a tree are freed.
+ * Called by the writer only, and never from a read section.
+ *
+ * @param rt_head  head structure. Must not be NULL.
+ */
+extern void rtn_rcu_synchronize(rt_head_t *rt_head);
+
+/**
+ * Wait until every reader that was in a read section when called has
+ * left it, e.g. before unmapping memory the readers could still see.
+ * Called by the writer only, and never from a read section.
+ */
+extern void rtn_rcu_quiesce(void);
+
+#endif  /* __RTN_EPOCH_H__ */
@@ -0,0 +1,173 @@
+/***
+ *   rtn_flowcache.c
+ *
+ *   Lookup result cache for the radix trie.
+ *
+ *    Copyright (c) 2016 Ericsson AB.
+ *    All rights reserved.
+ *
+ ***
+ * Description:
+ *
+ * The cache is an array of sets of fc_ways entries. The key, zero
+ * padded to two words, is hashed to a set; a set of up to 2 entries
+ * fits in a cache line.
+ *
+ * An entry is valid when its generation is the current one of the tree.
+ * There is no other invalidation: the entries of an older generation
+ * are simply replaced in time.
+ *
+ * A miss does rtn_lookup(), and puts the result first in its set,
+ * moving the others down and dropping the last one. A hit does not
+ * move the entry, so a set is kept in the order of the misses.
+ *
+ * The generation is read before rtn_lookup(), and the tree moves it
+ * forward once more after a delete is done. So a result cached during
+ * a change gets either the generation before the change, or one that
+ * the change has already made stale.
+ *
+ ***/
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include "corelibs/rtn_radix.h"
+#include "corelibs/rtn_flowcache.h"
+#include "rtn_private.h"
+
+/*
+ * rtn_flowcache_hash
+ *
+ * Return the set of a key.
+ */
+static inline u_int32_t
+rtn_flowcache_hash (rtn_flowcache_t *fc, u_int64_t *key)
+{
+    u_int64_t hash;
+
+    hash = (key[0] * 0x9e3779b97f4a7c15ULL) ^ (key[1] * 0xc2b2ae3d27d4eb4fULL);
+    hash ^= hash >> 29;
+
+    return ((u_int32_t) hash & fc->fc_set_mask);
+}
+
+/*
+ * rtn_flowcache_create
+ */
+rtn_flowcache_t *
+rtn_flowcache_create (rt_head_t *rt_head, u_int16_t keybytes,
+                      u_int32_t entries, u_int16_t ways)
+{
+    rtn_flowcache_t *fc;
+    u_int32_t sets;
+
+    if (!keybytes || (keybytes > RTN_FLOWCACHE_KEY_MAX) ||
+        !ways || (ways > RTN_FLOWCACHE_WAYS_MAX)) {
+        return (NULL);
+    }
+
+    for (sets = 1; ((u_int64_t) sets * ways < entries) && (sets < (1U << 30));
+         sets <<= 1) {
+        ;
+    }
+
+    fc = calloc(1, sizeof(rtn_flowcache_t));
+    if (!fc) {
+        return (NULL);
+    }
+
+    if (posix_memalign((void **) &fc->fc_flows, RTN_CACHE_LINE,
+                       (size_t) sets * ways * sizeof(rtn_flow_t))) {
+        free(fc);
+        return (NULL);
+    }
+    memset(fc->fc_flows, 0, (size_t) sets * ways * sizeof(rtn_flow_t));
+
+    fc->fc_head     = rt_head;
+    fc->fc_set_mask = sets - 1;
+    fc->fc_ways     = ways;
+    fc->fc_keybytes = keybytes;
+
+    return (fc);
+}
+
+/*
+ * rtn_flowcache_destroy
+ */
+void
+rtn_flowcache_destroy (rtn_flowcache_t *fc)
+{
+    if (fc) {
+        free(fc->fc_flows);
+        free(fc);
+    }
+}
+
+/*
+ * rtn_flowcache_lookup
+ */
+rt_info_t *
+rtn_flowcache_lookup (rtn_flowcache_t *fc, char *addr)
+{
+    u_int64_t key[RTN_FLOWCACHE_KEY_MAX / 8], generation;
+    rtn_flow_t *set, *flow;
+    rt_info_t *rinfo;
+    u_int16_t way;
+
+    generation = __atomic_load_n(&fc->fc_head->rt_generation,
+                                 __ATOMIC_ACQUIRE);
+    if (generation != fc->fc_generation) {
+        fc->fc_generation = generation;
+        fc->fc_generations++;
+    }
+    fc->fc_lookups++;
+
+    key[0] = key[1] = 0;
+    memcpy(key, addr, fc->fc_keybytes);
+
+    set = &fc->fc_flows[(size_t) rtn_flowcache_hash(fc, key) * fc->fc_ways];
+    for (way = 0; way < fc->fc_ways; way++) {
+        flow = &set[way];
+        if ((flow->fl_generation == generation) &&
+            (flow->fl_key[0] == key[0]) && (flow->fl_key[1] == key[1])) {
+            fc->fc_hits++;
+            return (flow->fl_info);
+        }
+    }
+
+    rinfo = rtn_lookup(fc->fc_head, addr, fc->fc_keybytes << RNSHIFT);
+
+    if (fc->fc_ways > 1) {
+        memmove(&set[1], &set[0], (fc->fc_ways - 1) * sizeof(rtn_flow_t));
+    }
+    set[0].fl_generation = generation;
+    set[0].fl_info       = rinfo;
+    set[0].fl_key[0]     = key[0];
+    set[0].fl_key[1]     = key[1];
+
+    return (rinfo);
+}
+
+/*
+ * rtn_flowcache_hit_rate
+ */
+u_int32_t
+rtn_flowcache_hit_rate (rtn_flowcache_t *fc)
+{
+    u_int32_t rate;
+
+    rate = fc->fc_lookups ? (u_int32_t) (fc->fc_hits * 100 / fc->fc_lookups)
+                          : 0;
+
+    return (rate);
+}
+
+/*
+ * rtn_flowcache_reset_stats
+ */
+void
+rtn_flowcache_reset_stats (rtn_flowcache_t *fc)
+{
+    fc->fc_lookups = fc->fc_hits = fc->fc_generations = 0;
+}
@@ -0,0 +1,105 @@
+/**
+ *  @name rtn_flowcache.h, Lookup result cache for radix trees
+ *
+ *  API for rtn_flowcache.c.
+ *
+ *  A flow cache keeps the results of the latest rtn_lookup() calls on a
+ *  tree, by address, in a small set-associative table, so that the
+ *  addresses seen most often skip the descent of the tree.
+ *
+ *  Each entry is tagged with the generation of the tree, rt_generation,
+ *  which moves forward on each change that could change the result of a
+ *  lookup: rtn_add(), rtn_delete(), the subtree calls and the unmap of a
+ *  snapshot. An entry from an older generation is a miss, so a change
+ *  costs one counter update, and no flush. rtn_bump_version() does not
+ *  change the info found, and keeps the entries.
+ *
+ *  The generation is per tree, not per prefix: any add or delete, of
+ *  any prefix, makes every entry of the cache a miss. The cache pays off
+ *  only when lookups outnumber the changes of the tree by far; a tree
+ *  with a steady stream of updates may see few hits, and fc_generations
+ *  counts how often the whole cache was lost.
+ *
+ *  A cache belongs to a single thread, so it takes no lock. With
+ *  RTN_BIT_RCU, the info it returns is only valid inside the read
+ *  section, as for rtn_lookup().
+ *
+ *     Copyright (c) 2016 Ericsson AB.
+ *
+ *     All rights reserved.
+ */
+
+#ifndef __RTN_FLOWCACHE_H__
+#define __RTN_FLOWCACHE_H__
+
+#include "corelibs/rtn_radix.h"
+
+#define RTN_FLOWCACHE_KEY_MAX    16    /* max. key length in bytes */
+#define RTN_FLOWCACHE_WAYS_MAX   8     /* max. entries per set */
+
+typedef struct _rtn_flow_t
+{
+    u_int64_t   fl_generation;        /* tree generation, 0 for none */
+    rt_info_t   *fl_info;             /* best match, could be NULL */
+    u_int64_t   fl_key[RTN_FLOWCACHE_KEY_MAX / 8];  /* zero padded */
+} rtn_flow_t;
+
+typedef struct _rtn_flowcache_t
+{
+    rt_head_t   *fc_head;             /* tree */
+    rtn_flow_t  *fc_flows;            /* the sets, one after the other */
+    u_int32_t   fc_set_mask;          /* sets - 1 */
+    u_int16_t   fc_ways;              /* entries per set */
+    u_int16_t   fc_keybytes;          /* key length in bytes */
+    u_int64_t   fc_generation;        /* tree generation last seen */
+
+    u_int64_t   fc_lookups;           /* count of lookups */
+    u_int64_t   fc_hits;              /* count of lookups from the cache */
+    u_int64_t   fc_generations;       /* count of generations seen */
+} rtn_flowcache_t;
+
+
+/**
+ * Create a flow cache for a tree.
+ *
+ * @param rt_head   head structure. Must not be NULL.
+ * @param keybytes  key length in bytes, up to RTN_FLOWCACHE_KEY_MAX.
+ *                  The lookups are done with a max. bit length of
+ *                  keybytes * 8.
+ * @param entries   number of entries, rounded up to a power of 2.
+ * @param ways      entries per set, 1 (direct mapped) up to
+ *                  RTN_FLOWCACHE_WAYS_MAX.
+ *
+ * @return
+ *     the cache, or NULL when out of memory or with a bad argument.
+ */
+extern rtn_flowcache_t *rtn_flowcache_create(rt_head_t *rt_head,
+                                             u_int16_t keybytes,
+                                             u_int32_t entries,
+                                             u_int16_t ways);
+
+/**
+ * Free a flow cache. This must be done before its tree is freed.
+ */
+extern void rtn_flowcache_destroy(rtn_flowcache_t *fc);
+
+/**
+ * Best match through the cache, as rtn_lookup().
+ *
+ * @param fc    the cache.
+ * @param addr  address in the network byte order, keybytes long.
+ */
+extern rt_info_t *rtn_flowcache_lookup(rtn_flowcache_t *fc, char *addr);
+
+/**
+ * Return the hit rate of a cache in percent, since its creation or the
+ * latest rtn_flowcache_reset_stats().
+ */
+extern u_int32_t rtn_flowcache_hit_rate(rtn_flowcache_t *fc);
+
+/**
+ * Reset the counters of a cache: fc_lookups, fc_hits and fc_generations.
+ */
+extern void rtn_flowcache_reset_stats(rtn_flowcache_t *fc);
+
+#endif  /* __RTN_FLOWCACHE_H__ */
@@ -0,0 +1,159 @@
+/***
+ *   rtn_key.c
+ *
+ *   Key compare for the radix trie.
+ *
+ *    Copyright (c) 2016 Ericsson AB.
+ *    All rights reserved.
+ *
+ ***
+ * Description:
+ *
+ * Adding a prefix, or attaching a subtree, needs the first bit that
+ * differs between two keys. The table version looks at one byte at a
+ * time. The other versions find the first differing word (8 bytes), or
+ * vector (16 or 32 bytes with SSE2 or AVX2), and then the bit in it
+ * with a count of leading or trailing zeros.
+ *
+ * No version reads past the last byte of the bit length: the tail of a
+ * key that is shorter than a vector is done with narrower loads.
+ *
+ * Keys of up to RTN_KEY_WORD_BITS (IPv4, IPv6) are done inline by
+ * rtn_key_diff_short(), as a call costs more than it would save. Longer
+ * keys go through rtn_key_diff_long, set on its first call to the best
+ * version that the CPU supports.
+ *
+ ***/
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+#include "corelibs/rtn_radix.h"
+#include "rtn_private.h"
+
+static u_int16_t rtn_key_diff_select(u_int8_t *key1, u_int8_t *key2,
+                                     u_int16_t bitlen);
+
+rtn_key_diff_func rtn_key_diff_long = rtn_key_diff_select;
+
+/*
+ * rtn_key_diff_table
+ *
+ * A byte at a time, the portable version.
+ */
+u_int16_t
+rtn_key_diff_table (u_int8_t *key1, u_int8_t *key2, u_int16_t bitlen)
+{
+    u_int16_t dbit;
+    u_int i;
+
+    for (dbit = 0; dbit < bitlen; dbit += RNBBY) {
+        i = dbit >> RNSHIFT;
+        if (key1[i] != key2[i]) {
+            dbit += first_bit_set[key1[i] ^ key2[i]];
+            break;
+        }
+    }
+
+    return (MIN(dbit, bitlen));
+}
+
+/*
+ * rtn_key_diff_word
+ *
+ * A word at a time.
+ */
+u_int16_t
+rtn_key_diff_word (u_int8_t *key1, u_int8_t *key2, u_int16_t bitlen)
+{
+    return (rtn_key_diff_short(key1, key2, bitlen));
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+/*
+ * rtn_key_diff_sse2
+ *
+ * 16 bytes at a time.
+ */
+__attribute__((target("sse2"))) u_int16_t
+rtn_key_diff_sse2 (u_int8_t *key1, u_int8_t *key2, u_int16_t bitlen)
+{
+    __m128i v1, v2;
+    u_int32_t mask;
+    u_int16_t dbit = 0;
+    u_int i;
+
+    for (; dbit + 128 <= bitlen; dbit += 128) {
+        v1 = _mm_loadu_si128((const __m128i *) (key1 + (dbit >> RNSHIFT)));
+        v2 = _mm_loadu_si128((const __m128i *) (key2 + (dbit >> RNSHIFT)));
+        mask = ~_mm_movemask_epi8(_mm_cmpeq_epi8(v1, v2)) & 0xffff;
+        if (mask) {
+            i = (dbit >> RNSHIFT) + __builtin_ctz(mask);
+            return ((i << RNSHIFT) + first_bit_set[key1[i] ^ key2[i]]);
+        }
+    }
+
+    return (dbit + rtn_key_diff_short(key1 + (dbit >> RNSHIFT),
+                                      key2 + (dbit >> RNSHIFT),
+                                      bitlen - dbit));
+}
+
+/*
+ * rtn_key_diff_avx2
+ *
+ * 32 bytes at a time.
+ */
+__attribute__((target("avx2"))) u_int16_t
+rtn_key_diff_avx2 (u_int8_t *key1, u_int8_t *key2, u_int16_t bitlen)
+{
+    __m256i v1, v2;
+    u_int32_t mask;
+    u_int16_t dbit = 0;
+    u_int i;
+
+    for (; dbit + 256 <= bitlen; dbit += 256) {
+        v1 = _mm256_loadu_si256((const __m256i *) (key1 + (dbit >> RNSHIFT)));
+        v2 = _mm256_loadu_si256((const __m256i *) (key2 + (dbit >> RNSHIFT)));
+        mask = ~(u_int32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(v1, v2));
+        if (mask) {
+            i = (dbit >> RNSHIFT) + __builtin_ctz(mask);
+            return ((i << RNSHIFT) + first_bit_set[key1[i] ^ key2[i]]);
+        }
+    }
+
+    return (dbit + rtn_key_diff_sse2(key1 + (dbit >> RNSHIFT),
+                                     key2 + (dbit >> RNSHIFT),
+                                     bitlen - dbit));
+}
+
+#endif
+
+/*
+ * rtn_key_diff_select
+ *
+ * Set rtn_key_diff_long for the CPU, on its first call. Each version
+ * gives the same result, so a race between threads does no harm.
+ */
+static u_int16_t
+rtn_key_diff_select (u_int8_t *key1, u_int8_t *key2, u_int16_t bitlen)
+{
+    rtn_key_diff_func func = rtn_key_diff_word;
+
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        func = rtn_key_diff_avx2;
+    } else if (__builtin_cpu_supports("sse2")) {
+        func = rtn_key_diff_sse2;
+    }
+#endif
+
+    __atomic_store_n(&rtn_key_diff_long, func, __ATOMIC_RELAXED);
+    return ((*func)(key1, key2, bitlen));
+}
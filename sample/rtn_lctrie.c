@@ -0,0 +1,875 @@
+/***
+ *   rtn_lctrie.c
+ *
+ *   Compiled level compressed tries for the radix trie.
+ *
+ *    Copyright (c) 2016 Ericsson AB.
+ *    All rights reserved.
+ *
+ ***
+ * Description:
+ *
+ * A compile walks a view of the tree, in the pre-order, so each prefix
+ * is followed by the prefixes it covers. A prefix that covers the next
+ * one goes to the prefix entries, the others to the leaf entries, which
+ * are then in the key order, and none of them is a prefix of another.
+ * Each entry points (le_pre) to the nearest prefix that covers it.
+ *
+ * The trie is built over the leaf entries, breadth first, so that the
+ * children of a node are next to each other. A node for a run of leaf
+ * entries skips the bits they all share (path compression), which is
+ * the first bit where the first and the last of the run differ, and
+ * takes as many bits at once as the fill factor allows (level
+ * compression), but never past the end of the shortest entry of the run.
+ * A slot that gets no entry is a "direct" leaf: no prefix longer than
+ * the bits taken so far can cover an address that ends there, so its
+ * best match is known at compile time, and it is looked up in the view.
+ * It is only right for the addresses that have the bits skipped above
+ * it, so when bits were skipped, a lookup checks them first.
+ *
+ * A lookup goes down to a leaf, and compares the address with the key
+ * of its entry. On a miss at bit d, the prefixes on the le_pre chain
+ * with a length up to d are the ones that match, so the first of them is
+ * the best match, with no further key compare.
+ *
+ ***/
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/types.h>
+#include <pthread.h>
+
+#include "corelibs/rtn_radix.h"
+#include "corelibs/rtn_epoch.h"
+#include "corelibs/rtn_view.h"
+#include "corelibs/rtn_lctrie.h"
+#include "rtn_private.h"
+
+#define RTN_LCTRIE_SLOTS_MIN    1024
+
+/*
+ * A prefix of the view, in the pre-order.
+ */
+typedef struct _rtn_lcprefix_t
+{
+    rt_info_t   *lp_info;
+    u_int32_t   lp_index;             /* entry */
+    u_int8_t    lp_covers;            /* covers the next one */
+} rtn_lcprefix_t;
+
+/*
+ * A node still to be built, breadth first.
+ */
+typedef struct _rtn_lcwork_t
+{
+    u_int32_t   lw_node;              /* node */
+    u_int32_t   lw_first;             /* first leaf entry */
+    u_int32_t   lw_count;             /* count of leaf entries */
+    u_int16_t   lw_pos;               /* bits already taken */
+    u_int16_t   lw_depth;             /* nodes above */
+    u_int8_t    lw_skipped;           /* bits skipped above */
+    u_int8_t    pad[3];
+} rtn_lcwork_t;
+
+/*
+ * State of a compile.
+ */
+typedef struct _rtn_lcbuild_t
+{
+    rtn_view_t      *lb_view;
+    double          lb_fill;
+    rtn_lcprefix_t  *lb_prefixes;     /* in the pre-order */
+    u_int32_t       lb_prefix_count;
+    u_int32_t       lb_prefix_size;
+    rtn_lcentry_t   *lb_entries;
+    u_int32_t       lb_leaf_count;    /* leaf entries */
+    rtn_lcnode_t    *lb_nodes;
+    u_int32_t       lb_node_count;
+    u_int32_t       lb_node_size;
+    rtn_lcdirect_t  *lb_direct;
+    u_int32_t       lb_direct_count;
+    u_int32_t       lb_direct_size;
+    rtn_lcwork_t    *lb_work;         /* a queue, one per node */
+    u_int32_t       lb_work_size;
+    u_int16_t       lb_maxlen;
+    u_int16_t       lb_depth;
+    u_int8_t        *lb_addr;         /* for the direct leaves */
+} rtn_lcbuild_t;
+
+/*
+ * rtn_lctrie_bits
+ *
+ * Return the count bits (up to RTN_LCTRIE_BRANCH_MAX) of a key from bit
+ * number pos.
+ */
+static inline u_int32_t
+rtn_lctrie_bits (u_int8_t *key, u_int16_t pos, u_int8_t count)
+{
+    u_int32_t word = 0;
+    u_int16_t i, last;
+
+    last = RNBYTE(pos + count - 1);
+    for (i = RNBYTE(pos); i <= last; i++) {
+        word = (word << RNBBY) | key[i];
+    }
+
+    return ((word >> (7 - ((pos + count - 1) & 0x7))) & ((1U << count) - 1));
+}
+
+/*
+ * rtn_lctrie_key
+ */
+static inline u_int8_t *
+rtn_lctrie_key (rtn_lcbuild_t *lb, u_int32_t leaf)
+{
+    return (lb->lb_entries[leaf].le_info->rninfo_key);
+}
+
+/*
+ * rtn_lctrie_now_ms
+ */
+static u_int64_t
+rtn_lctrie_now_ms (void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((u_int64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
+
+/*
+ * rtn_lctrie_now_ns
+ */
+static u_int64_t
+rtn_lctrie_now_ns (void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((u_int64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+}
+
+/*
+ * rtn_lctrie_grow
+ *
+ * Make room for one more element in an array of a compile.
+ */
+static int8_t
+rtn_lctrie_grow (void **array, u_int32_t *size, u_int32_t count,
+                 size_t elem_size)
+{
+    void *grown;
+    u_int32_t new_size;
+
+    if (count < *size) {
+        return (TRUE);
+    }
+
+    new_size = *size ? *size << 1 : RTN_LCTRIE_SLOTS_MIN;
+    if (new_size <= *size) {
+        return (FALSE);
+    }
+    grown = realloc(*array, (size_t) new_size * elem_size);
+    if (!grown) {
+        return (FALSE);
+    }
+    *array = grown;
+    *size = new_size;
+
+    return (TRUE);
+}
+
+/*
+ * rtn_lctrie_collect
+ *
+ * Walk function to take the prefixes of the view.
+ */
+static int
+rtn_lctrie_collect (rt_info_t *rinfo, va_list ap)
+{
+    rtn_lcbuild_t *lb = va_arg(ap, rtn_lcbuild_t *);
+
+    if (!rtn_lctrie_grow((void **) &lb->lb_prefixes, &lb->lb_prefix_size,
+                         lb->lb_prefix_count, sizeof(rtn_lcprefix_t))) {
+        return (RTWALK_ABORT);
+    }
+
+    lb->lb_prefixes[lb->lb_prefix_count].lp_info = rinfo;
+    lb->lb_prefix_count++;
+    lb->lb_maxlen = MAX(lb->lb_maxlen, rinfo->rnode_bit);
+
+    return (RTWALK_CONTINUE);
+}
+
+/*
+ * rtn_lctrie_covers
+ *
+ * Return TRUE if the first prefix covers the second one.
+ */
+static inline int8_t
+rtn_lctrie_covers (rt_info_t *ri1, rt_info_t *ri2)
+{
+    return ((ri1->rnode_bit <= ri2->rnode_bit) &&
+            (rtn_key_diff(ri1->rninfo_key, ri2->rninfo_key,
+                          ri1->rnode_bit) == ri1->rnode_bit));
+}
+
+/*
+ * rtn_lctrie_entries
+ *
+ * Sort the prefixes into leaf and prefix entries, and link them to the
+ * prefixes that cover them.
+ */
+static int8_t
+rtn_lctrie_entries (rtn_lcbuild_t *lb)
+{
+    rtn_lcprefix_t *lp;
+    u_int32_t *stack, top, i, leaves = 0, covering = 0;
+
+    lb->lb_entries = malloc((size_t) MAX(lb->lb_prefix_count, 1) *
+                            sizeof(rtn_lcentry_t));
+    stack = malloc((size_t) MAX(lb->lb_prefix_count, 1) * sizeof(u_int32_t));
+    if (!lb->lb_entries || !stack) {
+        free(stack);
+        return (FALSE);
+    }
+
+    /*
+     * In the pre-order, a prefix is followed by the prefixes it covers.
+     */
+    for (i = 0; i < lb->lb_prefix_count; i++) {
+        lp = &lb->lb_prefixes[i];
+        lp->lp_covers = (i + 1 < lb->lb_prefix_count) &&
+            rtn_lctrie_covers(lp->lp_info, lb->lb_prefixes[i + 1].lp_info);
+        if (!lp->lp_covers) {
+            lb->lb_leaf_count++;
+        }
+    }
+    for (i = 0; i < lb->lb_prefix_count; i++) {
+        lp = &lb->lb_prefixes[i];
+        lp->lp_index = lp->lp_covers ? lb->lb_leaf_count + covering++
+                                     : leaves++;
+    }
+
+    /*
+     * The prefixes that cover this one are on the stack, the longest on
+     * top.
+     */
+    for (i = 0, top = 0; i < lb->lb_prefix_count; i++) {
+        lp = &lb->lb_prefixes[i];
+        while (top && !rtn_lctrie_covers(lb->lb_prefixes[stack[top - 1]].lp_info,
+                                         lp->lp_info)) {
+            top--;
+        }
+
+        lb->lb_entries[lp->lp_index].le_info = lp->lp_info;
+        lb->lb_entries[lp->lp_index].le_len = lp->lp_info->rnode_bit;
+        lb->lb_entries[lp->lp_index].le_pre =
+            top ? lb->lb_prefixes[stack[top - 1]].lp_index : RTN_LCTRIE_NONE;
+        lb->lb_entries[lp->lp_index].pad = 0;
+
+        if (lp->lp_covers) {
+            stack[top++] = i;
+        }
+    }
+
+    free(stack);
+    return (TRUE);
+}
+
+/*
+ * rtn_lctrie_node_alloc
+ *
+ * Allocate count nodes next to each other, and return the first one,
+ * or RTN_LCTRIE_NONE when out of memory.
+ */
+static u_int32_t
+rtn_lctrie_node_alloc (rtn_lcbuild_t *lb, u_int32_t count)
+{
+    u_int32_t first;
+
+    while (lb->lb_node_count + count > lb->lb_node_size) {
+        if (!rtn_lctrie_grow((void **) &lb->lb_nodes, &lb->lb_node_size,
+                             lb->lb_node_size, sizeof(rtn_lcnode_t))) {
+            return (RTN_LCTRIE_NONE);
+        }
+    }
+
+    first = lb->lb_node_count;
+    lb->lb_node_count += count;
+    memset(&lb->lb_nodes[first], 0, count * sizeof(rtn_lcnode_t));
+
+    return (first);
+}
+
+/*
+ * rtn_lctrie_direct
+ *
+ * Make a direct leaf for the addresses that start with the first pos
+ * bits of a leaf entry, then pattern on count bits.
+ */
+static int8_t
+rtn_lctrie_direct (rtn_lcbuild_t *lb, rtn_lcnode_t *ln, u_int32_t leaf,
+                   u_int16_t pos, u_int32_t pattern, u_int8_t count,
+                   u_int8_t skipped)
+{
+    rtn_lcdirect_t *ld;
+    u_int16_t bit, bytes;
+    rt_info_t *rinfo;
+    u_int8_t i;
+
+    /*
+     * The address: the bits of the entry, the pattern, and zeros.
+     */
+    bytes = RNBYTE(lb->lb_maxlen + 7);
+    memset(lb->lb_addr, 0, bytes);
+    memcpy(lb->lb_addr, rtn_lctrie_key(lb, leaf), RNBYTE(pos + 7));
+    for (bit = pos; bit < ((pos + 7) & ~0x7); bit++) {
+        lb->lb_addr[RNBYTE(bit)] &= ~RNBIT(bit);
+    }
+    for (i = 0; i < count; i++) {
+        if (pattern & (1U << (count - 1 - i))) {
+            lb->lb_addr[RNBYTE(pos + i)] |= RNBIT(pos + i);
+        }
+    }
+
+    rinfo = rtn_view_lookup(lb->lb_view, (char *) lb->lb_addr, pos + count);
+
+    /*
+     * The slots next to each other often have the same best match.
+     */
+    ld = lb->lb_direct_count ? &lb->lb_direct[lb->lb_direct_count - 1] : NULL;
+    if (!ld || (ld->ld_info != rinfo) || (ld->ld_entry != leaf) ||
+        (ld->ld_len != (skipped ? pos : 0))) {
+        if (!rtn_lctrie_grow((void **) &lb->lb_direct, &lb->lb_direct_size,
+                             lb->lb_direct_count, sizeof(rtn_lcdirect_t))) {
+            return (FALSE);
+        }
+        ld = &lb->lb_direct[lb->lb_direct_count++];
+        ld->ld_info = rinfo;
+        ld->ld_entry = leaf;
+        ld->ld_len = skipped ? pos : 0;
+        ld->pad = 0;
+    }
+
+    ln->ln_adr = lb->lb_direct_count - 1;
+    ln->ln_flags = RTN_LCTRIE_F_DIRECT;
+    return (TRUE);
+}
+
+/*
+ * rtn_lctrie_branch
+ *
+ * Return the bits a node takes at pos for a run of leaf entries: as
+ * many as the fill factor allows, and at least one.
+ */
+static u_int8_t
+rtn_lctrie_branch (rtn_lcbuild_t *lb, u_int32_t first, u_int32_t count,
+                   u_int16_t pos)
+{
+    u_int32_t i, patterns, pattern, last;
+    u_int16_t minlen = 0xffff;
+    u_int8_t branch;
+
+    for (i = first; i < first + count; i++) {
+        minlen = MIN(minlen, lb->lb_entries[i].le_len);
+    }
+
+    for (branch = 1; (branch < RTN_LCTRIE_BRANCH_MAX) &&
+                     (pos + branch + 1 <= minlen); branch++) {
+        /*
+         * The entries are in the key order, so are their patterns.
+         */
+        patterns = 0;
+        last = RTN_LCTRIE_NONE;
+        for (i = first; i < first + count; i++) {
+            pattern = rtn_lctrie_bits(rtn_lctrie_key(lb, i), pos, branch + 1);
+            if (pattern != last) {
+                patterns++;
+                last = pattern;
+            }
+        }
+        if (patterns < lb->lb_fill * (1U << (branch + 1))) {
+            break;
+        }
+    }
+
+    return (branch);
+}
+
+/*
+ * rtn_lctrie_nodes
+ *
+ * Build the nodes over the leaf entries, breadth first.
+ */
+static int8_t
+rtn_lctrie_nodes (rtn_lcbuild_t *lb)
+{
+    rtn_lcwork_t *lw, *child;
+    rtn_lcnode_t *ln;
+    u_int32_t head, tail, i, next, pattern, children, end;
+    u_int16_t pos;
+    u_int8_t branch;
+
+    if (rtn_lctrie_node_alloc(lb, 1) == RTN_LCTRIE_NONE) {
+        return (FALSE);
+    }
+
+    /*
+     * An empty tree: a direct leaf with no info.
+     */
+    if (!lb->lb_leaf_count) {
+        if (!rtn_lctrie_grow((void **) &lb->lb_direct, &lb->lb_direct_size,
+                             0, sizeof(rtn_lcdirect_t))) {
+            return (FALSE);
+        }
+        memset(&lb->lb_direct[0], 0, sizeof(rtn_lcdirect_t));
+        lb->lb_direct_count = 1;
+        lb->lb_nodes[0].ln_flags = RTN_LCTRIE_F_DIRECT;
+        return (TRUE);
+    }
+
+    if (!rtn_lctrie_grow((void **) &lb->lb_work, &lb->lb_work_size, 0,
+                         sizeof(rtn_lcwork_t))) {
+        return (FALSE);
+    }
+    lw = &lb->lb_work[0];
+    lw->lw_node = 0;
+    lw->lw_first = 0;
+    lw->lw_count = lb->lb_leaf_count;
+    lw->lw_pos = 0;
+    lw->lw_depth = 1;
+    lw->lw_skipped = FALSE;
+
+    for (head = 0, tail = 1; head < tail; head++) {
+        lw = &lb->lb_work[head];
+        ln = &lb->lb_nodes[lw->lw_node];
+        lb->lb_depth = MAX(lb->lb_depth, lw->lw_depth);
+
+        if (lw->lw_count == 1) {
+            ln->ln_adr = lw->lw_first;
+            continue;
+        }
+
+        /*
+         * Skip the bits the run shares: the first and the last entries
+         * differ before the end of either.
+         */
+        end = lw->lw_first + lw->lw_count - 1;
+        pos = rtn_key_diff(rtn_lctrie_key(lb, lw->lw_first),
+                           rtn_lctrie_key(lb, end),
+                           MIN(lb->lb_entries[lw->lw_first].le_len,
+                               lb->lb_entries[end].le_len));
+        branch = rtn_lctrie_branch(lb, lw->lw_first, lw->lw_count, pos);
+
+        children = rtn_lctrie_node_alloc(lb, 1U << branch);
+        if (children == RTN_LCTRIE_NONE) {
+            return (FALSE);
+        }
+        lw = &lb->lb_work[head];
+        ln = &lb->lb_nodes[lw->lw_node];
+        ln->ln_adr = children;
+        ln->ln_pos = pos;
+        ln->ln_branch = branch;
+
+        /*
+         * A child per pattern, for the run of entries with it.
+         */
+        for (pattern = 0, i = lw->lw_first; pattern < (1U << branch);
+             pattern++) {
+            for (next = i; (next <= end) &&
+                 (rtn_lctrie_bits(rtn_lctrie_key(lb, next), pos, branch) ==
+                  pattern); next++) {
+                ;
+            }
+
+            if (next == i) {
+                if (!rtn_lctrie_direct(lb, &lb->lb_nodes[children + pattern],
+                                       lw->lw_first, pos, pattern, branch,
+                                       lw->lw_skipped || (pos > lw->lw_pos))) {
+                    return (FALSE);
+                }
+                continue;
+            }
+
+            if (!rtn_lctrie_grow((void **) &lb->lb_work, &lb->lb_work_size,
+                                 tail, sizeof(rtn_lcwork_t))) {
+                return (FALSE);
+            }
+            lw = &lb->lb_work[head];
+            child = &lb->lb_work[tail++];
+            child->lw_node = children + pattern;
+            child->lw_first = i;
+            child->lw_count = next - i;
+            child->lw_pos = pos + branch;
+            child->lw_depth = lw->lw_depth + 1;
+            child->lw_skipped = lw->lw_skipped || (pos > lw->lw_pos);
+            i = next;
+        }
+    }
+
+    return (TRUE);
+}
+
+/*
+ * rtn_lctrie_build
+ *
+ * Compile a view into one block.
+ */
+static rtn_lctrie_t *
+rtn_lctrie_build (rtn_view_t *view, double fill)
+{
+    rtn_lcbuild_t lb;
+    rtn_lctrie_t *lt = NULL;
+    size_t nodes, entries, direct, size;
+    u_int8_t *block;
+
+    memset(&lb, 0, sizeof(lb));
+    lb.lb_view = view;
+    lb.lb_fill = fill;
+
+    if (rtn_view_walk(view, rtn_lctrie_collect, &lb) ||
+        !rtn_lctrie_entries(&lb)) {
+        goto done;
+    }
+
+    lb.lb_addr = malloc(RNBYTE(lb.lb_maxlen + 7) + 1);
+    if (!lb.lb_addr || !rtn_lctrie_nodes(&lb)) {
+        goto done;
+    }
+
+    /*
+     * The header, the nodes, the entries and the direct infos, each on
+     * a cache line of its own.
+     */
+    nodes = (sizeof(rtn_lctrie_t) + RTN_CACHE_LINE - 1) & ~(RTN_CACHE_LINE - 1);
+    entries = nodes + (((size_t) lb.lb_node_count * sizeof(rtn_lcnode_t) +
+                        RTN_CACHE_LINE - 1) & ~(RTN_CACHE_LINE - 1));
+    direct = entries + (((size_t) lb.lb_prefix_count * sizeof(rtn_lcentry_t) +
+                         RTN_CACHE_LINE - 1) & ~(RTN_CACHE_LINE - 1));
+    size = direct + (size_t) lb.lb_direct_count * sizeof(rtn_lcdirect_t);
+
+    if (posix_memalign((void **) &block, RTN_CACHE_LINE, size)) {
+        goto done;
+    }
+
+    lt = (rtn_lctrie_t *) block;
+    memset(lt, 0, sizeof(rtn_lctrie_t));
+    lt->lt_nodes = (rtn_lcnode_t *) (block + nodes);
+    lt->lt_entries = (rtn_lcentry_t *) (block + entries);
+    lt->lt_direct = (rtn_lcdirect_t *) (block + direct);
+    lt->lt_node_count = lb.lb_node_count;
+    lt->lt_entry_count = lb.lb_prefix_count;
+    lt->lt_direct_count = lb.lb_direct_count;
+    lt->lt_maxlen = lb.lb_maxlen;
+    lt->lt_depth = lb.lb_depth;
+    lt->lt_bytes = size;
+
+    memcpy(lt->lt_nodes, lb.lb_nodes,
+           (size_t) lb.lb_node_count * sizeof(rtn_lcnode_t));
+    memcpy(lt->lt_entries, lb.lb_entries,
+           (size_t) lb.lb_prefix_count * sizeof(rtn_lcentry_t));
+    if (lb.lb_direct_count) {
+        memcpy(lt->lt_direct, lb.lb_direct,
+               (size_t) lb.lb_direct_count * sizeof(rtn_lcdirect_t));
+    }
+
+done:
+    free(lb.lb_prefixes);
+    free(lb.lb_entries);
+    free(lb.lb_nodes);
+    free(lb.lb_direct);
+    free(lb.lb_work);
+    free(lb.lb_addr);
+
+    return (lt);
+}
+
+/*
+ * rtn_lctrie_compile_lc
+ *
+ * Compile a tree and publish the result. The count of changes is read
+ * before the view is taken: a change counted is in the view, and a
+ * change in the view that is not counted yet makes the result stale
+ * at once, which is safe.
+ */
+static int8_t
+rtn_lctrie_compile_lc (rtn_lc_t *lc)
+{
+    rtn_lctrie_t *lt, *old;
+    rtn_view_t *view;
+    u_int64_t changes, start;
+
+    pthread_mutex_lock(&lc->lc_compile_mutex);
+
+    start = rtn_lctrie_now_ns();
+    changes = __atomic_load_n(&lc->lc_changes, __ATOMIC_ACQUIRE);
+    view = rtn_view_take(lc->lc_head);
+    if (!view) {
+        pthread_mutex_unlock(&lc->lc_compile_mutex);
+        return (FALSE);
+    }
+
+    lt = rtn_lctrie_build(view, lc->lc_fill);
+    rtn_view_release(view);
+    if (!lt) {
+        pthread_mutex_unlock(&lc->lc_compile_mutex);
+        return (FALSE);
+    }
+    lt->lt_changes = changes;
+
+    old = lc->lc_current;
+    RTN_PUBLISH(lc->lc_current, lt);
+    lc->lc_compiles++;
+    lc->lc_compile_ns = rtn_lctrie_now_ns() - start;
+
+    if (old) {
+        rtn_rcu_quiesce();
+        free(old);
+    }
+
+    pthread_mutex_unlock(&lc->lc_compile_mutex);
+    return (TRUE);
+}
+
+/*
+ * rtn_lctrie_current
+ */
+static inline int8_t
+rtn_lctrie_current (rtn_lc_t *lc)
+{
+    rtn_lctrie_t *lt;
+
+    lt = RTN_DEREF(lc->lc_current);
+    return (lt && (lt->lt_changes ==
+                   __atomic_load_n(&lc->lc_changes, __ATOMIC_ACQUIRE)));
+}
+
+/*
+ * rtn_lctrie_thread
+ *
+ * Compile again once the changes have stopped for lc_quiet_ms.
+ */
+static void *
+rtn_lctrie_thread (void *arg)
+{
+    rtn_lc_t *lc = arg;
+    struct timespec ts;
+    u_int64_t quiet;
+
+    pthread_mutex_lock(&lc->lc_mutex);
+    while (!lc->lc_stop) {
+        if (rtn_lctrie_current(lc)) {
+            lc->lc_idle = TRUE;
+            pthread_cond_wait(&lc->lc_cond, &lc->lc_mutex);
+            lc->lc_idle = FALSE;
+            continue;
+        }
+
+        quiet = rtn_lctrie_now_ms() -
+            __atomic_load_n(&lc->lc_last_change, __ATOMIC_RELAXED);
+        if (quiet < lc->lc_quiet_ms) {
+            clock_gettime(CLOCK_REALTIME, &ts);
+            quiet = lc->lc_quiet_ms - quiet;
+            ts.tv_sec += quiet / 1000;
+            ts.tv_nsec += (quiet % 1000) * 1000000;
+            if (ts.tv_nsec >= 1000000000) {
+                ts.tv_sec++;
+                ts.tv_nsec -= 1000000000;
+            }
+            pthread_cond_timedwait(&lc->lc_cond, &lc->lc_mutex, &ts);
+            continue;
+        }
+
+        pthread_mutex_unlock(&lc->lc_mutex);
+        if (!rtn_lctrie_compile_lc(lc)) {
+            /*
+             * Out of memory: try again after another quiet time.
+             */
+            __atomic_store_n(&lc->lc_last_change, rtn_lctrie_now_ms(),
+                             __ATOMIC_RELAXED);
+        }
+        pthread_mutex_lock(&lc->lc_mutex);
+    }
+    pthread_mutex_unlock(&lc->lc_mutex);
+
+    return (NULL);
+}
+
+/*
+ * rtn_lctrie_init
+ */
+int8_t
+rtn_lctrie_init (rt_head_t *rt_head, double fill, u_int32_t quiet_ms)
+{
+    rtn_lc_t *lc;
+
+    if ((fill <= 0) || (fill > 1) || rt_head->rt_lctrie) {
+        return (FALSE);
+    }
+
+    if (!rt_head->rt_view) {
+        return (FALSE);
+    }
+
+    /*
+     * The thread takes its views alongside the changes.
+     */
+    if (quiet_ms && !rtn_view_keep(rt_head)) {
+        return (FALSE);
+    }
+
+    lc = calloc(1, sizeof(rtn_lc_t));
+    if (!lc) {
+        if (quiet_ms) {
+            rtn_view_unkeep(rt_head);
+        }
+        return (FALSE);
+    }
+    lc->lc_head = rt_head;
+    lc->lc_fill = fill;
+    lc->lc_quiet_ms = quiet_ms;
+    pthread_mutex_init(&lc->lc_mutex, NULL);
+    pthread_mutex_init(&lc->lc_compile_mutex, NULL);
+    pthread_cond_init(&lc->lc_cond, NULL);
+
+    if (!rtn_lctrie_compile_lc(lc) ||
+        (quiet_ms && pthread_create(&lc->lc_thread, NULL, rtn_lctrie_thread,
+                                    lc))) {
+        free(lc->lc_current);
+        pthread_cond_destroy(&lc->lc_cond);
+        pthread_mutex_destroy(&lc->lc_compile_mutex);
+        pthread_mutex_destroy(&lc->lc_mutex);
+        free(lc);
+        if (quiet_ms) {
+            rtn_view_unkeep(rt_head);
+        }
+        return (FALSE);
+    }
+
+    rt_head->rt_lctrie = lc;
+    return (TRUE);
+}
+
+/*
+ * rtn_lctrie_free
+ */
+void
+rtn_lctrie_free (rt_head_t *rt_head)
+{
+    rtn_lc_t *lc = rt_head->rt_lctrie;
+
+    if (!lc) {
+        return;
+    }
+    rt_head->rt_lctrie = NULL;
+
+    if (lc->lc_quiet_ms) {
+        pthread_mutex_lock(&lc->lc_mutex);
+        lc->lc_stop = TRUE;
+        pthread_cond_signal(&lc->lc_cond);
+        pthread_mutex_unlock(&lc->lc_mutex);
+        pthread_join(lc->lc_thread, NULL);
+        rtn_view_unkeep(rt_head);
+    }
+
+    rtn_rcu_quiesce();
+    free(lc->lc_current);
+    pthread_cond_destroy(&lc->lc_cond);
+    pthread_mutex_destroy(&lc->lc_compile_mutex);
+    pthread_mutex_destroy(&lc->lc_mutex);
+    free(lc);
+}
+
+/*
+ * rtn_lctrie_compile
+ */
+int8_t
+rtn_lctrie_compile (rt_head_t *rt_head)
+{
+    return (rt_head->rt_lctrie ? rtn_lctrie_compile_lc(rt_head->rt_lctrie)
+                               : FALSE);
+}
+
+/*
+ * rtn_lctrie_lookup
+ */
+int8_t
+rtn_lctrie_lookup (rtn_lc_t *lc, u_int8_t *addr, u_int16_t maxbitlen,
+                   rt_info_t **rinfo)
+{
+    rtn_lctrie_t *lt;
+    rtn_lcnode_t *ln;
+    rtn_lcdirect_t *ld;
+    rtn_lcentry_t *le;
+    u_int32_t adr;
+    u_int16_t dbit;
+
+    if (rtn_rcu_read_lock()) {
+        return (FALSE);
+    }
+
+    lt = RTN_DEREF(lc->lc_current);
+    if (!lt || (maxbitlen < lt->lt_maxlen) ||
+        (lt->lt_changes != __atomic_load_n(&lc->lc_changes,
+                                           __ATOMIC_ACQUIRE))) {
+        rtn_rcu_read_unlock();
+        return (FALSE);
+    }
+
+    for (ln = lt->lt_nodes; ln->ln_branch;) {
+        ln = &lt->lt_nodes[ln->ln_adr + rtn_lctrie_bits(addr, ln->ln_pos,
+                                                         ln->ln_branch)];
+    }
+
+    /*
+     * On a miss, the covering prefixes up to the first different bit
+     * match.
+     */
+    if (ln->ln_flags & RTN_LCTRIE_F_DIRECT) {
+        ld = &lt->lt_direct[ln->ln_adr];
+        if (!ld->ld_len ||
+            (rtn_key_diff(addr, lt->lt_entries[ld->ld_entry].le_info->rninfo_key,
+                          ld->ld_len) == ld->ld_len)) {
+            *rinfo = ld->ld_info;
+            rtn_rcu_read_unlock();
+            return (TRUE);
+        }
+        adr = ld->ld_entry;
+        le = &lt->lt_entries[adr];
+        dbit = rtn_key_diff(addr, le->le_info->rninfo_key, ld->ld_len);
+    } else {
+        adr = ln->ln_adr;
+        le = &lt->lt_entries[adr];
+        dbit = rtn_key_diff(addr, le->le_info->rninfo_key, le->le_len);
+    }
+
+    for (; (adr != RTN_LCTRIE_NONE) &&
+         (lt->lt_entries[adr].le_len > dbit); adr = lt->lt_entries[adr].le_pre) {
+        ;
+    }
+    *rinfo = (adr != RTN_LCTRIE_NONE) ? lt->lt_entries[adr].le_info : NULL;
+
+    rtn_rcu_read_unlock();
+    return (TRUE);
+}
+
+/*
+ * rtn_lctrie_changed
+ */
+void
+rtn_lctrie_changed (rtn_lc_t *lc)
+{
+    __atomic_store_n(&lc->lc_last_change, rtn_lctrie_now_ms(),
+                     __ATOMIC_RELAXED);
+    __atomic_add_fetch(&lc->lc_changes, 1, __ATOMIC_RELEASE);
+
+    if (lc->lc_quiet_ms) {
+        pthread_mutex_lock(&lc->lc_mutex);
+        if (lc->lc_idle) {
+            pthread_cond_signal(&lc->lc_cond);
+        }
+        pthread_mutex_unlock(&lc->lc_mutex);
+    }
+}
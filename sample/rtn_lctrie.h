@@ -0,0 +1,188 @@
+/**
+ *  @name rtn_lctrie.h, Compiled level compressed tries for radix trees
+ *
+ *  API for rtn_lctrie.c.
+ *
+ *  For a table that changes a few times a day and is looked up all the
+ *  time, rtn_lctrie_init() lets rtn_lookup() go through a compiled form
+ *  of the tree: a level and path compressed trie (LC-trie, Nilsson and
+ *  Karlsson) held in one contiguous block. A lookup takes one node per
+ *  level, several bits at a time, one key compare at the leaf, and no
+ *  backtrack over nodes.
+ *
+ *  The compiled form is immutable. It is built from a view of the tree
+ *  (rtn_view.h), so the tree can be changed while it is built, and it
+ *  is published with a single pointer store. rtn_lookup() uses it only
+ *  while it is current, i.e., when no rtn_add() or rtn_delete() has been
+ *  done since the view was taken, and uses the tree otherwise.
+ *
+ *  So the tree must allow views: rtn_view_init() is called first, by
+ *  the owner of the tree. The cost of the views is then part of the
+ *  compiled mode: without a quiet time, each compile builds the trie of
+ *  the views from the tree, and the changes in between pay nothing for
+ *  it; with one, the thread takes its views at any time, so the trie is
+ *  kept up to date (rtn_view_keep()), and each change of the tree pays
+ *  for it.
+ *
+ *  With a quiet time, a thread of the tree compiles it again once the
+ *  changes have stopped for that long, so a burst of changes costs one
+ *  compile. Without, rtn_lctrie_compile() is called by the owner of the
+ *  tree when it sees fit.
+ *
+ *  A replaced compiled form is freed once the readers that could hold it
+ *  are gone (rtn_rcu_quiesce()): rtn_lookup() reads it inside a read
+ *  section of rtn_epoch.h, which the caller can open itself around many
+ *  lookups to make each of them cheaper.
+ *
+ *     Copyright (c) 2016 Ericsson AB.
+ *
+ *     All rights reserved.
+ */
+
+#ifndef __RTN_LCTRIE_H__
+#define __RTN_LCTRIE_H__
+
+#include <pthread.h>
+#include "corelibs/rtn_radix.h"
+
+#define RTN_LCTRIE_BRANCH_MAX   16     /* max. bits taken by a node */
+#define RTN_LCTRIE_NONE         0xffffffff
+
+/*
+ * A node. An internal node takes ln_branch bits of the key at ln_pos,
+ * and its children are the 2^ln_branch nodes at ln_adr. A leaf is the
+ * entry at ln_adr, or with RTN_LCTRIE_F_DIRECT, the slot at ln_adr in
+ * lt_direct.
+ */
+#define RTN_LCTRIE_F_DIRECT     0x01   /* leaf, no compare needed */
+
+typedef struct _rtn_lcnode_t
+{
+    u_int32_t   ln_adr;               /* first child, entry or direct */
+    u_int16_t   ln_pos;               /* first bit taken */
+    u_int8_t    ln_branch;            /* bits taken, 0 for a leaf */
+    u_int8_t    ln_flags;             /* RTN_LCTRIE_F_ flags */
+} rtn_lcnode_t;
+
+/*
+ * A prefix. The entries of the leaves (none of them covers another
+ * one) come first, in the key order, then the prefixes that cover
+ * others. le_pre is the longest prefix that covers this one.
+ */
+typedef struct _rtn_lcentry_t
+{
+    rt_info_t   *le_info;             /* the info */
+    u_int32_t   le_pre;               /* entry, or RTN_LCTRIE_NONE */
+    u_int16_t   le_len;               /* bit length */
+    u_int16_t   pad;
+} rtn_lcentry_t;
+
+/*
+ * A slot that no entry ends in. Its best match is known, once the bits
+ * skipped above it are checked: ld_len bits of the key of ld_entry.
+ */
+typedef struct _rtn_lcdirect_t
+{
+    rt_info_t   *ld_info;             /* best match, could be NULL */
+    u_int32_t   ld_entry;             /* entry for the check */
+    u_int16_t   ld_len;               /* bits to check, 0 for none */
+    u_int16_t   pad;
+} rtn_lcdirect_t;
+
+/*
+ * A compiled form, in one block.
+ */
+typedef struct _rtn_lctrie_t
+{
+    rtn_lcnode_t  *lt_nodes;          /* lt_nodes[0] is the root */
+    rtn_lcentry_t *lt_entries;        /* leaves, then covering prefixes */
+    rtn_lcdirect_t *lt_direct;        /* empty slots */
+    u_int64_t     lt_changes;         /* lc_changes when taken */
+    u_int32_t     lt_node_count;      /* nodes */
+    u_int32_t     lt_entry_count;     /* entries */
+    u_int32_t     lt_direct_count;    /* empty slots */
+    u_int16_t     lt_maxlen;          /* longest prefix */
+    u_int16_t     lt_depth;           /* most nodes on a path */
+    u_int64_t     lt_bytes;           /* size of the block */
+} rtn_lctrie_t;
+
+/*
+ * The compiled mode of a tree.
+ */
+typedef struct _rtn_lc_t
+{
+    rtn_lctrie_t  *lc_current;        /* published, could be NULL */
+    u_int64_t     lc_changes;         /* count of changes to the tree */
+    u_int64_t     lc_last_change;     /* time of the last change, ms */
+    double        lc_fill;            /* fill factor, (0, 1] */
+    u_int32_t     lc_quiet_ms;        /* 0 for no thread */
+
+    pthread_mutex_t lc_mutex;         /* lc_idle, lc_stop */
+    pthread_cond_t  lc_cond;          /* for the thread */
+    pthread_t     lc_thread;
+    u_int8_t      lc_idle;            /* thread waits for a change */
+    u_int8_t      lc_stop;            /* thread to exit */
+    u_int8_t      pad[2];
+    pthread_mutex_t lc_compile_mutex; /* one compile at a time */
+    rt_head_t     *lc_head;           /* the tree */
+
+    u_int64_t     lc_compiles;        /* count of compiles */
+    u_int64_t     lc_compile_ns;      /* time of the last compile */
+} rtn_lc_t;
+
+
+/**
+ * Start the compiled mode of a tree, and compile it a first time.
+ *
+ * @param rt_head   head structure. Must not be NULL.
+ * @param fill      fill factor: a node takes b bits when at least
+ *                  fill * 2^b of its slots hold something. 1.0 makes
+ *                  the smallest form, 0.5 one with fewer levels.
+ * @param quiet_ms  compile again in a thread of the tree once the
+ *                  changes have stopped for that long, or 0 for no
+ *                  thread.
+ *
+ * @return
+ *     TRUE: succeed; FALSE: no rtn_view_init() on the tree, or out of
+ *     memory.
+ */
+extern int8_t rtn_lctrie_init(rt_head_t *rt_head, double fill,
+                              u_int32_t quiet_ms);
+
+/**
+ * Stop the compiled mode of a tree, and free the compiled form. Called
+ * by rtn_root_free(). Not from a read section.
+ */
+extern void rtn_lctrie_free(rt_head_t *rt_head);
+
+/**
+ * Compile the current content of a tree, and publish it. Called by the
+ * owner of the tree, not from a read section.
+ *
+ * @return
+ *     TRUE: succeed; FALSE: out of memory, the previous form is kept.
+ */
+extern int8_t rtn_lctrie_compile(rt_head_t *rt_head);
+
+/**
+ * Best match through the compiled form, as rtn_lookup().
+ *
+ * @param lc         compiled mode of the tree.
+ * @param addr       address in the network byte order.
+ * @param maxbitlen  the max. bit length allowed.
+ * @param rinfo      set to the info found, could be NULL.
+ *
+ * @return
+ *     TRUE when answered; FALSE when the compiled form is not current,
+ *     or is not for maxbitlen (shorter than the longest prefix), and
+ *     the tree must be used.
+ */
+extern int8_t rtn_lctrie_lookup(rtn_lc_t *lc, u_int8_t *addr,
+                                u_int16_t maxbitlen, rt_info_t **rinfo);
+
+/*
+ * Update hook, called by rtn_radix.c after a change of the tree.
+ */
+extern void rtn_lctrie_changed(rtn_lc_t *lc);
+
+#endif  /* __RTN_LCTRIE_H__ */
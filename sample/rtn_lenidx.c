@@ -0,0 +1,594 @@
+/***
+ *   rtn_lenidx.c
+ *
+ *   Prefix length index of the radix trie.
+ *
+ *    Copyright (c) 2016 Ericsson AB.
+ *    All rights reserved.
+ *
+ ***
+ * Description:
+ *
+ * li_lists[len] holds the infos of bit length len, packed, in the order
+ * they were added and moved around by the deletes. li_hash maps an info
+ * to its length and index, with linear probing, at most half full; a
+ * remove shifts the following slots back instead of leaving a tomb, so
+ * a lookup stops at the first free slot. A delete moves the last info
+ * of the list into the hole, and updates its slot.
+ *
+ * The serial walk goes down each list from the end. An info deleted by
+ * the walk function is replaced by the last one of its list, which has
+ * been walked already, so every info is still walked once.
+ *
+ * A parallel walk cuts each list into chunks of RTN_LENIDX_CHUNK infos.
+ * The workers take the chunks from a shared counter, and find the list
+ * of a chunk from the first chunk of each list.
+ *
+ ***/
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <sys/types.h>
+#include <pthread.h>
+
+#include "corelibs/rtn_radix.h"
+#include "corelibs/rtn_lenidx.h"
+#include "corelibs/rtn_pwalk.h"
+#include "corelibs/rtn_snapshot.h"
+#include "rtn_private.h"
+
+#define RTN_LENIDX_LIST_MIN     16     /* initial room of a list */
+
+typedef struct _rtn_lenwalk_t
+{
+    rtn_lenidx_t *lw_li;
+    rtn_walk_func lw_fi;
+    u_int32_t   *lw_first;            /* first chunk of each length */
+    u_int32_t   lw_min;               /* first length */
+    u_int32_t   lw_lens;              /* lengths walked */
+    u_int32_t   lw_chunks;            /* number of chunks */
+    u_int32_t   lw_next;              /* next chunk to take */
+    u_int8_t    lw_abort;             /* a walk function aborted */
+    u_int8_t    pad[7];
+    va_list     lw_ap;                /* arguments of fi */
+} rtn_lenwalk_t;
+
+/*
+ * rtn_lenidx_hash
+ */
+static inline u_int32_t
+rtn_lenidx_hash (rtn_lenidx_t *li, rt_info_t *rinfo)
+{
+    u_int64_t hash;
+
+    hash = ((uintptr_t) rinfo >> 4) * 0x9e3779b97f4a7c15ULL;
+    return ((u_int32_t) (hash >> 32) & li->li_hash_mask);
+}
+
+/*
+ * rtn_lenidx_find
+ *
+ * Return the slot of an info, or NULL.
+ */
+static rtn_lenslot_t *
+rtn_lenidx_find (rtn_lenidx_t *li, rt_info_t *rinfo)
+{
+    u_int32_t i;
+
+    for (i = rtn_lenidx_hash(li, rinfo); li->li_hash[i].ls_info;
+         i = (i + 1) & li->li_hash_mask) {
+        if (li->li_hash[i].ls_info == rinfo) {
+            return (&li->li_hash[i]);
+        }
+    }
+
+    return (NULL);
+}
+
+/*
+ * rtn_lenidx_place
+ *
+ * Put an info in a free slot of li_hash, which has room.
+ */
+static void
+rtn_lenidx_place (rtn_lenidx_t *li, rt_info_t *rinfo, u_int16_t len,
+                  u_int32_t index)
+{
+    u_int32_t i;
+
+    for (i = rtn_lenidx_hash(li, rinfo); li->li_hash[i].ls_info;
+         i = (i + 1) & li->li_hash_mask) {
+        ;
+    }
+    li->li_hash[i].ls_info  = rinfo;
+    li->li_hash[i].ls_len   = len;
+    li->li_hash[i].ls_index = index;
+}
+
+/*
+ * rtn_lenidx_resize
+ *
+ * Give li_hash a new number of slots, a power of 2, and put the infos
+ * back in it.
+ */
+static int8_t
+rtn_lenidx_resize (rtn_lenidx_t *li, u_int32_t slots)
+{
+    rtn_lenslot_t *old;
+    u_int32_t old_slots, i;
+
+    old = li->li_hash;
+    old_slots = old ? li->li_hash_mask + 1 : 0;
+
+    li->li_hash = calloc(slots, sizeof(rtn_lenslot_t));
+    if (!li->li_hash) {
+        li->li_hash = old;
+        return (FALSE);
+    }
+    li->li_hash_mask = slots - 1;
+
+    for (i = 0; i < old_slots; i++) {
+        if (old[i].ls_info) {
+            rtn_lenidx_place(li, old[i].ls_info, old[i].ls_len,
+                             old[i].ls_index);
+        }
+    }
+    free(old);
+
+    return (TRUE);
+}
+
+/*
+ * rtn_lenidx_remove
+ *
+ * Free the slot of an info, and shift back the slots after it that
+ * would no longer be found.
+ */
+static void
+rtn_lenidx_remove (rtn_lenidx_t *li, rtn_lenslot_t *ls)
+{
+    u_int32_t hole, i, home;
+
+    hole = ls - li->li_hash;
+    for (i = (hole + 1) & li->li_hash_mask; li->li_hash[i].ls_info;
+         i = (i + 1) & li->li_hash_mask) {
+        home = rtn_lenidx_hash(li, li->li_hash[i].ls_info);
+
+        /*
+         * Leave the slot where it is when its home is after the hole,
+         * i.e., in (hole, i], going around the end.
+         */
+        if ((hole < i) ? ((home > hole) && (home <= i)) :
+                         ((home > hole) || (home <= i))) {
+            continue;
+        }
+        li->li_hash[hole] = li->li_hash[i];
+        hole = i;
+    }
+    li->li_hash[hole].ls_info = NULL;
+}
+
+/*
+ * rtn_lenidx_drop
+ *
+ * Empty the index, after it ran out of memory. It is built again by the
+ * next walk.
+ */
+static void
+rtn_lenidx_drop (rtn_lenidx_t *li)
+{
+    u_int32_t len;
+
+    for (len = 0; len < li->li_list_count; len++) {
+        free(li->li_lists[len].ll_infos);
+    }
+    free(li->li_lists);
+    free(li->li_hash);
+
+    li->li_lists      = NULL;
+    li->li_list_count = 0;
+    li->li_count      = 0;
+    li->li_hash       = NULL;
+    li->li_hash_mask  = 0;
+    li->li_valid      = FALSE;
+}
+
+/*
+ * rtn_lenidx_insert
+ *
+ * Add an info to its list and to li_hash. Nothing is changed when out
+ * of memory.
+ */
+static int8_t
+rtn_lenidx_insert (rtn_lenidx_t *li, rt_info_t *rinfo)
+{
+    rtn_lenlist_t *lists, *ll;
+    rt_info_t **infos;
+    u_int32_t count, size;
+    u_int16_t len;
+
+    len = rinfo->rnode_bit;
+
+    if (len >= li->li_list_count) {
+        count = MAX((u_int32_t) len + 1, li->li_list_count * 2);
+        lists = realloc(li->li_lists, count * sizeof(rtn_lenlist_t));
+        if (!lists) {
+            return (FALSE);
+        }
+        memset(&lists[li->li_list_count], 0,
+               (count - li->li_list_count) * sizeof(rtn_lenlist_t));
+        li->li_lists = lists;
+        li->li_list_count = count;
+    }
+
+    ll = &li->li_lists[len];
+    if (ll->ll_count == ll->ll_size) {
+        size = ll->ll_size ? ll->ll_size * 2 : RTN_LENIDX_LIST_MIN;
+        infos = realloc(ll->ll_infos, (size_t) size * sizeof(rt_info_t *));
+        if (!infos) {
+            return (FALSE);
+        }
+        ll->ll_infos = infos;
+        ll->ll_size = size;
+    }
+
+    if (((li->li_count + 1) * 2 > li->li_hash_mask + 1) &&
+        !rtn_lenidx_resize(li, (li->li_hash_mask + 1) * 2)) {
+        return (FALSE);
+    }
+
+    rtn_lenidx_place(li, rinfo, len, ll->ll_count);
+    ll->ll_infos[ll->ll_count++] = rinfo;
+    li->li_count++;
+
+    return (TRUE);
+}
+
+/*
+ * rtn_lenidx_build
+ *
+ * Fill an empty index with the infos of the tree.
+ */
+static int8_t
+rtn_lenidx_build (rtn_lenidx_t *li)
+{
+    rt_node_t *rn;
+    u_int32_t slots = RTN_LENIDX_HASH_MIN;
+
+    while (slots < li->li_head->ri_count * 2) {
+        slots *= 2;
+    }
+    if (!rtn_lenidx_resize(li, slots)) {
+        return (FALSE);
+    }
+
+    for (rn = li->li_head->root; rn; rn = rtn_walk_next_node(NULL, rn)) {
+        if ((rn->rnode_flags & RNODE_INFO) &&
+            !rtn_lenidx_insert(li, (rt_info_t *) rn)) {
+            rtn_lenidx_drop(li);
+            return (FALSE);
+        }
+    }
+
+    li->li_valid = TRUE;
+    return (TRUE);
+}
+
+/*
+ * rtn_lenidx_ready
+ *
+ * Check that the index of a tree can be walked, and build it again if
+ * it was dropped.
+ */
+static rtn_lenidx_t *
+rtn_lenidx_ready (rt_head_t *rt_head)
+{
+    rtn_lenidx_t *li = rt_head->rt_lenidx;
+
+    if (!li || (!li->li_valid && !rtn_lenidx_build(li))) {
+        return (NULL);
+    }
+
+    return (li);
+}
+
+/*
+ * rtn_lenidx_init
+ */
+int8_t
+rtn_lenidx_init (rt_head_t *rt_head)
+{
+    rtn_lenidx_t *li;
+
+    if (rt_head->rt_lenidx) {
+        return (TRUE);
+    }
+
+    if (rt_head->rt_snapshot && !rtn_snapshot_promote(rt_head, NULL)) {
+        return (FALSE);
+    }
+
+    li = calloc(1, sizeof(rtn_lenidx_t));
+    if (!li) {
+        return (FALSE);
+    }
+    li->li_head = rt_head;
+
+    if (!rtn_lenidx_build(li)) {
+        free(li);
+        return (FALSE);
+    }
+
+    rt_head->rt_lenidx = li;
+    return (TRUE);
+}
+
+/*
+ * rtn_lenidx_free
+ */
+void
+rtn_lenidx_free (rt_head_t *rt_head)
+{
+    rtn_lenidx_t *li = rt_head->rt_lenidx;
+
+    if (!li) {
+        return;
+    }
+
+    rt_head->rt_lenidx = NULL;
+    rtn_lenidx_drop(li);
+    free(li);
+}
+
+/*
+ * rtn_lenidx_count
+ */
+int64_t
+rtn_lenidx_count (rt_head_t *rt_head, u_int16_t bitlen)
+{
+    rtn_lenidx_t *li = rt_head->rt_lenidx;
+
+    if (!li || !li->li_valid) {
+        return (-1);
+    }
+
+    return ((bitlen < li->li_list_count) ?
+            li->li_lists[bitlen].ll_count : 0);
+}
+
+/*
+ * rtn_lenidx_add
+ */
+void
+rtn_lenidx_add (rtn_lenidx_t *li, rt_info_t *rinfo)
+{
+    if (li->li_valid && !rtn_lenidx_insert(li, rinfo)) {
+        rtn_lenidx_drop(li);
+    }
+}
+
+/*
+ * rtn_lenidx_delete
+ */
+void
+rtn_lenidx_delete (rtn_lenidx_t *li, rt_info_t *rinfo)
+{
+    rtn_lenlist_t *ll;
+    rtn_lenslot_t *ls;
+    rt_info_t *last;
+    u_int32_t index;
+
+    if (!li->li_valid) {
+        return;
+    }
+
+    ls = rtn_lenidx_find(li, rinfo);
+    if (!ls) {
+        return;
+    }
+    ll = &li->li_lists[ls->ls_len];
+    index = ls->ls_index;
+    rtn_lenidx_remove(li, ls);
+    li->li_count--;
+
+    last = ll->ll_infos[--ll->ll_count];
+    if (index < ll->ll_count) {
+        ll->ll_infos[index] = last;
+        rtn_lenidx_find(li, last)->ls_index = index;
+    }
+}
+
+/*
+ * rtn_walktree_keybits_indexed
+ */
+int8_t
+rtn_walktree_keybits_indexed (rt_head_t *rt_head, rtn_walk_func fi,
+                              u_int32_t min_keybits, u_int32_t max_keybits,
+                              ...)
+{
+    rtn_lenidx_t *li;
+    rtn_lenlist_t *ll;
+    u_int32_t len, i;
+    int errnum = RTWALK_CONTINUE;
+    va_list args, ap;
+
+    va_start(args, max_keybits);
+
+    li = rtn_lenidx_ready(rt_head);
+    if (!li) {
+        errnum = rtn_walktree_keybits_ap(NULL, fi, rt_head, min_keybits,
+                                         max_keybits, 0, FALSE, args);
+        va_end(args);
+        return (errnum);
+    }
+
+    max_keybits = MIN(max_keybits, li->li_list_count - 1);
+    for (len = min_keybits; (len <= max_keybits) && li->li_list_count &&
+         (errnum != RTWALK_ABORT); len++) {
+        ll = &li->li_lists[len];
+        for (i = ll->ll_count; i > 0; i--) {
+
+            /*
+             * The walk function could have deleted the info.
+             */
+            i = MIN(i, ll->ll_count);
+            if (!i) {
+                break;
+            }
+
+            va_copy(ap, args);
+            errnum = (*fi)(ll->ll_infos[i - 1], ap);
+            va_end(ap);
+
+            if (errnum == RTWALK_ABORT) {
+                break;
+            }
+        }
+    }
+
+    va_end(args);
+    return (errnum);
+}
+
+/*
+ * rtn_lenwalk_chunk
+ *
+ * Walk a chunk.
+ */
+static void
+rtn_lenwalk_chunk (rtn_lenwalk_t *lw, u_int32_t chunk)
+{
+    rtn_lenlist_t *ll;
+    u_int32_t len, i, end;
+    va_list ap;
+
+    for (len = 0; lw->lw_first[len + 1] <= chunk; len++) {
+        ;
+    }
+    ll = &lw->lw_li->li_lists[lw->lw_min + len];
+    i = (chunk - lw->lw_first[len]) * RTN_LENIDX_CHUNK;
+    end = MIN(i + RTN_LENIDX_CHUNK, ll->ll_count);
+
+    for (; i < end; i++) {
+        if (__atomic_load_n(&lw->lw_abort, __ATOMIC_RELAXED)) {
+            break;
+        }
+
+        va_copy(ap, lw->lw_ap);
+        if ((*lw->lw_fi)(ll->ll_infos[i], ap) == RTWALK_ABORT) {
+            __atomic_store_n(&lw->lw_abort, TRUE, __ATOMIC_RELAXED);
+        }
+        va_end(ap);
+    }
+}
+
+/*
+ * rtn_lenwalk_worker
+ *
+ * Take and walk the chunks until there is none left.
+ */
+static void *
+rtn_lenwalk_worker (void *arg)
+{
+    rtn_lenwalk_t *lw = arg;
+    u_int32_t chunk;
+
+    while (((chunk = __atomic_fetch_add(&lw->lw_next, 1, __ATOMIC_RELAXED)) <
+            lw->lw_chunks) && !__atomic_load_n(&lw->lw_abort,
+                                               __ATOMIC_RELAXED)) {
+        rtn_lenwalk_chunk(lw, chunk);
+    }
+
+    return (NULL);
+}
+
+/*
+ * rtn_lenwalk_run
+ *
+ * Cut the lists into chunks, and walk them.
+ */
+static int8_t
+rtn_lenwalk_run (rtn_lenwalk_t *lw, u_int32_t threads)
+{
+    pthread_t workers[RTN_PWALK_THREADS_MAX];
+    rtn_lenlist_t *ll;
+    u_int32_t started = 0, len, i;
+
+    lw->lw_first = malloc((lw->lw_lens + 1) * sizeof(u_int32_t));
+    if (!lw->lw_first) {
+        return (RTWALK_ABORT);
+    }
+    for (len = 0; len < lw->lw_lens; len++) {
+        ll = &lw->lw_li->li_lists[lw->lw_min + len];
+        lw->lw_first[len] = lw->lw_chunks;
+        lw->lw_chunks += (ll->ll_count + RTN_LENIDX_CHUNK - 1) /
+                         RTN_LENIDX_CHUNK;
+    }
+    lw->lw_first[lw->lw_lens] = lw->lw_chunks;
+
+    if (threads > RTN_PWALK_THREADS_MAX) {
+        threads = RTN_PWALK_THREADS_MAX;
+    }
+    if (threads > lw->lw_chunks) {
+        threads = lw->lw_chunks;
+    }
+
+    if (threads > 1) {
+        for (i = 0; i < threads; i++) {
+            if (pthread_create(&workers[started], NULL, rtn_lenwalk_worker,
+                               lw)) {
+                break;
+            }
+            started++;
+        }
+        for (i = 0; i < started; i++) {
+            pthread_join(workers[i], NULL);
+        }
+    }
+
+    /*
+     * Walk in the calling thread when no worker could be started.
+     */
+    if (!started) {
+        rtn_lenwalk_worker(lw);
+    }
+
+    free(lw->lw_first);
+
+    return (lw->lw_abort ? RTWALK_ABORT : RTWALK_CONTINUE);
+}
+
+/*
+ * rtn_walktree_keybits_parallel
+ */
+int8_t
+rtn_walktree_keybits_parallel (rt_head_t *rt_head, rtn_walk_func fi,
+                               u_int32_t min_keybits, u_int32_t max_keybits,
+                               u_int32_t threads, ...)
+{
+    rtn_lenwalk_t lw;
+    int8_t errnum = RTWALK_CONTINUE;
+
+    memset(&lw, 0, sizeof(lw));
+    va_start(lw.lw_ap, threads);
+
+    lw.lw_li = rtn_lenidx_ready(rt_head);
+    if (!lw.lw_li) {
+        errnum = rtn_walktree_keybits_ap(NULL, fi, rt_head, min_keybits,
+                                         max_keybits, 0, FALSE, lw.lw_ap);
+        va_end(lw.lw_ap);
+        return (errnum);
+    }
+
+    max_keybits = MIN(max_keybits, lw.lw_li->li_list_count - 1);
+    if (lw.lw_li->li_list_count && (min_keybits <= max_keybits)) {
+        lw.lw_fi   = fi;
+        lw.lw_min  = min_keybits;
+        lw.lw_lens = max_keybits - min_keybits + 1;
+        errnum = rtn_lenwalk_run(&lw, threads);
+    }
+
+    va_end(lw.lw_ap);
+    return (errnum);
+}
@@ -0,0 +1,150 @@
+/**
+ *  @name rtn_lenidx.h, Prefix length index of radix trees
+ *
+ *  API for rtn_lenidx.c.
+ *
+ *  rtn_walktree_keybits() has to go down every branch of the tree that
+ *  could hold a prefix in the range, so asking for the /32 routes only,
+ *  or the /8 to /16 aggregates only, still costs most of a full walk.
+ *  Once rtn_lenidx_init() is called, a tree keeps the infos of each
+ *  bit length in an array of their own, updated by rtn_add() and
+ *  rtn_delete(), and rtn_walktree_keybits_indexed() visits the infos
+ *  in the range and nothing else. rtn_walktree_keybits_parallel()
+ *  splits them into chunks, walked on a pool of worker threads.
+ *
+ *  The index is kept next to the tree, so the infos are left as they
+ *  are: an add costs an append and a hash insert, and a delete a swap
+ *  with the last info of its length and a hash remove.
+ *
+ *  The infos are walked in no particular order. Neither walk locks the
+ *  nodes or yields. During rtn_walktree_keybits_indexed(), the walk
+ *  function may delete the info it is given, and must not change the
+ *  tree otherwise. During rtn_walktree_keybits_parallel(), the tree must
+ *  not be changed at all, and the walk function must be safe to call
+ *  from several threads, as in rtn_pwalk.h.
+ *
+ *  When the index runs out of memory, it is dropped, and built again
+ *  by the next indexed walk. If it still can not be built, the walk
+ *  falls back to rtn_walktree_keybits().
+ *
+ *     Copyright (c) 2016 Ericsson AB.
+ *
+ *     All rights reserved.
+ */
+
+#ifndef __RTN_LENIDX_H__
+#define __RTN_LENIDX_H__
+
+#include "corelibs/rtn_radix.h"
+
+#define RTN_LENIDX_CHUNK        4096   /* infos per chunk of a parallel walk */
+#define RTN_LENIDX_HASH_MIN     256    /* initial slots of li_hash */
+
+/*
+ * The infos of one bit length.
+ */
+typedef struct _rtn_lenlist_t
+{
+    rt_info_t   **ll_infos;           /* the infos, in no order */
+    u_int32_t   ll_count;             /* infos in ll_infos */
+    u_int32_t   ll_size;              /* room in ll_infos */
+} rtn_lenlist_t;
+
+/*
+ * Where an info is in the lists, in li_hash. A slot with no info is
+ * free.
+ */
+typedef struct _rtn_lenslot_t
+{
+    rt_info_t   *ls_info;             /* the info, or NULL */
+    u_int32_t   ls_index;             /* in ll_infos */
+    u_int16_t   ls_len;               /* bit length, the list */
+    u_int16_t   pad;
+} rtn_lenslot_t;
+
+/*
+ * The index of a tree.
+ */
+typedef struct _rtn_lenidx_t
+{
+    rtn_lenlist_t *li_lists;          /* by bit length */
+    u_int32_t   li_list_count;        /* lengths in li_lists */
+    u_int32_t   li_count;             /* infos in all the lists */
+    rtn_lenslot_t *li_hash;           /* info to list and index */
+    u_int32_t   li_hash_mask;         /* slots in li_hash, minus 1 */
+    u_int8_t    li_valid;             /* FALSE once dropped */
+    u_int8_t    pad[3];
+    rt_head_t   *li_head;             /* the tree */
+} rtn_lenidx_t;
+
+
+/**
+ * Start the prefix length index of a tree, and fill it with the infos
+ * already in it. A mapped snapshot is promoted first.
+ *
+ * @param rt_head   head structure. Must not be NULL.
+ *
+ * @return
+ *     TRUE: succeed; FALSE: out of memory.
+ */
+extern int8_t rtn_lenidx_init(rt_head_t *rt_head);
+
+/**
+ * Stop the index of a tree, and free it. Called by rtn_root_free().
+ */
+extern void rtn_lenidx_free(rt_head_t *rt_head);
+
+/**
+ * Return the number of infos of a bit length, from the index, or -1
+ * when the tree has no valid index.
+ */
+extern int64_t rtn_lenidx_count(rt_head_t *rt_head, u_int16_t bitlen);
+
+/**
+ * Walk the infos with a bit length in [min_keybits, max_keybits],
+ * through the index, in the calling thread.
+ *
+ * @param rt_head      head structure. Must not be NULL.
+ * @param fi           walk function to process an radix info.
+ * @param min_keybits  min. bit length (inclusive).
+ * @param max_keybits  max. bit length (inclusive).
+ * @param ...          arguments passed to fi.
+ *
+ * @return
+ *      0: walk successful.
+ *     -1: walk aborted.
+ */
+extern int8_t rtn_walktree_keybits_indexed(rt_head_t *rt_head,
+                                           rtn_walk_func fi,
+                                           u_int32_t min_keybits,
+                                           u_int32_t max_keybits, ...);
+
+/**
+ * Walk the infos with a bit length in [min_keybits, max_keybits],
+ * through the index, on worker threads.
+ *
+ * @param rt_head      head structure. Must not be NULL.
+ * @param fi           walk function to process an radix info.
+ * @param min_keybits  min. bit length (inclusive).
+ * @param max_keybits  max. bit length (inclusive).
+ * @param threads      number of worker threads. With 0 or 1, the walk
+ *                     is done by the calling thread.
+ * @param ...          arguments passed to fi.
+ *
+ * @return
+ *      0: walk successful.
+ *     -1: walk aborted.
+ */
+extern int8_t rtn_walktree_keybits_parallel(rt_head_t *rt_head,
+                                            rtn_walk_func fi,
+                                            u_int32_t min_keybits,
+                                            u_int32_t max_keybits,
+                                            u_int32_t threads, ...);
+
+/*
+ * Update hooks, called by rtn_radix.c.
+ */
+extern void rtn_lenidx_add(rtn_lenidx_t *li, rt_info_t *rinfo);
+extern void rtn_lenidx_delete(rtn_lenidx_t *li, rt_info_t *rinfo);
+
+#endif  /* __RTN_LENIDX_H__ */
@@ -11,6 +11,7 @@
 #ifndef __RTN_PRIVATE_H__
 #define __RTN_PRIVATE_H__
 
+#include <string.h>
 
 #ifndef     TRUE
 #define     TRUE           (1 == 1)
@@ -24,6 +25,10 @@
 #define     MIN(a, b)     (((a) > (b)) ? (b) : (a))
 #endif
 
+#ifndef MAX
+#define     MAX(a, b)     (((a) > (b)) ? (a) : (b))
+#endif
+
 /*
  * XXX Assumes NBBY is 8.  If it isn't we're in trouble anyway.
  */
@@ -32,7 +37,14 @@
 #define	RNBIT(x)     (0x80 >> ((x) & (RNBBY-1)))
 #define	RNBYTE(x)    ((x) >> RNSHIFT)
 
-#define RNODE_CHUNK_ELEM   1000
+#define RTN_CACHE_LINE     64
+
+/*
+ * Link a fully initialized node into a tree, and load a link, so that
+ * lock-free readers (RTN_BIT_RCU) never see a partially built node.
+ */
+#define RTN_PUBLISH(ptr, val)   __atomic_store_n(&(ptr), (val), __ATOMIC_RELEASE)
+#define RTN_DEREF(ptr)          __atomic_load_n(&(ptr), __ATOMIC_ACQUIRE)
 
 /* Return the bit position of the msb */
 static const u_char first_bit_set[256] = {
@@ -60,6 +72,287 @@ static const u_char first_bit_set[256] = {
 };
 
 
+/*
+ * Load a key word in the network byte order, so that the first bit of
+ * the key is the msb of the word.
+ */
+static inline u_int64_t
+rtn_key_load64 (const u_int8_t *key)
+{
+    u_int64_t word;
+
+    memcpy(&word, key, sizeof(word));
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    word = __builtin_bswap64(word);
+#endif
+    return (word);
+}
+
+static inline u_int32_t
+rtn_key_load32 (const u_int8_t *key)
+{
+    u_int32_t word;
+
+    memcpy(&word, key, sizeof(word));
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    word = __builtin_bswap32(word);
+#endif
+    return (word);
+}
+
+/*
+ * Versions of rtn_key_diff(), in rtn_key.c. All of them return the
+ * first bit that differs between two keys, or bitlen when the first
+ * bitlen bits are the same, and read no byte past the bitlen.
+ */
+typedef u_int16_t (*rtn_key_diff_func)(u_int8_t *key1, u_int8_t *key2,
+                                       u_int16_t bitlen);
+
+extern u_int16_t rtn_key_diff_table(u_int8_t *key1, u_int8_t *key2,
+                                    u_int16_t bitlen);
+extern u_int16_t rtn_key_diff_word(u_int8_t *key1, u_int8_t *key2,
+                                   u_int16_t bitlen);
+#if defined(__x86_64__) || defined(__i386__)
+extern u_int16_t rtn_key_diff_sse2(u_int8_t *key1, u_int8_t *key2,
+                                   u_int16_t bitlen);
+extern u_int16_t rtn_key_diff_avx2(u_int8_t *key1, u_int8_t *key2,
+                                   u_int16_t bitlen);
+#endif
+
+/*
+ * The best version for the CPU, for keys longer than RTN_KEY_WORD_BITS.
+ */
+#define RTN_KEY_WORD_BITS  128
+extern rtn_key_diff_func rtn_key_diff_long;
+
+/*
+ * rtn_key_diff_short
+ *
+ * rtn_key_diff() for keys of up to RTN_KEY_WORD_BITS, inline.
+ */
+static inline u_int16_t
+rtn_key_diff_short (u_int8_t *key1, u_int8_t *key2, u_int16_t bitlen)
+{
+    u_int64_t diff64;
+    u_int32_t diff32;
+    u_int16_t dbit = 0;
+    u_int8_t diff;
+
+    for (; dbit + 64 <= bitlen; dbit += 64) {
+        diff64 = rtn_key_load64(key1 + (dbit >> RNSHIFT)) ^
+                 rtn_key_load64(key2 + (dbit >> RNSHIFT));
+        if (diff64) {
+            return (dbit + __builtin_clzll(diff64));
+        }
+    }
+    if (dbit + 32 <= bitlen) {
+        diff32 = rtn_key_load32(key1 + (dbit >> RNSHIFT)) ^
+                 rtn_key_load32(key2 + (dbit >> RNSHIFT));
+        if (diff32) {
+            return (dbit + __builtin_clz(diff32));
+        }
+        dbit += 32;
+    }
+    for (; dbit < bitlen; dbit += RNBBY) {
+        diff = key1[dbit >> RNSHIFT] ^ key2[dbit >> RNSHIFT];
+        if (diff) {
+            dbit += first_bit_set[diff];
+            break;
+        }
+    }
+
+    return (MIN(dbit, bitlen));
+}
+
+/*
+ * rtn_key_diff
+ *
+ * Return the first bit that differs between two keys, or bitlen when
+ * the first bitlen bits are the same.
+ */
+static inline u_int16_t
+rtn_key_diff (u_int8_t *key1, u_int8_t *key2, u_int16_t bitlen)
+{
+    if (bitlen <= RTN_KEY_WORD_BITS) {
+        return (rtn_key_diff_short(key1, key2, bitlen));
+    }
+    return ((*rtn_key_diff_long)(key1, key2, bitlen));
+}
+
+/*
+ * rtn_key_cmp
+ *
+ * Compare the specified bits of two keys.
+ */
+static inline int8_t
+rtn_key_cmp (u_int8_t *key1, u_int8_t *key2, u_int16_t bitlen)
+{
+    u_int8_t bits, mask;
+    u_int16_t bytelen;
+
+    /*
+     * Short keys (IPv4, IPv6) are compared a word at a time.
+     */
+    if (bitlen <= RTN_KEY_WORD_BITS) {
+        return (rtn_key_diff_short(key1, key2, bitlen) == bitlen);
+    }
+
+    bits = bitlen & 0x7;
+    bytelen = bitlen >> 3;
+
+    if (bits) {
+        mask = 0xff << (8 - bits);
+        if ((key1[bytelen] ^ key2[bytelen]) & mask)
+            return (FALSE);
+    }
+
+    if (bytelen && memcmp(key1, key2, bytelen))
+        return (FALSE);
+
+    return (TRUE);
+}
+
+/*
+ * Move the generation of a tree forward, after a change that could
+ * change the result of a lookup (see rtn_flowcache.h). The values come
+ * from one counter for all the trees, so that a tree freed and then
+ * initialized again never reuses one.
+ */
+extern u_int64_t rtn_generation;
+
+static inline void
+rtn_generation_bump (rt_head_t *rt_head)
+{
+    __atomic_store_n(&rt_head->rt_generation,
+                     __atomic_add_fetch(&rtn_generation, 1, __ATOMIC_RELAXED),
+                     __ATOMIC_RELEASE);
+}
+
+/*
+ * rtn_bulk_load() with no promotion of the snapshot, for the promotion
+ * itself, in rtn_radix.c.
+ */
+extern u_int32_t rtn_bulk_load_live(rt_head_t *rt_head,
+                                    rtn_bulk_entry_t *entries,
+                                    u_int32_t count);
+
+/*
+ * rtn_walktree_keybits() with a va_list, in rtn_radix.c.
+ */
+extern int8_t rtn_walktree_keybits_ap(rt_node_t *start_node, rtn_walk_func fi,
+                                      rt_head_t *rt_head,
+                                      u_int32_t min_keybits,
+                                      u_int32_t max_keybits,
+                                      u_int32_t limit_ms, int8_t blocking,
+                                      va_list args);
+
+/*
+ * Instrumentation (see rtn_stats.h). Without RTN_STATS, the macros are
+ * empty, and RTN_STATS_ONLY() drops the code kept for the counts.
+ */
+#ifdef RTN_STATS
+#include <time.h>
+#include "corelibs/rtn_stats.h"
+
+extern __thread rtn_stats_t *rtn_stats_self;
+extern rtn_stats_t *rtn_stats_attach(void);
+
+/*
+ * rtn_stats_get
+ *
+ * Return the block of this thread, or NULL when out of memory.
+ */
+static inline rtn_stats_t *
+rtn_stats_get (void)
+{
+    rtn_stats_t *st = rtn_stats_self;
+
+    if (__builtin_expect(!st, 0)) {
+        st = rtn_stats_attach();
+    }
+    return (st);
+}
+
+/*
+ * The counts are only written by the owner thread, but they are stored
+ * atomically so that rtn_stats_collect() can read them at any time.
+ */
+#define RTN_STATS_BUMP(field, n)                                         \
+    __atomic_store_n(&(field), (field) + (n), __ATOMIC_RELAXED)
+
+static inline void
+rtn_stats_add (rtn_stat_t counter, u_int64_t n)
+{
+    rtn_stats_t *st = rtn_stats_get();
+
+    if (st) {
+        RTN_STATS_BUMP(st->st_counters[counter], n);
+    }
+}
+
+static inline void
+rtn_stats_record (rtn_hist_id_t id, u_int64_t value)
+{
+    rtn_stats_t *st = rtn_stats_get();
+    rtn_hist_t *hist;
+
+    if (st) {
+        hist = &st->st_hists[id];
+        RTN_STATS_BUMP(hist->h_buckets[rtn_hist_bucket(value)], 1);
+        RTN_STATS_BUMP(hist->h_count, 1);
+        RTN_STATS_BUMP(hist->h_sum, value);
+        if (value > hist->h_max) {
+            __atomic_store_n(&hist->h_max, value, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+/*
+ * rtn_stats_now
+ *
+ * Monotonic time in ns.
+ */
+static inline u_int64_t
+rtn_stats_now (void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((u_int64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+}
+
+#define RTN_STATS_ONLY(code)          code
+#define RTN_STATS_ADD(counter, n)     rtn_stats_add((counter), (n))
+#define RTN_STATS_RECORD(id, value)   rtn_stats_record((id), (value))
+#else
+#define RTN_STATS_ONLY(code)
+#define RTN_STATS_ADD(counter, n)     do { } while (0)
+#define RTN_STATS_RECORD(id, value)   do { } while (0)
+#endif  /* RTN_STATS */
+
+/*
+ * Number of lookups in flight in a batched lookup.
+ */
+#define RTN_BATCH_GROUP    16
+
+/*
+ * Number of trees gathered for rtn_lookup_interleave() by
+ * rtn_lookup_multi().
+ */
+#define RTN_MULTI_GROUP    64
+
+/*
+ * State of a lookup in flight in a batched lookup.
+ */
+typedef struct _rtn_batch_state_t
+{
+    rt_head_t    *rt_head;
+    u_int8_t     *addr;
+    rt_node_t    *rn;
+    u_int32_t    idx;
+    u_int32_t    pad;
+} rtn_batch_state_t;
+
 /*
  * Subtree info used during subtree walk.
  */
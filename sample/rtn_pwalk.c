@@ -0,0 +1,421 @@
+/***
+ *   rtn_pwalk.c
+ *
+ *   Parallel walks of the radix trie.
+ *
+ *    Copyright (c) 2016 Ericsson AB.
+ *    All rights reserved.
+ *
+ ***
+ * Description:
+ *
+ * The walk is done in two steps:
+ *
+ *   o The calling thread walks the top of the tree in pre-order, down
+ *     to the first node of each branch with a bit number no less than
+ *     the split depth (or without any child). Each such node is the
+ *     root of a shard. An info met above the split depth is a shard of
+ *     its own, so the shards come out in lexical order.
+ *
+ *   o The workers take the shards in order from a shared counter, and
+ *     walk each of them as rtn_walk_subtree() does, bounded by the
+ *     shard root.
+ *
+ * For a version walk, a node whose rnode_version is not newer than the
+ * min. version is pruned at both steps, as in rtn_walktree_version().
+ *
+ * With a merge function, a worker marks each shard done, and the
+ * calling thread waits for the shards in order and merges them. Once a
+ * walk function aborts, the shards left are marked done without being
+ * walked, so the calling thread never waits for a shard that will not
+ * complete.
+ *
+ ***/
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <sys/types.h>
+#include <pthread.h>
+
+#include "corelibs/rtn_radix.h"
+#include "corelibs/rtn_pwalk.h"
+#include "rtn_private.h"
+
+typedef struct _rtn_pwalk_shard_t
+{
+    rt_node_t   *ps_root;             /* subtree root, or a single info */
+    u_int8_t    ps_single;            /* the info only, not its subtree */
+    u_int8_t    ps_done;              /* walked, or skipped on abort */
+    u_int8_t    pad[6];               /* for alignment */
+} rtn_pwalk_shard_t;
+
+typedef struct _rtn_pwalk_t
+{
+    rt_head_t   *pw_head;
+    rtn_walk_func pw_fi;
+    rtn_walk_merge_func pw_fm;
+    rtn_pwalk_shard_t *pw_shards;
+    u_int32_t   pw_count;             /* number of shards */
+    u_int32_t   pw_next;              /* next shard to take */
+    u_int32_t   pw_min_version;
+    u_int32_t   pw_max_version;
+    u_int8_t    pw_version;           /* version walk */
+    u_int8_t    pw_abort;             /* a walk function aborted */
+    u_int8_t    pad[2];               /* for alignment */
+    pthread_mutex_t pw_mutex;         /* for the merge */
+    pthread_cond_t  pw_cond;          /* a shard is done */
+    va_list     pw_ap;                /* arguments of fi and fm */
+} rtn_pwalk_t;
+
+static __thread u_int32_t rtn_pwalk_shard_self;
+
+/*
+ * rtn_pwalk_prune
+ *
+ * Check if the subtree of a node has no entry newer than the min.
+ * version of a version walk.
+ */
+static inline int8_t
+rtn_pwalk_prune (rtn_pwalk_t *pw, rt_node_t *rn)
+{
+    return (pw->pw_version && (rn->rnode_version <= pw->pw_min_version));
+}
+
+/*
+ * rtn_pwalk_split
+ *
+ * Walk the top of the tree, and fill the shards. Only count them when
+ * shards is NULL. Return the number of shards.
+ */
+static u_int32_t
+rtn_pwalk_split (rtn_pwalk_t *pw, u_int16_t depth, rtn_pwalk_shard_t *shards)
+{
+    rt_node_t *rn;
+    u_int32_t count = 0;
+
+    rn = pw->pw_head->root;
+    while (rn) {
+        if (rtn_pwalk_prune(pw, rn)) {
+            rn = rtn_walk_ascend(NULL, rn);
+            continue;
+        }
+
+        if ((rn->rnode_bit >= depth) ||
+            (!rn->rnode_left && !rn->rnode_right)) {
+            if (shards) {
+                shards[count].ps_root = rn;
+                shards[count].ps_single = FALSE;
+            }
+            count++;
+            rn = rtn_walk_ascend(NULL, rn);
+            continue;
+        }
+
+        if (rn->rnode_flags & RNODE_INFO) {
+            if (shards) {
+                shards[count].ps_root = rn;
+                shards[count].ps_single = TRUE;
+            }
+            count++;
+        }
+        rn = rtn_walk_next_node(NULL, rn);
+    }
+
+    return (count);
+}
+
+/*
+ * rtn_pwalk_call
+ *
+ * Call the walk function for an info, with a copy of the arguments.
+ */
+static inline int
+rtn_pwalk_call (rtn_pwalk_t *pw, rt_info_t *ri)
+{
+    va_list ap;
+    int errnum;
+
+    va_copy(ap, pw->pw_ap);
+    errnum = (*pw->pw_fi)(ri, ap);
+    va_end(ap);
+
+    return (errnum);
+}
+
+/*
+ * rtn_pwalk_shard
+ *
+ * Walk a shard.
+ */
+static void
+rtn_pwalk_shard (rtn_pwalk_t *pw, rtn_pwalk_shard_t *ps)
+{
+    rt_node_t *st_root, *rn, *node;
+    rt_info_t *ri;
+
+    st_root = ps->ps_root;
+    for (rn = st_root; rn; rn = node) {
+
+        if (__atomic_load_n(&pw->pw_abort, __ATOMIC_RELAXED)) {
+            break;
+        }
+
+        if (rtn_pwalk_prune(pw, rn)) {
+            node = rtn_walk_ascend(st_root, rn);
+            continue;
+        }
+
+        node = ps->ps_single ? NULL : rtn_walk_next_node(st_root, rn);
+
+        /*
+         * Skip the internal node, and the info outside the versions.
+         */
+        if (!(rn->rnode_flags & RNODE_INFO)) {
+            continue;
+        }
+        ri = (rt_info_t *) rn;
+        if (pw->pw_version &&
+            ((ri->version <= pw->pw_min_version) ||
+             (!(pw->pw_head->flags & RTN_BIT_MULTI_INFO) &&
+              (ri->version > pw->pw_max_version)))) {
+            continue;
+        }
+
+        if (rtn_pwalk_call(pw, ri) == RTWALK_ABORT) {
+            __atomic_store_n(&pw->pw_abort, TRUE, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+/*
+ * rtn_pwalk_worker
+ *
+ * Take and walk the shards until there is none left.
+ */
+static void *
+rtn_pwalk_worker (void *arg)
+{
+    rtn_pwalk_t *pw = arg;
+    rtn_pwalk_shard_t *ps;
+    u_int32_t shard;
+
+    while ((shard = __atomic_fetch_add(&pw->pw_next, 1, __ATOMIC_RELAXED)) <
+           pw->pw_count) {
+        ps = &pw->pw_shards[shard];
+        if (!__atomic_load_n(&pw->pw_abort, __ATOMIC_RELAXED)) {
+            rtn_pwalk_shard_self = shard;
+            rtn_pwalk_shard(pw, ps);
+        }
+
+        if (pw->pw_fm) {
+            pthread_mutex_lock(&pw->pw_mutex);
+            ps->ps_done = TRUE;
+            pthread_cond_broadcast(&pw->pw_cond);
+            pthread_mutex_unlock(&pw->pw_mutex);
+        }
+    }
+
+    return (NULL);
+}
+
+/*
+ * rtn_pwalk_merge
+ *
+ * Merge the shards in order, as they are done.
+ */
+static void
+rtn_pwalk_merge (rtn_pwalk_t *pw)
+{
+    u_int32_t shard;
+    va_list ap;
+    int errnum;
+
+    for (shard = 0; shard < pw->pw_count; shard++) {
+        pthread_mutex_lock(&pw->pw_mutex);
+        while (!pw->pw_shards[shard].ps_done) {
+            pthread_cond_wait(&pw->pw_cond, &pw->pw_mutex);
+        }
+        pthread_mutex_unlock(&pw->pw_mutex);
+
+        if (__atomic_load_n(&pw->pw_abort, __ATOMIC_RELAXED)) {
+            break;
+        }
+
+        va_copy(ap, pw->pw_ap);
+        errnum = (*pw->pw_fm)(shard, ap);
+        va_end(ap);
+
+        if (errnum == RTWALK_ABORT) {
+            __atomic_store_n(&pw->pw_abort, TRUE, __ATOMIC_RELAXED);
+            break;
+        }
+    }
+}
+
+/*
+ * rtn_pwalk_run
+ *
+ * Split the tree, and walk the shards.
+ */
+static int8_t
+rtn_pwalk_run (rtn_pwalk_t *pw, u_int16_t depth, u_int32_t threads)
+{
+    pthread_t workers[RTN_PWALK_THREADS_MAX];
+    u_int32_t shard, started = 0, i;
+
+    pw->pw_count = rtn_pwalk_split(pw, depth, NULL);
+    if (pw->pw_count == 0) {
+        return (RTWALK_CONTINUE);
+    }
+
+    pw->pw_shards = calloc(pw->pw_count, sizeof(rtn_pwalk_shard_t));
+    if (!pw->pw_shards) {
+        return (RTWALK_ABORT);
+    }
+    rtn_pwalk_split(pw, depth, pw->pw_shards);
+
+    if (threads > RTN_PWALK_THREADS_MAX) {
+        threads = RTN_PWALK_THREADS_MAX;
+    }
+    if (threads > pw->pw_count) {
+        threads = pw->pw_count;
+    }
+
+    if (threads > 1) {
+        pthread_mutex_init(&pw->pw_mutex, NULL);
+        pthread_cond_init(&pw->pw_cond, NULL);
+
+        for (i = 0; i < threads; i++) {
+            if (pthread_create(&workers[started], NULL, rtn_pwalk_worker, pw)) {
+                break;
+            }
+            started++;
+        }
+
+        /*
+         * The workers take all the shards, even if not all of them
+         * could be started, unless none could.
+         */
+        if (started) {
+            if (pw->pw_fm) {
+                rtn_pwalk_merge(pw);
+            }
+            for (i = 0; i < started; i++) {
+                pthread_join(workers[i], NULL);
+            }
+        }
+
+        pthread_cond_destroy(&pw->pw_cond);
+        pthread_mutex_destroy(&pw->pw_mutex);
+    }
+
+    /*
+     * Walk in the calling thread, and merge each shard right away.
+     */
+    if (!started) {
+        for (shard = 0; (shard < pw->pw_count) && !pw->pw_abort; shard++) {
+            rtn_pwalk_shard_self = shard;
+            rtn_pwalk_shard(pw, &pw->pw_shards[shard]);
+
+            if (pw->pw_fm && !pw->pw_abort) {
+                va_list ap;
+
+                va_copy(ap, pw->pw_ap);
+                if ((*pw->pw_fm)(shard, ap) == RTWALK_ABORT) {
+                    pw->pw_abort = TRUE;
+                }
+                va_end(ap);
+            }
+        }
+    }
+
+    free(pw->pw_shards);
+
+    return (pw->pw_abort ? RTWALK_ABORT : RTWALK_CONTINUE);
+}
+
+/*
+ * rtn_walktree_shards
+ *
+ * Count the shards of a split.
+ */
+u_int32_t
+rtn_walktree_shards (rt_head_t *rt_head, u_int16_t depth)
+{
+    rtn_pwalk_t pw;
+
+    memset(&pw, 0, sizeof(pw));
+    pw.pw_head = rt_head;
+
+    return (rtn_pwalk_split(&pw, depth, NULL));
+}
+
+/*
+ * rtn_walk_shard
+ *
+ * Return the shard of the calling worker.
+ */
+u_int32_t
+rtn_walk_shard (void)
+{
+    return (rtn_pwalk_shard_self);
+}
+
+/*
+ * rtn_walktree_parallel
+ *
+ * Perform a parallel walk.
+ */
+int8_t
+rtn_walktree_parallel (rt_head_t *rt_head, rtn_walk_func fi,
+                       rtn_walk_merge_func fm, u_int16_t depth,
+                       u_int32_t threads, ...)
+{
+    rtn_pwalk_t pw;
+    int8_t errnum;
+
+    rt_head->rtn_walktree_count++;
+
+    memset(&pw, 0, sizeof(pw));
+    pw.pw_head = rt_head;
+    pw.pw_fi   = fi;
+    pw.pw_fm   = fm;
+
+    va_start(pw.pw_ap, threads);
+    errnum = rtn_pwalk_run(&pw, depth, threads);
+    va_end(pw.pw_ap);
+
+    return (errnum);
+}
+
+/*
+ * rtn_walktree_version_parallel
+ *
+ * Perform a parallel version walk.
+ */
+int8_t
+rtn_walktree_version_parallel (rt_head_t *rt_head, rtn_walk_func fi,
+                               rtn_walk_merge_func fm, u_int16_t depth,
+                               u_int32_t threads, u_int32_t min_version,
+                               u_int32_t max_version, ...)
+{
+    rtn_pwalk_t pw;
+    int8_t errnum;
+
+    rt_head->rtn_walktree_version_count++;
+
+    memset(&pw, 0, sizeof(pw));
+    pw.pw_head        = rt_head;
+    pw.pw_fi          = fi;
+    pw.pw_fm          = fm;
+    pw.pw_version     = TRUE;
+    pw.pw_min_version = min_version;
+    pw.pw_max_version = max_version;
+
+    va_start(pw.pw_ap, max_version);
+    errnum = rtn_pwalk_run(&pw, depth, threads);
+    va_end(pw.pw_ap);
+
+    return (errnum);
+}
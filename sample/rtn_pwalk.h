@@ -0,0 +1,106 @@
+/**
+ *  @name rtn_pwalk.h, Parallel walks of radix trees
+ *
+ *  API for rtn_pwalk.c.
+ *
+ *  A parallel walk splits a tree at a bit depth into shards, and walks
+ *  the shards on a pool of worker threads. A shard is either the
+ *  subtree of a node at the split depth, walked as rtn_walk_subtree()
+ *  does, or a single info above the split depth. The shards are
+ *  numbered in lexical order, so the results that the walk function
+ *  keeps per shard (see rtn_walk_shard()) can be merged back in the
+ *  order of rtn_walktree() by a merge function, which is called by the
+ *  calling thread for each shard in turn as soon as it is done.
+ *
+ *  Unlike the other walks, a parallel walk does not lock the nodes and
+ *  does not yield: the tree must not be updated until the walk returns,
+ *  and the walk function must be safe to call from several threads.
+ *
+ *     Copyright (c) 2016 Ericsson AB.
+ *
+ *     All rights reserved.
+ */
+
+#ifndef __RTN_PWALK_H__
+#define __RTN_PWALK_H__
+
+#include "corelibs/rtn_radix.h"
+
+/*
+ * Max. number of worker threads of a walk.
+ */
+#define RTN_PWALK_THREADS_MAX   64
+
+/**
+ * Merge function, called for each shard in lexical order once the
+ * shard has been walked.
+ *
+ * @return
+ *     RTWALK_ABORT    - run into error, or need to abort.
+ *     RTWALK_CONTINUE - no error and continue to next shard.
+ */
+typedef int (*rtn_walk_merge_func)(u_int32_t shard, va_list ap);
+
+/**
+ * Return the number of shards of a tree split at a bit depth.
+ *
+ * @param rt_head  head structure. Must not be NULL.
+ * @param depth    bit depth of the split.
+ */
+extern u_int32_t rtn_walktree_shards(rt_head_t *rt_head, u_int16_t depth);
+
+/**
+ * Return the shard being walked by the calling thread. Only valid in a
+ * walk function called by rtn_walktree_parallel() or
+ * rtn_walktree_version_parallel().
+ */
+extern u_int32_t rtn_walk_shard(void);
+
+/**
+ * Parallel walk of a tree.
+ *
+ * @param rt_head  head structure. Must not be NULL.
+ * @param fi       walk function to process an radix info.
+ * @param fm       merge function, or NULL when the order does not
+ *                 matter.
+ * @param depth    bit depth of the split, e.g. 8 for up to 256 subtrees.
+ * @param threads  number of worker threads. With 0 or 1, the walk is
+ *                 done by the calling thread.
+ * @param ...      arguments passed to fi and fm.
+ *
+ * @return
+ *      0: walk successful.
+ *     -1: walk aborted.
+ */
+extern int8_t rtn_walktree_parallel(rt_head_t *rt_head, rtn_walk_func fi,
+                                    rtn_walk_merge_func fm, u_int16_t depth,
+                                    u_int32_t threads, ...);
+
+/**
+ * Parallel version walk. Process entries with version number greater
+ * than min_version and no greater than max_version, as
+ * rtn_walktree_version() does. The subtrees without any newer version
+ * are pruned, both in the split and in each shard.
+ *
+ * @param rt_head      head structure. Must not be NULL.
+ * @param fi           walk function to process an radix info.
+ * @param fm           merge function, or NULL.
+ * @param depth        bit depth of the split.
+ * @param threads      number of worker threads.
+ * @param min_version  minimal version number (exclusive).
+ * @param max_version  maximum version number (inclusive).
+ * @param ...          arguments passed to fi and fm.
+ *
+ * @return
+ *      0: walk successful.
+ *     -1: walk aborted.
+ */
+extern int8_t rtn_walktree_version_parallel(rt_head_t *rt_head,
+                                            rtn_walk_func fi,
+                                            rtn_walk_merge_func fm,
+                                            u_int16_t depth,
+                                            u_int32_t threads,
+                                            u_int32_t min_version,
+                                            u_int32_t max_version, ...);
+
+#endif  /* __RTN_PWALK_H__ */
@@ -42,8 +42,16 @@
 #include <pthread.h>
 #include "platform-os/pthread_np.h"
 
-#include "corelibs/chunk.h"
 #include "corelibs/rtn_radix.h"
+#include "corelibs/rtn_stride.h"
+#include "corelibs/rtn_epoch.h"
+#include "corelibs/rtn_snapshot.h"
+#include "corelibs/rtn_compact.h"
+#include "corelibs/rtn_changelog.h"
+#include "corelibs/rtn_view.h"
+#include "corelibs/rtn_lctrie.h"
+#include "corelibs/rtn_lenidx.h"
+#include "corelibs/rtn_stats.h"
 #include "rtn_private.h"
 
 /*
@@ -51,10 +59,26 @@
  */
 static struct timeval rtn_wc_tv = {0, 500000};        /* 1/2 second */
 
+u_int64_t rtn_generation;                 /* see rtn_generation_bump() */
+
 /*
- * chunk for radix node.
+ * The infos released by a rtn_delete_each() or rtn_purge_subtree() with
+ * RTN_PURGE_ASYNC, chained through their rnode_parent, to be freed by a
+ * thread of their own.
  */
-static chunk_header_t *rnode_chunk_header = NULL;
+typedef struct _rtn_purge_t
+{
+    rt_node_t     *pg_head;
+    rt_node_t     *pg_tail;
+    u_int32_t     pg_count;
+    u_int8_t      pg_keep;           /* RTN_BIT_KEEP_INFO */
+    u_int8_t      pad[3];
+    rt_info_free  pg_free;           /* ri_free of the tree */
+} rtn_purge_t;
+
+static pthread_mutex_t rtn_purge_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t rtn_purge_cond = PTHREAD_COND_INITIALIZER;
+static u_int32_t rtn_purge_pending;     /* threads not done */
 
 /*
  * rtn_node_alloc
@@ -66,7 +90,7 @@ rtn_node_alloc (rt_head_t *rt_head)
 {
     rt_node_t *node;
 
-    node = chunk_alloc(rnode_chunk_header, TRUE);
+    node = rtn_arena_alloc(&rt_head->rn_arena);
     if (node) {
         rt_head->rn_count++;
     }
@@ -75,63 +99,134 @@ rtn_node_alloc (rt_head_t *rt_head)
 }
 
 /*
- * rtn_node_free
+ * rtn_node_release
  *
- * Free a node (internal or external).
+ * Release the memory of a node (internal or external).
  */
 static inline void
-rtn_node_free (rt_head_t *rt_head, rt_node_t *rn)
+rtn_node_release (rt_head_t *rt_head, rt_node_t *rn)
 {
     if (rn->rnode_flags & RNODE_EXTERNAL) {
+        if (rt_head->rt_view &&
+            rtn_view_hold(rt_head->rt_view, (rt_info_t *) rn)) {
+            return;
+        }
+        if (rt_head->rt_purge) {
+            rn->rnode_parent = NULL;
+            if (rt_head->rt_purge->pg_tail) {
+                rt_head->rt_purge->pg_tail->rnode_parent = rn;
+            } else {
+                rt_head->rt_purge->pg_head = rn;
+            }
+            rt_head->rt_purge->pg_tail = rn;
+            rt_head->rt_purge->pg_count++;
+            return;
+        }
         if (rt_head->ri_free) {
             (*(rt_head->ri_free))((rt_info_t *)rn);
         } else if (!(rt_head->flags & RTN_BIT_KEEP_INFO)) {
             free(rn);
         }
-        rt_head->ri_count--;
     } else {
-        chunk_free(rnode_chunk_header, rn);
-        rt_head->rn_count--;
+        rtn_arena_free(&rt_head->rn_arena, rn);
     }
 }
 
 /*
- * rtn_key_nextbit
+ * rtn_node_retire
  *
- * Check the (N+1)'th bit of a specified key where N = 0, 1, ....
+ * Queue a node that is no longer in the tree until no lock-free reader
+ * can hold it. The node is stamped with the current epoch in its
+ * rnode_version, and chained through its rnode_parent. Neither is
+ * looked at by the readers.
+ */
+static void
+rtn_node_retire (rt_head_t *rt_head, rt_node_t *rn)
+{
+    rn->rnode_version = (u_int32_t) rtn_epoch_get();
+    rn->rnode_parent = NULL;
+
+    if (rt_head->rt_retire_tail) {
+        rt_head->rt_retire_tail->rnode_parent = rn;
+    } else {
+        rt_head->rt_retire_head = rn;
+    }
+    rt_head->rt_retire_tail = rn;
+
+    if (++rt_head->rt_retire_count >= RTN_RCU_RECLAIM_BATCH) {
+        rtn_rcu_reclaim(rt_head);
+    }
+}
+
+/*
+ * rtn_node_free
  *
- * For example, when N is zero, we test the first bit of the key.
+ * Free a node (internal or external).
  */
-static inline int8_t
-rtn_key_nextbit (u_int8_t *key, u_int16_t bitlen)
+static inline void
+rtn_node_free (rt_head_t *rt_head, rt_node_t *rn)
 {
-    return (key[RNBYTE(bitlen)] & RNBIT(bitlen));
+    if (rn->rnode_flags & RNODE_EXTERNAL) {
+        rt_head->ri_count--;
+    } else {
+        rt_head->rn_count--;
+    }
+
+    /*
+     * An info the caller keeps is its own once out of the tree: it is
+     * not chained on the retire list, which the caller could overwrite
+     * by adding it again.
+     */
+    if ((rt_head->flags & RTN_BIT_RCU) &&
+        (!(rn->rnode_flags & RNODE_EXTERNAL) || rt_head->ri_free ||
+         !(rt_head->flags & RTN_BIT_KEEP_INFO))) {
+        rtn_node_retire(rt_head, rn);
+    } else {
+        rtn_node_release(rt_head, rn);
+    }
 }
 
 /*
- * rtn_key_cmp
+ * rtn_rcu_reclaim
  *
- * Compare the specified bits of two keys.
+ * Free the retired nodes whose grace period has passed, i.e. the
+ * global epoch is at least two past their stamp.
  */
-static inline int8_t
-rtn_key_cmp (u_int8_t *key1, u_int8_t *key2, u_int16_t bitlen)
+u_int32_t
+rtn_rcu_reclaim (rt_head_t *rt_head)
 {
-    u_int8_t bits, mask;
-    u_int16_t bytelen;
+    rt_node_t *rn;
+    u_int32_t epoch;
 
-    bits = bitlen & 0x7;
-    bytelen = bitlen >> 3;
+    if (!rt_head->rt_retire_head) {
+        return (0);
+    }
 
-    if (bits) {
-        mask = 0xff << (8 - bits);
-        if ((key1[bytelen] ^ key2[bytelen]) & mask)
-            return (FALSE);
+    epoch = (u_int32_t) rtn_epoch_advance();
+    while ((rn = rt_head->rt_retire_head) &&
+           ((int32_t) (epoch - rn->rnode_version) >= 2)) {
+        rt_head->rt_retire_head = rn->rnode_parent;
+        if (!rt_head->rt_retire_head) {
+            rt_head->rt_retire_tail = NULL;
+        }
+        rt_head->rt_retire_count--;
+        rtn_node_release(rt_head, rn);
     }
 
-    if (bytelen && memcmp(key1, key2, bytelen))
-        return (FALSE);
+    return (rt_head->rt_retire_count);
+}
 
-    return (TRUE);
+/*
+ * rtn_key_nextbit
+ *
+ * Check the (N+1)'th bit of a specified key where N = 0, 1, ....
+ *
+ * For example, when N is zero, we test the first bit of the key.
+ */
+static inline int8_t
+rtn_key_nextbit (u_int8_t *key, u_int16_t bitlen)
+{
+    return (key[RNBYTE(bitlen)] & RNBIT(bitlen));
 }
 
 /*
@@ -154,17 +249,21 @@ rtn_root_init (rt_head_t *rt_head, u_int8_t flags, rt_info_free func)
     rt_head->ri_free = func;
     rt_head->flags   = flags;
 
-    if (!rnode_chunk_header) {
-        rnode_chunk_header = chunk_header_init(sizeof(rt_node_t),
-                                      RNODE_CHUNK_ELEM, CHUNK_FLAGS_LOCK,
-                                      "radix node");
-        if (!rnode_chunk_header) {
-            return (NULL);
-        }
-    }
+    rtn_arena_init(&rt_head->rn_arena, sizeof(rt_node_t),
+                   RTN_ARENA_F_ALIGN |
+                   ((flags & RTN_BIT_HUGEPAGE) ? RTN_ARENA_F_HUGEPAGE : 0));
 
     rn = rtn_node_alloc(rt_head);
     rt_head->root = rn;
+    rtn_generation_bump(rt_head);
+
+    if ((flags & RTN_BIT_COMPACT) && !(flags & RTN_BIT_RCU) &&
+        !rtn_compact_init(rt_head)) {
+        rtn_node_free(rt_head, rn);
+        rt_head->root = NULL;
+        return (NULL);
+    }
+
     return (rn);
 }
 
@@ -176,10 +275,33 @@ rtn_root_init (rt_head_t *rt_head, u_int8_t flags, rt_info_free func)
 void
 rtn_root_free (rt_head_t *rt_head)
 {
+    rtn_lctrie_free(rt_head);
+    rtn_lenidx_free(rt_head);
+
+    if (rt_head->rt_stride) {
+        rtn_stride_free(rt_head);
+    }
+
+    rtn_snapshot_unmap(rt_head);
+    rtn_compact_free(rt_head);
+    rtn_changelog_free(rt_head);
+
     if (rt_head->root) {
         rtn_node_free(rt_head, rt_head->root);
         rt_head->root = NULL;
     }
+
+    if (rt_head->flags & RTN_BIT_RCU) {
+        rtn_rcu_synchronize(rt_head);
+    }
+
+    rtn_view_free(rt_head);
+
+    /*
+     * Any internal node left goes away with the arena.
+     */
+    rtn_arena_destroy(&rt_head->rn_arena);
+    rt_head->rn_count = 0;
 }
 
 /*
@@ -203,6 +325,10 @@ rtn_search (rt_head_t *rt_head, char *addr, u_int16_t bitlen)
     rt_node_t *rn;
     int8_t dir_r;
 
+    if (rt_head->rt_snapshot) {
+        return (rtn_snapshot_search(rt_head, (u_int8_t *) addr, bitlen));
+    }
+
     /*
      * Search down the tree until we find a node which
      * has a bit number the same as ours.
@@ -294,6 +420,81 @@ rtn_lookup_node (rt_head_t *rt_head, char *addr, u_int16_t bitlen)
     return(rn_last);
 }
 
+/*
+ * rtn_lookup_backtrack
+ *
+ * Second half of a best match: given the node where the descent for
+ * an address stopped, backtrack to find the entry that matches the addr.
+ */
+static inline rt_info_t *
+rtn_lookup_backtrack (rt_head_t *rt_head, rt_node_t *rn, u_int8_t *addr,
+                      u_int16_t bitlen)
+{
+    void       *node_key;
+    RTN_STATS_ONLY(u_int32_t steps = 0;)
+
+    node_key = (rn->rnode_flags & RNODE_EXTERNAL) ?
+        ((rt_info_t *) rn)->rninfo_key : NULL;
+    /*
+     * We should never get here, but if we do, return NULL
+     */
+    if (!node_key) {
+        return (NULL);
+    }
+
+    /*
+     * Backtrack to find the node.
+     */
+    for (; rn != rt_head->root; rn = rn->rnode_parent) {
+        if ((rn->rnode_bit <= bitlen) &&
+            rtn_key_cmp(addr, node_key, rn->rnode_bit) &&
+            (rn->rnode_flags & RNODE_INFO)) {
+            break;
+        }
+        RTN_STATS_ONLY(steps++;)
+    }
+
+    RTN_STATS_ADD(RTN_STAT_LOOKUP_NODES, steps);
+    RTN_STATS_RECORD(RTN_HIST_LOOKUP_BACKTRACK, steps);
+    return (rtn_node2info(rn));
+}
+
+/*
+ * rtn_lookup_rcu
+ *
+ * Best match for lock-free readers. The parent pointers are not stable
+ * while the writer runs, so there is no backtrack: each info node on
+ * the way down is checked against its own key, which is the same as
+ * checking it against the key of the node where rtn_lookup() stops, as
+ * the keys below a node share its first rnode_bit bits.
+ */
+static rt_info_t *
+rtn_lookup_rcu (rt_head_t *rt_head, u_int8_t *addr, u_int16_t bitlen)
+{
+    rt_node_t  *rn, *best = NULL;
+
+    for (rn = RTN_DEREF(rt_head->root); rn && (rn->rnode_bit <= bitlen);) {
+        if (rn->rnode_flags & RNODE_INFO) {
+            /*
+             * Nothing further down can match if this one does not.
+             */
+            if (!rtn_key_cmp(addr, ((rt_info_t *) rn)->rninfo_key,
+                             rn->rnode_bit)) {
+                break;
+            }
+            best = rn;
+        }
+
+        if (rn->rnode_bit == bitlen) {
+            break;
+        }
+        rn = rtn_key_nextbit(addr, rn->rnode_bit) ?
+            RTN_DEREF(rn->rnode_right) : RTN_DEREF(rn->rnode_left);
+    }
+
+    return ((rt_info_t *) best);
+}
+
 /*
  * rtn_lookup
  *
@@ -305,8 +506,25 @@ rt_info_t *
 rtn_lookup (rt_head_t *rt_head, char *addr, u_int16_t bitlen)
 {
     rt_node_t  *rn, *rn_next;
-    void       *node_key;
+    rt_info_t  *rinfo;
     int8_t     dir_r;
+    RTN_STATS_ONLY(u_int32_t depth = 0;)
+
+    RTN_STATS_ADD(RTN_STAT_LOOKUP, 1);
+
+    if (rt_head->rt_snapshot) {
+        return (rtn_snapshot_lookup(rt_head, (u_int8_t *) addr, bitlen));
+    }
+
+    if (rt_head->rt_lctrie &&
+        rtn_lctrie_lookup(rt_head->rt_lctrie, (u_int8_t *) addr, bitlen,
+                          &rinfo)) {
+        return (rinfo);
+    }
+
+    if (rt_head->flags & RTN_BIT_RCU) {
+        return (rtn_lookup_rcu(rt_head, (u_int8_t *) addr, bitlen));
+    }
 
     /*
      * Search down the tree as far as we can, stopping at a node
@@ -320,28 +538,177 @@ rtn_lookup (rt_head_t *rt_head, char *addr, u_int16_t bitlen)
             break;
         }
         rn = rn_next;
+        RTN_STATS_ONLY(depth++;)
     }
 
-    node_key = (rn->rnode_flags & RNODE_EXTERNAL) ?
-        ((rt_info_t *) rn)->rninfo_key : NULL;
+    RTN_STATS_ADD(RTN_STAT_LOOKUP_NODES, depth + 1);
+    RTN_STATS_RECORD(RTN_HIST_LOOKUP_DEPTH, depth);
+    return (rtn_lookup_backtrack(rt_head, rn, (u_int8_t *) addr, bitlen));
+}
+
+/*
+ * rtn_lookup_interleave
+ *
+ * Best match for a set of (tree, address) pairs. This is rtn_lookup()
+ * turned inside out: up to RTN_BATCH_GROUP descents are in flight, and
+ * each of them moves one node down in turn after a prefetch of the next
+ * node has been issued. By the time a descent comes back to a node,
+ * the node is likely in the cache, and the memory latency of the group
+ * overlaps instead of adding up (AMAC style).
+ *
+ * The tree of the i'th pair is rt_heads[i * head_step], and the address
+ * is addrs[i * addr_step], which lets a batch share a tree or an address.
+ */
+static void
+rtn_lookup_interleave (rt_head_t **rt_heads, u_int32_t head_step,
+                       char **addrs, u_int32_t addr_step, u_int16_t bitlen,
+                       rt_info_t **results, u_int32_t count)
+{
+    rtn_batch_state_t state[RTN_BATCH_GROUP];
+    rtn_batch_state_t *st;
+    rt_node_t *rn, *rn_next;
+    u_int32_t next, active, i;
+
+    RTN_STATS_ADD(RTN_STAT_LOOKUP, count);
+
     /*
-     * We should never get here, but if we do, return NULL
+     * Start the first group.
      */
-    if (!node_key) {
-        return (NULL);
+    for (i = 0, next = 0; (i < RTN_BATCH_GROUP) && (next < count); i++, next++) {
+        state[i].rt_head = rt_heads[next * head_step];
+        state[i].addr = (u_int8_t *) addrs[next * addr_step];
+        state[i].rn = state[i].rt_head->root;
+        state[i].idx = next;
+        __builtin_prefetch(state[i].rn);
+    }
+    active = i;
+
+    while (active) {
+        for (i = 0; i < active;) {
+            st = &state[i];
+            rn = st->rn;
+
+            /*
+             * One step of the descent of rtn_lookup().
+             */
+            if ((rn->rnode_bit < bitlen) ||
+                !(rn->rnode_flags & RNODE_EXTERNAL)) {
+                rn_next = rtn_key_nextbit(st->addr, rn->rnode_bit) ?
+                    rn->rnode_right : rn->rnode_left;
+                if (rn_next) {
+                    st->rn = rn_next;
+                    __builtin_prefetch(rn_next);
+                    RTN_STATS_ADD(RTN_STAT_LOOKUP_NODES, 1);
+                    i++;
+                    continue;
+                }
+            }
+
+            /*
+             * The descent is over. The backtrack runs over the nodes we
+             * just visited, so finish it right away, and reuse the slot
+             * for the next address in the batch, if any.
+             */
+            results[st->idx] = rtn_lookup_backtrack(st->rt_head, rn, st->addr,
+                                                    bitlen);
+            if (next < count) {
+                st->rt_head = rt_heads[next * head_step];
+                st->addr = (u_int8_t *) addrs[next * addr_step];
+                st->rn = st->rt_head->root;
+                st->idx = next++;
+                __builtin_prefetch(st->rn);
+                i++;
+            } else {
+                state[i] = state[--active];
+            }
+        }
+    }
+}
+
+/*
+ * rtn_lookup_batch
+ *
+ * Find the best match for each of an array of addresses in one tree.
+ * The results are the same as calling rtn_lookup() for each address.
+ */
+void
+rtn_lookup_batch (rt_head_t *rt_head, char **addrs, u_int16_t maxbitlen,
+                  rt_info_t **results, u_int32_t count)
+{
+    u_int32_t i;
+
+    if (rt_head->rt_snapshot) {
+        for (i = 0; i < count; i++) {
+            results[i] = rtn_snapshot_lookup(rt_head, (u_int8_t *) addrs[i],
+                                             maxbitlen);
+        }
+        return;
     }
 
     /*
-     * Backtrack to find the node.
+     * Once the compiled form is not current, the rest of the batch goes
+     * through the tree.
      */
-    for (; rn != rt_head->root; rn = rn->rnode_parent) {
-        if ((rn->rnode_bit <= bitlen) &&
-            rtn_key_cmp((u_int8_t *) addr, node_key, rn->rnode_bit) &&
-            (rn->rnode_flags & RNODE_INFO)) {
-            break;
+    if (rt_head->rt_lctrie && (rtn_rcu_read_lock() == 0)) {
+        for (i = 0; (i < count) &&
+             rtn_lctrie_lookup(rt_head->rt_lctrie, (u_int8_t *) addrs[i],
+                               maxbitlen, &results[i]); i++) {
+            ;
+        }
+        rtn_rcu_read_unlock();
+        addrs += i;
+        results += i;
+        count -= i;
+    }
+
+    if (rt_head->flags & RTN_BIT_RCU) {
+        for (i = 0; i < count; i++) {
+            results[i] = rtn_lookup_rcu(rt_head, (u_int8_t *) addrs[i],
+                                        maxbitlen);
+        }
+        return;
+    }
+
+    rtn_lookup_interleave(&rt_head, 0, addrs, 1, maxbitlen, results, count);
+}
+
+/*
+ * rtn_lookup_multi
+ *
+ * Find the best match for one address in each of a set of trees. The
+ * plain trees (no lookup structure in use) go through
+ * rtn_lookup_interleave() in groups, one tree per descent, so that the
+ * descents move down their trees in lock-step and the cache misses of
+ * the upper levels overlap. Any other tree goes through rtn_lookup().
+ */
+void
+rtn_lookup_multi (rt_head_t **rt_heads, char *addr, u_int16_t maxbitlen,
+                  rt_info_t **results, u_int32_t count)
+{
+    rt_head_t *heads[RTN_MULTI_GROUP];
+    rt_info_t *found[RTN_MULTI_GROUP];
+    u_int32_t index[RTN_MULTI_GROUP];
+    rt_head_t *rt_head;
+    u_int32_t i, j, n;
+
+    for (i = 0, n = 0; i < count; i++) {
+        rt_head = rt_heads[i];
+        if (rt_head->rt_snapshot || rt_head->rt_lctrie ||
+            (rt_head->flags & RTN_BIT_RCU)) {
+            results[i] = rtn_lookup(rt_head, addr, maxbitlen);
+        } else {
+            heads[n] = rt_head;
+            index[n++] = i;
+        }
+
+        if ((n == RTN_MULTI_GROUP) || (n && (i == count - 1))) {
+            rtn_lookup_interleave(heads, 1, &addr, 0, maxbitlen, found, n);
+            for (j = 0; j < n; j++) {
+                results[index[j]] = found[j];
+            }
+            n = 0;
         }
     }
-    return (rtn_node2info(rn));
 }
 
 /*
@@ -453,6 +820,315 @@ rtn_lookup_prefix_overlap(rt_head_t *rt_head, char *addr, u_int16_t maxbitlen)
 
 }
 
+/*
+ * A descent path, kept from one query of a batch to the next.
+ */
+#define RTN_PATH_STACK     160
+
+typedef struct _rtn_path_t
+{
+    rt_node_t    **rp_nodes;          /* rp_stack, or from malloc() */
+    u_int32_t    rp_depth;            /* nodes on the path */
+    u_int32_t    rp_size;             /* room in rp_nodes */
+    rt_node_t    *rp_stack[RTN_PATH_STACK];
+} rtn_path_t;
+
+/*
+ * rtn_path_push
+ *
+ * Add a node at the end of a path. Return FALSE when out of memory.
+ */
+static inline int8_t
+rtn_path_push (rtn_path_t *path, rt_node_t *rn)
+{
+    rt_node_t **nodes;
+
+    if (path->rp_depth == path->rp_size) {
+        nodes = malloc(2 * path->rp_size * sizeof(rt_node_t *));
+        if (!nodes) {
+            return (FALSE);
+        }
+        memcpy(nodes, path->rp_nodes, path->rp_depth * sizeof(rt_node_t *));
+        if (path->rp_nodes != path->rp_stack) {
+            free(path->rp_nodes);
+        }
+        path->rp_nodes = nodes;
+        path->rp_size *= 2;
+    }
+    path->rp_nodes[path->rp_depth++] = rn;
+    return (TRUE);
+}
+
+/*
+ * rtn_path_resume
+ *
+ * Cut the path of the previous query down to the nodes that the
+ * descent for addr goes through as well, and return the number of
+ * nodes left. The descent tests the bit of each node, so it takes the
+ * same way for both addresses until it reaches a node whose bit is
+ * past the first bit that differs.
+ */
+static inline u_int32_t
+rtn_path_resume (rtn_path_t *path, u_int8_t *prev, u_int8_t *addr)
+{
+    u_int32_t depth;
+    u_int16_t dbit;
+
+    if (!prev || !path->rp_depth) {
+        return (0);
+    }
+
+    dbit = rtn_key_diff(prev, addr,
+                        path->rp_nodes[path->rp_depth - 1]->rnode_bit + 1);
+    for (depth = 1; depth < path->rp_depth; depth++) {
+        if (path->rp_nodes[depth - 1]->rnode_bit >= dbit) {
+            break;
+        }
+    }
+    return (depth);
+}
+
+/*
+ * rtn_lookup_prefix_batch
+ *
+ * Do rtn_lookup_range() (overlap FALSE), or rtn_lookup_prefix_overlap()
+ * (overlap TRUE), for an array of prefixes. Each descent starts from
+ * the nodes it shares with the descent of the previous prefix, so a
+ * sorted array is merged with the tree in about one pass.
+ */
+static void
+rtn_lookup_prefix_batch (rt_head_t *rt_head, char **addrs, u_int16_t *bitlens,
+                         rt_info_t **results, u_int32_t count, int8_t overlap)
+{
+    rt_node_t *rn, *rn_next;
+    rt_info_t *ri;
+    u_int8_t *addr, *prev = NULL;
+    u_int16_t maxbitlen;
+    u_int32_t i, depth;
+    rtn_path_t path;
+
+    path.rp_nodes = path.rp_stack;
+    path.rp_depth = 0;
+    path.rp_size  = RTN_PATH_STACK;
+
+    for (i = 0; i < count; i++) {
+        addr = (u_int8_t *) addrs[i];
+        maxbitlen = bitlens[i];
+        results[i] = NULL;
+
+        /*
+         * Start from the shared part of the previous path. For an
+         * overlap, it has to be checked again, as the prefix length
+         * may not be the same.
+         */
+        path.rp_depth = rtn_path_resume(&path, prev, addr);
+        prev = addr;
+        if (!path.rp_depth) {
+            if (!rt_head->root) {
+                continue;
+            }
+            path.rp_nodes[path.rp_depth++] = rt_head->root;
+        }
+
+        ri = NULL;
+        for (depth = 0; overlap && (depth < path.rp_depth - 1); depth++) {
+            rn = path.rp_nodes[depth];
+            if ((rn->rnode_bit >= maxbitlen) &&
+                (rn->rnode_flags & RNODE_INFO) &&
+                rtn_key_cmp(addr, ((rt_info_t *) rn)->rninfo_key, maxbitlen)) {
+                ri = (rt_info_t *) rn;
+                path.rp_depth = depth + 1;
+                break;
+            }
+        }
+        if (ri) {
+            results[i] = ri;
+            continue;
+        }
+
+        /*
+         * Continue the descent as the single lookup does.
+         */
+        rn = path.rp_nodes[path.rp_depth - 1];
+        rn_next = NULL;
+        while (rn) {
+            if (overlap && (rn->rnode_bit >= maxbitlen) &&
+                (rn->rnode_flags & RNODE_INFO) &&
+                rtn_key_cmp(addr, ((rt_info_t *) rn)->rninfo_key, maxbitlen)) {
+                ri = (rt_info_t *) rn;
+                break;
+            }
+            rn_next = rtn_key_nextbit(addr, rn->rnode_bit) ?
+                rn->rnode_right : rn->rnode_left;
+            if (!rn_next) {
+                break;
+            }
+            if (!rtn_path_push(&path, rn_next)) {
+                break;
+            }
+            rn = rn_next;
+        }
+        if (ri) {
+            results[i] = ri;
+            continue;
+        }
+
+        /*
+         * Out of memory for a long path: do this one alone, and do not
+         * share its path.
+         */
+        if (rn_next) {
+            prev = NULL;
+            path.rp_depth = 0;
+            results[i] = overlap ?
+                rtn_lookup_prefix_overlap(rt_head, (char *) addr, maxbitlen) :
+                rtn_lookup_range(rt_head, (char *) addr, maxbitlen);
+            continue;
+        }
+
+        /*
+         * Backtrack, without the root: a range takes the shortest
+         * covered entry, an overlap the longest covering one.
+         */
+        if (overlap) {
+            for (depth = path.rp_depth - 1; depth > 0; depth--) {
+                rn = path.rp_nodes[depth];
+                if ((rn->rnode_flags & RNODE_INFO) &&
+                    rtn_key_cmp(addr, ((rt_info_t *) rn)->rninfo_key,
+                                rn->rnode_bit)) {
+                    results[i] = (rt_info_t *) rn;
+                    break;
+                }
+            }
+        } else {
+            for (depth = 1; depth < path.rp_depth; depth++) {
+                rn = path.rp_nodes[depth];
+                if ((rn->rnode_flags & RNODE_INFO) &&
+                    (rn->rnode_bit >= maxbitlen) &&
+                    rtn_key_cmp(addr, ((rt_info_t *) rn)->rninfo_key,
+                                maxbitlen)) {
+                    results[i] = (rt_info_t *) rn;
+                    break;
+                }
+            }
+        }
+    }
+
+    if (path.rp_nodes != path.rp_stack) {
+        free(path.rp_nodes);
+    }
+}
+
+/*
+ * rtn_lookup_range_batch
+ *
+ * rtn_lookup_range() for an array of prefixes.
+ */
+void
+rtn_lookup_range_batch (rt_head_t *rt_head, char **addrs, u_int16_t *bitlens,
+                        rt_info_t **results, u_int32_t count)
+{
+    rtn_lookup_prefix_batch(rt_head, addrs, bitlens, results, count, FALSE);
+}
+
+/*
+ * rtn_lookup_prefix_overlap_batch
+ *
+ * rtn_lookup_prefix_overlap() for an array of prefixes.
+ */
+void
+rtn_lookup_prefix_overlap_batch (rt_head_t *rt_head, char **addrs,
+                                 u_int16_t *bitlens, rt_info_t **results,
+                                 u_int32_t count)
+{
+    rtn_lookup_prefix_batch(rt_head, addrs, bitlens, results, count, TRUE);
+}
+
+/*
+ * rtn_notify_add
+ *
+ * Let the lookup structures attached to a tree know about an info entry
+ * that has been added to the tree.
+ */
+static inline void
+rtn_notify_add (rt_head_t *rt_head, rt_info_t *rinfo)
+{
+    rtn_generation_bump(rt_head);
+    if (rt_head->rt_stride) {
+        rtn_stride_add(rt_head->rt_stride, rinfo);
+    }
+    if (rt_head->rt_compact) {
+        rtn_compact_add(rt_head->rt_compact, rinfo);
+    }
+    if (rt_head->rt_view) {
+        rtn_view_add(rt_head->rt_view, rinfo);
+    }
+    if (rt_head->rt_lctrie) {
+        rtn_lctrie_changed(rt_head->rt_lctrie);
+    }
+    if (rt_head->rt_lenidx) {
+        rtn_lenidx_add(rt_head->rt_lenidx, rinfo);
+    }
+}
+
+/*
+ * rtn_notify_delete
+ *
+ * Let the lookup structures attached to a tree know about an info entry
+ * that is about to be removed from the tree.
+ */
+static inline void
+rtn_notify_delete (rt_head_t *rt_head, rt_info_t *rinfo)
+{
+    rtn_generation_bump(rt_head);
+    if (rt_head->rt_stride) {
+        rtn_stride_delete(rt_head->rt_stride, rinfo);
+    }
+    if (rt_head->rt_compact) {
+        rtn_compact_delete(rt_head->rt_compact, rinfo);
+    }
+    if (rt_head->rt_changelog) {
+        rtn_changelog_delete(rt_head, rinfo);
+    }
+    if (rt_head->rt_view) {
+        rtn_view_delete(rt_head->rt_view, rinfo);
+    }
+    if (rt_head->rt_lctrie) {
+        rtn_lctrie_changed(rt_head->rt_lctrie);
+    }
+    if (rt_head->rt_lenidx) {
+        rtn_lenidx_delete(rt_head->rt_lenidx, rinfo);
+    }
+}
+
+/*
+ * rtn_notify_subtree
+ *
+ * Notify about all the info entries of a subtree that has been attached
+ * to, or is being detached from, a tree.
+ */
+static void
+rtn_notify_subtree (rt_head_t *rt_head, rt_node_t *st_root, int8_t add)
+{
+    rt_node_t *rn;
+
+    rtn_generation_bump(rt_head);
+    if (!rt_head->rt_stride && !rt_head->rt_compact && !rt_head->rt_view &&
+        !rt_head->rt_lenidx && (add || !rt_head->rt_changelog)) {
+        return;
+    }
+
+    for (rn = st_root; rn; rn = rtn_walk_next_node(st_root, rn)) {
+        if (rn->rnode_flags & RNODE_INFO) {
+            if (add) {
+                rtn_notify_add(rt_head, (rt_info_t *) rn);
+            } else {
+                rtn_notify_delete(rt_head, (rt_info_t *) rn);
+            }
+        }
+    }
+}
+
 /*
  * rtn_replace_node
  *
@@ -478,10 +1154,10 @@ rtn_replace_node (rt_head_t *rt_head, rt_node_t *rn_old, rt_node_t *rn_new)
     parent = rn_old->rnode_parent;
     if (parent) {
         if (parent->rnode_left == rn_old) {
-            parent->rnode_left = rn_new;
+            RTN_PUBLISH(parent->rnode_left, rn_new);
         } else {
             assert(parent->rnode_right == rn_old);
-            parent->rnode_right = rn_new;
+            RTN_PUBLISH(parent->rnode_right, rn_new);
         }
     }
 
@@ -494,7 +1170,7 @@ rtn_replace_node (rt_head_t *rt_head, rt_node_t *rn_old, rt_node_t *rn_new)
     }
 
     if (rt_head->root == rn_old) {
-        rt_head->root = rn_new;
+        RTN_PUBLISH(rt_head->root, rn_new);
     }
 
     /*
@@ -510,7 +1186,7 @@ rtn_replace_node (rt_head_t *rt_head, rt_node_t *rn_old, rt_node_t *rn_new)
 }
 
 /*
- * rtn_add
+ * rtn_add_node
  *
  * Insert an info item into the tree (adapted from Gated/IENG).
  *
@@ -530,14 +1206,19 @@ rtn_replace_node (rt_head_t *rt_head, rt_node_t *rn_old, rt_node_t *rn_new)
  * children.
  *
  * End of GateD quote.
+ *
+ * When rn_start is not NULL, the search down the tree is skipped and
+ * rn_start is used as the node found. It must be an external node that
+ * shares the longest prefix with the new key among all the nodes in the
+ * tree (see rtn_bulk_load()).
  */
-int8_t
-rtn_add (rt_head_t *rt_head, rt_info_t *rinfo, u_int16_t bitlen)
+static int8_t
+rtn_add_node (rt_head_t *rt_head, rt_info_t *rinfo, u_int16_t bitlen,
+              rt_node_t *rn_start)
 {
     register rt_node_t *rn, *rn_prev, *rn_add, *rn_new;
     register u_short bits2chk, dbit;
     register u_char *addr, *his_addr;
-    register u_int i;
 
     /*
      * just to be safe.
@@ -554,9 +1235,10 @@ rtn_add (rt_head_t *rt_head, rt_info_t *rinfo, u_int16_t bitlen)
      * is possible we won't get down the tree this far, however,
      * so deal with that as well.
      */
-    rn = rt_head->root;
+    rn = rn_start ? rn_start : rt_head->root;
     addr = rinfo->rninfo_key;
-    while ((rn->rnode_bit < bitlen) || !(rn->rnode_flags & RNODE_EXTERNAL)) {
+    while (!rn_start &&
+           ((rn->rnode_bit < bitlen) || !(rn->rnode_flags & RNODE_EXTERNAL))) {
         if (addr[RNBYTE(rn->rnode_bit)] & RNBIT(rn->rnode_bit)) {
             if (!(rn->rnode_right)) {
                 break;
@@ -581,13 +1263,7 @@ rtn_add (rt_head_t *rt_head, rt_info_t *rinfo, u_int16_t bitlen)
 
     assert (his_addr || (bits2chk == 0));
 
-    for (dbit = 0; dbit < bits2chk; dbit += RNBBY) {
-        i = dbit >> RNSHIFT;
-        if (addr[i] != his_addr[i]) {
-            dbit += first_bit_set[addr[i] ^ his_addr[i]];
-            break;
-        }
-    }
+    dbit = rtn_key_diff(addr, his_addr, bits2chk);
 
     /*
      * If the different bit is less than bits2chk we will need to
@@ -615,6 +1291,7 @@ rtn_add (rt_head_t *rt_head, rt_info_t *rinfo, u_int16_t bitlen)
          */
         if (rn->rnode_flags & RNODE_INFO) {
             rt_head->ri_count--;
+            RTN_STATS_ADD(RTN_STAT_ADD_EXIST, 1);
             return(FALSE);
         }
 
@@ -635,73 +1312,248 @@ rtn_add (rt_head_t *rt_head, rt_info_t *rinfo, u_int16_t bitlen)
     if (rn->rnode_bit == dbit) {
         assert(dbit < bitlen);
 
-        rn_add->rnode_parent = rn;
-        if (addr[RNBYTE(rn->rnode_bit)] & RNBIT(rn->rnode_bit)) {
-            assert(!(rn->rnode_right));
-            rn->rnode_right = rn_add;
-        } else {
-            assert(!(rn->rnode_left));
-            rn->rnode_left = rn_add;
+        rn_add->rnode_parent = rn;
+        if (addr[RNBYTE(rn->rnode_bit)] & RNBIT(rn->rnode_bit)) {
+            assert(!(rn->rnode_right));
+            RTN_PUBLISH(rn->rnode_right, rn_add);
+        } else {
+            assert(!(rn->rnode_left));
+            RTN_PUBLISH(rn->rnode_left, rn_add);
+        }
+        return (TRUE);
+    }
+
+    /*
+     * The other case where we don't need to add a split is where
+     * we were on the same branch as the guy we found.  In this case
+     * we insert rn_add into the tree between rn_prev and rn.  Otherwise
+     * we add a split between rn_prev and rn and append the node we're
+     * adding to one side of it.
+     */
+    if (dbit == bitlen) {
+        if (his_addr[RNBYTE(bitlen)] & RNBIT(bitlen)) {
+            rn_add->rnode_right = rn;
+        } else {
+            rn_add->rnode_left = rn;
+        }
+        rn_new = rn_add;
+    } else {
+        rn_new = rtn_node_alloc(rt_head);
+        if (!rn_new) {
+            rt_head->ri_count--;
+            return (FALSE);
+        }
+        RTN_STATS_ADD(RTN_STAT_ADD_SPLIT, 1);
+
+        rn_new->rnode_bit = dbit;
+        rn_add->rnode_parent = rn_new;
+        if (addr[RNBYTE(dbit)] & RNBIT(dbit)) {
+            rn_new->rnode_right = rn_add;
+            rn_new->rnode_left = rn;
+        } else {
+            rn_new->rnode_left = rn_add;
+            rn_new->rnode_right = rn;
+        }
+    }
+    rn->rnode_parent = rn_new;
+    rn_new->rnode_parent = rn_prev;
+
+    /*
+     * If rn_prev is NULL this is a new root node, otherwise it
+     * is attached to the guy above in the place where rn was.
+     */
+    if (!rn_prev) {
+        ;
+	/* rtt->rt_table_tree = rn_new; */
+    } else if (rn_prev->rnode_right == rn) {
+        RTN_PUBLISH(rn_prev->rnode_right, rn_new);
+    } else {
+        assert(rn_prev->rnode_left == rn);
+        RTN_PUBLISH(rn_prev->rnode_left, rn_new);
+    }
+
+    /*
+     * Update the rnode_version of the new midnode with that of
+     * its child to ensure that the max. version number of its
+     * subtree as recorded in rnode_version is still correct.
+     */
+    rn_new->rnode_version = rn->rnode_version;
+
+    return (TRUE);
+}
+
+/*
+ * rtn_add
+ *
+ * Insert an info item into the tree, and update the lookup structures
+ * attached to the tree.
+ */
+int8_t
+rtn_add (rt_head_t *rt_head, rt_info_t *rinfo, u_int16_t bitlen)
+{
+    RTN_STATS_ONLY(u_int64_t start = rtn_stats_now();)
+
+    RTN_STATS_ADD(RTN_STAT_ADD, 1);
+
+    if (rt_head->rt_snapshot && !rtn_snapshot_promote(rt_head, NULL)) {
+        return (FALSE);
+    }
+
+    if (!rtn_add_node(rt_head, rinfo, bitlen, NULL)) {
+        return (FALSE);
+    }
+
+    rtn_notify_add(rt_head, rinfo);
+
+    RTN_STATS_RECORD(RTN_HIST_ADD_NS, rtn_stats_now() - start);
+    return (TRUE);
+}
+
+/*
+ * rtn_prefix_order
+ *
+ * Compare two prefixes in the order of a pre-order walk of the tree:
+ * a covering prefix comes before the prefixes it covers, and otherwise
+ * the prefix with a zero at the first different bit comes first.
+ *
+ * Return < 0, 0 or > 0 when the first prefix comes before, is the same
+ * as, or comes after the second one.
+ */
+static int
+rtn_prefix_order (u_int8_t *key1, u_int16_t bitlen1,
+                  u_int8_t *key2, u_int16_t bitlen2)
+{
+    u_int16_t bits2chk, dbit;
+
+    bits2chk = MIN(bitlen1, bitlen2);
+    dbit = rtn_key_diff(key1, key2, bits2chk);
+
+    if (dbit < bits2chk) {
+        return ((key1[RNBYTE(dbit)] & RNBIT(dbit)) ? 1 : -1);
+    }
+
+    return ((int) bitlen1 - (int) bitlen2);
+}
+
+/*
+ * rtn_bulk_last
+ *
+ * Find the last node of the tree in the pre-order, i.e. the external
+ * node with the largest prefix. Return NULL for an empty tree.
+ */
+static rt_node_t *
+rtn_bulk_last (rt_head_t *rt_head)
+{
+    rt_node_t *rn;
+
+    rn = rt_head->root;
+    while (rn->rnode_right || rn->rnode_left) {
+        rn = rn->rnode_right ? rn->rnode_right : rn->rnode_left;
+    }
+
+    return ((rn->rnode_flags & RNODE_EXTERNAL) ? rn : NULL);
+}
+
+/*
+ * rtn_bulk_add
+ *
+ * Insert one prefix of a bulk load. The prefix that comes right before
+ * it in a sorted stream is the last one of the tree, and also the one
+ * that shares the longest prefix with it, so the search down the tree
+ * starts (and mostly ends) there. The same prefix again is found there
+ * as well. A prefix out of order is added with a regular search from
+ * the root.
+ */
+static int8_t
+rtn_bulk_add (rt_head_t *rt_head, rt_node_t **rn_last, rt_info_t *rinfo,
+              u_int16_t bitlen)
+{
+    rt_node_t *rn;
+    bool in_order;
+
+    rn = *rn_last;
+    in_order = !rn || (rtn_prefix_order(rinfo->rninfo_key, bitlen,
+                                        ((rt_info_t *) rn)->rninfo_key,
+                                        rn->rnode_bit) >= 0);
+
+    /*
+     * An empty tree starts from the root, as rtn_add() does.
+     */
+    if (!rtn_add_node(rt_head, rinfo, bitlen, in_order ? rn : NULL)) {
+        return (FALSE);
+    }
+    if (in_order) {
+        *rn_last = (rt_node_t *) rinfo;
+    }
+
+    rtn_notify_add(rt_head, rinfo);
+    return (TRUE);
+}
+
+/*
+ * rtn_bulk_load_live
+ *
+ * rtn_bulk_load() into the tree itself, with a snapshot left mapped.
+ */
+u_int32_t
+rtn_bulk_load_live (rt_head_t *rt_head, rtn_bulk_entry_t *entries,
+                    u_int32_t count)
+{
+    rt_node_t *rn_last;
+    u_int32_t i, added = 0;
+
+    rn_last = rtn_bulk_last(rt_head);
+    for (i = 0; i < count; i++) {
+        if (rtn_bulk_add(rt_head, &rn_last, entries[i].rinfo,
+                         entries[i].bitlen)) {
+            added++;
         }
-        return (TRUE);
     }
 
-    /*
-     * The other case where we don't need to add a split is where
-     * we were on the same branch as the guy we found.  In this case
-     * we insert rn_add into the tree between rn_prev and rn.  Otherwise
-     * we add a split between rn_prev and rn and append the node we're
-     * adding to one side of it.
-     */
-    if (dbit == bitlen) {
-        if (his_addr[RNBYTE(bitlen)] & RNBIT(bitlen)) {
-            rn_add->rnode_right = rn;
-        } else {
-            rn_add->rnode_left = rn;
-        }
-        rn_new = rn_add;
-    } else {
-        rn_new = rtn_node_alloc(rt_head);
-        if (!rn_new) {
-            rt_head->ri_count--;
-            return (FALSE);
-        }
+    return (added);
+}
 
-        rn_new->rnode_bit = dbit;
-        rn_add->rnode_parent = rn_new;
-        if (addr[RNBYTE(dbit)] & RNBIT(dbit)) {
-            rn_new->rnode_right = rn_add;
-            rn_new->rnode_left = rn;
-        } else {
-            rn_new->rnode_left = rn_add;
-            rn_new->rnode_right = rn;
-        }
+/*
+ * rtn_bulk_load
+ *
+ * Insert an array of prefixes sorted in the pre-order of the tree.
+ */
+u_int32_t
+rtn_bulk_load (rt_head_t *rt_head, rtn_bulk_entry_t *entries, u_int32_t count)
+{
+    if (rt_head->rt_snapshot && !rtn_snapshot_promote(rt_head, NULL)) {
+        return (0);
     }
-    rn->rnode_parent = rn_new;
-    rn_new->rnode_parent = rn_prev;
 
-    /*
-     * If rn_prev is NULL this is a new root node, otherwise it
-     * is attached to the guy above in the place where rn was.
-     */
-    if (!rn_prev) {
-        ;
-	/* rtt->rt_table_tree = rn_new; */
-    } else if (rn_prev->rnode_right == rn) {
-        rn_prev->rnode_right = rn_new;
-    } else {
-        assert(rn_prev->rnode_left == rn);
-        rn_prev->rnode_left = rn_new;
+    return (rtn_bulk_load_live(rt_head, entries, count));
+}
+
+/*
+ * rtn_bulk_load_iter
+ *
+ * Insert the prefixes returned by an iterator, in the pre-order of the
+ * tree.
+ */
+u_int32_t
+rtn_bulk_load_iter (rt_head_t *rt_head, rtn_bulk_next_func next, void *arg)
+{
+    rt_node_t *rn_last;
+    rt_info_t *rinfo;
+    u_int16_t bitlen;
+    u_int32_t added = 0;
+
+    if (rt_head->rt_snapshot && !rtn_snapshot_promote(rt_head, NULL)) {
+        return (0);
     }
 
-    /*
-     * Update the rnode_version of the new midnode with that of
-     * its child to ensure that the max. version number of its
-     * subtree as recorded in rnode_version is still correct.
-     */
-    rn_new->rnode_version = rn->rnode_version;
+    rn_last = rtn_bulk_last(rt_head);
+    while ((rinfo = (*next)(arg, &bitlen)) != NULL) {
+        if (rtn_bulk_add(rt_head, &rn_last, rinfo, bitlen)) {
+            added++;
+        }
+    }
 
-    return (TRUE);
+    return (added);
 }
 
 /*
@@ -758,9 +1610,9 @@ rtn_delete_node (rt_head_t *rt_head, rt_node_t *rn)
             child = rn->rnode_right;
 
         if (node->rnode_left == rn)
-            node->rnode_left = child;
+            RTN_PUBLISH(node->rnode_left, child);
         else
-            node->rnode_right = child;
+            RTN_PUBLISH(node->rnode_right, child);
 
         if (child) {
             child->rnode_parent = node;
@@ -788,11 +1640,23 @@ void
 rtn_delete (rt_info_t *rinfo, rt_head_t *rt_head)
 {
     rt_node_t *rn, *node;
+    RTN_STATS_ONLY(u_int64_t start = rtn_stats_now();)
+
+    RTN_STATS_ADD(RTN_STAT_DELETE, 1);
+
+    /*
+     * The info may come from the snapshot: delete its copy.
+     */
+    if (rt_head->rt_snapshot && !rtn_snapshot_promote(rt_head, &rinfo)) {
+        return;
+    }
 
     rn = RADIX_INFO2NODE(rinfo);
     assert(rn && ((rn->rnode_flags & (RNODE_INFO | RNODE_EXTERNAL)) ==
                   (RNODE_INFO | RNODE_EXTERNAL)));
 
+    rtn_notify_delete(rt_head, rinfo);
+
     /*
      * Delete the info flag immediately to avoid complications
      * by (delete, add) during yield.
@@ -812,9 +1676,17 @@ rtn_delete (rt_info_t *rinfo, rt_head_t *rt_head)
         }
     } else if (rn->rnode_lock) {
         rn->rnode_flags |= RNODE_DELETED;
+        RTN_STATS_ADD(RTN_STAT_DELETE_DELAYED, 1);
     } else {
         rtn_delete_node(rt_head, rn);
     }
+
+    /*
+     * Again, now that the info can no longer be found.
+     */
+    rtn_generation_bump(rt_head);
+
+    RTN_STATS_RECORD(RTN_HIST_DELETE_NS, rtn_stats_now() - start);
 }
 
 /*
@@ -842,6 +1714,25 @@ rtn_bump_version_internal(rt_info_t *rinfo, u_int32_t version)
     return ((version == 0) ? TRUE : FALSE);
 }
 
+/*
+ * rtn_bump_version_log
+ *
+ * Set the info version as rtn_bump_version_internal() does, and log the
+ * change when the table version is the one of the change log of rt_head.
+ */
+static inline int8_t
+rtn_bump_version_log (rt_head_t *rt_head, rt_info_t *rinfo,
+                      u_int32_t *table_version)
+{
+    int8_t wrap;
+
+    wrap = rtn_bump_version_internal(rinfo, *table_version);
+    if (rt_head && rt_head->rt_changelog) {
+        rtn_changelog_bump(rt_head, table_version, rinfo);
+    }
+    return (wrap);
+}
+
 /*
  * rtn_bump_version
  *
@@ -852,6 +1743,18 @@ rtn_bump_version_internal(rt_info_t *rinfo, u_int32_t version)
  */
 int8_t
 rtn_bump_version (rt_info_t *rinfo, u_int32_t *table_version)
+{
+    return (rtn_head_bump_version(NULL, rinfo, table_version));
+}
+
+/*
+ * rtn_head_bump_version
+ *
+ * Same as rtn_bump_version(), for an info of rt_head.
+ */
+int8_t
+rtn_head_bump_version (rt_head_t *rt_head, rt_info_t *rinfo,
+                       u_int32_t *table_version)
 {
 
     /*
@@ -863,7 +1766,7 @@ rtn_bump_version (rt_info_t *rinfo, u_int32_t *table_version)
 	return(FALSE);
     }
     (*table_version)++;
-    return (rtn_bump_version_internal(rinfo, *table_version));
+    return (rtn_bump_version_log(rt_head, rinfo, table_version));
 }
 
 /*
@@ -877,6 +1780,18 @@ rtn_bump_version (rt_info_t *rinfo, u_int32_t *table_version)
  */
 int8_t
 rtn_bump_version_max_limit (rt_info_t *rinfo, u_int32_t *table_version, u_int32_t max)
+{
+    return (rtn_head_bump_version_max_limit(NULL, rinfo, table_version, max));
+}
+
+/*
+ * rtn_head_bump_version_max_limit
+ *
+ * Same as rtn_bump_version_max_limit(), for an info of rt_head.
+ */
+int8_t
+rtn_head_bump_version_max_limit (rt_head_t *rt_head, rt_info_t *rinfo,
+                                 u_int32_t *table_version, u_int32_t max)
 {
     /*
      * Check if any of the arguments is a null pointer
@@ -891,7 +1806,7 @@ rtn_bump_version_max_limit (rt_info_t *rinfo, u_int32_t *table_version, u_int32_
     if (*table_version > max) {
         *table_version = 0;
     }
-    return (rtn_bump_version_internal(rinfo, *table_version));
+    return (rtn_bump_version_log(rt_head, rinfo, table_version));
 }
 
 /*
@@ -1032,7 +1947,6 @@ rtn_key_getnext_node (rt_head_t *rt_head, rt_node_t *st_root, u_char *addr,
     register rt_node_t *rn, *rn_prev;
     register u_short bits2chk, dbit;
     register u_char *his_addr;
-    register u_int i;
 
     /*
      * If the stree_node is not the root, check if it is still
@@ -1079,13 +1993,7 @@ rtn_key_getnext_node (rt_head_t *rt_head, rt_node_t *st_root, u_char *addr,
 
     assert (his_addr || (bits2chk == 0));
 
-    for (dbit = 0; dbit < bits2chk; dbit += RNBBY) {
-        i = dbit >> RNSHIFT;
-        if (addr[i] != his_addr[i]) {
-            dbit += first_bit_set[addr[i] ^ his_addr[i]];
-            break;
-        }
-    }
+    dbit = rtn_key_diff(addr, his_addr, bits2chk);
 
     /*
      * If the different bit is less than bits2chk we will need to
@@ -1173,6 +2081,134 @@ rtn_key_getnext (rt_head_t *rt_head, char *addr, u_int16_t bitlen,
     return (NULL);
 }
 
+/*
+ * rtn_getnext_cursor_last
+ *
+ * The copy of the last key of a cursor.
+ */
+static inline u_int8_t *
+rtn_getnext_cursor_last (rtn_getnext_cursor_t *gc)
+{
+    return ((RNBYTE(gc->gc_bitlen + 7) > RTN_GETNEXT_KEY_BYTES) ?
+            gc->gc_key_long : gc->gc_key_buf);
+}
+
+/*
+ * rtn_getnext_cursor_key
+ *
+ * Keep a copy of a key in a cursor.
+ */
+static int8_t
+rtn_getnext_cursor_key (rtn_getnext_cursor_t *gc, u_int8_t *key,
+                        u_int16_t bitlen)
+{
+    u_int8_t *buf;
+    u_int16_t bytes;
+
+    bytes = RNBYTE(bitlen + 7);
+    if (bytes <= RTN_GETNEXT_KEY_BYTES) {
+        buf = gc->gc_key_buf;
+    } else {
+        if (bytes > gc->gc_key_size) {
+            buf = malloc(bytes);
+            if (!buf) {
+                return (FALSE);
+            }
+            free(gc->gc_key_long);
+            gc->gc_key_long = buf;
+            gc->gc_key_size = bytes;
+        }
+        buf = gc->gc_key_long;
+    }
+
+    memcpy(buf, key, bytes);
+    gc->gc_bitlen = bitlen;
+    return (TRUE);
+}
+
+/*
+ * rtn_getnext_cursor_init
+ */
+void
+rtn_getnext_cursor_init (rtn_getnext_cursor_t *gc, rt_head_t *rt_head)
+{
+    memset(gc, 0, sizeof(rtn_getnext_cursor_t));
+    gc->gc_head = rt_head;
+}
+
+/*
+ * rtn_getnext_cursor_seek
+ */
+int8_t
+rtn_getnext_cursor_seek (rtn_getnext_cursor_t *gc, char *addr,
+                         u_int16_t bitlen)
+{
+    gc->gc_node = NULL;
+    gc->gc_done = FALSE;
+    gc->gc_started = rtn_getnext_cursor_key(gc, (u_int8_t *) addr, bitlen);
+
+    return (gc->gc_started);
+}
+
+/*
+ * rtn_getnext_cursor_next
+ *
+ * The generation is read before the step: a change made after it is
+ * seen by the next call. Any change that takes a node out of the tree
+ * moves the generation, so an unchanged generation means gc_node is
+ * still in the tree, at the same place in the order.
+ */
+rt_info_t *
+rtn_getnext_cursor_next (rtn_getnext_cursor_t *gc)
+{
+    rt_head_t *rt_head = gc->gc_head;
+    rt_info_t *rinfo;
+    u_int64_t generation;
+
+    if (gc->gc_done) {
+        return (NULL);
+    }
+
+    generation = __atomic_load_n(&rt_head->rt_generation, __ATOMIC_ACQUIRE);
+    if (gc->gc_node && (generation == gc->gc_generation)) {
+        rinfo = rtn_walk_next_info(NULL, gc->gc_node);
+        gc->gc_steps++;
+    } else if (gc->gc_started) {
+        rinfo = rtn_key_getnext(rt_head, (char *) rtn_getnext_cursor_last(gc),
+                                gc->gc_bitlen, FALSE);
+        gc->gc_descents++;
+    } else {
+        rinfo = (rt_head->root->rnode_flags & RNODE_INFO) ?
+            (rt_info_t *) rt_head->root :
+            rtn_walk_next_info(NULL, rt_head->root);
+        gc->gc_started = TRUE;
+        gc->gc_descents++;
+    }
+
+    if (!rinfo || !rtn_getnext_cursor_key(gc, (u_int8_t *) rinfo->rninfo_key,
+                                          rinfo->rnode_bit)) {
+        gc->gc_node = NULL;
+        gc->gc_done = TRUE;
+        return (NULL);
+    }
+
+    gc->gc_node = RADIX_INFO2NODE(rinfo);
+    gc->gc_generation = generation;
+    return (rinfo);
+}
+
+/*
+ * rtn_getnext_cursor_free
+ */
+void
+rtn_getnext_cursor_free (rtn_getnext_cursor_t *gc)
+{
+    free(gc->gc_key_long);
+    gc->gc_key_long = NULL;
+    gc->gc_key_size = 0;
+    gc->gc_node = NULL;
+}
+
 /*
  * rtn_update_subtree_info
  *
@@ -1227,6 +2263,7 @@ rtn_process_external_node (rt_head_t *rt_head, stree_info_t *st_info,
 {
     rt_node_t *node, *st_root;
     rt_info_t *ri;
+    RTN_STATS_ONLY(u_int64_t start;)
 
     /*
      * Lock this node so that it does not get deleted when we yield
@@ -1240,6 +2277,9 @@ rtn_process_external_node (rt_head_t *rt_head, stree_info_t *st_info,
     ri = (rt_info_t *) rn;
     *errnum = (*fi)(ri, ap);
 
+    RTN_STATS_ADD(RTN_STAT_WALK_INFO, 1);
+    RTN_STATS_ONLY(start = blocking ? rtn_stats_now() : 0;)
+
     switch (blocking) {
       case 0:
         break;
@@ -1253,6 +2293,11 @@ rtn_process_external_node (rt_head_t *rt_head, stree_info_t *st_info,
         pthread_may_yield(tval, &rtn_wc_tv);
     }
 
+    if (blocking) {
+        RTN_STATS_ADD(RTN_STAT_WALK_YIELD, 1);
+        RTN_STATS_RECORD(RTN_HIST_WALK_YIELD_NS, rtn_stats_now() - start);
+    }
+
     /*
      * Check and update the subtree info after the yield.
      */
@@ -1353,8 +2398,10 @@ rtn_walktree (rt_node_t *start_node, rtn_walk_func fi, rt_head_t *rt_head,
     int errnum = RTWALK_CONTINUE;
     struct timeval tval;
     va_list ap;
+    RTN_STATS_ONLY(u_int64_t start = rtn_stats_now();)
 
     rt_head->rtn_walktree_count++;
+    RTN_STATS_ADD(RTN_STAT_WALK, 1);
 
     /*
      * Start from the root when the start node is not given.
@@ -1392,6 +2439,7 @@ rtn_walktree (rt_node_t *start_node, rtn_walk_func fi, rt_head_t *rt_head,
         }
     }
 
+    RTN_STATS_RECORD(RTN_HIST_WALK_NS, rtn_stats_now() - start);
     return (errnum);
 }
 
@@ -1421,8 +2469,10 @@ rtn_walktree_version (rt_node_t *start_node, rtn_walk_func fi,
     int errnum = RTWALK_CONTINUE;
     struct timeval tval;
     va_list ap;
+    RTN_STATS_ONLY(u_int64_t start = rtn_stats_now();)
 
     rt_head->rtn_walktree_version_count++;
+    RTN_STATS_ADD(RTN_STAT_WALK, 1);
     /*
      * Start from the root when the start node is not given.
      */
@@ -1480,6 +2530,7 @@ rtn_walktree_version (rt_node_t *start_node, rtn_walk_func fi,
         }
     }
 
+    RTN_STATS_RECORD(RTN_HIST_WALK_NS, rtn_stats_now() - start);
     return (errnum);
 }
 
@@ -1662,41 +2713,173 @@ rtn_walktree_version_limited (rt_node_t *start_node, rtn_walk_func fi,
         }
 
         /*
-         * Skip if the info version is outside the range.
+         * Skip if the info version is outside the range.
+         */
+        ri = (rt_info_t *) rn;
+        if ((ri->version <= min_version) ||
+            (!(rt_head->flags & RTN_BIT_MULTI_INFO) &&
+             ri->version > max_version)) {
+            node = rtn_walk_next_node(NULL, rn);
+            continue;
+        }
+
+        /*
+         * Check the limit.
+         */
+        if (item_done++ >= limit) {
+            errnum = RTWALK_ABORT;
+            *last_item = (rt_info_t *) rn;
+            break;
+        }
+
+        /*
+         * Process the external node.
+         */
+        va_start(ap, limit);
+        node = rtn_process_external_node(rt_head, NULL, rn, FALSE, fi, NULL,
+                                         &errnum, ap);
+        va_end(ap);
+
+        if (errnum == RTWALK_ABORT) {
+            errnum = RTWALK_ABORT;
+            *last_item = (rt_info_t *) rn;
+            break;
+        }
+    }
+
+    return (errnum);
+}
+
+/*
+ * rtn_walk_cursor_park
+ *
+ * Keep the position of a cursor at the next info from a node, with a
+ * lock on it, as a walk does while it yields.
+ */
+static void
+rtn_walk_cursor_park (rtn_walk_cursor_t *wc, rt_node_t *rn)
+{
+    while (rn && !(rn->rnode_flags & RNODE_INFO)) {
+        rn = rtn_walk_next_node(NULL, rn);
+    }
+
+    if (rn) {
+        rn->rnode_lock++;
+    }
+    wc->wc_node = rn;
+}
+
+/*
+ * rtn_walk_cursor_unpark
+ *
+ * Release the lock of a cursor, and return the node to go on with. The
+ * node locked is still in the tree unless it has been replaced; if its
+ * info has been deleted, the walk goes on after it.
+ */
+static rt_node_t *
+rtn_walk_cursor_unpark (rtn_walk_cursor_t *wc)
+{
+    rt_node_t *rn, *node;
+    rt_info_t *ri;
+
+    rn = wc->wc_node;
+    if (!rn) {
+        return (NULL);
+    }
+    wc->wc_node = NULL;
+
+    if (rn->rnode_flags & RNODE_REPLACED) {
+        ri = (rt_info_t *) rn;
+        node = rtn_key_getnext_node(wc->wc_head, NULL, (u_char *) ri->rninfo_key,
+                                    ri->rnode_bit, FALSE);
+    } else if (!(rn->rnode_flags & RNODE_INFO)) {
+        node = rtn_walk_next_node(NULL, rn);
+    } else {
+        node = rn;
+    }
+
+    if (--rn->rnode_lock == 0) {
+        rtn_check_node_deletion(wc->wc_head, rn);
+    }
+
+    return (node);
+}
+
+/*
+ * rtn_walk_cursor_init
+ */
+void
+rtn_walk_cursor_init (rtn_walk_cursor_t *wc, rt_head_t *rt_head,
+                      rt_node_t *start_node)
+{
+    rt_head->rtn_walktree_count++;
+
+    wc->wc_head = rt_head;
+    wc->wc_count = 0;
+    rtn_walk_cursor_park(wc, start_node ? start_node : rt_head->root);
+}
+
+/*
+ * rtn_walk_cursor_resume
+ *
+ * Process up to count infos from the position of a cursor, without any
+ * yield, as rtn_walktree_limited() does, and keep the position for the
+ * next call. The internal nodes skipped, here and in the park, are only
+ * the ones between two infos of the walk, so the count bounds the work.
+ */
+int8_t
+rtn_walk_cursor_resume (rtn_walk_cursor_t *wc, u_int32_t count,
+                        rtn_walk_func fi, ...)
+{
+    rt_node_t *rn, *node;
+    u_int32_t item_done = 0;
+    int errnum = RTWALK_CONTINUE;
+    va_list ap;
+
+    for (rn = rtn_walk_cursor_unpark(wc); rn; rn = node) {
+
+        /*
+         * Skip the internal node.
          */
-        ri = (rt_info_t *) rn;
-        if ((ri->version <= min_version) ||
-            (!(rt_head->flags & RTN_BIT_MULTI_INFO) &&
-             ri->version > max_version)) {
+        if (!(rn->rnode_flags & RNODE_INFO)) {
             node = rtn_walk_next_node(NULL, rn);
             continue;
         }
 
-        /*
-         * Check the limit.
-         */
-        if (item_done++ >= limit) {
-            errnum = RTWALK_ABORT;
-            *last_item = (rt_info_t *) rn;
+        if (item_done++ >= count) {
             break;
         }
 
         /*
          * Process the external node.
          */
-        va_start(ap, limit);
-        node = rtn_process_external_node(rt_head, NULL, rn, FALSE, fi, NULL,
-                                         &errnum, ap);
+        va_start(ap, fi);
+        node = rtn_process_external_node(wc->wc_head, NULL, rn, FALSE, fi,
+                                         NULL, &errnum, ap);
         va_end(ap);
+        wc->wc_count++;
 
         if (errnum == RTWALK_ABORT) {
-            errnum = RTWALK_ABORT;
-            *last_item = (rt_info_t *) rn;
+            rn = node;
             break;
         }
     }
 
-    return (errnum);
+    rtn_walk_cursor_park(wc, rn);
+
+    if (errnum == RTWALK_ABORT) {
+        return (-1);
+    }
+    return (wc->wc_node ? 1 : 0);
+}
+
+/*
+ * rtn_walk_cursor_stop
+ */
+void
+rtn_walk_cursor_stop (rtn_walk_cursor_t *wc)
+{
+    rtn_walk_cursor_unpark(wc);
 }
 
 /*
@@ -2088,19 +3271,16 @@ rtn_walk_subtree_version (rt_head_t *rt_head, u_char *st_addr,
 }
 
 /*
- * rtn_walktree_keybits
+ * rtn_walktree_keybits_ap
  *
- * This function walks entries with keybits between (min_keybits,
- * max_keybits). When the specified max_keybits is smaller than the
- * max bits of the tree, this function is more efficient than walking
- * the entire tree. The arguments of this function are similar to those
- * in rtn_walktree_version().
+ * rtn_walktree_keybits(), with the arguments of the walk function in a
+ * va_list, for rtn_lenidx.c.
  */
 int8_t
-rtn_walktree_keybits (rt_node_t *start_node, rtn_walk_func fi,
-                      rt_head_t *rt_head, u_int32_t min_keybits,
-                      u_int32_t max_keybits, u_int32_t limit_ms,
-                      int8_t blocking, ...)
+rtn_walktree_keybits_ap (rt_node_t *start_node, rtn_walk_func fi,
+                         rt_head_t *rt_head, u_int32_t min_keybits,
+                         u_int32_t max_keybits, u_int32_t limit_ms,
+                         int8_t blocking, va_list args)
 {
     rt_node_t *rn, *node;
     int errnum = RTWALK_CONTINUE;
@@ -2142,7 +3322,7 @@ rtn_walktree_keybits (rt_node_t *start_node, rtn_walk_func fi,
         /*
          * Process the external node.
          */
-        va_start(ap, blocking);
+        va_copy(ap, args);
         node = rtn_process_external_node(rt_head, NULL, rn, blocking, fi,
                                          &tval, &errnum, ap);
         va_end(ap);
@@ -2155,6 +3335,179 @@ rtn_walktree_keybits (rt_node_t *start_node, rtn_walk_func fi,
     return (errnum);
 }
 
+/*
+ * rtn_walktree_keybits
+ *
+ * This function walks entries with keybits between (min_keybits,
+ * max_keybits). When the specified max_keybits is smaller than the
+ * max bits of the tree, this function is more efficient than walking
+ * the entire tree. The arguments of this function are similar to those
+ * in rtn_walktree_version().
+ */
+int8_t
+rtn_walktree_keybits (rt_node_t *start_node, rtn_walk_func fi,
+                      rt_head_t *rt_head, u_int32_t min_keybits,
+                      u_int32_t max_keybits, u_int32_t limit_ms,
+                      int8_t blocking, ...)
+{
+    int8_t errnum;
+    va_list ap;
+
+    va_start(ap, blocking);
+    errnum = rtn_walktree_keybits_ap(start_node, fi, rt_head, min_keybits,
+                                     max_keybits, limit_ms, blocking, ap);
+    va_end(ap);
+
+    return (errnum);
+}
+
+/*
+ * rtn_subtree_scan
+ *
+ * Count the infos of a subtree. Return FALSE when a walk has yielded on
+ * one of its internal nodes: the walk frees such a node to the arena it
+ * was in when it unlocks it, so the node can not be moved to another.
+ */
+static int8_t
+rtn_subtree_scan (rt_node_t *st_root, u_int32_t *infos)
+{
+    rt_node_t *rn;
+
+    *infos = 0;
+    for (rn = st_root; rn; rn = rtn_walk_next_node(st_root, rn)) {
+        if (rn->rnode_flags & RNODE_EXTERNAL) {
+            (*infos)++;
+        } else if (rn->rnode_lock) {
+            return (FALSE);
+        }
+    }
+
+    return (TRUE);
+}
+
+/*
+ * rtn_move_subtree_free
+ *
+ * Free the first count nodes of rtn_move_subtree_alloc(), and the
+ * array.
+ */
+static void
+rtn_move_subtree_free (rt_head_t *rt_head, rt_node_t **nodes,
+                       u_int32_t count, bool orphan)
+{
+    while (count--) {
+        if (orphan) {
+            free(nodes[count]);
+        } else {
+            rtn_node_free(rt_head, nodes[count]);
+        }
+    }
+    free(nodes);
+}
+
+/*
+ * rtn_move_subtree_alloc
+ *
+ * Allocate the nodes rtn_move_subtree() takes to move the internal
+ * nodes of a subtree, from the heap when orphan is TRUE, otherwise from
+ * the arena of the tree, and set count to their number. They are all
+ * allocated before anything moves, so that the move cannot fail half
+ * way, with the subtree in two arenas.
+ *
+ * Return the nodes, or NULL when out of memory, with none allocated.
+ */
+static rt_node_t **
+rtn_move_subtree_alloc (rt_head_t *rt_head, rt_node_t *st_root, bool orphan,
+                        u_int32_t *count)
+{
+    rt_node_t *rn, **nodes;
+    u_int32_t i;
+
+    *count = 0;
+    for (rn = st_root; rn; rn = rtn_walk_next_node(st_root, rn)) {
+        if (!(rn->rnode_flags & RNODE_EXTERNAL) &&
+            (orphan != !!(rn->rnode_flags & RNODE_ORPHAN))) {
+            (*count)++;
+        }
+    }
+
+    nodes = malloc(MAX(*count, 1) * sizeof(rt_node_t *));
+    if (!nodes) {
+        return (NULL);
+    }
+    for (i = 0; i < *count; i++) {
+        nodes[i] = orphan ? calloc(1, sizeof(rt_node_t)) :
+                            rtn_node_alloc(rt_head);
+        if (!nodes[i]) {
+            rtn_move_subtree_free(rt_head, nodes, i, orphan);
+            return (NULL);
+        }
+    }
+
+    return (nodes);
+}
+
+/*
+ * rtn_move_subtree
+ *
+ * Move the internal nodes of a subtree between the arena of a tree and
+ * the heap. When orphan is TRUE, the nodes of a subtree just detached
+ * from the tree are moved to the heap, so that the subtree no longer
+ * depends on the tree. Otherwise the orphan nodes of a subtree about to
+ * be attached are moved to the arena of the tree. No internal node of
+ * the subtree may be locked (see rtn_subtree_scan()), and the subtree
+ * must have no parent.
+ *
+ * The new nodes are the ones of rtn_move_subtree_alloc() for the same
+ * subtree, taken in the same order, and the array is freed. Return the
+ * (possibly new) root of the subtree.
+ */
+static rt_node_t *
+rtn_move_subtree (rt_head_t *rt_head, rt_node_t *st_root, bool orphan,
+                  rt_node_t **nodes)
+{
+    rt_node_t *rn, *rn_new, *parent;
+    u_int32_t i = 0;
+
+    for (rn = st_root; rn; rn = rtn_walk_next_node(NULL, rn)) {
+        if (rn->rnode_flags & RNODE_EXTERNAL) {
+            continue;
+        }
+        if (orphan == !!(rn->rnode_flags & RNODE_ORPHAN)) {
+            continue;
+        }
+
+        rn_new = nodes[i++];
+        *rn_new = *rn;
+        rn_new->rnode_flags ^= RNODE_ORPHAN;
+
+        parent = rn->rnode_parent;
+        if (!parent) {
+            st_root = rn_new;
+        } else if (parent->rnode_left == rn) {
+            RTN_PUBLISH(parent->rnode_left, rn_new);
+        } else {
+            RTN_PUBLISH(parent->rnode_right, rn_new);
+        }
+        if (rn->rnode_left) {
+            rn->rnode_left->rnode_parent = rn_new;
+        }
+        if (rn->rnode_right) {
+            rn->rnode_right->rnode_parent = rn_new;
+        }
+
+        if (orphan) {
+            rtn_node_free(rt_head, rn);
+        } else {
+            free(rn);
+        }
+        rn = rn_new;
+    }
+    free(nodes);
+
+    return (st_root);
+}
+
 /*
  * rtn_detach_subtree
  *
@@ -2166,6 +3519,9 @@ rtn_detach_subtree (rt_head_t *rt_head, char *prefix, u_int32_t bitlen)
 {
     rt_node_t *st_root;
     rt_node_t *st_root_parent;
+    rt_node_t *rn_root = NULL;
+    rt_node_t **nodes;
+    u_int32_t infos, count;
 
     /* Find subtree root node */
     st_root = rtn_lookup_node(rt_head, prefix, bitlen);
@@ -2173,6 +3529,28 @@ rtn_detach_subtree (rt_head_t *rt_head, char *prefix, u_int32_t bitlen)
         /* Return in case of not found */
         return (NULL);
     }
+    if (!rtn_subtree_scan(st_root, &infos)) {
+        return (NULL);
+    }
+
+    /*
+     * Allocate all that the detach takes first, so that the tree is
+     * unchanged when out of memory.
+     */
+    nodes = rtn_move_subtree_alloc(rt_head, st_root, TRUE, &count);
+    if (!nodes) {
+        return (NULL);
+    }
+    if (!st_root->rnode_parent) {
+        rn_root = rtn_node_alloc(rt_head);
+        if (!rn_root) {
+            rtn_move_subtree_free(rt_head, nodes, count, TRUE);
+            return (NULL);
+        }
+    }
+
+    rtn_notify_subtree(rt_head, st_root, FALSE);
+    rt_head->ri_count -= infos;
 
     /* Detach sub-tree from main tree */
     st_root_parent = st_root->rnode_parent;
@@ -2182,20 +3560,22 @@ rtn_detach_subtree (rt_head_t *rt_head, char *prefix, u_int32_t bitlen)
          * Replace main tree root node with internal node
          * and return replaced root node.
          */
-        rt_head->root = rtn_node_alloc(rt_head);
-        return (st_root);
+        RTN_PUBLISH(rt_head->root, rn_root);
+        rtn_generation_bump(rt_head);
+        return (rtn_move_subtree(rt_head, st_root, TRUE, nodes));
     } else if (st_root_parent->rnode_right == st_root) {
-        st_root_parent->rnode_right = NULL;
+        RTN_PUBLISH(st_root_parent->rnode_right, NULL);
     } else {
         assert(st_root_parent->rnode_left == st_root);
-        st_root_parent->rnode_left = NULL;
+        RTN_PUBLISH(st_root_parent->rnode_left, NULL);
     }
     /* st_root is orphan now */
     st_root->rnode_parent = NULL;
     /* Clean up the main tree for any redundant splitter node */
     rtn_delete_node(rt_head, st_root_parent);
+    rtn_generation_bump(rt_head);
 
-    return (st_root);
+    return (rtn_move_subtree(rt_head, st_root, TRUE, nodes));
 }
 
 /*
@@ -2209,12 +3589,27 @@ rtn_attach_subtree (rt_head_t *rt_head, rt_node_t *st_root,
         char *addr, u_int32_t bitlen)
 {
     rt_node_t *rn, *rn_prev, *rn_add, *rn_new;
+    rt_node_t **nodes;
     u_short bits2chk, dbit;
     char *his_addr;
-    u_int i;
+    u_int32_t infos, count;
 
     rn = rt_head->root;
 
+    if (!rtn_subtree_scan(st_root, &infos)) {
+        return (FALSE);
+    }
+
+    /*
+     * The nodes of the subtree move to the arena of the tree only once
+     * nothing can fail, so that the subtree is unchanged, still out of
+     * any arena, when FALSE is returned.
+     */
+    nodes = rtn_move_subtree_alloc(rt_head, st_root, FALSE, &count);
+    if (!nodes) {
+        return (FALSE);
+    }
+
     /*
      * Case 0:
      * Attach subtree with prefix 0.0.0.0/0 (or ::/0) to an empty tree.
@@ -2225,12 +3620,16 @@ rtn_attach_subtree (rt_head_t *rt_head, rt_node_t *st_root,
         if ((rn->rnode_flags & RNODE_EXTERNAL) ||
                 rn->rnode_left || rn->rnode_right) {
             /* main tree is not empty, return */
+            rtn_move_subtree_free(rt_head, nodes, count, FALSE);
             return (FALSE);
         }
+        st_root = rtn_move_subtree(rt_head, st_root, FALSE, nodes);
         rn->rnode_left = st_root->rnode_left;
         rn->rnode_right = st_root->rnode_right;
         /* Replace root with subtree */
         rtn_replace_node(rt_head, rn, st_root);
+        rt_head->ri_count += infos;
+        rtn_notify_subtree(rt_head, st_root, TRUE);
         return (TRUE);
     }
 
@@ -2263,13 +3662,7 @@ rtn_attach_subtree (rt_head_t *rt_head, rt_node_t *st_root,
 
     assert (his_addr || (bits2chk == 0));
 
-    for (dbit = 0; dbit < bits2chk; dbit += RNBBY) {
-        i = dbit >> RNSHIFT;
-        if (addr[i] != his_addr[i]) {
-            dbit += first_bit_set[addr[i] ^ his_addr[i]];
-            break;
-        }
-    }
+    dbit = rtn_key_diff((u_int8_t *) addr, (u_int8_t *) his_addr, bits2chk);
 
     /*
      * If the different bit is less than bits2chk we will need to
@@ -2298,10 +3691,10 @@ rtn_attach_subtree (rt_head_t *rt_head, rt_node_t *st_root,
      * subtree is already part of main tree, just return.
      */
     if (dbit == bitlen && rn->rnode_bit == bitlen) {
+        rtn_move_subtree_free(rt_head, nodes, count, FALSE);
         return (FALSE);
     }
 
-    rn_add = st_root;
     /*
      * Check if we can attach directly to the rn.
      */
@@ -2310,14 +3703,18 @@ rtn_attach_subtree (rt_head_t *rt_head, rt_node_t *st_root,
         /* Case 1
          * Making st_root child of rn
          */
+        st_root = rtn_move_subtree(rt_head, st_root, FALSE, nodes);
+        rn_add = st_root;
         rn_add->rnode_parent = rn;
         if (addr[RNBYTE(rn->rnode_bit)] & RNBIT(rn->rnode_bit)) {
             assert(!(rn->rnode_right));
-            rn->rnode_right = rn_add;
+            RTN_PUBLISH(rn->rnode_right, rn_add);
         } else {
             assert(!(rn->rnode_left));
-            rn->rnode_left = rn_add;
+            RTN_PUBLISH(rn->rnode_left, rn_add);
         }
+        rt_head->ri_count += infos;
+        rtn_notify_subtree(rt_head, st_root, TRUE);
         return (TRUE);
     }
 
@@ -2327,6 +3724,7 @@ rtn_attach_subtree (rt_head_t *rt_head, rt_node_t *st_root,
      */
     if (dbit == bitlen) {
         /* Subtree already there just return */
+        rtn_move_subtree_free(rt_head, nodes, count, FALSE);
         return (FALSE);
     } else {
         /*
@@ -2337,10 +3735,12 @@ rtn_attach_subtree (rt_head_t *rt_head, rt_node_t *st_root,
         /* Allocating internal splitter node */
         rn_new = rtn_node_alloc(rt_head);
         if (!rn_new) {
-            rt_head->ri_count--;
+            rtn_move_subtree_free(rt_head, nodes, count, FALSE);
             return (FALSE);
         }
         rn_new->rnode_bit = dbit;
+        st_root = rtn_move_subtree(rt_head, st_root, FALSE, nodes);
+        rn_add = st_root;
 
         /* Making rn and st_root childs of splitter node */
         rn_add->rnode_parent = rn_new;
@@ -2358,16 +3758,242 @@ rtn_attach_subtree (rt_head_t *rt_head, rt_node_t *st_root,
         if (!rn_prev) {
             ;
         } else if (rn_prev->rnode_right == rn) {
-            rn_prev->rnode_right = rn_new;
+            RTN_PUBLISH(rn_prev->rnode_right, rn_new);
         } else {
             assert(rn_prev->rnode_left == rn);
-            rn_prev->rnode_left = rn_new;
+            RTN_PUBLISH(rn_prev->rnode_left, rn_new);
         }
     }
 
+    rt_head->ri_count += infos;
+    rtn_notify_subtree(rt_head, st_root, TRUE);
     return (TRUE);
 }
 
+/*
+ * rtn_purge_release
+ *
+ * Free the infos of a purge.
+ */
+static void
+rtn_purge_release (rtn_purge_t *purge)
+{
+    rt_node_t *rn, *next;
+
+    for (rn = purge->pg_head; rn; rn = next) {
+        next = rn->rnode_parent;
+        if (purge->pg_free) {
+            (*(purge->pg_free))((rt_info_t *) rn);
+        } else if (!purge->pg_keep) {
+            free(rn);
+        }
+    }
+    free(purge);
+}
+
+/*
+ * rtn_purge_thread
+ */
+static void *
+rtn_purge_thread (void *arg)
+{
+    rtn_purge_release(arg);
+
+    pthread_mutex_lock(&rtn_purge_mutex);
+    if (--rtn_purge_pending == 0) {
+        pthread_cond_broadcast(&rtn_purge_cond);
+    }
+    pthread_mutex_unlock(&rtn_purge_mutex);
+
+    return (NULL);
+}
+
+/*
+ * rtn_purge_begin
+ *
+ * With RTN_PURGE_ASYNC, have the infos released from now on chained
+ * instead of freed, when there is anything to free.
+ */
+static void
+rtn_purge_begin (rt_head_t *rt_head, u_int8_t flags)
+{
+    rtn_purge_t *purge;
+
+    if (!(flags & RTN_PURGE_ASYNC) ||
+        (!rt_head->ri_free && (rt_head->flags & RTN_BIT_KEEP_INFO))) {
+        return;
+    }
+
+    /*
+     * Out of memory: the infos are freed as usual.
+     */
+    purge = calloc(1, sizeof(rtn_purge_t));
+    if (purge) {
+        purge->pg_free = rt_head->ri_free;
+        purge->pg_keep = !!(rt_head->flags & RTN_BIT_KEEP_INFO);
+        rt_head->rt_purge = purge;
+    }
+}
+
+/*
+ * rtn_purge_end
+ *
+ * Hand the infos chained since rtn_purge_begin() to a thread, or free
+ * them here when no thread can be started.
+ */
+static void
+rtn_purge_end (rt_head_t *rt_head)
+{
+    rtn_purge_t *purge = rt_head->rt_purge;
+    pthread_attr_t attr;
+    pthread_t thread;
+    int err;
+
+    if (!purge) {
+        return;
+    }
+    rt_head->rt_purge = NULL;
+
+    if (!purge->pg_head) {
+        free(purge);
+        return;
+    }
+
+    pthread_mutex_lock(&rtn_purge_mutex);
+    rtn_purge_pending++;
+    pthread_mutex_unlock(&rtn_purge_mutex);
+
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    err = pthread_create(&thread, &attr, rtn_purge_thread, purge);
+    pthread_attr_destroy(&attr);
+    if (err) {
+        rtn_purge_thread(purge);
+    }
+}
+
+/*
+ * rtn_purge_wait
+ */
+void
+rtn_purge_wait (void)
+{
+    pthread_mutex_lock(&rtn_purge_mutex);
+    while (rtn_purge_pending) {
+        pthread_cond_wait(&rtn_purge_cond, &rtn_purge_mutex);
+    }
+    pthread_mutex_unlock(&rtn_purge_mutex);
+}
+
+/*
+ * rtn_delete_each
+ *
+ * Each entry is deleted as by rtn_delete(), which stops its cleanup at
+ * the first node above that still has an info or two children, so the
+ * entries of the list never free each other.
+ */
+u_int32_t
+rtn_delete_each (rt_head_t *rt_head, rt_info_t **rinfos, u_int32_t count,
+                 u_int8_t flags)
+{
+    u_int32_t i;
+
+    rtn_purge_begin(rt_head, flags);
+    for (i = 0; i < count; i++) {
+        rtn_delete(rinfos[i], rt_head);
+    }
+    rtn_purge_end(rt_head);
+
+    return (count);
+}
+
+/*
+ * rtn_purge_subtree
+ *
+ * Detach the subtree of a prefix, as rtn_detach_subtree() does, with a
+ * single cleanup above it, then free its nodes in one post-order sweep,
+ * children first, so that a node is freed after the last look at it.
+ *
+ * A node locked by a walk is not freed: it is marked as replaced, with
+ * no info, as when rtn_delete() takes it out of the tree. The walk then
+ * goes on from its key in the tree, and frees it when it unlocks it.
+ */
+u_int32_t
+rtn_purge_subtree (rt_head_t *rt_head, char *prefix, u_int16_t bitlen,
+                   u_int8_t flags)
+{
+    rt_node_t *st_root, *parent, *rn, *next;
+    u_int32_t count = 0;
+
+    if (rt_head->rt_snapshot && !rtn_snapshot_promote(rt_head, NULL)) {
+        return (0);
+    }
+
+    st_root = rtn_lookup_node(rt_head, prefix, bitlen);
+    if (!st_root) {
+        return (0);
+    }
+    rtn_notify_subtree(rt_head, st_root, FALSE);
+
+    parent = st_root->rnode_parent;
+    if (!parent) {
+        next = rtn_node_alloc(rt_head);
+        if (!next) {
+            return (0);
+        }
+        RTN_PUBLISH(rt_head->root, next);
+    } else {
+        if (parent->rnode_right == st_root) {
+            RTN_PUBLISH(parent->rnode_right, NULL);
+        } else {
+            assert(parent->rnode_left == st_root);
+            RTN_PUBLISH(parent->rnode_left, NULL);
+        }
+        st_root->rnode_parent = NULL;
+        rtn_delete_node(rt_head, parent);
+    }
+    rtn_generation_bump(rt_head);
+
+    rtn_purge_begin(rt_head, flags);
+
+    for (rn = st_root; rn->rnode_left || rn->rnode_right;) {
+        rn = rn->rnode_left ? rn->rnode_left : rn->rnode_right;
+    }
+
+    for (; rn; rn = next) {
+        /*
+         * The next node in the post-order, before this one goes.
+         */
+        parent = rn->rnode_parent;
+        if (rn == st_root) {
+            next = NULL;
+        } else if ((parent->rnode_left == rn) && parent->rnode_right) {
+            for (next = parent->rnode_right;
+                 next->rnode_left || next->rnode_right;) {
+                next = next->rnode_left ? next->rnode_left : next->rnode_right;
+            }
+        } else {
+            next = parent;
+        }
+
+        if (rn->rnode_flags & RNODE_INFO) {
+            count++;
+        }
+        rn->rnode_flags &= ~(RNODE_INFO | RNODE_DELETED);
+
+        if (rn->rnode_lock) {
+            rn->rnode_flags |= RNODE_REPLACED;
+        } else {
+            rtn_node_free(rt_head, rn);
+        }
+    }
+
+    rtn_purge_end(rt_head);
+    RTN_STATS_ADD(RTN_STAT_DELETE, count);
+
+    return (count);
+}
+
 /*
  * rtn_get_info_node
  *
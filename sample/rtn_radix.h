@@ -18,6 +18,12 @@
 #include <sys/types.h>
 #include <stdarg.h>
 #include "core-data-types/baseTypes.h"
+#include "corelibs/rtn_arena.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
 
 #define     RTWALK_ABORT        -1
 #define     RTWALK_CONTINUE      0
@@ -32,6 +38,7 @@
 #define  RNODE_EXTERNAL    0x02    /* external node */
 #define  RNODE_DELETED     0x04    /* marked for deletion */
 #define  RNODE_REPLACED    0x08    /* node replaced (not in the tree) */
+#define  RNODE_ORPHAN      0x10    /* detached node, not in any arena */
 
 /*
  * Shared by the internal node and the external node.
@@ -99,19 +106,53 @@ typedef void (*rt_info_free)(rt_info_t *rinfo);
  * entries chained off a node, and we can not simply look at the node
  * version to decide if the node can be skipped in rtn_walktree_version().
  * The user function supplied must perform the skipping (a corner case).
+ *
+ * When RTN_BIT_RCU is set, rtn_lookup() and rtn_lookup_batch() may run
+ * in other threads, inside rtn_rcu_read_lock()/rtn_rcu_read_unlock(),
+ * while one writer thread updates the tree. Nodes (and the info through
+ * rt_info_free) are then freed only after a grace period, and the writer
+ * should call rtn_rcu_reclaim() now and then to let that happen. With
+ * RTN_BIT_KEEP_INFO and no rt_info_free, a deleted info goes back to
+ * the caller at once, while a reader may still hold it: the caller must
+ * not change or free it before rtn_rcu_quiesce() (rtn_epoch.h) returns.
+ *
+ * When RTN_BIT_COMPACT is set, the tree also keeps a compact copy of its
+ * shape, for rtn_compact_lookup() (see rtn_compact.h). It is
+ * experimental: rtn_lookup() does not use it. It is ignored together
+ * with RTN_BIT_RCU.
+ *
+ * When RTN_BIT_HUGEPAGE is set, the internal nodes come from 2 MB huge
+ * pages (see rtn_arena.h), or from the heap when there are none. It is
+ * for large trees, where a lookup would take a TLB miss on most nodes.
  */
 #define RTN_BIT_CHUNK_NONE     0x00  /* do not use chunk for node */
 #define RTN_BIT_USE_CHUNK      0x01  /* use chunk for node */
 #define RTN_BIT_KEEP_INFO      0x02  /* do not free rt_info */
 #define RTN_BIT_MULTI_INFO     0x04  /* multiple info entries for a node */
 #define RTN_BIT_USE_CHUNK2     0x08  /* use the new chunk for node */
+#define RTN_BIT_RCU            0x10  /* lock-free readers, see rtn_epoch.h */
+#define RTN_BIT_COMPACT        0x20  /* compact nodes for lookups */
+#define RTN_BIT_HUGEPAGE       0x40  /* internal nodes on huge pages */
 
 /*
+ * The internal nodes of a tree always come from its own arena
+ * (rt_head_t.rn_arena), so the chunk flags are kept for compatibility
+ * only.
+ *
  * re-map some old defs.
  */
 #define RNODE_CHUNK_NONE       RTN_BIT_CHUNK_NONE
 #define RNODE_CHUNK_SHARED     RTN_BIT_USE_CHUNK
 
+struct _rtn_stride_t;
+struct _rtn_snapshot_t;
+struct _rtn_compact_t;
+struct _rtn_changelog_t;
+struct _rtn_views_t;
+struct _rtn_lc_t;
+struct _rtn_purge_t;
+struct _rtn_lenidx_t;
+
 typedef struct _rt_head_t
 {
     rt_node_t *root;          /* radix trie root */
@@ -121,8 +162,24 @@ typedef struct _rt_head_t
 
     u_int32_t rn_count;       /* count of internal nodes */
     u_int32_t ri_count;       /* count of external nodes */
+    rtn_arena_t rn_arena;     /* internal nodes of this tree, and stats */
     u_int32_t rtn_walktree_count;  /* count of calling rtn_walktree() */
     u_int32_t rtn_walktree_version_count;  /* count of calling rtn_walktree() */
+
+    struct _rtn_stride_t *rt_stride;   /* multibit lookup, could be NULL */
+    struct _rtn_snapshot_t *rt_snapshot; /* mapped snapshot, could be NULL */
+    struct _rtn_compact_t *rt_compact; /* RTN_BIT_COMPACT, could be NULL */
+    struct _rtn_changelog_t *rt_changelog; /* change log, could be NULL */
+    struct _rtn_views_t *rt_view;      /* versions for rtn_view.h, or NULL */
+    struct _rtn_lc_t *rt_lctrie;       /* compiled form, rtn_lctrie.h, or NULL */
+    struct _rtn_lenidx_t *rt_lenidx;   /* length index, rtn_lenidx.h, or NULL */
+    u_int64_t rt_generation;           /* moved on changes, rtn_flowcache.h */
+
+    struct _rtn_purge_t *rt_purge;     /* RTN_PURGE_ASYNC in progress, or NULL */
+
+    struct _rt_node_t *rt_retire_head; /* RTN_BIT_RCU: nodes to be freed */
+    struct _rt_node_t *rt_retire_tail; /* ... */
+    u_int32_t rt_retire_count;         /* ... */
 } rt_head_t;
 
 
@@ -142,6 +199,26 @@ typedef int (*rtn_walk_func)(rt_info_t *rinfo, va_list ap);
  */
 typedef void (*rnode_walk_func)(rt_node_t *rn);
 
+/*
+ * An entry for rtn_bulk_load(). The key is rinfo->rninfo_key.
+ */
+typedef struct _rtn_bulk_entry_t
+{
+    rt_info_t   *rinfo;              /* info to insert */
+    u_int16_t   bitlen;              /* bit length for the info */
+} rtn_bulk_entry_t;
+
+/**
+ * Iterator for rtn_bulk_load_iter().
+ *
+ * @param arg     as passed to rtn_bulk_load_iter().
+ * @param bitlen  set to the bit length for the info returned.
+ *
+ * @return
+ *     the next info to insert, or NULL at the end.
+ */
+typedef rt_info_t *(*rtn_bulk_next_func)(void *arg, u_int16_t *bitlen);
+
 
 /**
  * @name API for radix.c
@@ -153,7 +230,7 @@ typedef void (*rnode_walk_func)(rt_node_t *rn);
  * anything with the tree.
  *
  * @param rt_head  Structure for root, free and stats. Can not be NULL.
- * @param chunk_flags  Should be one of RNODE_CHUNK_ flags.
+ * @param flags    RTN_BIT_ flags.
  * @param ri_free  The function pointer to free the user info. It could
  *                 be NULL in which case free() is used.
  * @return
@@ -163,7 +240,8 @@ extern rt_node_t *rtn_root_init(rt_head_t *rt_head, u_int8_t flags,
                                 rt_info_free ri_free);
 
 /*
- * Function to free the root when a radix tree is deleted.
+ * Function to free the root when a radix tree is deleted. The arena of
+ * internal nodes is released in bulk.
  *
  * @param rt_head  structure that holds the root and stats. Can not be NULL.
  */
@@ -183,6 +261,40 @@ extern void rtn_root_free(rt_head_t *rt_head);
  */
 extern int8_t rtn_add(rt_head_t *rt_head, rt_info_t *rinfo, u_int16_t bitlen);
 
+/**
+ * Insert a stream of infos sorted in the order of a pre-order walk of
+ * the tree: by key, and for the same key by bit length, where only the
+ * bits within the bit length of a key count. This is the order in which
+ * rtn_walktree() returns them.
+ *
+ * Each info is linked right after the one before it, with no search from
+ * the root, so a full table is built in one linear pass, with the
+ * internal nodes allocated in the order of the walk. The tree is the same
+ * as the one built by rtn_add() for each info. An info that does not come
+ * after all the infos already in the tree is still inserted, but at the
+ * cost of rtn_add(). A mapped snapshot (rtn_snapshot.h) is promoted
+ * first, as by rtn_add().
+ *
+ * @param rt_head     head structure. Must not be NULL.
+ * @param entries     array of infos to insert, and their bit lengths.
+ * @param count       number of entries.
+ *
+ * @return
+ *     number of infos inserted. An info already in the tree is skipped.
+ */
+extern u_int32_t rtn_bulk_load(rt_head_t *rt_head, rtn_bulk_entry_t *entries,
+                               u_int32_t count);
+
+/**
+ * Same as rtn_bulk_load(), for infos returned by an iterator.
+ *
+ * @param rt_head     head structure. Must not be NULL.
+ * @param next        iterator, called until it returns NULL.
+ * @param arg         passed to the iterator.
+ */
+extern u_int32_t rtn_bulk_load_iter(rt_head_t *rt_head,
+                                    rtn_bulk_next_func next, void *arg);
+
 
 /**
  * Delete an info entry.
@@ -201,6 +313,13 @@ extern void rtn_delete(rt_info_t *rinfo, rt_head_t *rt_head);
  * and update the subtree max version of all its parents.
  * Return TRUE if there is a version wrap.
  *
+ * rtn_head_bump_version() and rtn_head_bump_version_max_limit() also
+ * take the tree of the info, and log the change when the tree has a
+ * change log on that table version (see rtn_changelog.h). A tree with a
+ * change log must be bumped through them; the plain functions do not
+ * know the tree and log nothing.
+ *
+ * @param rt_head         head structure of the info, could be NULL
  * @param rinfo           an info entry
  * @param table_version   table/tree version
  *
@@ -210,6 +329,12 @@ extern void rtn_delete(rt_info_t *rinfo, rt_head_t *rt_head);
  */
 extern int8_t rtn_bump_version(rt_info_t *rinfo, u_int32_t *table_version);
 extern int8_t rtn_bump_version_max_limit(rt_info_t *rinfo, u_int32_t *table_version, u_int32_t max);
+extern int8_t rtn_head_bump_version(rt_head_t *rt_head, rt_info_t *rinfo,
+                                    u_int32_t *table_version);
+extern int8_t rtn_head_bump_version_max_limit(rt_head_t *rt_head,
+                                              rt_info_t *rinfo,
+                                              u_int32_t *table_version,
+                                              u_int32_t max);
 
 
 /**
@@ -237,6 +362,39 @@ extern rt_info_t *rtn_search(rt_head_t *rt_head, char *addr, u_int16_t bitlen);
  *      radix info found, could be NULL.
  */
 extern rt_info_t *rtn_lookup(rt_head_t *rt_head, char *addr, u_int16_t maxbitlen);
+
+/**
+ * Perform best match for a burst of addresses. The descents for the
+ * addresses are interleaved with prefetching so that their cache misses
+ * overlap. The result for each address is the same as rtn_lookup().
+ *
+ * @param rt_head     the ptr to the head structure.
+ * @param addrs       array of addresses in the network byte order
+ * @param maxbitlen   the max bit length allowed, as in rtn_lookup().
+ * @param results     array of count entries, filled with the radix info
+ *                    found for each address, could be NULL.
+ * @param count       number of addresses.
+ */
+extern void rtn_lookup_batch(rt_head_t *rt_head, char **addrs,
+                             u_int16_t maxbitlen, rt_info_t **results,
+                             u_int32_t count);
+
+/**
+ * Perform best match for one address in each of a set of trees, e.g.,
+ * the VRFs a route could be leaked from. The descents in the trees are
+ * interleaved as in rtn_lookup_batch(). The result for each tree is the
+ * same as rtn_lookup().
+ *
+ * @param rt_heads    array of count trees, could hold the same tree twice.
+ * @param addr        address in the network byte order
+ * @param maxbitlen   the max bit length allowed, as in rtn_lookup().
+ * @param results     array of count entries, results[i] is filled with
+ *                    the radix info found in rt_heads[i], could be NULL.
+ * @param count       number of trees.
+ */
+extern void rtn_lookup_multi(rt_head_t **rt_heads, char *addr,
+                             u_int16_t maxbitlen, rt_info_t **results,
+                             u_int32_t count);
 extern rt_node_t *rtn_lookup_node (rt_head_t *rt_head, char *addr,
                                    u_int16_t bitlen);
 
@@ -280,6 +438,28 @@ rt_info_t *
 rtn_lookup_prefix_overlap (rt_head_t *rt_head, char *addr, u_int16_t
                            maxbitlen);
 
+/**
+ * Do rtn_lookup_range(), or rtn_lookup_prefix_overlap(), for an array of
+ * prefixes. Each descent goes on from the nodes it shares with the one
+ * of the previous prefix, so when the prefixes are sorted (as for
+ * rtn_bulk_load()), the array and the tree are merged in about a single
+ * pass. The result for each prefix is the same as with the single call.
+ *
+ * @param rt_head     ptr to the head structure, cannot be NULL.
+ * @param addrs       array of addresses in the network byte order
+ * @param bitlens     array of prefix lengths, the maxbitlen of each call.
+ * @param results     array of count entries, filled with the radix info
+ *                    found for each prefix, could be NULL.
+ * @param count       number of prefixes.
+ */
+extern void rtn_lookup_range_batch(rt_head_t *rt_head, char **addrs,
+                                   u_int16_t *bitlens, rt_info_t **results,
+                                   u_int32_t count);
+extern void rtn_lookup_prefix_overlap_batch(rt_head_t *rt_head, char **addrs,
+                                            u_int16_t *bitlens,
+                                            rt_info_t **results,
+                                            u_int32_t count);
+
 
 /**
  * Walk all entries, and yield after the specified number of entries
@@ -351,6 +531,80 @@ extern int8_t rtn_walktree_keybits(rt_node_t *start_node, rtn_walk_func f,
 extern rt_info_t *rtn_key_getnext(rt_head_t *rt_head, char *addr,
                                   u_int16_t bitlen, int exact_match);
 
+/**
+ * A position in the lexical order of a tree, for getnext requests that
+ * come one at a time, e.g. SNMP getnext or a paginated show command.
+ *
+ * The cursor keeps the last info it returned, and the generation of the
+ * tree (rt_generation) at that time. While the tree does not change, the
+ * next info is one step away; once it changes, the cursor goes down the
+ * tree again from a copy of the last key, as rtn_key_getnext() does. It
+ * takes no lock, so any number of cursors can be kept on a tree, and
+ * each one is used as rtn_key_getnext() would be.
+ *
+ * A cursor holds no pointer into itself, so it can be copied by
+ * assignment, e.g. to keep a position and go on from it later, as long
+ * as its keys fit in RTN_GETNEXT_KEY_BYTES. A cursor on longer keys
+ * keeps the last one in memory of its own (gc_key_long), which a copy
+ * would share: such a cursor must not be copied.
+ */
+#define RTN_GETNEXT_KEY_BYTES  16
+
+typedef struct _rtn_getnext_cursor_t
+{
+    rt_head_t   *gc_head;       /* the tree */
+    rt_node_t   *gc_node;       /* last info returned, or NULL */
+    u_int64_t   gc_generation;  /* rt_generation when gc_node was taken */
+    u_int8_t    *gc_key_long;   /* last key, when longer than gc_key_buf */
+    u_int16_t   gc_bitlen;      /* its bit length */
+    u_int16_t   gc_key_size;    /* bytes at gc_key_long, or 0 */
+    u_int8_t    gc_started;     /* FALSE: the next info is the first one */
+    u_int8_t    gc_done;        /* past the last info */
+    u_int8_t    pad[2];
+    u_int64_t   gc_steps;       /* infos returned with one step */
+    u_int64_t   gc_descents;    /* infos returned with a descent */
+    u_int8_t    gc_key_buf[RTN_GETNEXT_KEY_BYTES];  /* last key */
+} rtn_getnext_cursor_t;
+
+/**
+ * Set a cursor before the first info of a tree.
+ *
+ * @param gc          the cursor.
+ * @param rt_head     ptr to the head structure, can not be NULL.
+ */
+extern void rtn_getnext_cursor_init(rtn_getnext_cursor_t *gc,
+                                    rt_head_t *rt_head);
+
+/**
+ * Set a cursor at a key, so that the next info is the one after it,
+ * as rtn_key_getnext() with exact_match FALSE.
+ *
+ * @param gc          the cursor.
+ * @param addr        address in network byte order.
+ * @param bitlen      bit length.
+ *
+ * @return
+ *     TRUE: succeed; FALSE: out of memory for a long key.
+ */
+extern int8_t rtn_getnext_cursor_seek(rtn_getnext_cursor_t *gc, char *addr,
+                                      u_int16_t bitlen);
+
+/**
+ * Return the next info of a cursor, and move the cursor to it.
+ *
+ * @param gc          the cursor.
+ *
+ * @return
+ *     the next info, or NULL past the last one (or out of memory for a
+ *     long key).
+ */
+extern rt_info_t *rtn_getnext_cursor_next(rtn_getnext_cursor_t *gc);
+
+/**
+ * Free the memory of a cursor for a long key.
+ */
+extern void rtn_getnext_cursor_free(rtn_getnext_cursor_t *gc);
+
 /**
  * Walk limited number of entries, and then return.
  * The next_item is the item at which we stop processing (i.e., not processed).
@@ -420,6 +674,70 @@ rtn_walktree_version_limited(rt_node_t *start_node, rtn_walk_func f,
                              u_int32_t max_version, u_int32_t limit, ...);
 
 
+/**
+ * A walk that returns to its caller after a given number of entries,
+ * and goes on from there on the next call, e.g. from an event loop that
+ * interleaves a long walk with other work instead of yielding.
+ *
+ * Between calls the cursor keeps a lock on the next info, as a walk
+ * that yields does, so the tree can change meanwhile. A cursor that
+ * is not walked to the end must be stopped, to release its lock. The
+ * cursor belongs to the thread that changes the tree.
+ *
+ * An info deleted while the cursor is parked on it (wc_node) stays
+ * linked in the tree until the next call or the stop, so it must not
+ * be freed or added back before then: rtn_add() would clear the links
+ * of a node still in the tree. Add a copy instead.
+ *
+ * The work of one call is bounded by its count, not by the size of the
+ * tree: besides the count calls of the walk function, it visits the
+ * internal nodes between two infos in the walk order, at most two per
+ * bit of the key (up to the common parent, and down again), and at
+ * most one search by key when the parked info was replaced meanwhile.
+ * That is O(count * key bits) nodes, most of them cache misses in a
+ * large tree: on 160k IPv4 prefixes, 64 infos per call take about 20 us,
+ * 30-50 us at the 99th percentile.
+ */
+typedef struct _rtn_walk_cursor_t
+{
+    rt_head_t   *wc_head;       /* the tree */
+    rt_node_t   *wc_node;       /* next info, locked, or NULL at the end */
+    u_int64_t   wc_count;       /* count of infos processed */
+} rtn_walk_cursor_t;
+
+/**
+ * Set a cursor at the start of a walk.
+ *
+ * @param wc          the cursor.
+ * @param rt_head     ptr to the head structure, can not be NULL.
+ * @param start_node  node to start the walk, NULL for the root.
+ */
+extern void rtn_walk_cursor_init(rtn_walk_cursor_t *wc, rt_head_t *rt_head,
+                                 rt_node_t *start_node);
+
+/**
+ * Process the next entries of a walk.
+ *
+ * @param wc     the cursor.
+ * @param count  max. number of entries to process.
+ * @param f      walk function to process an radix info.
+ * @param ...    arguments passed to f.
+ *
+ * @return
+ *      1: entries are left for the next call.
+ *      0: the walk is done.
+ *     -1: aborted by f. The cursor is after the entry, and should be
+ *         stopped unless the walk goes on.
+ */
+extern int8_t rtn_walk_cursor_resume(rtn_walk_cursor_t *wc, u_int32_t count,
+                                     rtn_walk_func f, ...);
+
+/**
+ * Stop a walk before its end.
+ */
+extern void rtn_walk_cursor_stop(rtn_walk_cursor_t *wc);
+
+
 /**
  * Walk a subtree (ie. all entries below a given prefix), and yield after
  * the specified number of entries have been processed if blocking is TRUE.
@@ -512,6 +830,8 @@ rtn_dumptree (rt_node_t *start_node, rtn_walk_func fi, rnode_walk_func fn,
 /*
  * Attach the subtree with given prefix string and len to the
  * main tree. Return error if subtree is already part of main tree.
+ * The infos of the subtree are added to ri_count. On an error, out of
+ * memory included, both the tree and the subtree are unchanged.
  *
  * @param rt_head     Main tree head structure. Must not be NULL.
  * @param st_root     root node of subtree to be attached.
@@ -527,18 +847,73 @@ rtn_attach_subtree(rt_head_t *rt_head, rt_node_t *st_root,
 
 /*
  * Find and detach the subtree with given prefix string and len
- * from the main tree.
+ * from the main tree. The internal nodes of the subtree are moved out
+ * of the arena of the tree, so the subtree can outlive the tree, and
+ * be attached to another one, and its infos are taken out of ri_count.
+ * A subtree with an internal node a walk has yielded on (rnode_lock)
+ * is not detached, since the walk frees that node to the arena.
  *
  * @param rt_head     Main tree head structure. Must not be NULL.
  * @param prefix      subtree prefix address in the network byte order
  * @param bitlen      subtree prefix bit length
  *
- * @return            subtree root node if found else NULL.
+ * @return            subtree root node if found and not locked, else
+ *                    NULL. When out of memory, NULL and the tree is
+ *                    unchanged.
  *
  */
 rt_node_t *
 rtn_detach_subtree(rt_head_t *rt_head, char *prefix, u_int32_t bitlen);
 
+/*
+ * Flags of rtn_delete_each() and rtn_purge_subtree().
+ */
+#define RTN_PURGE_ASYNC        0x01  /* free the infos in a thread */
+
+/**
+ * Delete a list of info entries, by a loop of rtn_delete(). The entries
+ * need not be related, so there is no work saved in the tree: each one
+ * costs its own rtn_delete(), and its own cleanup above it. For the
+ * entries under one prefix, rtn_purge_subtree() detaches them at once.
+ *
+ * What it adds is RTN_PURGE_ASYNC: the infos are then freed (ri_free, or
+ * free() without RTN_BIT_KEEP_INFO) in a thread, once all of them are
+ * out of the tree, so the caller does not wait for them. An info held by
+ * a view, or by a walk that has yielded on it, is freed later as usual.
+ *
+ * @param rt_head     head structure. Must not be NULL.
+ * @param rinfos      array of count infos, each of them in the tree.
+ * @param count       number of infos.
+ * @param flags       RTN_PURGE_ flags.
+ *
+ * @return            number of infos deleted.
+ */
+extern u_int32_t rtn_delete_each(rt_head_t *rt_head, rt_info_t **rinfos,
+                                 u_int32_t count, u_int8_t flags);
+
+/**
+ * Delete all the info entries under a prefix, e.g., the routes of a VRF
+ * or of a peer in a tree keyed by it. The subtree is detached at once,
+ * with one cleanup above it, instead of one per entry, and its nodes are
+ * then freed in one sweep. A node a walk has yielded on is left to the
+ * walk, which goes on after it in the tree, as after rtn_delete().
+ *
+ * @param rt_head     head structure. Must not be NULL.
+ * @param prefix      prefix address in the network byte order
+ * @param bitlen      prefix bit length
+ * @param flags       RTN_PURGE_ flags, as in rtn_delete_each().
+ *
+ * @return            number of infos deleted.
+ */
+extern u_int32_t rtn_purge_subtree(rt_head_t *rt_head, char *prefix,
+                                   u_int16_t bitlen, u_int8_t flags);
+
+/**
+ * Wait until the infos of all the RTN_PURGE_ASYNC calls are freed, e.g.,
+ * before the callback of ri_free goes away.
+ */
+extern void rtn_purge_wait(void);
+
 
 /*
  * Return parent info node of passed node.
@@ -627,4 +1002,8 @@ rtn_get_info_node(rt_head_t *rt_head, char *addr, u_int16_t bitlen);
     } while (turbo_node_p != (end_p)); \
  }
 
+#ifdef __cplusplus
+};
+#endif
+
 #endif  /* __RTN_RADIX_H__ */
@@ -0,0 +1,358 @@
+/**
+ *  @name rtn_radix.hpp, Radix trees with a fixed key width
+ *
+ *  C++ front end of rtn_radix.h.
+ *
+ *  rtn_radix.c takes a key as bytes and a bit length, and tests a bit
+ *  with RNBYTE()/RNBIT(), and compares keys a word or a byte at a time.
+ *  When all the keys of a tree have the same width (32 bits for IPv4,
+ *  128 for IPv6, 20 for MPLS labels), RadixTree<KeyBits> loads the key
+ *  once into a register, and the lookup is shifts and compares:
+ *
+ *   o a bit test is a shift of the key;
+ *
+ *   o the backtrack of rtn_lookup() compares the key with the key of
+ *     the node where the descent stopped at each level; here the first
+ *     differing bit of the two is found once, and each level compares
+ *     it with its bit number.
+ *
+ *  The tree is an rt_head_t, with the nodes and the infos of the C code,
+ *  so the infos are the same structures with RADIX_INFO_HEADER, and
+ *  head() gives the tree to the rest of the C API. Changes, walks and
+ *  the lookup structures (RTN_BIT_RCU, rtn_lctrie.h, snapshots) are
+ *  those of rtn_radix.c; lookup() falls back to rtn_lookup() when any
+ *  of the latter is in use.
+ *
+ *  The key of each info, and each address passed, must hold KeyBits
+ *  bits, i.e., (KeyBits + 7) / 8 bytes in the network byte order.
+ *
+ *     Copyright (c) 2016 Ericsson AB.
+ *
+ *     All rights reserved.
+ */
+
+#ifndef __RTN_RADIX_HPP__
+#define __RTN_RADIX_HPP__
+
+#include <string.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "corelibs/rtn_radix.h"
+
+namespace rtn {
+
+/*
+ * The smallest word that holds a key of KeyBits bits. The key is kept
+ * with its first bit as the msb of the word.
+ */
+template <unsigned KeyBits, bool Fit32 = (KeyBits <= 32),
+          bool Fit64 = (KeyBits <= 64)>
+struct RadixWord {
+    typedef unsigned __int128 word_t;
+};
+
+template <unsigned KeyBits>
+struct RadixWord<KeyBits, false, true> {
+    typedef uint64_t word_t;
+};
+
+template <unsigned KeyBits>
+struct RadixWord<KeyBits, true, true> {
+    typedef uint32_t word_t;
+};
+
+/*
+ * Key operations for a key width.
+ */
+template <unsigned KeyBits>
+struct RadixKey {
+    typedef typename RadixWord<KeyBits>::word_t word_t;
+
+    enum {
+        WORD_BITS = sizeof(word_t) * 8,
+        KEY_BYTES = (KeyBits + 7) / 8
+    };
+
+    /*
+     * Load a key in the network byte order.
+     */
+    static inline word_t load (const void *addr)
+    {
+        const uint8_t *bytes = (const uint8_t *) addr;
+        word_t word = 0;
+        uint64_t half;
+        uint32_t w32;
+        unsigned i = 0;
+
+        if (KEY_BYTES == sizeof(word_t)) {
+            return (from_bytes(bytes));
+        }
+
+        /*
+         * A key shorter than its word (the 96 bits of a VPN key, the 20
+         * of an MPLS label): 64 bits, then 32, while they fit in the key,
+         * and the rest a byte at a time, so nothing is read past it.
+         */
+        for (; i + sizeof(half) <= KEY_BYTES; i += sizeof(half)) {
+            memcpy(&half, bytes + i, sizeof(half));
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+            half = __builtin_bswap64(half);
+#endif
+            word |= (word_t) half << (WORD_BITS - 64 - 8 * i);
+        }
+        if (i + sizeof(w32) <= KEY_BYTES) {
+            memcpy(&w32, bytes + i, sizeof(w32));
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+            w32 = __builtin_bswap32(w32);
+#endif
+            word |= (word_t) w32 << (WORD_BITS - 32 - 8 * i);
+            i += sizeof(w32);
+        }
+        for (; i < KEY_BYTES; i++) {
+            word |= (word_t) bytes[i] << (WORD_BITS - 8 - 8 * i);
+        }
+        return (word);
+    }
+
+    /*
+     * Test bit number bit (0 is the first one). The bits past the key are
+     * clear.
+     */
+    static inline bool bit (word_t key, u_int16_t bit)
+    {
+        return ((bit < WORD_BITS) && ((key >> (WORD_BITS - 1 - bit)) & 1));
+    }
+
+    /*
+     * The first bit that differs between two keys, or WORD_BITS.
+     */
+    static inline u_int16_t diff (word_t key1, word_t key2)
+    {
+        return (clz(key1 ^ key2));
+    }
+
+private:
+    static inline word_t from_bytes (const uint8_t *buf);
+    static inline u_int16_t clz (word_t word);
+};
+
+template <unsigned KeyBits>
+inline typename RadixKey<KeyBits>::word_t
+RadixKey<KeyBits>::from_bytes (const uint8_t *buf)
+{
+    word_t word = 0;
+    uint64_t half;
+    unsigned i;
+
+    /*
+     * One 32-bit load, or 64 bits at a time.
+     */
+    if (sizeof(word_t) == sizeof(uint32_t)) {
+        uint32_t w32;
+
+        memcpy(&w32, buf, sizeof(w32));
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        w32 = __builtin_bswap32(w32);
+#endif
+        return ((word_t) w32);
+    }
+
+    for (i = 0; i < sizeof(word_t); i += sizeof(half)) {
+        memcpy(&half, buf + i, sizeof(half));
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        half = __builtin_bswap64(half);
+#endif
+        word = (word_t) (((unsigned __int128) word << 64) | half);
+    }
+    return (word);
+}
+
+template <unsigned KeyBits>
+inline u_int16_t
+RadixKey<KeyBits>::clz (word_t word)
+{
+    if (!word) {
+        return (WORD_BITS);
+    }
+    if (sizeof(word_t) == sizeof(uint32_t)) {
+        return (__builtin_clz((uint32_t) word));
+    }
+    if (sizeof(word_t) == sizeof(uint64_t)) {
+        return (__builtin_clzll((uint64_t) word));
+    }
+
+    /*
+     * 128 bits.
+     */
+    if ((uint64_t) ((unsigned __int128) word >> 64)) {
+        return (__builtin_clzll((uint64_t) ((unsigned __int128) word >> 64)));
+    }
+    return (64 + __builtin_clzll((uint64_t) word));
+}
+
+/*
+ * A radix tree with keys of KeyBits bits.
+ */
+template <unsigned KeyBits>
+class RadixTree {
+public:
+    typedef RadixKey<KeyBits> key_ops;
+    typedef typename key_ops::word_t word_t;
+
+    explicit RadixTree (u_int8_t flags = RTN_BIT_CHUNK_NONE,
+                        rt_info_free func = NULL)
+    {
+        rtn_root_init(&head_, flags, func);
+    }
+
+    ~RadixTree ()
+    {
+        rtn_root_free(&head_);
+    }
+
+    /*
+     * The tree, for the rest of the C API.
+     */
+    rt_head_t *head ()
+    {
+        return (&head_);
+    }
+
+    /*
+     * rtn_add(): TRUE when added.
+     */
+    bool add (rt_info_t *rinfo, u_int16_t bitlen)
+    {
+        return ((bitlen <= KeyBits) && rtn_add(&head_, rinfo, bitlen));
+    }
+
+    /*
+     * rtn_delete().
+     */
+    void remove (rt_info_t *rinfo)
+    {
+        rtn_delete(rinfo, &head_);
+    }
+
+    /*
+     * Exact match, as rtn_search().
+     */
+    rt_info_t *search (const void *addr, u_int16_t bitlen)
+    {
+        if (head_.rt_snapshot) {
+            return (rtn_search(&head_, (char *) addr, bitlen));
+        }
+        return (search(&head_, key_ops::load(addr), bitlen));
+    }
+
+    /*
+     * Best match, as rtn_lookup().
+     */
+    rt_info_t *lookup (const void *addr, u_int16_t maxbitlen = KeyBits)
+    {
+        if (!fast(&head_)) {
+            return (rtn_lookup(&head_, (char *) addr, maxbitlen));
+        }
+        return (lookup(&head_, key_ops::load(addr), maxbitlen));
+    }
+
+    /*
+     * Best match for a key already in a register, e.g. from a packet.
+     */
+    rt_info_t *lookup_key (word_t key, u_int16_t maxbitlen = KeyBits)
+    {
+        return (lookup(&head_, key, maxbitlen));
+    }
+
+    /*
+     * The same on a tree of the C code, which must have no lookup
+     * structure (see fast()).
+     */
+    static rt_info_t *search (rt_head_t *rt_head, word_t key,
+                              u_int16_t bitlen);
+    static rt_info_t *lookup (rt_head_t *rt_head, word_t key,
+                              u_int16_t maxbitlen);
+
+    /*
+     * Whether a tree is done by the plain descent of rtn_lookup().
+     */
+    static bool fast (rt_head_t *rt_head)
+    {
+        return (!rt_head->rt_snapshot && !rt_head->rt_lctrie &&
+                !(rt_head->flags & RTN_BIT_RCU));
+    }
+
+private:
+    RadixTree (const RadixTree &);
+    RadixTree &operator= (const RadixTree &);
+
+    rt_head_t head_;
+};
+
+template <unsigned KeyBits>
+rt_info_t *
+RadixTree<KeyBits>::search (rt_head_t *rt_head, word_t key, u_int16_t bitlen)
+{
+    rt_node_t *rn;
+
+    for (rn = rt_head->root; rn && (rn->rnode_bit < bitlen);) {
+        rn = key_ops::bit(key, rn->rnode_bit) ? rn->rnode_right
+                                              : rn->rnode_left;
+    }
+
+    if (!rn || (rn->rnode_bit != bitlen) ||
+        !(rn->rnode_flags & RNODE_INFO)) {
+        return (NULL);
+    }
+
+    if (key_ops::diff(key, key_ops::load(((rt_info_t *) rn)->rninfo_key)) <
+        bitlen) {
+        return (NULL);
+    }
+    return ((rt_info_t *) rn);
+}
+
+template <unsigned KeyBits>
+rt_info_t *
+RadixTree<KeyBits>::lookup (rt_head_t *rt_head, word_t key,
+                            u_int16_t maxbitlen)
+{
+    rt_node_t *rn, *rn_next;
+    u_int16_t dbit;
+
+    /*
+     * Search down the tree as far as we can, stopping at a node with a
+     * bit number >= ours which has info attached.
+     */
+    rn = rt_head->root;
+    while ((rn->rnode_bit < maxbitlen) || !(rn->rnode_flags & RNODE_EXTERNAL)) {
+        rn_next = key_ops::bit(key, rn->rnode_bit) ? rn->rnode_right
+                                                   : rn->rnode_left;
+        if (!rn_next) {
+            break;
+        }
+        rn = rn_next;
+    }
+
+    if (!(rn->rnode_flags & RNODE_EXTERNAL)) {
+        return (NULL);
+    }
+
+    /*
+     * Backtrack: a node matches when its bit number is at most the first
+     * bit where our key and the key of the last node differ.
+     */
+    dbit = key_ops::diff(key, key_ops::load(((rt_info_t *) rn)->rninfo_key));
+    for (; rn != rt_head->root; rn = rn->rnode_parent) {
+        if ((rn->rnode_bit <= maxbitlen) && (rn->rnode_bit <= dbit) &&
+            (rn->rnode_flags & RNODE_INFO)) {
+            break;
+        }
+    }
+
+    return ((rn->rnode_flags & RNODE_INFO) ? (rt_info_t *) rn : NULL);
+}
+
+}  /* namespace rtn */
+
+#endif  /* __RTN_RADIX_HPP__ */
@@ -0,0 +1,583 @@
+/***
+ *   rtn_shape.c
+ *
+ *   Shape analysis of the radix trie.
+ *
+ *    Copyright (c) 2016 Ericsson AB.
+ *    All rights reserved.
+ *
+ ***
+ * Description:
+ *
+ * The tree is walked once in pre-order, keeping the depth, so every
+ * node is seen with its parent:
+ *
+ *   o An edge from a parent at bit p to a node at bit b skips b - p - 1
+ *     bits. The root has a parent at bit -1.
+ *
+ *   o A prefix of c bits has a longer info under it when an edge goes
+ *     past bit c (p < c < b), or ends at a node of bit c with children.
+ *     Each such prefix is found on exactly one edge, so sh_cut[] is
+ *     summed up from the edges with a difference array. A multibit trie
+ *     of stride s has a node for each of these prefixes at c = k * s,
+ *     and an info of l bits is expanded in the node of level
+ *     (l - 1) / s, so it is reached in ceil(l / s) levels.
+ *
+ *   o The nodes of a subtree under the split depth come in a row in
+ *     pre-order: a subtree starts at the first node at or under the
+ *     split, and ends at the next node that starts one, or that is
+ *     above the split.
+ *
+ ***/
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include "corelibs/rtn_radix.h"
+#include "corelibs/rtn_shape.h"
+#include "rtn_private.h"
+
+#define RTN_SHAPE_BAR           40     /* width of a histogram bar */
+
+typedef struct _rtn_shape_walk_t
+{
+    rtn_shape_t *sw_shape;
+    int64_t     sw_diff[RTN_SHAPE_BITS + 2]; /* sh_cut[], as differences */
+    rtn_shape_subtree_t sw_subtree;   /* subtree being walked */
+    u_int32_t   sw_subtree_depth;     /* depth of its root */
+    u_int8_t    sw_in_subtree;        /* sw_subtree is open */
+    u_int8_t    pad[3];
+} rtn_shape_walk_t;
+
+/*
+ * rtn_shape_subtree_key
+ *
+ * Copy the prefix of a subtree root, from the key of an external node
+ * under it.
+ */
+static void
+rtn_shape_subtree_key (rt_node_t *rn, rtn_shape_subtree_t *ss)
+{
+    rt_node_t *leaf = rn;
+    u_int16_t bytes;
+
+    while (!(leaf->rnode_flags & RNODE_EXTERNAL)) {
+        leaf = leaf->rnode_left ? leaf->rnode_left : leaf->rnode_right;
+        if (!leaf) {
+            return;
+        }
+    }
+
+    bytes = MIN(RNBYTE(rn->rnode_bit + RNBBY - 1), RTN_SHAPE_KEY_BYTES);
+    memcpy(ss->ss_key, ((rt_info_t *) leaf)->rninfo_key, bytes);
+    if ((rn->rnode_bit & 0x7) && (bytes == RNBYTE(rn->rnode_bit) + 1)) {
+        ss->ss_key[bytes - 1] &= ~(0xff >> (rn->rnode_bit & 0x7));
+    }
+}
+
+/*
+ * rtn_shape_close
+ *
+ * Count the subtree being walked, and keep it if it is one of the
+ * largest.
+ */
+static void
+rtn_shape_close (rtn_shape_walk_t *sw)
+{
+    rtn_shape_t *sh = sw->sw_shape;
+    rtn_shape_subtree_t *ss = &sw->sw_subtree;
+    u_int32_t bucket, i;
+
+    if (!sw->sw_in_subtree) {
+        return;
+    }
+    sw->sw_in_subtree = FALSE;
+
+    sh->sh_subtree_count++;
+    bucket = ss->ss_bytes ? 64 - __builtin_clzll(ss->ss_bytes) : 0;
+    sh->sh_subtree_size[MIN(bucket, RTN_SHAPE_SIZE_BUCKETS - 1)]++;
+
+    if ((sh->sh_top_count == RTN_SHAPE_TOP) &&
+        (ss->ss_bytes <= sh->sh_top[RTN_SHAPE_TOP - 1].ss_bytes)) {
+        return;
+    }
+    if (sh->sh_top_count < RTN_SHAPE_TOP) {
+        sh->sh_top_count++;
+    }
+    for (i = sh->sh_top_count - 1;
+         (i > 0) && (sh->sh_top[i - 1].ss_bytes < ss->ss_bytes); i--) {
+        sh->sh_top[i] = sh->sh_top[i - 1];
+    }
+    sh->sh_top[i] = *ss;
+}
+
+/*
+ * rtn_shape_visit
+ *
+ * Take the measures of a node.
+ */
+static void
+rtn_shape_visit (rtn_shape_walk_t *sw, rt_node_t *rn, u_int32_t depth)
+{
+    rtn_shape_t *sh = sw->sw_shape;
+    rtn_shape_subtree_t *ss = &sw->sw_subtree;
+    int32_t pbit, skip;
+    u_int32_t bit, len, children, bytes;
+    int8_t info;
+
+    pbit = rn->rnode_parent ? rn->rnode_parent->rnode_bit : -1;
+    bit = rn->rnode_bit;
+    info = !!(rn->rnode_flags & RNODE_INFO);
+    children = !!rn->rnode_left + !!rn->rnode_right;
+
+    /*
+     * Path compression.
+     */
+    skip = MAX((int32_t) bit - pbit - 1, 0);
+    sh->sh_skip[MIN(skip, RTN_SHAPE_SKIP)]++;
+    sh->sh_skip_bits += skip;
+    sh->sh_children[info][children]++;
+
+    /*
+     * The prefixes with a longer info under them, on this edge.
+     */
+    if (pbit + 1 <= RTN_SHAPE_BITS) {
+        sw->sw_diff[pbit + 1]++;
+        sw->sw_diff[MIN(bit, RTN_SHAPE_BITS + 1)]--;
+    }
+    if (children && (bit <= RTN_SHAPE_BITS)) {
+        sw->sw_diff[bit]++;
+        sw->sw_diff[bit + 1]--;
+    }
+
+    /*
+     * Subtrees.
+     */
+    if (bit < sh->sh_split) {
+        rtn_shape_close(sw);
+    } else if (pbit < sh->sh_split) {
+        rtn_shape_close(sw);
+        memset(ss, 0, sizeof(rtn_shape_subtree_t));
+        ss->ss_bitlen = bit;
+        rtn_shape_subtree_key(rn, ss);
+        sw->sw_subtree_depth = depth;
+        sw->sw_in_subtree = TRUE;
+    }
+
+    bytes = info ? sh->sh_info_size : sizeof(rt_node_t);
+    sh->sh_bytes += bytes;
+    if (sw->sw_in_subtree) {
+        ss->ss_bytes += bytes;
+        ss->ss_depth = MAX(ss->ss_depth, depth - sw->sw_subtree_depth + 1);
+        if (info) {
+            ss->ss_infos++;
+        } else {
+            ss->ss_nodes++;
+        }
+    } else {
+        sh->sh_above_bytes += bytes;
+    }
+
+    if (!info) {
+        sh->sh_internal++;
+        return;
+    }
+
+    sh->sh_infos++;
+    sh->sh_depth[MIN(depth, RTN_SHAPE_BITS)]++;
+    sh->sh_depth_sum += depth;
+    sh->sh_depth_max = MAX(sh->sh_depth_max, depth);
+    sh->sh_maxlen = MAX(sh->sh_maxlen, bit);
+
+    len = MIN(bit, RTN_SHAPE_BITS);
+    sh->sh_len_count[len]++;
+    sh->sh_len_depth_sum[len] += depth;
+    sh->sh_len_depth_max[len] = MAX(sh->sh_len_depth_max[len], depth);
+}
+
+/*
+ * rtn_shape_strides
+ *
+ * Estimate the multibit tries, from sh_cut[].
+ */
+static void
+rtn_shape_strides (rtn_shape_t *sh)
+{
+    rtn_shape_stride_t *st;
+    u_int64_t levels;
+    u_int32_t stride, bit, len;
+
+    for (stride = 1; stride <= RTN_SHAPE_STRIDES; stride++) {
+        st = &sh->sh_strides[stride - 1];
+
+        for (bit = 0; bit <= RTN_SHAPE_BITS; bit += stride) {
+            st->st_nodes += sh->sh_cut[bit];
+        }
+        st->st_nodes = MAX(st->st_nodes, 1);
+        st->st_bytes = (st->st_nodes << stride) * RTN_SHAPE_SLOT_BYTES;
+        st->st_levels = MAX((sh->sh_maxlen + stride - 1) / stride, 1);
+
+        levels = 0;
+        for (len = 0; len <= RTN_SHAPE_BITS; len++) {
+            levels += sh->sh_len_count[len] *
+                      MAX((len + stride - 1) / stride, 1);
+        }
+        st->st_mean_levels = sh->sh_infos ?
+                             (double) levels / sh->sh_infos : 0.0;
+    }
+}
+
+/*
+ * rtn_shape_analyze
+ */
+int8_t
+rtn_shape_analyze (rt_head_t *rt_head, u_int16_t split, u_int32_t info_size,
+                   rtn_shape_t *shape)
+{
+    rtn_shape_walk_t *sw;
+    rt_node_t *rn;
+    u_int32_t depth = 1, bit;
+    int64_t cut = 0;
+
+    if (rt_head->rt_snapshot) {
+        return (FALSE);
+    }
+
+    /*
+     * sw_diff[] is 2 KB: keep it off the stack.
+     */
+    sw = calloc(1, sizeof(rtn_shape_walk_t));
+    if (!sw) {
+        return (FALSE);
+    }
+
+    memset(shape, 0, sizeof(rtn_shape_t));
+    shape->sh_split = split;
+    shape->sh_info_size = info_size ? info_size : sizeof(rt_info_t);
+    sw->sw_shape = shape;
+
+    for (rn = rt_head->root; rn; ) {
+        rtn_shape_visit(sw, rn, depth);
+
+        if (rn->rnode_left || rn->rnode_right) {
+            rn = rn->rnode_left ? rn->rnode_left : rn->rnode_right;
+            depth++;
+            continue;
+        }
+
+        /*
+         * Go up to the first left child with a right sibling.
+         */
+        while (rn->rnode_parent &&
+               ((rn == rn->rnode_parent->rnode_right) ||
+                !rn->rnode_parent->rnode_right)) {
+            rn = rn->rnode_parent;
+            depth--;
+        }
+        rn = rn->rnode_parent ? rn->rnode_parent->rnode_right : NULL;
+    }
+    rtn_shape_close(sw);
+
+    for (bit = 0; bit <= RTN_SHAPE_BITS; bit++) {
+        cut += sw->sw_diff[bit];
+        shape->sh_cut[bit] = cut;
+    }
+    rtn_shape_strides(shape);
+
+    free(sw);
+    return (TRUE);
+}
+
+/*
+ * rtn_shape_bar
+ *
+ * A bar for a histogram line, scaled to the largest bucket.
+ */
+static const char *
+rtn_shape_bar (u_int64_t count, u_int64_t max)
+{
+    static const char bar[RTN_SHAPE_BAR + 1] =
+        "########################################";
+
+    return (bar + RTN_SHAPE_BAR -
+            (max ? (u_int32_t) ((count * RTN_SHAPE_BAR + max - 1) / max) : 0));
+}
+
+/*
+ * rtn_shape_prefix
+ *
+ * Format the prefix of a subtree, in hex.
+ */
+static void
+rtn_shape_prefix (rtn_shape_subtree_t *ss, char *buf, size_t size)
+{
+    u_int16_t bytes, i;
+    size_t off;
+
+    bytes = MIN(RNBYTE(ss->ss_bitlen + RNBBY - 1), RTN_SHAPE_KEY_BYTES);
+    off = snprintf(buf, size, "0x");
+    for (i = 0; (i < bytes) && (off + 2 < size); i++) {
+        off += snprintf(buf + off, size - off, "%02x", ss->ss_key[i]);
+    }
+    if (!bytes) {
+        off += snprintf(buf + off, size - off, "0");
+    }
+    snprintf(buf + off, size - off, "/%u", ss->ss_bitlen);
+}
+
+/*
+ * rtn_shape_dump
+ */
+void
+rtn_shape_dump (rtn_shape_t *sh, rtn_stats_print_func print, void *ctx)
+{
+    rtn_shape_stride_t *st;
+    rtn_shape_subtree_t *ss;
+    char line[256], prefix[64];
+    u_int64_t max, nodes;
+    u_int32_t i;
+
+    nodes = sh->sh_internal + sh->sh_infos;
+
+    snprintf(line, sizeof(line),
+             "nodes %llu: %llu internal, %llu infos, %.2f internal per info",
+             (unsigned long long) nodes,
+             (unsigned long long) sh->sh_internal,
+             (unsigned long long) sh->sh_infos,
+             sh->sh_infos ? (double) sh->sh_internal / sh->sh_infos : 0.0);
+    (*print)(ctx, line);
+    snprintf(line, sizeof(line),
+             "memory %llu bytes, %.1f per info (node %u bytes, info %u)",
+             (unsigned long long) sh->sh_bytes,
+             sh->sh_infos ? (double) sh->sh_bytes / sh->sh_infos : 0.0,
+             (u_int32_t) sizeof(rt_node_t), sh->sh_info_size);
+    (*print)(ctx, line);
+    snprintf(line, sizeof(line),
+             "children of internal nodes 0/1/2: %llu/%llu/%llu, "
+             "of infos: %llu/%llu/%llu",
+             (unsigned long long) sh->sh_children[0][0],
+             (unsigned long long) sh->sh_children[0][1],
+             (unsigned long long) sh->sh_children[0][2],
+             (unsigned long long) sh->sh_children[1][0],
+             (unsigned long long) sh->sh_children[1][1],
+             (unsigned long long) sh->sh_children[1][2]);
+    (*print)(ctx, line);
+
+    /*
+     * Depth.
+     */
+    snprintf(line, sizeof(line), "info depth: mean %.2f, max %u",
+             sh->sh_infos ? (double) sh->sh_depth_sum / sh->sh_infos : 0.0,
+             sh->sh_depth_max);
+    (*print)(ctx, line);
+    for (i = 0, max = 0; i <= RTN_SHAPE_BITS; i++) {
+        max = MAX(max, sh->sh_depth[i]);
+    }
+    for (i = 0; i <= RTN_SHAPE_BITS; i++) {
+        if (sh->sh_depth[i]) {
+            snprintf(line, sizeof(line), "  %4u%s %10llu %5.1f%% %s", i,
+                     (i == RTN_SHAPE_BITS) ? "+" : " ",
+                     (unsigned long long) sh->sh_depth[i],
+                     100.0 * sh->sh_depth[i] / sh->sh_infos,
+                     rtn_shape_bar(sh->sh_depth[i], max));
+            (*print)(ctx, line);
+        }
+    }
+
+    /*
+     * Prefix lengths, and the path to them.
+     */
+    (*print)(ctx, "prefix lengths: infos, depth mean and max");
+    for (i = 0, max = 0; i <= RTN_SHAPE_BITS; i++) {
+        max = MAX(max, sh->sh_len_count[i]);
+    }
+    for (i = 0; i <= RTN_SHAPE_BITS; i++) {
+        if (sh->sh_len_count[i]) {
+            snprintf(line, sizeof(line),
+                     "  /%-4u%s %10llu %6.2f %4u %s", i,
+                     (i == RTN_SHAPE_BITS) ? "+" : " ",
+                     (unsigned long long) sh->sh_len_count[i],
+                     (double) sh->sh_len_depth_sum[i] / sh->sh_len_count[i],
+                     sh->sh_len_depth_max[i],
+                     rtn_shape_bar(sh->sh_len_count[i], max));
+            (*print)(ctx, line);
+        }
+    }
+
+    /*
+     * Path compression.
+     */
+    snprintf(line, sizeof(line),
+             "path compression: %llu bits skipped, %.2f per node, "
+             "%llu nodes in a binary trie (%.1fx)",
+             (unsigned long long) sh->sh_skip_bits,
+             nodes ? (double) sh->sh_skip_bits / nodes : 0.0,
+             (unsigned long long) sh->sh_strides[0].st_nodes,
+             nodes ? (double) sh->sh_strides[0].st_nodes / nodes : 0.0);
+    (*print)(ctx, line);
+    for (i = 0, max = 0; i <= RTN_SHAPE_SKIP; i++) {
+        max = MAX(max, sh->sh_skip[i]);
+    }
+    for (i = 0; i <= RTN_SHAPE_SKIP; i++) {
+        if (sh->sh_skip[i]) {
+            snprintf(line, sizeof(line), "  skip %3u%s %10llu %s", i,
+                     (i == RTN_SHAPE_SKIP) ? "+" : " ",
+                     (unsigned long long) sh->sh_skip[i],
+                     rtn_shape_bar(sh->sh_skip[i], max));
+            (*print)(ctx, line);
+        }
+    }
+
+    /*
+     * Strides.
+     */
+    snprintf(line, sizeof(line),
+             "fixed strides: nodes, memory, levels max and mean "
+             "(radix: %llu bytes, depth mean %.2f)",
+             (unsigned long long) sh->sh_bytes,
+             sh->sh_infos ? (double) sh->sh_depth_sum / sh->sh_infos : 0.0);
+    (*print)(ctx, line);
+    for (i = 0; i < RTN_SHAPE_STRIDES; i++) {
+        st = &sh->sh_strides[i];
+        snprintf(line, sizeof(line),
+                 "  %2u bits %12llu %16llu %4u %6.2f", i + 1,
+                 (unsigned long long) st->st_nodes,
+                 (unsigned long long) st->st_bytes, st->st_levels,
+                 st->st_mean_levels);
+        (*print)(ctx, line);
+    }
+
+    /*
+     * Subtrees.
+     */
+    snprintf(line, sizeof(line),
+             "subtrees at bit %u: %llu, %llu bytes above",
+             sh->sh_split, (unsigned long long) sh->sh_subtree_count,
+             (unsigned long long) sh->sh_above_bytes);
+    (*print)(ctx, line);
+    for (i = 0, max = 0; i < RTN_SHAPE_SIZE_BUCKETS; i++) {
+        max = MAX(max, sh->sh_subtree_size[i]);
+    }
+    for (i = 0; i < RTN_SHAPE_SIZE_BUCKETS; i++) {
+        if (sh->sh_subtree_size[i]) {
+            snprintf(line, sizeof(line), "  < %12llu bytes %10llu %s",
+                     (unsigned long long) (1ULL << i),
+                     (unsigned long long) sh->sh_subtree_size[i],
+                     rtn_shape_bar(sh->sh_subtree_size[i], max));
+            (*print)(ctx, line);
+        }
+    }
+    for (i = 0; i < sh->sh_top_count; i++) {
+        ss = &sh->sh_top[i];
+        rtn_shape_prefix(ss, prefix, sizeof(prefix));
+        snprintf(line, sizeof(line),
+                 "  %-40s %8u nodes %8u infos %10llu bytes depth %u",
+                 prefix, ss->ss_nodes, ss->ss_infos,
+                 (unsigned long long) ss->ss_bytes, ss->ss_depth);
+        (*print)(ctx, line);
+    }
+}
+
+/*
+ * rtn_shape_export_array
+ *
+ * Write the buckets of a histogram, as pairs, leaving out the empty
+ * ones.
+ */
+static void
+rtn_shape_export_array (FILE *fp, const char *name, u_int64_t *counts,
+                        u_int32_t size)
+{
+    u_int32_t i;
+    int8_t first = TRUE;
+
+    fprintf(fp, "  \"%s\": [", name);
+    for (i = 0; i < size; i++) {
+        if (counts[i]) {
+            fprintf(fp, "%s[%u, %llu]", first ? "" : ", ", i,
+                    (unsigned long long) counts[i]);
+            first = FALSE;
+        }
+    }
+    fprintf(fp, "],\n");
+}
+
+/*
+ * rtn_shape_export
+ */
+int8_t
+rtn_shape_export (rtn_shape_t *sh, FILE *fp)
+{
+    rtn_shape_stride_t *st;
+    rtn_shape_subtree_t *ss;
+    char prefix[64];
+    u_int32_t i;
+    int8_t first = TRUE;
+
+    fprintf(fp, "{\n  \"internal\": %llu,\n  \"infos\": %llu,\n"
+            "  \"bytes\": %llu,\n  \"node_size\": %u,\n"
+            "  \"info_size\": %u,\n  \"max_len\": %u,\n"
+            "  \"depth_mean\": %.3f,\n  \"depth_max\": %u,\n",
+            (unsigned long long) sh->sh_internal,
+            (unsigned long long) sh->sh_infos,
+            (unsigned long long) sh->sh_bytes, (u_int32_t) sizeof(rt_node_t),
+            sh->sh_info_size, sh->sh_maxlen,
+            sh->sh_infos ? (double) sh->sh_depth_sum / sh->sh_infos : 0.0,
+            sh->sh_depth_max);
+    fprintf(fp, "  \"children\": {\"internal\": [%llu, %llu, %llu], "
+            "\"info\": [%llu, %llu, %llu]},\n",
+            (unsigned long long) sh->sh_children[0][0],
+            (unsigned long long) sh->sh_children[0][1],
+            (unsigned long long) sh->sh_children[0][2],
+            (unsigned long long) sh->sh_children[1][0],
+            (unsigned long long) sh->sh_children[1][1],
+            (unsigned long long) sh->sh_children[1][2]);
+    rtn_shape_export_array(fp, "depth", sh->sh_depth, RTN_SHAPE_BITS + 1);
+
+    fprintf(fp, "  \"lengths\": [");
+    for (i = 0; i <= RTN_SHAPE_BITS; i++) {
+        if (sh->sh_len_count[i]) {
+            fprintf(fp, "%s\n    {\"len\": %u, \"infos\": %llu, "
+                    "\"depth_mean\": %.3f, \"depth_max\": %u}",
+                    first ? "" : ",", i,
+                    (unsigned long long) sh->sh_len_count[i],
+                    (double) sh->sh_len_depth_sum[i] / sh->sh_len_count[i],
+                    sh->sh_len_depth_max[i]);
+            first = FALSE;
+        }
+    }
+    fprintf(fp, "\n  ],\n  \"skip_bits\": %llu,\n",
+            (unsigned long long) sh->sh_skip_bits);
+    rtn_shape_export_array(fp, "skip", sh->sh_skip, RTN_SHAPE_SKIP + 1);
+
+    fprintf(fp, "  \"strides\": [");
+    for (i = 0; i < RTN_SHAPE_STRIDES; i++) {
+        st = &sh->sh_strides[i];
+        fprintf(fp, "%s\n    {\"bits\": %u, \"nodes\": %llu, "
+                "\"bytes\": %llu, \"levels_max\": %u, "
+                "\"levels_mean\": %.3f}",
+                i ? "," : "", i + 1, (unsigned long long) st->st_nodes,
+                (unsigned long long) st->st_bytes, st->st_levels,
+                st->st_mean_levels);
+    }
+    fprintf(fp, "\n  ],\n  \"split\": %u,\n  \"subtrees\": %llu,\n"
+            "  \"above_bytes\": %llu,\n",
+            sh->sh_split, (unsigned long long) sh->sh_subtree_count,
+            (unsigned long long) sh->sh_above_bytes);
+    rtn_shape_export_array(fp, "subtree_log2_bytes", sh->sh_subtree_size,
+                           RTN_SHAPE_SIZE_BUCKETS);
+
+    fprintf(fp, "  \"largest\": [");
+    for (i = 0; i < sh->sh_top_count; i++) {
+        ss = &sh->sh_top[i];
+        rtn_shape_prefix(ss, prefix, sizeof(prefix));
+        fprintf(fp, "%s\n    {\"prefix\": \"%s\", \"nodes\": %u, "
+                "\"infos\": %u, \"bytes\": %llu, \"depth\": %u}",
+                i ? "," : "", prefix, ss->ss_nodes, ss->ss_infos,
+                (unsigned long long) ss->ss_bytes, ss->ss_depth);
+    }
+    fprintf(fp, "\n  ]\n}\n");
+
+    return (ferror(fp) ? FALSE : TRUE);
+}
@@ -0,0 +1,153 @@
+/**
+ *  @name rtn_shape.h, Shape analysis of radix trees
+ *
+ *  API for rtn_shape.c.
+ *
+ *  rtn_shape_analyze() takes the measures of a tree in one pass: the
+ *  depth of the infos, the path length to each prefix length (e.g. to
+ *  the /24s of an IPv4 table, or the /48s of an IPv6 one), the ratio of
+ *  internal to external nodes, the bits skipped by path compression,
+ *  and the size of the subtrees under a split depth. From the same pass,
+ *  it estimates the memory and the levels of a lookup of a multibit
+ *  trie with a fixed stride of 1 to RTN_SHAPE_STRIDES bits, with prefix
+ *  expansion, so the layouts can be compared on a real table before one
+ *  is picked (see rtn_stride.h and rtn_lctrie.h).
+ *
+ *  rtn_shape_dump() prints the result as text, with histograms, and
+ *  rtn_shape_export() writes it as one JSON object.
+ *
+ *  The analysis does not lock the nodes and does not yield: the tree
+ *  must not be changed until it returns, as for rtn_pwalk.h. A mapped
+ *  snapshot must be promoted first.
+ *
+ *     Copyright (c) 2016 Ericsson AB.
+ *
+ *     All rights reserved.
+ */
+
+#ifndef __RTN_SHAPE_H__
+#define __RTN_SHAPE_H__
+
+#include <stdio.h>
+#include "corelibs/rtn_radix.h"
+#include "corelibs/rtn_stats.h"
+
+#define RTN_SHAPE_BITS          256    /* lengths and depths kept, the last
+                                          bucket takes the rest */
+#define RTN_SHAPE_SKIP          64     /* skips kept, the last takes the rest */
+#define RTN_SHAPE_STRIDES       16     /* strides estimated, 1 to 16 bits */
+#define RTN_SHAPE_TOP           8      /* largest subtrees kept */
+#define RTN_SHAPE_KEY_BYTES     16     /* key kept for a subtree */
+#define RTN_SHAPE_SIZE_BUCKETS  48     /* subtree sizes, by power of 2 */
+#define RTN_SHAPE_SLOT_BYTES    16     /* a slot of a stride node: a child
+                                          and an info */
+
+/*
+ * A subtree under the split depth.
+ */
+typedef struct _rtn_shape_subtree_t
+{
+    u_int8_t    ss_key[RTN_SHAPE_KEY_BYTES]; /* first bytes of the prefix */
+    u_int16_t   ss_bitlen;            /* bit of the subtree root */
+    u_int16_t   ss_depth;             /* most nodes under the root */
+    u_int32_t   ss_nodes;             /* internal nodes */
+    u_int32_t   ss_infos;             /* infos */
+    u_int32_t   pad;
+    u_int64_t   ss_bytes;             /* memory of the nodes and infos */
+} rtn_shape_subtree_t;
+
+/*
+ * A multibit trie with a fixed stride, with the prefixes expanded to
+ * the next stride boundary.
+ */
+typedef struct _rtn_shape_stride_t
+{
+    u_int64_t   st_nodes;             /* stride nodes */
+    u_int64_t   st_bytes;             /* st_nodes of 2^stride slots */
+    u_int32_t   st_levels;            /* levels of the longest prefix */
+    u_int32_t   pad;
+    double      st_mean_levels;       /* levels to an info, on average */
+} rtn_shape_stride_t;
+
+/*
+ * The shape of a tree. About 11 KB: allocate it, rather than keep it on
+ * the stack.
+ */
+typedef struct _rtn_shape_t
+{
+    u_int64_t   sh_internal;          /* internal nodes */
+    u_int64_t   sh_infos;             /* infos */
+    u_int64_t   sh_bytes;             /* memory of the nodes and infos */
+    u_int32_t   sh_info_size;         /* bytes of an info */
+    u_int16_t   sh_split;             /* split depth of the subtrees */
+    u_int16_t   sh_maxlen;            /* longest prefix */
+    u_int32_t   sh_depth_max;         /* deepest info, in nodes */
+    u_int32_t   pad;
+    u_int64_t   sh_depth_sum;         /* sum of the depths of the infos */
+
+    /*
+     * Infos by depth, the root at depth 1, and by bit length.
+     */
+    u_int64_t   sh_depth[RTN_SHAPE_BITS + 1];
+    u_int64_t   sh_len_count[RTN_SHAPE_BITS + 1];
+    u_int64_t   sh_len_depth_sum[RTN_SHAPE_BITS + 1];
+    u_int32_t   sh_len_depth_max[RTN_SHAPE_BITS + 1];
+
+    /*
+     * Path compression: the bits skipped from a node to its parent, and
+     * the nodes by count of children, internal ([0]) and infos ([1]).
+     */
+    u_int64_t   sh_skip[RTN_SHAPE_SKIP + 1];
+    u_int64_t   sh_skip_bits;
+    u_int64_t   sh_children[2][3];
+
+    /*
+     * sh_cut[b]: prefixes of b bits that have a longer info under them,
+     * i.e., nodes of a multibit trie at a level that starts at bit b.
+     */
+    u_int64_t   sh_cut[RTN_SHAPE_BITS + 1];
+    rtn_shape_stride_t sh_strides[RTN_SHAPE_STRIDES]; /* stride i + 1 */
+
+    /*
+     * Subtrees under the split depth.
+     */
+    u_int64_t   sh_above_bytes;       /* memory above the split */
+    u_int64_t   sh_subtree_count;     /* subtrees */
+    u_int64_t   sh_subtree_size[RTN_SHAPE_SIZE_BUCKETS]; /* by log2 bytes */
+    rtn_shape_subtree_t sh_top[RTN_SHAPE_TOP]; /* largest, by bytes */
+    u_int32_t   sh_top_count;         /* subtrees in sh_top */
+    u_int32_t   pad2;
+} rtn_shape_t;
+
+
+/**
+ * Analyze the shape of a tree.
+ *
+ * @param rt_head    head structure. Must not be NULL.
+ * @param split      bit depth of the subtrees, e.g. 8 or 16.
+ * @param info_size  bytes of an info of the tree, for the memory, or 0
+ *                   for sizeof(rt_info_t).
+ * @param shape      filled with the result.
+ *
+ * @return
+ *     TRUE: succeed; FALSE: the tree holds a mapped snapshot, or out of
+ *     memory.
+ */
+extern int8_t rtn_shape_analyze(rt_head_t *rt_head, u_int16_t split,
+                                u_int32_t info_size, rtn_shape_t *shape);
+
+/**
+ * Print a shape as text, one line at a time.
+ */
+extern void rtn_shape_dump(rtn_shape_t *shape, rtn_stats_print_func print,
+                           void *ctx);
+
+/**
+ * Write a shape as a JSON object.
+ *
+ * @return
+ *     TRUE: succeed; FALSE: write error.
+ */
+extern int8_t rtn_shape_export(rtn_shape_t *shape, FILE *fp);
+
+#endif  /* __RTN_SHAPE_H__ */
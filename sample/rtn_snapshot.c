@@ -0,0 +1,652 @@
+/***
+ *   rtn_snapshot.c
+ *
+ *   Memory mapped snapshots of radix trees.
+ *
+ *    Copyright (c) 2016 Ericsson AB.
+ *    All rights reserved.
+ *
+ ***
+ * Description:
+ *
+ * The file is made of a header, an array of nodes and an array of info
+ * records, each section 8 byte aligned. Both arrays are in the pre-order
+ * of the tree, and the root is node 0. Links are indexes plus one into
+ * the arrays, with zero for none, so the file can be mapped anywhere.
+ *
+ * An info record is a copy of the user structure, with the rt_info_t
+ * links cleared, followed by the key. The lookup returns a pointer to
+ * the record, which makes the mapped infos look like the live ones.
+ *
+ * The checksum is a Fletcher-64 over the whole file, taken with the
+ * checksum field zero'ed.
+ *
+ * The records are in the pre-order, so the tree is rebuilt from them by
+ * rtn_bulk_load_live() in one pass.
+ *
+ ***/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "corelibs/rtn_radix.h"
+#include "corelibs/rtn_snapshot.h"
+#include "corelibs/rtn_epoch.h"
+#include "rtn_private.h"
+
+#define RTN_SNAP_MAGIC      0x31504e534e5452ULL    /* "RTNSNP1" */
+#define RTN_SNAP_VERSION    1
+
+#define RTN_SNAP_ALIGN(x)   (((x) + 7) & ~((u_int64_t) 7))
+
+typedef struct _rtn_snap_hdr_t
+{
+    u_int64_t   sh_magic;             /* RTN_SNAP_MAGIC */
+    u_int32_t   sh_version;           /* RTN_SNAP_VERSION */
+    u_int32_t   sh_hdr_size;          /* size of this header */
+    u_int64_t   sh_file_size;         /* size of the file */
+    u_int64_t   sh_checksum;          /* over the file, with this zero'ed */
+    u_int64_t   sh_node_off;          /* offset of the nodes */
+    u_int64_t   sh_info_off;          /* offset of the info records */
+    u_int32_t   sh_node_count;        /* number of nodes */
+    u_int32_t   sh_info_count;        /* number of info records */
+    u_int32_t   sh_info_size;         /* size of a user structure */
+    u_int32_t   sh_rec_size;          /* size of an info record */
+    u_int32_t   sh_key_off;           /* offset of the key in a record */
+    u_int16_t   sh_keybytes;          /* bytes of key in a record */
+    u_int8_t    sh_flags;             /* RTN_BIT_ flags of the tree */
+    u_int8_t    sh_pad;               /* for alignment */
+} rtn_snap_hdr_t;
+
+typedef struct _rtn_snap_node_t
+{
+    u_int32_t   sn_left;              /* child when bit clear */
+    u_int32_t   sn_right;             /* child when bit set */
+    u_int32_t   sn_info;              /* info record, if any */
+    u_int16_t   sn_bit;               /* bit number for node */
+    u_int16_t   sn_pad;               /* for alignment */
+} rtn_snap_node_t;
+
+struct _rtn_snapshot_t
+{
+    u_int8_t              *ss_base;   /* mapping */
+    size_t                ss_size;    /* size of the mapping */
+    const rtn_snap_hdr_t  *ss_hdr;    /* header */
+    const rtn_snap_node_t *ss_nodes;  /* nodes */
+    u_int8_t              *ss_infos;  /* info records */
+};
+
+#define RTN_SNAP_INFO(ss, idx)                                          \
+    ((rt_info_t *) ((ss)->ss_infos + (u_int64_t) ((idx) - 1) *         \
+                    (ss)->ss_hdr->sh_rec_size))
+
+#define RTN_SNAP_KEY(ss, rinfo)                                         \
+    ((u_int8_t *) (rinfo) + RTN_SNAP_ALIGN((ss)->ss_hdr->sh_info_size))
+
+/*
+ * rtn_snapshot_checksum
+ *
+ * Add a buffer whose size is a multiple of 4 to a Fletcher-64 checksum.
+ * The sums start at zero.
+ */
+static void
+rtn_snapshot_checksum (const u_int8_t *buf, u_int64_t size,
+                       u_int64_t *sum1, u_int64_t *sum2)
+{
+    u_int32_t word;
+    u_int64_t i, end;
+
+    /*
+     * The sums can not overflow within a block of 4096 words, so the
+     * modulo is only taken once per block.
+     */
+    for (i = 0; i < size; ) {
+        end = MIN(size, i + 4096 * sizeof(u_int32_t));
+        for (; i < end; i += sizeof(u_int32_t)) {
+            memcpy(&word, buf + i, sizeof(u_int32_t));
+            *sum1 += word;
+            *sum2 += *sum1;
+        }
+        *sum1 %= 0xffffffffULL;
+        *sum2 %= 0xffffffffULL;
+    }
+}
+
+/*
+ * rtn_snapshot_build
+ *
+ * Lay out the image of a tree in memory. Return NULL when out of memory.
+ */
+static u_int8_t *
+rtn_snapshot_build (rt_head_t *rt_head, u_int32_t info_size, u_int64_t *size)
+{
+    rtn_snap_hdr_t *hdr;
+    rtn_snap_node_t *nodes, *node;
+    rt_node_t *rn, **path;
+    u_int32_t *path_idx;
+    u_int32_t node_count = 0, info_count = 0, depth, i, j;
+    u_int16_t max_bit = 0, info_bit = 0;
+    u_int64_t key_off = ~0ULL, off, sum1, sum2;
+    u_int8_t *image, *rec;
+
+    /*
+     * Count, and see if all the keys are at the same place in the user
+     * structure, in which case a promoted info keeps it there.
+     */
+    for (rn = rt_head->root; rn; rn = rtn_walk_next_node(NULL, rn)) {
+        node_count++;
+        max_bit = MAX(max_bit, rn->rnode_bit);
+        if (!(rn->rnode_flags & RNODE_INFO)) {
+            continue;
+        }
+        info_count++;
+        info_bit = MAX(info_bit, rn->rnode_bit);
+
+        off = (u_int8_t *) ((rt_info_t *) rn)->rninfo_key - (u_int8_t *) rn;
+        if ((off < sizeof(rt_info_t)) ||
+            (off + ((rn->rnode_bit + 7) >> 3) > info_size) ||
+            ((key_off != ~0ULL) && (key_off != off))) {
+            key_off = RTN_SNAP_ALIGN(info_size);
+        } else if (key_off == ~0ULL) {
+            key_off = off;
+        }
+    }
+    if (key_off == ~0ULL) {
+        key_off = RTN_SNAP_ALIGN(info_size);
+    }
+
+    *size = RTN_SNAP_ALIGN(sizeof(rtn_snap_hdr_t)) +
+        RTN_SNAP_ALIGN((u_int64_t) node_count * sizeof(rtn_snap_node_t)) +
+        (u_int64_t) info_count * (RTN_SNAP_ALIGN(info_size) +
+                                  RTN_SNAP_ALIGN((info_bit + 7) >> 3));
+
+    image = calloc(1, *size);
+    path = malloc((max_bit + 2) * sizeof(rt_node_t *));
+    path_idx = malloc((max_bit + 2) * sizeof(u_int32_t));
+    if (!image || !path || !path_idx) {
+        free(image);
+        free(path);
+        free(path_idx);
+        errno = ENOMEM;
+        return (NULL);
+    }
+
+    hdr = (rtn_snap_hdr_t *) image;
+    hdr->sh_magic = RTN_SNAP_MAGIC;
+    hdr->sh_version = RTN_SNAP_VERSION;
+    hdr->sh_hdr_size = sizeof(rtn_snap_hdr_t);
+    hdr->sh_file_size = *size;
+    hdr->sh_node_off = RTN_SNAP_ALIGN(sizeof(rtn_snap_hdr_t));
+    hdr->sh_info_off = hdr->sh_node_off +
+        RTN_SNAP_ALIGN((u_int64_t) node_count * sizeof(rtn_snap_node_t));
+    hdr->sh_node_count = node_count;
+    hdr->sh_info_count = info_count;
+    hdr->sh_info_size = info_size;
+    hdr->sh_keybytes = (info_bit + 7) >> 3;
+    hdr->sh_rec_size = RTN_SNAP_ALIGN(info_size) +
+        RTN_SNAP_ALIGN(hdr->sh_keybytes);
+    hdr->sh_key_off = key_off;
+    hdr->sh_flags = rt_head->flags;
+
+    /*
+     * Number the nodes in the pre-order, keeping the path from the root
+     * to link each node to its parent. The bit numbers grow along a path,
+     * so it is no longer than max_bit + 2.
+     */
+    nodes = (rtn_snap_node_t *) (image + hdr->sh_node_off);
+    depth = 0;
+    for (rn = rt_head->root, i = 0, j = 0; rn;
+         rn = rtn_walk_next_node(NULL, rn), i++) {
+        while (depth && (path[depth - 1] != rn->rnode_parent)) {
+            depth--;
+        }
+        if (depth) {
+            node = &nodes[path_idx[depth - 1]];
+            if (path[depth - 1]->rnode_left == rn) {
+                node->sn_left = i + 1;
+            } else {
+                node->sn_right = i + 1;
+            }
+        }
+        path[depth] = rn;
+        path_idx[depth] = i;
+        depth++;
+
+        node = &nodes[i];
+        node->sn_bit = rn->rnode_bit;
+        if (!(rn->rnode_flags & RNODE_INFO)) {
+            continue;
+        }
+
+        rec = image + hdr->sh_info_off + (u_int64_t) j * hdr->sh_rec_size;
+        memcpy(rec, rn, info_size);
+        memset(rec, 0, sizeof(rt_node_t));
+        ((rt_info_t *) rec)->rnode_bit = rn->rnode_bit;
+        ((rt_info_t *) rec)->rnode_flags = (RNODE_INFO | RNODE_EXTERNAL);
+        ((rt_info_t *) rec)->rninfo_key = NULL;
+        memcpy(rec + RTN_SNAP_ALIGN(info_size),
+               ((rt_info_t *) rn)->rninfo_key, (rn->rnode_bit + 7) >> 3);
+        node->sn_info = ++j;
+    }
+
+    free(path);
+    free(path_idx);
+
+    sum1 = sum2 = 0;
+    rtn_snapshot_checksum(image, *size, &sum1, &sum2);
+    hdr->sh_checksum = (sum2 << 32) | sum1;
+    return (image);
+}
+
+/*
+ * rtn_snapshot_write
+ *
+ * Write a snapshot of a tree to a file.
+ */
+int8_t
+rtn_snapshot_write (rt_head_t *rt_head, const char *path, u_int32_t info_size)
+{
+    u_int8_t *image;
+    u_int64_t size, done;
+    char *tmp;
+    ssize_t len;
+    int fd, err;
+
+    if (info_size < sizeof(rt_info_t)) {
+        errno = EINVAL;
+        return (FALSE);
+    }
+
+    image = rtn_snapshot_build(rt_head, info_size, &size);
+    if (!image) {
+        return (FALSE);
+    }
+
+    tmp = malloc(strlen(path) + sizeof(".tmp"));
+    if (!tmp) {
+        free(image);
+        errno = ENOMEM;
+        return (FALSE);
+    }
+    sprintf(tmp, "%s.tmp", path);
+
+    fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        err = errno;
+        free(image);
+        free(tmp);
+        errno = err;
+        return (FALSE);
+    }
+
+    for (done = 0; done < size; done += len) {
+        len = write(fd, image + done, size - done);
+        if (len < 0) {
+            if (errno == EINTR) {
+                len = 0;
+                continue;
+            }
+            break;
+        }
+    }
+
+    err = (done < size) ? errno : 0;
+    if (!err && fsync(fd)) {
+        err = errno;
+    }
+    if (close(fd) && !err) {
+        err = errno;
+    }
+    if (!err && rename(tmp, path)) {
+        err = errno;
+    }
+    if (err) {
+        unlink(tmp);
+    }
+
+    free(image);
+    free(tmp);
+
+    errno = err;
+    return (err ? FALSE : TRUE);
+}
+
+/*
+ * rtn_snapshot_valid
+ *
+ * Check a mapped snapshot: format, bounds, links and checksum. The key
+ * of a record must be past its rt_info_t, which a promotion rewrites.
+ */
+static bool
+rtn_snapshot_valid (const u_int8_t *base, u_int64_t size)
+{
+    const rtn_snap_hdr_t *hdr = (const rtn_snap_hdr_t *) base;
+    const rtn_snap_node_t *nodes, *node;
+    const rt_info_t *rinfo;
+    rtn_snap_hdr_t copy;
+    u_int64_t sum1, sum2;
+    u_int32_t i, info;
+
+    if ((size < sizeof(rtn_snap_hdr_t)) || (size & 7) ||
+        (hdr->sh_magic != RTN_SNAP_MAGIC) ||
+        (hdr->sh_version != RTN_SNAP_VERSION) ||
+        (hdr->sh_hdr_size != sizeof(rtn_snap_hdr_t)) ||
+        (hdr->sh_file_size != size)) {
+        return (FALSE);
+    }
+
+    if ((hdr->sh_node_count == 0) ||
+        (hdr->sh_info_size < sizeof(rt_info_t)) ||
+        (hdr->sh_rec_size < RTN_SNAP_ALIGN(hdr->sh_info_size) +
+                            hdr->sh_keybytes) ||
+        (hdr->sh_key_off < sizeof(rt_info_t)) ||
+        (hdr->sh_key_off > hdr->sh_rec_size - hdr->sh_keybytes) ||
+        (hdr->sh_node_off != RTN_SNAP_ALIGN(sizeof(rtn_snap_hdr_t))) ||
+        (hdr->sh_info_off != hdr->sh_node_off +
+         RTN_SNAP_ALIGN((u_int64_t) hdr->sh_node_count *
+                        sizeof(rtn_snap_node_t))) ||
+        (hdr->sh_info_off + (u_int64_t) hdr->sh_info_count *
+         hdr->sh_rec_size != size)) {
+        return (FALSE);
+    }
+
+    /*
+     * Children come after their parent, so there is no loop, and test a
+     * later bit, so a lookup reads no further into the key than the
+     * bit of the node. No bit is past the keys of the records. The
+     * records are numbered in the pre-order as well, one per info node,
+     * and hold the bit of their node, which the promotion goes by.
+     */
+    nodes = (const rtn_snap_node_t *) (base + hdr->sh_node_off);
+    for (i = 0, info = 0; i < hdr->sh_node_count; i++) {
+        node = &nodes[i];
+        if ((node->sn_left && ((node->sn_left <= i + 1) ||
+                               (node->sn_left > hdr->sh_node_count) ||
+                               (nodes[node->sn_left - 1].sn_bit <=
+                                node->sn_bit))) ||
+            (node->sn_right && ((node->sn_right <= i + 1) ||
+                                (node->sn_right > hdr->sh_node_count) ||
+                                (nodes[node->sn_right - 1].sn_bit <=
+                                 node->sn_bit))) ||
+            (node->sn_bit > (u_int32_t) hdr->sh_keybytes << 3)) {
+            return (FALSE);
+        }
+        if (!node->sn_info) {
+            continue;
+        }
+        rinfo = (const rt_info_t *) (base + hdr->sh_info_off +
+                                     (u_int64_t) info * hdr->sh_rec_size);
+        if ((node->sn_info != ++info) ||
+            (rinfo->rnode_bit != node->sn_bit)) {
+            return (FALSE);
+        }
+    }
+    if (info != hdr->sh_info_count) {
+        return (FALSE);
+    }
+
+    memcpy(&copy, hdr, sizeof(copy));
+    copy.sh_checksum = 0;
+    sum1 = sum2 = 0;
+    rtn_snapshot_checksum((const u_int8_t *) &copy, sizeof(copy), &sum1, &sum2);
+    rtn_snapshot_checksum(base + sizeof(copy), size - sizeof(copy),
+                          &sum1, &sum2);
+
+    return (hdr->sh_checksum == ((sum2 << 32) | sum1));
+}
+
+/*
+ * rtn_snapshot_map
+ *
+ * Initialize a tree, and attach a snapshot to it.
+ */
+int8_t
+rtn_snapshot_map (rt_head_t *rt_head, const char *path, u_int8_t flags,
+                  rt_info_free ri_free)
+{
+    rtn_snapshot_t *snap;
+    struct stat st;
+    void *base;
+    int fd, err;
+
+    if (!rtn_root_init(rt_head, flags, ri_free)) {
+        errno = ENOMEM;
+        return (FALSE);
+    }
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return (FALSE);
+    }
+    if (fstat(fd, &st)) {
+        err = errno;
+        close(fd);
+        errno = err;
+        return (FALSE);
+    }
+
+    base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    err = errno;
+    close(fd);
+    if (base == MAP_FAILED) {
+        errno = err;
+        return (FALSE);
+    }
+
+    if (!rtn_snapshot_valid(base, st.st_size)) {
+        munmap(base, st.st_size);
+        errno = EINVAL;
+        return (FALSE);
+    }
+
+    snap = malloc(sizeof(rtn_snapshot_t));
+    if (!snap) {
+        munmap(base, st.st_size);
+        errno = ENOMEM;
+        return (FALSE);
+    }
+    snap->ss_base = base;
+    snap->ss_size = st.st_size;
+    snap->ss_hdr = base;
+    snap->ss_nodes = (rtn_snap_node_t *) (snap->ss_base +
+                                          snap->ss_hdr->sh_node_off);
+    snap->ss_infos = snap->ss_base + snap->ss_hdr->sh_info_off;
+
+    rt_head->ri_count = snap->ss_hdr->sh_info_count;
+    rt_head->rt_snapshot = snap;
+    return (TRUE);
+}
+
+/*
+ * rtn_snapshot_unmap
+ *
+ * Unmap the snapshot of a tree, once no lock-free reader can be using
+ * it.
+ */
+void
+rtn_snapshot_unmap (rt_head_t *rt_head)
+{
+    rtn_snapshot_t *snap = rt_head->rt_snapshot;
+
+    if (!snap) {
+        return;
+    }
+
+    RTN_PUBLISH(rt_head->rt_snapshot, NULL);
+    rtn_generation_bump(rt_head);
+    if (rt_head->flags & RTN_BIT_RCU) {
+        rtn_rcu_quiesce();
+    }
+
+    munmap(snap->ss_base, snap->ss_size);
+    free(snap);
+}
+
+/*
+ * rtn_snapshot_lookup
+ *
+ * Best match in a snapshot. Each info on the way down is checked
+ * against its own key, and nothing further down can match once one
+ * does not. The tree is used once the snapshot is gone.
+ */
+rt_info_t *
+rtn_snapshot_lookup (rt_head_t *rt_head, u_int8_t *addr, u_int16_t maxbitlen)
+{
+    rtn_snapshot_t *snap;
+    const rtn_snap_node_t *node;
+    rt_info_t *rinfo, *best = NULL;
+    u_int32_t idx;
+
+    snap = RTN_DEREF(rt_head->rt_snapshot);
+    if (!snap) {
+        return (rtn_lookup(rt_head, (char *) addr, maxbitlen));
+    }
+
+    for (idx = 1; idx; ) {
+        node = &snap->ss_nodes[idx - 1];
+        if (node->sn_bit > maxbitlen) {
+            break;
+        }
+
+        if (node->sn_info) {
+            rinfo = RTN_SNAP_INFO(snap, node->sn_info);
+            if (!rtn_key_cmp(addr, RTN_SNAP_KEY(snap, rinfo), node->sn_bit)) {
+                break;
+            }
+            best = rinfo;
+        }
+
+        if (node->sn_bit == maxbitlen) {
+            break;
+        }
+        idx = (addr[RNBYTE(node->sn_bit)] & RNBIT(node->sn_bit)) ?
+            node->sn_right : node->sn_left;
+    }
+
+    return (best);
+}
+
+/*
+ * rtn_snapshot_search
+ *
+ * Exact match in a snapshot. The tree is used once the snapshot is
+ * gone.
+ */
+rt_info_t *
+rtn_snapshot_search (rt_head_t *rt_head, u_int8_t *addr, u_int16_t bitlen)
+{
+    rtn_snapshot_t *snap;
+    const rtn_snap_node_t *node;
+    rt_info_t *rinfo;
+    u_int32_t idx;
+
+    snap = RTN_DEREF(rt_head->rt_snapshot);
+    if (!snap) {
+        return (rtn_search(rt_head, (char *) addr, bitlen));
+    }
+
+    node = &snap->ss_nodes[0];
+    for (idx = 1; idx && (node = &snap->ss_nodes[idx - 1])->sn_bit < bitlen; ) {
+        idx = (addr[RNBYTE(node->sn_bit)] & RNBIT(node->sn_bit)) ?
+            node->sn_right : node->sn_left;
+    }
+
+    if (!idx || (node->sn_bit != bitlen) || !node->sn_info) {
+        return (NULL);
+    }
+
+    rinfo = RTN_SNAP_INFO(snap, node->sn_info);
+    if (!rtn_key_cmp(addr, RTN_SNAP_KEY(snap, rinfo), bitlen)) {
+        return (NULL);
+    }
+
+    return (rinfo);
+}
+
+/*
+ * rtn_snapshot_key
+ *
+ * Return the key of an info of a snapshot.
+ */
+u_int8_t *
+rtn_snapshot_key (rt_head_t *rt_head, rt_info_t *rinfo)
+{
+    return (RTN_SNAP_KEY(rt_head->rt_snapshot, rinfo));
+}
+
+/*
+ * rtn_snapshot_promote
+ *
+ * Rebuild a tree from its snapshot. The infos are copied to the heap,
+ * and inserted in the pre-order. The subtree max. versions are not in
+ * the snapshot, and are set again from the info versions.
+ */
+int8_t
+rtn_snapshot_promote (rt_head_t *rt_head, rt_info_t **rinfo)
+{
+    rtn_snapshot_t *snap = rt_head->rt_snapshot;
+    const rtn_snap_hdr_t *hdr;
+    rtn_bulk_entry_t *entries;
+    rt_info_t *copy;
+    rt_node_t *rn;
+    u_int32_t i;
+
+    if (!snap) {
+        return (TRUE);
+    }
+    hdr = snap->ss_hdr;
+
+    entries = malloc(MAX(hdr->sh_info_count, 1) * sizeof(rtn_bulk_entry_t));
+    if (!entries) {
+        return (FALSE);
+    }
+
+    for (i = 0; i < hdr->sh_info_count; i++) {
+        copy = malloc(hdr->sh_rec_size);
+        if (!copy) {
+            while (i--) {
+                free(entries[i].rinfo);
+            }
+            free(entries);
+            return (FALSE);
+        }
+        memcpy(copy, RTN_SNAP_INFO(snap, i + 1), hdr->sh_rec_size);
+        copy->rninfo_key = (u_int8_t *) copy + hdr->sh_key_off;
+
+        entries[i].rinfo = copy;
+        entries[i].bitlen = copy->rnode_bit;
+    }
+
+    /*
+     * Lookups are served from the snapshot until the tree is complete,
+     * and the snapshot is unmapped. The count of infos is the one of the
+     * snapshot until then, and is counted again by the inserts.
+     */
+    rt_head->ri_count = 0;
+    rtn_bulk_load_live(rt_head, entries, hdr->sh_info_count);
+
+    for (i = 0; i < hdr->sh_info_count; i++) {
+        for (rn = RADIX_INFO2NODE(entries[i].rinfo); rn &&
+                 (rn->rnode_version < entries[i].rinfo->version);
+             rn = rn->rnode_parent) {
+            rn->rnode_version = entries[i].rinfo->version;
+        }
+    }
+
+    if (rinfo && ((u_int8_t *) *rinfo >= snap->ss_infos) &&
+        ((u_int8_t *) *rinfo < snap->ss_base + snap->ss_size)) {
+        *rinfo = entries[((u_int8_t *) *rinfo - snap->ss_infos) /
+                         hdr->sh_rec_size].rinfo;
+    }
+
+    free(entries);
+    rtn_snapshot_unmap(rt_head);
+    return (TRUE);
+}
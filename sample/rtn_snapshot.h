@@ -0,0 +1,101 @@
+/**
+ *  @name rtn_snapshot.h, Memory mapped snapshots of radix trees
+ *
+ *  API for rtn_snapshot.c.
+ *
+ *  A snapshot is a file that holds the nodes and the infos of a tree,
+ *  linked by offsets rather than pointers, so it can be mapped read-only
+ *  at any address. After a restart, rtn_snapshot_map() attaches the file
+ *  to an empty rt_head_t, and rtn_lookup(), rtn_lookup_batch() and
+ *  rtn_search() are served from the mapping right away, with no rebuild.
+ *
+ *  The tree is rebuilt from the snapshot (copy on write) by the first
+ *  rtn_add() or rtn_delete(), or by rtn_snapshot_promote(). Any other
+ *  call on the tree, e.g. a walk, needs rtn_snapshot_promote() first.
+ *
+ *  An info returned from a mapped snapshot is read-only, its links are
+ *  NULL, and so is its rninfo_key: use rtn_snapshot_key() for the key.
+ *  Once promoted, the infos are allocated by malloc(), and their payload
+ *  is a byte copy of the one written, so the payload must not hold any
+ *  pointer.
+ *
+ *     Copyright (c) 2016 Ericsson AB.
+ *
+ *     All rights reserved.
+ */
+
+#ifndef __RTN_SNAPSHOT_H__
+#define __RTN_SNAPSHOT_H__
+
+#include "corelibs/rtn_radix.h"
+
+typedef struct _rtn_snapshot_t rtn_snapshot_t;
+
+/**
+ * Write a snapshot of a tree to a file. The file is written under a
+ * temporary name first, and renamed when complete.
+ *
+ * @param rt_head    head structure. Must not be NULL.
+ * @param path       file name.
+ * @param info_size  size of the user structure holding an rt_info_t,
+ *                   the same for all the infos of the tree.
+ *
+ * @return
+ *     TRUE: succeed; FALSE: fail, with errno set.
+ */
+extern int8_t rtn_snapshot_write(rt_head_t *rt_head, const char *path,
+                                 u_int32_t info_size);
+
+/**
+ * Initialize a tree, as rtn_root_init() does, and attach a snapshot to
+ * it. The snapshot is validated (format and checksum) first.
+ *
+ * @param rt_head  head structure. Must not be NULL.
+ * @param path     file name.
+ * @param flags    RTN_BIT_ flags, as for rtn_root_init().
+ * @param ri_free  as for rtn_root_init(). It also gets the infos of a
+ *                 promoted snapshot, which come from malloc().
+ *
+ * @return
+ *     TRUE: succeed; FALSE: fail, with errno set, and the tree is empty.
+ */
+extern int8_t rtn_snapshot_map(rt_head_t *rt_head, const char *path,
+                               u_int8_t flags, rt_info_free ri_free);
+
+/**
+ * Rebuild the tree from its snapshot, and unmap the snapshot. Nothing
+ * is done when no snapshot is attached.
+ *
+ * @param rt_head  head structure. Must not be NULL.
+ * @param rinfo    when not NULL, an info of the snapshot, replaced with
+ *                 its copy in the tree.
+ *
+ * @return
+ *     TRUE: succeed; FALSE: out of memory, and the snapshot is kept.
+ */
+extern int8_t rtn_snapshot_promote(rt_head_t *rt_head, rt_info_t **rinfo);
+
+/**
+ * Unmap the snapshot of a tree, if any, without a rebuild. Called by
+ * rtn_root_free().
+ */
+extern void rtn_snapshot_unmap(rt_head_t *rt_head);
+
+/**
+ * Best match in the snapshot of a tree, as rtn_lookup().
+ */
+extern rt_info_t *rtn_snapshot_lookup(rt_head_t *rt_head, u_int8_t *addr,
+                                      u_int16_t maxbitlen);
+
+/**
+ * Exact match in the snapshot of a tree, as rtn_search().
+ */
+extern rt_info_t *rtn_snapshot_search(rt_head_t *rt_head, u_int8_t *addr,
+                                      u_int16_t bitlen);
+
+/**
+ * Return the key of an info of the snapshot of a tree.
+ */
+extern u_int8_t *rtn_snapshot_key(rt_head_t *rt_head, rt_info_t *rinfo);
+
+#endif  /* __RTN_SNAPSHOT_H__ */
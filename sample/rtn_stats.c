@@ -0,0 +1,350 @@
+/***
+ *   rtn_stats.c
+ *
+ *   Instrumentation of the radix trie.
+ *
+ *    Copyright (c) 2016 Ericsson AB.
+ *    All rights reserved.
+ *
+ ***
+ * Description:
+ *
+ * Each thread that counts gets a block on its first count, and keeps it
+ * in rtn_stats_self. The blocks are never freed: they are chained from
+ * rtn_stats_blocks, and the block of an exiting thread is released for
+ * the next thread that needs one, with its counts.
+ *
+ * A block is aligned to a cache line, and its size is rounded up to one,
+ * so the counts of two threads never share a line. Only the owner of a
+ * block writes it, so the counts take no atomic add; they are stored
+ * atomically, and rtn_stats_collect() reads them as they are.
+ *
+ ***/
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <pthread.h>
+
+#include "corelibs/rtn_radix.h"
+#include "corelibs/rtn_stats.h"
+#include "rtn_private.h"
+
+static const char *rtn_stats_counter_names[RTN_STAT_COUNTERS] = {
+    "rtn_lookup_total",
+    "rtn_lookup_nodes_total",
+    "rtn_add_total",
+    "rtn_add_split_total",
+    "rtn_add_exist_total",
+    "rtn_delete_total",
+    "rtn_delete_delayed_total",
+    "rtn_walk_total",
+    "rtn_walk_info_total",
+    "rtn_walk_yield_total",
+};
+
+static const char *rtn_stats_hist_names[RTN_HISTS] = {
+    "rtn_lookup_depth",
+    "rtn_lookup_backtrack",
+    "rtn_add_ns",
+    "rtn_delete_ns",
+    "rtn_walk_ns",
+    "rtn_walk_yield_ns",
+};
+
+#ifdef RTN_STATS
+
+__thread rtn_stats_t *rtn_stats_self = NULL;
+
+static rtn_stats_t *rtn_stats_blocks = NULL;
+static pthread_key_t rtn_stats_key;
+static pthread_once_t rtn_stats_once = PTHREAD_ONCE_INIT;
+
+/*
+ * rtn_stats_thread_exit
+ *
+ * Release the block of an exiting thread.
+ */
+static void
+rtn_stats_thread_exit (void *arg)
+{
+    rtn_stats_t *st = arg;
+
+    __atomic_store_n(&st->st_owned, 0, __ATOMIC_RELEASE);
+}
+
+/*
+ * rtn_stats_key_init
+ */
+static void
+rtn_stats_key_init (void)
+{
+    pthread_key_create(&rtn_stats_key, rtn_stats_thread_exit);
+}
+
+/*
+ * rtn_stats_attach
+ *
+ * Find a released block for the calling thread, or add a new one.
+ */
+rtn_stats_t *
+rtn_stats_attach (void)
+{
+    rtn_stats_t *st;
+    size_t size;
+    u_int8_t unused;
+
+    pthread_once(&rtn_stats_once, rtn_stats_key_init);
+
+    for (st = __atomic_load_n(&rtn_stats_blocks, __ATOMIC_ACQUIRE); st;
+         st = st->st_next) {
+        unused = 0;
+        if (__atomic_compare_exchange_n(&st->st_owned, &unused, 1, FALSE,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+            break;
+        }
+    }
+
+    if (!st) {
+        size = (sizeof(rtn_stats_t) + RTN_CACHE_LINE - 1) &
+               ~((size_t) RTN_CACHE_LINE - 1);
+        if (posix_memalign((void **) &st, RTN_CACHE_LINE, size)) {
+            return (NULL);
+        }
+        memset(st, 0, size);
+        st->st_owned = 1;
+
+        st->st_next = __atomic_load_n(&rtn_stats_blocks, __ATOMIC_RELAXED);
+        while (!__atomic_compare_exchange_n(&rtn_stats_blocks, &st->st_next,
+                                            st, FALSE, __ATOMIC_RELEASE,
+                                            __ATOMIC_RELAXED)) {
+            ;
+        }
+    }
+
+    rtn_stats_self = st;
+    pthread_setspecific(rtn_stats_key, st);
+
+    return (st);
+}
+
+#endif  /* RTN_STATS */
+
+/*
+ * rtn_hist_bucket_low
+ */
+u_int64_t
+rtn_hist_bucket_low (u_int32_t bucket)
+{
+    u_int32_t shift;
+
+    if (bucket < 2 * RTN_HIST_SUB) {
+        return (bucket);
+    }
+
+    shift = bucket / RTN_HIST_SUB - 1;
+    return ((u_int64_t) (bucket % RTN_HIST_SUB + RTN_HIST_SUB) << shift);
+}
+
+/*
+ * rtn_hist_percentile
+ */
+u_int64_t
+rtn_hist_percentile (rtn_hist_t *hist, double percent)
+{
+    u_int64_t rank, seen = 0;
+    u_int32_t i;
+
+    if (!hist->h_count) {
+        return (0);
+    }
+
+    rank = (u_int64_t) (hist->h_count * percent / 100.0 + 0.5);
+    if (rank < 1) {
+        rank = 1;
+    }
+
+    for (i = 0; i < RTN_HIST_BUCKETS; i++) {
+        seen += hist->h_buckets[i];
+        if (seen >= rank) {
+            return (MIN(rtn_hist_bucket_low(i), hist->h_max));
+        }
+    }
+
+    return (hist->h_max);
+}
+
+/*
+ * rtn_stats_collect
+ */
+int8_t
+rtn_stats_collect (rtn_stats_t *sum)
+{
+#ifdef RTN_STATS
+    rtn_stats_t *st;
+    rtn_hist_t *hist, *total;
+    u_int64_t max;
+    u_int32_t i, j;
+#endif
+
+    memset(sum, 0, sizeof(rtn_stats_t));
+
+#ifdef RTN_STATS
+    for (st = __atomic_load_n(&rtn_stats_blocks, __ATOMIC_ACQUIRE); st;
+         st = st->st_next) {
+        for (i = 0; i < RTN_STAT_COUNTERS; i++) {
+            sum->st_counters[i] += __atomic_load_n(&st->st_counters[i],
+                                                   __ATOMIC_RELAXED);
+        }
+
+        for (i = 0; i < RTN_HISTS; i++) {
+            hist = &st->st_hists[i];
+            total = &sum->st_hists[i];
+
+            total->h_count += __atomic_load_n(&hist->h_count,
+                                              __ATOMIC_RELAXED);
+            total->h_sum += __atomic_load_n(&hist->h_sum, __ATOMIC_RELAXED);
+            max = __atomic_load_n(&hist->h_max, __ATOMIC_RELAXED);
+            total->h_max = MAX(total->h_max, max);
+            for (j = 0; j < RTN_HIST_BUCKETS; j++) {
+                total->h_buckets[j] += __atomic_load_n(&hist->h_buckets[j],
+                                                       __ATOMIC_RELAXED);
+            }
+        }
+    }
+
+    return (TRUE);
+#else
+    return (FALSE);
+#endif
+}
+
+/*
+ * rtn_stats_sub
+ */
+void
+rtn_stats_sub (rtn_stats_t *later, rtn_stats_t *earlier)
+{
+    u_int32_t i, j;
+
+    for (i = 0; i < RTN_STAT_COUNTERS; i++) {
+        later->st_counters[i] -= earlier->st_counters[i];
+    }
+
+    for (i = 0; i < RTN_HISTS; i++) {
+        later->st_hists[i].h_count -= earlier->st_hists[i].h_count;
+        later->st_hists[i].h_sum -= earlier->st_hists[i].h_sum;
+        for (j = 0; j < RTN_HIST_BUCKETS; j++) {
+            later->st_hists[i].h_buckets[j] -=
+                earlier->st_hists[i].h_buckets[j];
+        }
+    }
+}
+
+/*
+ * rtn_stats_counter_name
+ */
+const char *
+rtn_stats_counter_name (rtn_stat_t counter)
+{
+    return ((counter < RTN_STAT_COUNTERS) ?
+            rtn_stats_counter_names[counter] : "unknown");
+}
+
+/*
+ * rtn_stats_hist_name
+ */
+const char *
+rtn_stats_hist_name (rtn_hist_id_t hist)
+{
+    return ((hist < RTN_HISTS) ? rtn_stats_hist_names[hist] : "unknown");
+}
+
+/*
+ * rtn_stats_dump
+ */
+void
+rtn_stats_dump (rtn_stats_t *stats, rtn_stats_print_func print, void *ctx)
+{
+    char line[256];
+    rtn_hist_t *hist;
+    u_int32_t i;
+
+    for (i = 0; i < RTN_STAT_COUNTERS; i++) {
+        snprintf(line, sizeof(line), "%-26s %llu",
+                 rtn_stats_counter_names[i],
+                 (unsigned long long) stats->st_counters[i]);
+        (*print)(ctx, line);
+    }
+
+    for (i = 0; i < RTN_HISTS; i++) {
+        hist = &stats->st_hists[i];
+        snprintf(line, sizeof(line),
+                 "%-26s count %llu mean %.1f p50 %llu p90 %llu p99 %llu "
+                 "p99.9 %llu max %llu",
+                 rtn_stats_hist_names[i], (unsigned long long) hist->h_count,
+                 hist->h_count ? (double) hist->h_sum / hist->h_count : 0.0,
+                 (unsigned long long) rtn_hist_percentile(hist, 50),
+                 (unsigned long long) rtn_hist_percentile(hist, 90),
+                 (unsigned long long) rtn_hist_percentile(hist, 99),
+                 (unsigned long long) rtn_hist_percentile(hist, 99.9),
+                 (unsigned long long) hist->h_max);
+        (*print)(ctx, line);
+    }
+}
+
+/*
+ * rtn_stats_export
+ *
+ * The buckets are cumulative, as Prometheus wants them, and only the
+ * buckets with values are printed, with their largest value as "le".
+ */
+int8_t
+rtn_stats_export (FILE *fp)
+{
+    rtn_stats_t *stats;
+    rtn_hist_t *hist;
+    u_int64_t seen;
+    u_int32_t i, j;
+
+    /*
+     * A block is about 15 KB: keep it off the stack.
+     */
+    stats = malloc(sizeof(rtn_stats_t));
+    if (!stats) {
+        return (FALSE);
+    }
+    if (!rtn_stats_collect(stats)) {
+        free(stats);
+        return (FALSE);
+    }
+
+    for (i = 0; i < RTN_STAT_COUNTERS; i++) {
+        fprintf(fp, "# TYPE %s counter\n%s %llu\n",
+                rtn_stats_counter_names[i], rtn_stats_counter_names[i],
+                (unsigned long long) stats->st_counters[i]);
+    }
+
+    for (i = 0; i < RTN_HISTS; i++) {
+        hist = &stats->st_hists[i];
+        fprintf(fp, "# TYPE %s histogram\n", rtn_stats_hist_names[i]);
+        for (j = 0, seen = 0; j < RTN_HIST_BUCKETS - 1; j++) {
+            if (!hist->h_buckets[j]) {
+                continue;
+            }
+            seen += hist->h_buckets[j];
+            fprintf(fp, "%s_bucket{le=\"%llu\"} %llu\n",
+                    rtn_stats_hist_names[i],
+                    (unsigned long long) (rtn_hist_bucket_low(j + 1) - 1),
+                    (unsigned long long) seen);
+        }
+        fprintf(fp, "%s_bucket{le=\"+Inf\"} %llu\n%s_sum %llu\n"
+                "%s_count %llu\n",
+                rtn_stats_hist_names[i], (unsigned long long) hist->h_count,
+                rtn_stats_hist_names[i], (unsigned long long) hist->h_sum,
+                rtn_stats_hist_names[i], (unsigned long long) hist->h_count);
+    }
+
+    free(stats);
+    return (TRUE);
+}
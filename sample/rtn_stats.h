@@ -0,0 +1,171 @@
+/**
+ *  @name rtn_stats.h, Instrumentation of the radix trees
+ *
+ *  API for rtn_stats.c.
+ *
+ *  With RTN_STATS defined at compile time, rtn_radix.c counts what its
+ *  hot paths do (lookups, nodes visited, splits on rtn_add(), delayed
+ *  deletions, walks and yields), and records histograms of the lookup
+ *  depth, the backtrack length, the time of rtn_add() and rtn_delete(),
+ *  and the time of a walk and of its yields. Without RTN_STATS, none of
+ *  this is compiled in, and rtn_stats_collect() returns FALSE.
+ *
+ *  The counts are kept per thread, in a block of its own aligned to a
+ *  cache line, so that the threads never write to the same line. They
+ *  are for all the trees together, and only go up: to measure a period,
+ *  collect before and after, and take the difference (rtn_stats_sub()).
+ *  The block of a thread that exits is taken over by the next thread
+ *  that starts counting, so nothing is lost.
+ *
+ *  A histogram is log-linear, as HDR histograms are: values below
+ *  2 * RTN_HIST_SUB have a bucket each, and each power of 2 above is
+ *  split into RTN_HIST_SUB buckets, so a percentile is within 1/8 of
+ *  the true value. Times are in ns.
+ *
+ *     Copyright (c) 2016 Ericsson AB.
+ *
+ *     All rights reserved.
+ */
+
+#ifndef __RTN_STATS_H__
+#define __RTN_STATS_H__
+
+#include <stdio.h>
+#include "corelibs/rtn_radix.h"
+
+/*
+ * Counters.
+ */
+typedef enum {
+    RTN_STAT_LOOKUP,               /* rtn_lookup() */
+    RTN_STAT_LOOKUP_NODES,         /* nodes visited, down and back up */
+    RTN_STAT_ADD,                  /* rtn_add() */
+    RTN_STAT_ADD_SPLIT,            /* internal nodes added by rtn_add() */
+    RTN_STAT_ADD_EXIST,            /* rtn_add() of an existing prefix */
+    RTN_STAT_DELETE,               /* rtn_delete() */
+    RTN_STAT_DELETE_DELAYED,       /* rtn_delete() of a locked node */
+    RTN_STAT_WALK,                 /* rtn_walktree(), rtn_walktree_version() */
+    RTN_STAT_WALK_INFO,            /* infos processed by any walk */
+    RTN_STAT_WALK_YIELD,           /* yields in any walk */
+    RTN_STAT_COUNTERS
+} rtn_stat_t;
+
+/*
+ * Histograms.
+ */
+typedef enum {
+    RTN_HIST_LOOKUP_DEPTH,         /* nodes down in rtn_lookup() */
+    RTN_HIST_LOOKUP_BACKTRACK,     /* nodes back up in a lookup */
+    RTN_HIST_ADD_NS,               /* time of rtn_add() */
+    RTN_HIST_DELETE_NS,            /* time of rtn_delete() */
+    RTN_HIST_WALK_NS,              /* time of rtn_walktree(), ... */
+    RTN_HIST_WALK_YIELD_NS,        /* time of a yield in a walk */
+    RTN_HISTS
+} rtn_hist_id_t;
+
+#define RTN_HIST_SUB_BITS   3
+#define RTN_HIST_SUB        (1 << RTN_HIST_SUB_BITS)
+#define RTN_HIST_MAX_BITS   40     /* larger values go to the last bucket */
+#define RTN_HIST_BUCKETS    ((RTN_HIST_MAX_BITS - RTN_HIST_SUB_BITS + 1) * \
+                             RTN_HIST_SUB)
+
+typedef struct _rtn_hist_t
+{
+    u_int64_t   h_count;                     /* count of values */
+    u_int64_t   h_sum;                       /* sum of values */
+    u_int64_t   h_max;                       /* largest value */
+    u_int64_t   h_buckets[RTN_HIST_BUCKETS]; /* see rtn_hist_bucket() */
+} rtn_hist_t;
+
+typedef struct _rtn_stats_t
+{
+    u_int64_t   st_counters[RTN_STAT_COUNTERS];
+    rtn_hist_t  st_hists[RTN_HISTS];
+    struct _rtn_stats_t *st_next;     /* all the blocks, rtn_stats.c */
+    u_int8_t    st_owned;             /* in use by a thread */
+} rtn_stats_t;
+
+
+/**
+ * Return the bucket of a value.
+ */
+static inline u_int32_t
+rtn_hist_bucket (u_int64_t value)
+{
+    u_int32_t shift;
+
+    if (value < 2 * RTN_HIST_SUB) {
+        return ((u_int32_t) value);
+    }
+    if (value >> RTN_HIST_MAX_BITS) {
+        return (RTN_HIST_BUCKETS - 1);
+    }
+
+    shift = 63 - __builtin_clzll(value) - RTN_HIST_SUB_BITS;
+    return (shift * RTN_HIST_SUB + (u_int32_t) (value >> shift));
+}
+
+/**
+ * Return the smallest value of a bucket.
+ */
+extern u_int64_t rtn_hist_bucket_low(u_int32_t bucket);
+
+/**
+ * Return a percentile of a histogram.
+ *
+ * @param hist     the histogram.
+ * @param percent  0 to 100, e.g. 99.9.
+ *
+ * @return
+ *     the smallest value of the bucket that holds the percentile, or 0
+ *     for an empty histogram.
+ */
+extern u_int64_t rtn_hist_percentile(rtn_hist_t *hist, double percent);
+
+/**
+ * Sum up the counts of all the threads.
+ *
+ * @param sum  filled in with the counts.
+ *
+ * @return
+ *     TRUE, or FALSE when built without RTN_STATS (the counts are 0).
+ */
+extern int8_t rtn_stats_collect(rtn_stats_t *sum);
+
+/**
+ * Subtract the counts of an earlier collection, for the counts of the
+ * period in between. h_max is kept as the largest of the later one.
+ */
+extern void rtn_stats_sub(rtn_stats_t *later, rtn_stats_t *earlier);
+
+/**
+ * Names, for an exporter.
+ */
+extern const char *rtn_stats_counter_name(rtn_stat_t counter);
+extern const char *rtn_stats_hist_name(rtn_hist_id_t hist);
+
+/**
+ * Function to print one line of a dump.
+ */
+typedef void (*rtn_stats_print_func)(void *ctx, const char *line);
+
+/**
+ * Dump the counters, and the count, mean, max. and the 50, 90, 99 and
+ * 99.9 percentiles of each histogram, a line each.
+ */
+extern void rtn_stats_dump(rtn_stats_t *stats, rtn_stats_print_func print,
+                           void *ctx);
+
+/**
+ * Sample exporter: collect the counts of all the threads, and print
+ * them to a file in the text format of Prometheus, e.g.
+ *
+ *     rtn_lookup_total 1048576
+ *     rtn_lookup_depth_bucket{le="23"} 1032128
+ *
+ * @return
+ *     FALSE when built without RTN_STATS, and nothing printed.
+ */
+extern int8_t rtn_stats_export(FILE *fp);
+
+#endif  /* __RTN_STATS_H__ */
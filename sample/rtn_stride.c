@@ -0,0 +1,558 @@
+/***
+ *   rtn_stride.c
+ *
+ *   Multibit stride lookup engine for the radix trie.
+ *
+ *    Copyright (c) 2016 Ericsson AB.
+ *    All rights reserved.
+ *
+ ***
+ * Description:
+ *
+ * A best match in rtn_lookup() walks one bit per level down the radix
+ * nodes, and then backtracks via the parent pointers. Each of these
+ * steps is a dependent memory access.
+ *
+ * The stride engine keeps a second view of the same entries, in which
+ * a node covers RTN_STRIDE_BITS bits of the key:
+ *
+ *   o A prefix of length L (L > 0) is rooted in the node at level
+ *     (L - 1) / RTN_STRIDE_BITS, and is expanded over the slots of
+ *     that node that it covers. The longest prefix wins a slot.
+ *
+ *   o The slots are compressed as in Poptrie: the leaf map has a bit
+ *     set for each slot that starts a run of slots sharing the same
+ *     best match, and the child map has a bit set for each slot with
+ *     a child node. popcount() on the maps indexes the dense arrays.
+ *
+ *   o The zero length prefix is kept off the engine.
+ *
+ * The lookup remembers the last non-NULL leaf while it descends, and
+ * stops at the first slot without a child.
+ *
+ * Each node also keeps the list of prefixes rooted in it, so that a
+ * single update only repaints the slots of one node. There is never a
+ * need for a full rebuild.
+ *
+ ***/
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <sys/types.h>
+
+#include "corelibs/rtn_radix.h"
+#include "corelibs/rtn_stride.h"
+#include "rtn_private.h"
+
+struct _rtn_stride_node_t
+{
+    u_int64_t sn_child_map[RTN_STRIDE_MAPWORDS];  /* slot has a child */
+    u_int64_t sn_leaf_map[RTN_STRIDE_MAPWORDS];   /* slot starts a run */
+    u_int16_t sn_child_base[RTN_STRIDE_MAPWORDS]; /* children before word */
+    u_int16_t sn_leaf_base[RTN_STRIDE_MAPWORDS];  /* runs before word */
+
+    struct _rtn_stride_node_t **sn_child;  /* children, in slot order */
+    rt_info_t **sn_leaf;                   /* best match per run */
+    rt_info_t **sn_prefix;                 /* prefixes rooted here */
+    struct _rtn_stride_node_t *sn_parent;  /* parent */
+
+    u_int16_t sn_nchild;               /* count of children */
+    u_int16_t sn_nleaf;                /* count of leaf runs */
+    u_int16_t sn_nprefix;              /* count of prefixes rooted here */
+    u_int16_t sn_maxprefix;            /* size of sn_prefix */
+    u_int8_t  sn_slot;                 /* slot in the parent */
+    u_int8_t  sn_level;                /* level of the node */
+    u_int8_t  sn_dirty;                /* leaves need to be repainted */
+    u_int8_t  pad;                     /* for alignment */
+};
+
+/*
+ * rtn_stride_map_test
+ *
+ * Test the bit of a slot in a map.
+ */
+static inline int
+rtn_stride_map_test (const u_int64_t *map, u_int32_t slot)
+{
+    return ((map[slot >> 6] >> (slot & 63)) & 1);
+}
+
+/*
+ * rtn_stride_rank
+ *
+ * Return the number of bits set in a map up to and including the slot.
+ */
+static inline u_int32_t
+rtn_stride_rank (const u_int64_t *map, const u_int16_t *base, u_int32_t slot)
+{
+    u_int32_t word = slot >> 6;
+
+    return (base[word] +
+            __builtin_popcountll(map[word] & (~0ULL >> (63 - (slot & 63)))));
+}
+
+/*
+ * rtn_stride_set_base
+ *
+ * Recompute the per-word counts of a map.
+ */
+static void
+rtn_stride_set_base (const u_int64_t *map, u_int16_t *base)
+{
+    u_int32_t i, count = 0;
+
+    for (i = 0; i < RTN_STRIDE_MAPWORDS; i++) {
+        base[i] = count;
+        count += __builtin_popcountll(map[i]);
+    }
+}
+
+/*
+ * rtn_stride_node_alloc
+ *
+ * Allocate an empty node. An empty node still has a single leaf run.
+ */
+static rtn_stride_node_t *
+rtn_stride_node_alloc (rtn_stride_t *rs, rtn_stride_node_t *parent,
+                       u_int8_t slot)
+{
+    rtn_stride_node_t *sn;
+
+    sn = calloc(1, sizeof(rtn_stride_node_t));
+    if (!sn) {
+        return (NULL);
+    }
+
+    sn->sn_leaf = calloc(1, sizeof(rt_info_t *));
+    if (!sn->sn_leaf) {
+        free(sn);
+        return (NULL);
+    }
+    sn->sn_leaf_map[0] = 1;
+    sn->sn_nleaf = 1;
+    rtn_stride_set_base(sn->sn_leaf_map, sn->sn_leaf_base);
+
+    sn->sn_parent = parent;
+    sn->sn_slot = slot;
+    sn->sn_level = parent ? (parent->sn_level + 1) : 0;
+    rs->rs_node_count++;
+
+    return (sn);
+}
+
+/*
+ * rtn_stride_node_free
+ *
+ * Free a node and all the nodes below it.
+ */
+static void
+rtn_stride_node_free (rtn_stride_t *rs, rtn_stride_node_t *sn)
+{
+    u_int32_t i;
+
+    for (i = 0; i < sn->sn_nchild; i++) {
+        rtn_stride_node_free(rs, sn->sn_child[i]);
+    }
+
+    free(sn->sn_child);
+    free(sn->sn_leaf);
+    free(sn->sn_prefix);
+    free(sn);
+    rs->rs_node_count--;
+}
+
+/*
+ * rtn_stride_child
+ *
+ * Return the child of a node at a slot, and create it if asked to.
+ */
+static rtn_stride_node_t *
+rtn_stride_child (rtn_stride_t *rs, rtn_stride_node_t *sn, u_int8_t slot,
+                  int create)
+{
+    rtn_stride_node_t **child, *node;
+    u_int32_t idx;
+
+    if (rtn_stride_map_test(sn->sn_child_map, slot)) {
+        idx = rtn_stride_rank(sn->sn_child_map, sn->sn_child_base, slot);
+        return (sn->sn_child[idx - 1]);
+    }
+
+    if (!create) {
+        return (NULL);
+    }
+
+    child = realloc(sn->sn_child,
+                    (sn->sn_nchild + 1) * sizeof(rtn_stride_node_t *));
+    if (!child) {
+        return (NULL);
+    }
+    sn->sn_child = child;
+
+    node = rtn_stride_node_alloc(rs, sn, slot);
+    if (!node) {
+        return (NULL);
+    }
+
+    /*
+     * The new child goes right after the children of the lower slots.
+     */
+    idx = rtn_stride_rank(sn->sn_child_map, sn->sn_child_base, slot);
+    memmove(&child[idx + 1], &child[idx],
+            (sn->sn_nchild - idx) * sizeof(rtn_stride_node_t *));
+    child[idx] = node;
+    sn->sn_nchild++;
+
+    sn->sn_child_map[slot >> 6] |= (1ULL << (slot & 63));
+    rtn_stride_set_base(sn->sn_child_map, sn->sn_child_base);
+
+    return (node);
+}
+
+/*
+ * rtn_stride_unlink
+ *
+ * Remove an empty node from its parent, and continue with the parent
+ * when it becomes empty as well. The root is never removed.
+ */
+static void
+rtn_stride_unlink (rtn_stride_t *rs, rtn_stride_node_t *sn)
+{
+    rtn_stride_node_t *parent;
+    u_int32_t idx;
+
+    while (sn->sn_parent && !sn->sn_nprefix && !sn->sn_nchild) {
+        parent = sn->sn_parent;
+
+        idx = rtn_stride_rank(parent->sn_child_map, parent->sn_child_base,
+                              sn->sn_slot) - 1;
+        assert(parent->sn_child[idx] == sn);
+        memmove(&parent->sn_child[idx], &parent->sn_child[idx + 1],
+                (parent->sn_nchild - idx - 1) * sizeof(rtn_stride_node_t *));
+        parent->sn_nchild--;
+
+        parent->sn_child_map[sn->sn_slot >> 6] &= ~(1ULL << (sn->sn_slot & 63));
+        rtn_stride_set_base(parent->sn_child_map, parent->sn_child_base);
+
+        rtn_stride_node_free(rs, sn);
+        sn = parent;
+    }
+}
+
+/*
+ * rtn_stride_paint
+ *
+ * Recompute the leaf runs of a node from the prefixes rooted in it.
+ * A longer prefix overrides a shorter one on the slots it covers.
+ */
+static int8_t
+rtn_stride_paint (rtn_stride_node_t *sn)
+{
+    rt_info_t *best[RTN_STRIDE_SLOTS], **leaf;
+    u_int8_t bestlen[RTN_STRIDE_SLOTS];
+    u_int32_t i, slot, start, count, nleaf;
+    u_int16_t plen;
+    u_int8_t *key;
+
+    memset(best, 0, sizeof(best));
+    memset(bestlen, 0, sizeof(bestlen));
+
+    for (i = 0; i < sn->sn_nprefix; i++) {
+        key = sn->sn_prefix[i]->rninfo_key;
+        plen = sn->sn_prefix[i]->rnode_bit - sn->sn_level * RTN_STRIDE_BITS;
+
+        start = key[sn->sn_level] & (0xff << (RTN_STRIDE_BITS - plen)) & 0xff;
+        count = 1 << (RTN_STRIDE_BITS - plen);
+        for (slot = start; slot < start + count; slot++) {
+            if (plen > bestlen[slot]) {
+                bestlen[slot] = plen;
+                best[slot] = sn->sn_prefix[i];
+            }
+        }
+    }
+
+    nleaf = 1;
+    for (slot = 1; slot < RTN_STRIDE_SLOTS; slot++) {
+        if (best[slot] != best[slot - 1]) {
+            nleaf++;
+        }
+    }
+
+    if (nleaf != sn->sn_nleaf) {
+        leaf = realloc(sn->sn_leaf, nleaf * sizeof(rt_info_t *));
+        if (!leaf) {
+            return (FALSE);
+        }
+        sn->sn_leaf = leaf;
+        sn->sn_nleaf = nleaf;
+    }
+
+    memset(sn->sn_leaf_map, 0, sizeof(sn->sn_leaf_map));
+    for (slot = 0, nleaf = 0; slot < RTN_STRIDE_SLOTS; slot++) {
+        if (!slot || (best[slot] != best[slot - 1])) {
+            sn->sn_leaf_map[slot >> 6] |= (1ULL << (slot & 63));
+            sn->sn_leaf[nleaf++] = best[slot];
+        }
+    }
+    rtn_stride_set_base(sn->sn_leaf_map, sn->sn_leaf_base);
+    sn->sn_dirty = FALSE;
+
+    return (TRUE);
+}
+
+/*
+ * rtn_stride_find
+ *
+ * Return the node in which a prefix is rooted, and create the nodes
+ * along the way if asked to.
+ */
+static rtn_stride_node_t *
+rtn_stride_find (rtn_stride_t *rs, u_int8_t *key, u_int16_t bitlen,
+                 int create)
+{
+    rtn_stride_node_t *sn;
+    u_int32_t level, levels;
+
+    levels = (bitlen - 1) / RTN_STRIDE_BITS;
+    for (sn = rs->rs_root, level = 0; sn && (level < levels); level++) {
+        sn = rtn_stride_child(rs, sn, key[level], create);
+    }
+
+    return (sn);
+}
+
+/*
+ * rtn_stride_insert
+ *
+ * Root a prefix in its node. The leaves are repainted right away
+ * unless the caller batches the updates.
+ */
+static void
+rtn_stride_insert (rtn_stride_t *rs, rt_info_t *rinfo, int paint)
+{
+    rtn_stride_node_t *sn;
+    rt_info_t **prefix;
+    u_int16_t bitlen;
+
+    bitlen = rinfo->rnode_bit;
+    if (bitlen > rs->rs_keybits) {
+        rs->rs_invalid = TRUE;
+        return;
+    }
+
+    rs->rs_prefix_count++;
+    if (bitlen == 0) {
+        rs->rs_default = rinfo;
+        return;
+    }
+
+    sn = rtn_stride_find(rs, rinfo->rninfo_key, bitlen, TRUE);
+    if (!sn) {
+        rs->rs_invalid = TRUE;
+        return;
+    }
+
+    if (sn->sn_nprefix == sn->sn_maxprefix) {
+        prefix = realloc(sn->sn_prefix,
+                         (sn->sn_maxprefix + 8) * sizeof(rt_info_t *));
+        if (!prefix) {
+            rtn_stride_unlink(rs, sn);
+            rs->rs_invalid = TRUE;
+            return;
+        }
+        sn->sn_prefix = prefix;
+        sn->sn_maxprefix += 8;
+    }
+    sn->sn_prefix[sn->sn_nprefix++] = rinfo;
+    sn->sn_dirty = TRUE;
+
+    if (paint && !rtn_stride_paint(sn)) {
+        rs->rs_invalid = TRUE;
+    }
+}
+
+/*
+ * rtn_stride_paint_all
+ *
+ * Repaint all the nodes marked dirty by batched updates.
+ */
+static void
+rtn_stride_paint_all (rtn_stride_t *rs, rtn_stride_node_t *sn)
+{
+    u_int32_t i;
+
+    if (sn->sn_dirty && !rtn_stride_paint(sn)) {
+        rs->rs_invalid = TRUE;
+    }
+
+    for (i = 0; i < sn->sn_nchild; i++) {
+        rtn_stride_paint_all(rs, sn->sn_child[i]);
+    }
+}
+
+/*
+ * rtn_stride_add
+ *
+ * An info entry has been added to the tree.
+ */
+void
+rtn_stride_add (rtn_stride_t *rs, rt_info_t *rinfo)
+{
+    rtn_stride_insert(rs, rinfo, TRUE);
+}
+
+/*
+ * rtn_stride_delete
+ *
+ * An info entry is about to be removed from the tree.
+ */
+void
+rtn_stride_delete (rtn_stride_t *rs, rt_info_t *rinfo)
+{
+    rtn_stride_node_t *sn;
+    u_int16_t bitlen;
+    u_int32_t i;
+
+    bitlen = rinfo->rnode_bit;
+    if (bitlen > rs->rs_keybits) {
+        return;
+    }
+
+    if (bitlen == 0) {
+        if (rs->rs_default == rinfo) {
+            rs->rs_default = NULL;
+            rs->rs_prefix_count--;
+        }
+        return;
+    }
+
+    sn = rtn_stride_find(rs, rinfo->rninfo_key, bitlen, FALSE);
+    if (!sn) {
+        return;
+    }
+
+    for (i = 0; i < sn->sn_nprefix; i++) {
+        if (sn->sn_prefix[i] == rinfo) {
+            break;
+        }
+    }
+    if (i == sn->sn_nprefix) {
+        return;
+    }
+
+    sn->sn_prefix[i] = sn->sn_prefix[--sn->sn_nprefix];
+    rs->rs_prefix_count--;
+
+    if (!rtn_stride_paint(sn)) {
+        rs->rs_invalid = TRUE;
+    }
+    rtn_stride_unlink(rs, sn);
+}
+
+/*
+ * rtn_stride_init
+ *
+ * Build the stride engine from the entries in the tree, and attach
+ * it to the tree.
+ */
+rtn_stride_t *
+rtn_stride_init (rt_head_t *rt_head, u_int16_t keybits)
+{
+    rtn_stride_t *rs;
+    rt_node_t *rn;
+
+    if (rt_head->rt_stride) {
+        rtn_stride_free(rt_head);
+    }
+
+    rs = calloc(1, sizeof(rtn_stride_t));
+    if (!rs) {
+        return (NULL);
+    }
+    rs->rs_keybits = keybits;
+    rs->rs_levels = (keybits + RTN_STRIDE_BITS - 1) / RTN_STRIDE_BITS;
+
+    rs->rs_root = rtn_stride_node_alloc(rs, NULL, 0);
+    if (!rs->rs_root) {
+        free(rs);
+        return (NULL);
+    }
+
+    /*
+     * Batch the repaint of the nodes until all entries are in.
+     */
+    for (rn = rt_head->root; rn; rn = rtn_walk_next_node(NULL, rn)) {
+        if (rn->rnode_flags & RNODE_INFO) {
+            rtn_stride_insert(rs, (rt_info_t *) rn, FALSE);
+        }
+    }
+    rtn_stride_paint_all(rs, rs->rs_root);
+
+    rt_head->rt_stride = rs;
+    return (rs);
+}
+
+/*
+ * rtn_stride_free
+ *
+ * Detach the stride engine from the tree and free it.
+ */
+void
+rtn_stride_free (rt_head_t *rt_head)
+{
+    rtn_stride_t *rs;
+
+    rs = rt_head->rt_stride;
+    if (!rs) {
+        return;
+    }
+
+    rt_head->rt_stride = NULL;
+    rtn_stride_node_free(rs, rs->rs_root);
+    free(rs);
+}
+
+/*
+ * rtn_stride_lookup
+ *
+ * Find the best match for an address, one stride at a time.
+ */
+rt_info_t *
+rtn_stride_lookup (rt_head_t *rt_head, char *addr, u_int16_t maxbitlen)
+{
+    rtn_stride_t *rs;
+    rtn_stride_node_t *sn;
+    rt_info_t *best, *leaf;
+    u_int8_t *key = (u_int8_t *) addr;
+    u_int32_t level, levels, slot;
+
+    rs = rt_head->rt_stride;
+    if (!rs || rs->rs_invalid ||
+        ((maxbitlen < rs->rs_keybits) && (maxbitlen % RTN_STRIDE_BITS))) {
+        return (rtn_lookup(rt_head, addr, maxbitlen));
+    }
+
+    levels = MIN(rs->rs_levels, maxbitlen / RTN_STRIDE_BITS +
+                 ((maxbitlen % RTN_STRIDE_BITS) ? 1 : 0));
+    best = rs->rs_default;
+
+    for (sn = rs->rs_root, level = 0; level < levels; level++) {
+        slot = key[level];
+
+        leaf = sn->sn_leaf[rtn_stride_rank(sn->sn_leaf_map, sn->sn_leaf_base,
+                                           slot) - 1];
+        if (leaf) {
+            best = leaf;
+        }
+
+        if (!rtn_stride_map_test(sn->sn_child_map, slot)) {
+            break;
+        }
+        sn = sn->sn_child[rtn_stride_rank(sn->sn_child_map, sn->sn_child_base,
+                                          slot) - 1];
+        __builtin_prefetch(sn);
+    }
+
+    return (best);
+}
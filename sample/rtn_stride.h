@@ -0,0 +1,90 @@
+/**
+ *  @name rtn_stride.h, Multibit stride lookup for radix trees
+ *
+ *  API for rtn_stride.c.
+ *
+ *  The stride engine is a read-optimized companion of an rt_head_t. It
+ *  consumes the key RTN_STRIDE_BITS at a time, and each level is a
+ *  compressed 256-slot node (Poptrie style): a bitmap of child slots and
+ *  a bitmap of leaf runs index dense arrays through popcount, so a
+ *  lookup touches one node per byte of the key instead of one radix node
+ *  per bit, and never backtracks.
+ *
+ *  Once attached with rtn_stride_init(), the engine is kept current by
+ *  rtn_add(), rtn_delete(), rtn_attach_subtree() and rtn_detach_subtree(),
+ *  and is released by rtn_root_free() or rtn_stride_free().
+ *
+ *     Copyright (c) 2016 Ericsson AB.
+ *
+ *     All rights reserved.
+ */
+
+#ifndef __RTN_STRIDE_H__
+#define __RTN_STRIDE_H__
+
+#include "corelibs/rtn_radix.h"
+
+#define RTN_STRIDE_BITS      8
+#define RTN_STRIDE_SLOTS     (1 << RTN_STRIDE_BITS)
+#define RTN_STRIDE_MAPWORDS  (RTN_STRIDE_SLOTS / 64)
+
+typedef struct _rtn_stride_node_t rtn_stride_node_t;
+
+typedef struct _rtn_stride_t
+{
+    rtn_stride_node_t *rs_root;       /* level 0 node */
+    rt_info_t *rs_default;            /* zero length prefix, if any */
+    u_int16_t rs_keybits;             /* max. key length in bits */
+    u_int16_t rs_levels;              /* number of levels */
+    u_int8_t  rs_invalid;             /* out of memory, or bad prefix */
+    u_int8_t  pad[3];                 /* for alignment */
+
+    u_int32_t rs_node_count;          /* count of stride nodes */
+    u_int32_t rs_prefix_count;        /* count of prefixes */
+} rtn_stride_t;
+
+
+/**
+ * Build the stride engine from the current content of a tree, and
+ * attach it to the tree so that later updates are applied to it.
+ *
+ * @param rt_head   head structure. Must not be NULL.
+ * @param keybits   max. bit length of the keys in the tree, e.g. 32
+ *                  for IPv4 and 128 for IPv6.
+ *
+ * @return
+ *     the engine, or NULL when out of memory.
+ */
+extern rtn_stride_t *rtn_stride_init(rt_head_t *rt_head, u_int16_t keybits);
+
+/**
+ * Detach the stride engine from a tree and free it.
+ *
+ * @param rt_head   head structure. Must not be NULL.
+ */
+extern void rtn_stride_free(rt_head_t *rt_head);
+
+/**
+ * Perform best (i.e., longest) match for an address through the stride
+ * engine. The result is the same as that of rtn_lookup(). When the engine
+ * can not answer the query (maxbitlen not on a stride boundary, or the
+ * engine is invalid), the query is passed to rtn_lookup().
+ *
+ * @param rt_head     the ptr to the head structure.
+ * @param addr        address in the network byte order
+ * @param maxbitlen   the max bit length allowed.
+ *
+ * @return
+ *      radix info found, could be NULL.
+ */
+extern rt_info_t *rtn_stride_lookup(rt_head_t *rt_head, char *addr,
+                                    u_int16_t maxbitlen);
+
+/*
+ * Update hooks, called by rtn_radix.c for an info entry that has been
+ * added to the tree, or that is about to be removed from the tree.
+ */
+extern void rtn_stride_add(rtn_stride_t *rs, rt_info_t *rinfo);
+extern void rtn_stride_delete(rtn_stride_t *rs, rt_info_t *rinfo);
+
+#endif  /* __RTN_STRIDE_H__ */
@@ -0,0 +1,852 @@
+/***
+ *   rtn_view.c
+ *
+ *   Point in time views of the radix trie.
+ *
+ *    Copyright (c) 2016 Ericsson AB.
+ *    All rights reserved.
+ *
+ ***
+ * Description:
+ *
+ * The nodes of the tree have a parent, and the infos are the nodes of
+ * the user, so the tree itself can not be shared between versions. The
+ * views use their own trie instead, with the same shape, which is kept
+ * by the add and delete hooks of the tree.
+ *
+ * A node of this trie is held by its parents in each version, and by
+ * the views (or the tree) whose version it is the root of. A node that
+ * is held once, under a root that is held once, is only in the current
+ * version, and is changed in place. Any other node on the path of a
+ * change is copied, and the copy replaces it in its (writable) parent.
+ * So the first change after a view is taken copies one path, and the
+ * next ones only what they share with a view.
+ *
+ * An info is held by the nodes that point to it, through a record, and
+ * is freed when its last node goes, if the tree has released it. The
+ * delete hook puts the record on vw_held before it removes the info, so
+ * that rtn_view_hold() finds it when the tree releases the info.
+ *
+ * The change hooks run with vw_mutex held, and so does rtn_view_take(),
+ * which then sees each version complete. The release of a view takes
+ * the mutex only to drop a record off vw_held.
+ *
+ * The trie is only kept while it is of use: it is built by the take that
+ * finds none, and dropped by the first change that finds no view held
+ * (vw_refs of 1, the tree) and no rtn_view_keep(). Between the two, the
+ * hooks cost a load of vw_built. The build walks the tree, which is why
+ * that take must not run alongside a change; a change that finds the
+ * trie in use can not drop it, so the takes that find it built are safe
+ * from any thread.
+ *
+ ***/
+
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <stdint.h>
+#include <assert.h>
+#include <sys/types.h>
+#include <pthread.h>
+
+#include "corelibs/rtn_radix.h"
+#include "corelibs/rtn_view.h"
+#include "rtn_private.h"
+
+#define RTN_VIEW_HELD_MIN     64      /* initial buckets of vw_held */
+
+/*
+ * The child of a node in the direction of a key.
+ */
+#define RTN_VIEW_LINK(vn, addr) \
+    (((addr)[RNBYTE((vn)->vn_bit)] & RNBIT((vn)->vn_bit)) ? \
+     &(vn)->vn_right : &(vn)->vn_left)
+
+static void rtn_view_unref(rtn_views_t *vw);
+
+/*
+ * rtn_view_info_free
+ *
+ * Free an info as the tree would have.
+ */
+static void
+rtn_view_info_free (rtn_views_t *vw, rt_info_t *rinfo)
+{
+    if (vw->vw_ri_free) {
+        (*(vw->vw_ri_free))(rinfo);
+    } else if (!(vw->vw_flags & RTN_BIT_KEEP_INFO)) {
+        free(rinfo);
+    }
+}
+
+/*
+ * rtn_view_hash
+ */
+static inline u_int32_t
+rtn_view_hash (rtn_views_t *vw, rt_info_t *rinfo)
+{
+    u_int64_t hash;
+
+    hash = ((uintptr_t) rinfo >> 4) * 0x9e3779b97f4a7c15ULL;
+    return ((u_int32_t) (hash >> 32) & vw->vw_held_mask);
+}
+
+/*
+ * rtn_view_held_add
+ *
+ * Put a record on vw_held, growing it when it gets full. If it can not
+ * grow, the chains only get longer.
+ */
+static void
+rtn_view_held_add (rtn_views_t *vw, rtn_vinfo_t *vi)
+{
+    rtn_vinfo_t **held, *next;
+    u_int32_t old, i, bucket;
+
+    if (vw->vw_held_count > vw->vw_held_mask) {
+        held = calloc((size_t) (vw->vw_held_mask + 1) * 2,
+                      sizeof(rtn_vinfo_t *));
+        if (held) {
+            old = vw->vw_held_mask + 1;
+            vw->vw_held_mask = old * 2 - 1;
+            for (i = 0; i < old; i++) {
+                for (; vw->vw_held[i]; vw->vw_held[i] = next) {
+                    next = vw->vw_held[i]->vi_next;
+                    bucket = rtn_view_hash(vw, vw->vw_held[i]->vi_info);
+                    vw->vw_held[i]->vi_next = held[bucket];
+                    held[bucket] = vw->vw_held[i];
+                }
+            }
+            free(vw->vw_held);
+            vw->vw_held = held;
+        }
+    }
+
+    bucket = rtn_view_hash(vw, vi->vi_info);
+    vi->vi_next = vw->vw_held[bucket];
+    vw->vw_held[bucket] = vi;
+    vi->vi_held = TRUE;
+    __atomic_store_n(&vw->vw_held_count, vw->vw_held_count + 1,
+                     __ATOMIC_RELAXED);
+}
+
+/*
+ * rtn_view_held_remove
+ */
+static void
+rtn_view_held_remove (rtn_views_t *vw, rtn_vinfo_t *vi)
+{
+    rtn_vinfo_t **prev;
+
+    prev = &vw->vw_held[rtn_view_hash(vw, vi->vi_info)];
+    while (*prev != vi) {
+        prev = &(*prev)->vi_next;
+    }
+    *prev = vi->vi_next;
+    vi->vi_held = FALSE;
+    __atomic_store_n(&vw->vw_held_count, vw->vw_held_count - 1,
+                     __ATOMIC_RELAXED);
+}
+
+/*
+ * rtn_vinfo_put
+ *
+ * Drop a hold on a record. The last one frees the record, and the info
+ * when the tree has released it.
+ */
+static void
+rtn_vinfo_put (rtn_views_t *vw, rtn_vinfo_t *vi, int8_t locked)
+{
+    int8_t gone;
+
+    if (__atomic_sub_fetch(&vi->vi_refs, 1, __ATOMIC_ACQ_REL)) {
+        return;
+    }
+
+    if (!locked) {
+        pthread_mutex_lock(&vw->vw_mutex);
+    }
+    if (vi->vi_held) {
+        rtn_view_held_remove(vw, vi);
+    }
+    gone = vi->vi_gone;
+    if (!locked) {
+        pthread_mutex_unlock(&vw->vw_mutex);
+    }
+
+    if (gone) {
+        rtn_view_info_free(vw, vi->vi_info);
+    }
+    free(vi);
+}
+
+/*
+ * rtn_vnode_get
+ */
+static inline void
+rtn_vnode_get (rtn_vnode_t *vn)
+{
+    if (vn) {
+        __atomic_add_fetch(&vn->vn_refs, 1, __ATOMIC_RELAXED);
+    }
+}
+
+/*
+ * rtn_vnode_put
+ *
+ * Drop a hold on a node, and free what is no longer held. The left
+ * subtree is done by recursion, the right one in the loop.
+ */
+static void
+rtn_vnode_put (rtn_views_t *vw, rtn_vnode_t *vn, int8_t locked)
+{
+    rtn_vnode_t *next;
+
+    while (vn && !__atomic_sub_fetch(&vn->vn_refs, 1, __ATOMIC_ACQ_REL)) {
+        if (vn->vn_info) {
+            rtn_vinfo_put(vw, vn->vn_info, locked);
+        }
+        rtn_vnode_put(vw, vn->vn_left, locked);
+        next = vn->vn_right;
+        free(vn);
+        vn = next;
+    }
+}
+
+/*
+ * rtn_vnode_new
+ *
+ * A node held once, by the link it goes into.
+ */
+static rtn_vnode_t *
+rtn_vnode_new (u_int16_t bit, rtn_vinfo_t *vi)
+{
+    rtn_vnode_t *vn;
+
+    vn = calloc(1, sizeof(rtn_vnode_t));
+    if (vn) {
+        vn->vn_refs = 1;
+        vn->vn_bit = bit;
+        vn->vn_info = vi;
+    }
+
+    return (vn);
+}
+
+/*
+ * rtn_vnode_own
+ *
+ * Make the node of a writable link writable, by copying it when it is
+ * held by anything else. Return NULL when out of memory.
+ */
+static rtn_vnode_t *
+rtn_vnode_own (rtn_views_t *vw, rtn_vnode_t **link)
+{
+    rtn_vnode_t *vn, *copy;
+
+    vn = *link;
+    if (__atomic_load_n(&vn->vn_refs, __ATOMIC_ACQUIRE) == 1) {
+        return (vn);
+    }
+
+    /*
+     * Field by field: vn_refs can change under us.
+     */
+    copy = rtn_vnode_new(vn->vn_bit, vn->vn_info);
+    if (!copy) {
+        return (NULL);
+    }
+
+    copy->vn_left = vn->vn_left;
+    copy->vn_right = vn->vn_right;
+    rtn_vnode_get(copy->vn_left);
+    rtn_vnode_get(copy->vn_right);
+    if (copy->vn_info) {
+        __atomic_add_fetch(&copy->vn_info->vi_refs, 1, __ATOMIC_RELAXED);
+    }
+
+    *link = copy;
+    rtn_vnode_put(vw, vn, TRUE);
+    vw->vw_copies++;
+
+    return (copy);
+}
+
+/*
+ * rtn_view_insert
+ *
+ * Add an info to the current version, as rtn_compact_add() does.
+ */
+static int8_t
+rtn_view_insert (rtn_views_t *vw, rt_info_t *rinfo)
+{
+    rtn_vnode_t **link, *vn, *child, *node;
+    rtn_vinfo_t *vi;
+    u_int8_t *addr, *his_addr;
+    u_int16_t bitlen, dbit;
+
+    addr = rinfo->rninfo_key;
+    bitlen = rinfo->rnode_bit;
+
+    /*
+     * Search down as far as we can, stopping at a node with a bit number
+     * >= ours which has info attached, and find the first bit in our
+     * address which differs from his address.
+     */
+    vn = vw->vw_root;
+    while ((vn->vn_bit < bitlen) || !vn->vn_info) {
+        child = *RTN_VIEW_LINK(vn, addr);
+        if (!child) {
+            break;
+        }
+        vn = child;
+    }
+
+    his_addr = vn->vn_info ? vn->vn_info->vi_info->rninfo_key : NULL;
+    assert(his_addr || (vn->vn_bit == 0));
+    dbit = his_addr ? rtn_key_diff(addr, his_addr,
+                                   MIN(vn->vn_bit, bitlen)) : 0;
+
+    /*
+     * Find the highest node with a bit number >= dbit on our path, and
+     * make writable what is going to change.
+     */
+    link = &vw->vw_root;
+    vn = vw->vw_root;
+    while (vn->vn_bit <= dbit) {
+        vn = rtn_vnode_own(vw, link);
+        if (!vn) {
+            return (FALSE);
+        }
+        if (vn->vn_bit == dbit) {
+            break;
+        }
+        link = RTN_VIEW_LINK(vn, addr);
+        vn = *link;
+        assert(vn);
+    }
+
+    if ((dbit == bitlen) && (vn->vn_bit == bitlen) && vn->vn_info) {
+        return (TRUE);
+    }
+
+    vi = calloc(1, sizeof(rtn_vinfo_t));
+    if (!vi) {
+        return (FALSE);
+    }
+    vi->vi_info = rinfo;
+    vi->vi_refs = 1;
+
+    if (vn->vn_bit == dbit) {
+        if (dbit == bitlen) {
+            vn->vn_info = vi;
+            return (TRUE);
+        }
+
+        /*
+         * Attach below him.
+         */
+        link = RTN_VIEW_LINK(vn, addr);
+        assert(!*link);
+        *link = rtn_vnode_new(bitlen, vi);
+        if (!*link) {
+            free(vi);
+            return (FALSE);
+        }
+        return (TRUE);
+    }
+
+    /*
+     * Insert above him, who keeps the hold of the link: either our node,
+     * or a split.
+     */
+    node = rtn_vnode_new(dbit, (dbit == bitlen) ? vi : NULL);
+    child = NULL;
+    if (node && (dbit != bitlen)) {
+        child = rtn_vnode_new(bitlen, vi);
+        if (!child) {
+            free(node);
+            node = NULL;
+        }
+    }
+    if (!node) {
+        free(vi);
+        return (FALSE);
+    }
+
+    if (child) {
+        *RTN_VIEW_LINK(node, addr) = child;
+    }
+    *RTN_VIEW_LINK(node, his_addr) = vn;
+    *link = node;
+
+    return (TRUE);
+}
+
+/*
+ * rtn_view_remove
+ *
+ * Remove an info from the current version. The root stays, and so does
+ * a node with info or with two children.
+ *
+ * With a view left, the record is put on vw_held first. With none, the
+ * info can only be in the current version, and the hold is not needed.
+ */
+static int8_t
+rtn_view_remove (rtn_views_t *vw, rt_info_t *rinfo)
+{
+    rtn_vnode_t **link, **plink, *vn, *pn, *child;
+    rtn_vinfo_t *vi;
+    u_int8_t *addr;
+    u_int16_t bitlen;
+
+    addr = rinfo->rninfo_key;
+    bitlen = rinfo->rnode_bit;
+
+    plink = NULL;
+    pn = NULL;
+    link = &vw->vw_root;
+    vn = vw->vw_root;
+    while (vn) {
+        vn = rtn_vnode_own(vw, link);
+        if (!vn) {
+            return (FALSE);
+        }
+        if (vn->vn_bit >= bitlen) {
+            break;
+        }
+        plink = link;
+        pn = vn;
+        link = RTN_VIEW_LINK(vn, addr);
+        vn = *link;
+    }
+
+    if (!vn || (vn->vn_bit != bitlen) || !vn->vn_info ||
+        (vn->vn_info->vi_info != rinfo)) {
+        return (TRUE);
+    }
+
+    vi = vn->vn_info;
+    if ((__atomic_load_n(&vw->vw_refs, __ATOMIC_ACQUIRE) > 1) &&
+        !vi->vi_held) {
+        rtn_view_held_add(vw, vi);
+    }
+    vn->vn_info = NULL;
+    rtn_vinfo_put(vw, vi, TRUE);
+
+    if (!pn || (vn->vn_left && vn->vn_right)) {
+        return (TRUE);
+    }
+
+    child = vn->vn_left ? vn->vn_left : vn->vn_right;
+    rtn_vnode_get(child);
+    *link = child;
+    rtn_vnode_put(vw, vn, TRUE);
+    if (child || (pn == vw->vw_root) || pn->vn_info) {
+        return (TRUE);
+    }
+
+    /*
+     * A leaf went, and left a split node with one child: pull the child
+     * up.
+     */
+    child = pn->vn_left ? pn->vn_left : pn->vn_right;
+    rtn_vnode_get(child);
+    *plink = child;
+    rtn_vnode_put(vw, pn, TRUE);
+
+    return (TRUE);
+}
+
+/*
+ * rtn_view_build
+ *
+ * Build the current version from the tree, with vw_mutex held. Return
+ * FALSE when out of memory, with no trie.
+ */
+static int8_t
+rtn_view_build (rtn_views_t *vw, rt_head_t *rt_head)
+{
+    rtn_vnode_t *root;
+    rt_node_t *rn;
+
+    root = rtn_vnode_new(0, NULL);
+    if (!root) {
+        return (FALSE);
+    }
+    vw->vw_root = root;
+    vw->vw_invalid = FALSE;
+
+    for (rn = rt_head->root; rn; rn = rtn_walk_next_node(rt_head->root, rn)) {
+        if ((rn->rnode_flags & RNODE_INFO) &&
+            !(rn->rnode_flags & RNODE_DELETED) &&
+            !rtn_view_insert(vw, (rt_info_t *) rn)) {
+            vw->vw_root = NULL;
+            rtn_vnode_put(vw, root, TRUE);
+            return (FALSE);
+        }
+    }
+
+    __atomic_store_n(&vw->vw_built, TRUE, __ATOMIC_RELAXED);
+    vw->vw_builds++;
+    return (TRUE);
+}
+
+/*
+ * rtn_view_change
+ *
+ * Start a change hook: take vw_mutex and return TRUE when the trie is
+ * to be changed. Drop the trie instead when nothing uses it.
+ */
+static inline int8_t
+rtn_view_change (rtn_views_t *vw)
+{
+    rtn_vnode_t *root;
+
+    if (!__atomic_load_n(&vw->vw_built, __ATOMIC_RELAXED)) {
+        return (FALSE);
+    }
+
+    pthread_mutex_lock(&vw->vw_mutex);
+    if (vw->vw_keep ||
+        (__atomic_load_n(&vw->vw_refs, __ATOMIC_ACQUIRE) > 1)) {
+        return (TRUE);
+    }
+
+    /*
+     * Only the tree holds the version, and nothing can be on vw_held.
+     */
+    assert(!vw->vw_held_count);
+    root = vw->vw_root;
+    vw->vw_root = NULL;
+    __atomic_store_n(&vw->vw_built, FALSE, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&vw->vw_mutex);
+
+    rtn_vnode_put(vw, root, FALSE);
+    return (FALSE);
+}
+
+/*
+ * rtn_view_add
+ */
+void
+rtn_view_add (rtn_views_t *vw, rt_info_t *rinfo)
+{
+    if (!rtn_view_change(vw)) {
+        return;
+    }
+    if (!vw->vw_invalid && !rtn_view_insert(vw, rinfo)) {
+        vw->vw_invalid = TRUE;
+    }
+    pthread_mutex_unlock(&vw->vw_mutex);
+}
+
+/*
+ * rtn_view_delete
+ *
+ * Remove an info, which is still in the tree. If the remove runs out of
+ * memory, the info stays in the current version, which keeps it until
+ * the views are freed.
+ */
+void
+rtn_view_delete (rtn_views_t *vw, rt_info_t *rinfo)
+{
+    if (!rtn_view_change(vw)) {
+        return;
+    }
+    if (!rtn_view_remove(vw, rinfo)) {
+        vw->vw_invalid = TRUE;
+    }
+    pthread_mutex_unlock(&vw->vw_mutex);
+}
+
+/*
+ * rtn_view_hold
+ *
+ * Called when the tree releases an info. Return TRUE when a view still
+ * holds it, and will free it instead of the tree.
+ */
+int8_t
+rtn_view_hold (rtn_views_t *vw, rt_info_t *rinfo)
+{
+    rtn_vinfo_t *vi;
+
+    if (!__atomic_load_n(&vw->vw_held_count, __ATOMIC_RELAXED)) {
+        return (FALSE);
+    }
+
+    pthread_mutex_lock(&vw->vw_mutex);
+    for (vi = vw->vw_held[rtn_view_hash(vw, rinfo)]; vi; vi = vi->vi_next) {
+        if ((vi->vi_info == rinfo) && !vi->vi_gone) {
+            vi->vi_gone = TRUE;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&vw->vw_mutex);
+
+    return (vi != NULL);
+}
+
+/*
+ * rtn_view_init
+ */
+int8_t
+rtn_view_init (rt_head_t *rt_head)
+{
+    rtn_views_t *vw;
+
+    if (rt_head->rt_view) {
+        return (TRUE);
+    }
+
+    vw = calloc(1, sizeof(rtn_views_t));
+    if (!vw) {
+        return (FALSE);
+    }
+
+    vw->vw_held = calloc(RTN_VIEW_HELD_MIN, sizeof(rtn_vinfo_t *));
+    if (!vw->vw_held) {
+        free(vw);
+        return (FALSE);
+    }
+
+    pthread_mutex_init(&vw->vw_mutex, NULL);
+    vw->vw_held_mask = RTN_VIEW_HELD_MIN - 1;
+    vw->vw_refs = 1;
+    vw->vw_ri_free = rt_head->ri_free;
+    vw->vw_flags = rt_head->flags;
+
+    rt_head->rt_view = vw;
+    return (TRUE);
+}
+
+/*
+ * rtn_view_keep
+ */
+int8_t
+rtn_view_keep (rt_head_t *rt_head)
+{
+    rtn_views_t *vw;
+    int8_t ok;
+
+    vw = rt_head->rt_view;
+    if (!vw) {
+        return (FALSE);
+    }
+
+    pthread_mutex_lock(&vw->vw_mutex);
+    ok = vw->vw_root ? TRUE : rtn_view_build(vw, rt_head);
+    if (ok) {
+        vw->vw_keep++;
+    }
+    pthread_mutex_unlock(&vw->vw_mutex);
+
+    return (ok);
+}
+
+/*
+ * rtn_view_unkeep
+ */
+void
+rtn_view_unkeep (rt_head_t *rt_head)
+{
+    rtn_views_t *vw;
+
+    vw = rt_head->rt_view;
+    if (vw) {
+        pthread_mutex_lock(&vw->vw_mutex);
+        assert(vw->vw_keep);
+        vw->vw_keep--;
+        pthread_mutex_unlock(&vw->vw_mutex);
+    }
+}
+
+/*
+ * rtn_view_unref
+ *
+ * Drop a hold on the trie, by the tree or a view, after it has dropped
+ * its version.
+ */
+static void
+rtn_view_unref (rtn_views_t *vw)
+{
+    if (__atomic_sub_fetch(&vw->vw_refs, 1, __ATOMIC_ACQ_REL)) {
+        return;
+    }
+
+    rtn_vnode_put(vw, vw->vw_root, FALSE);
+    assert(!vw->vw_held_count);
+    pthread_mutex_destroy(&vw->vw_mutex);
+    free(vw->vw_held);
+    free(vw);
+}
+
+/*
+ * rtn_view_free
+ *
+ * The current version goes with the last hold on the trie. An info the
+ * tree still has, and that a view holds, is never freed by the view.
+ */
+void
+rtn_view_free (rt_head_t *rt_head)
+{
+    rtn_views_t *vw;
+
+    vw = rt_head->rt_view;
+    if (!vw) {
+        return;
+    }
+    rt_head->rt_view = NULL;
+
+    pthread_mutex_lock(&vw->vw_mutex);
+    vw->vw_invalid = TRUE;
+    pthread_mutex_unlock(&vw->vw_mutex);
+
+    rtn_view_unref(vw);
+}
+
+/*
+ * rtn_view_take
+ */
+rtn_view_t *
+rtn_view_take (rt_head_t *rt_head)
+{
+    rtn_views_t *vw;
+    rtn_view_t *view;
+
+    vw = rt_head->rt_view;
+    if (!vw) {
+        return (NULL);
+    }
+
+    view = malloc(sizeof(rtn_view_t));
+    if (!view) {
+        return (NULL);
+    }
+
+    pthread_mutex_lock(&vw->vw_mutex);
+    if ((!vw->vw_root && !rtn_view_build(vw, rt_head)) || vw->vw_invalid) {
+        pthread_mutex_unlock(&vw->vw_mutex);
+        free(view);
+        return (NULL);
+    }
+    view->vv_views = vw;
+    view->vv_root = vw->vw_root;
+    view->vv_generation = __atomic_load_n(&rt_head->rt_generation,
+                                          __ATOMIC_RELAXED);
+    rtn_vnode_get(view->vv_root);
+    __atomic_add_fetch(&vw->vw_refs, 1, __ATOMIC_RELAXED);
+    vw->vw_taken++;
+    pthread_mutex_unlock(&vw->vw_mutex);
+
+    return (view);
+}
+
+/*
+ * rtn_view_release
+ */
+void
+rtn_view_release (rtn_view_t *view)
+{
+    if (view) {
+        rtn_vnode_put(view->vv_views, view->vv_root, FALSE);
+        rtn_view_unref(view->vv_views);
+        free(view);
+    }
+}
+
+/*
+ * rtn_view_search
+ */
+rt_info_t *
+rtn_view_search (rtn_view_t *view, char *addr, u_int16_t bitlen)
+{
+    rtn_vnode_t *vn;
+    rt_info_t *rinfo;
+
+    vn = view->vv_root;
+    while (vn && (vn->vn_bit < bitlen)) {
+        vn = *RTN_VIEW_LINK(vn, (u_int8_t *) addr);
+    }
+
+    if (!vn || (vn->vn_bit != bitlen) || !vn->vn_info) {
+        return (NULL);
+    }
+
+    rinfo = vn->vn_info->vi_info;
+    return (rtn_key_cmp(rinfo->rninfo_key, (u_int8_t *) addr, bitlen) ?
+            rinfo : NULL);
+}
+
+/*
+ * rtn_view_lookup
+ *
+ * Going down, each info on the path is checked against the address.
+ * The keys below a node share its first vn_bit bits, so the first one
+ * that does not match ends the search.
+ */
+rt_info_t *
+rtn_view_lookup (rtn_view_t *view, char *addr, u_int16_t maxbitlen)
+{
+    rtn_vnode_t *vn;
+    rt_info_t *rinfo, *best = NULL;
+
+    for (vn = view->vv_root; vn && (vn->vn_bit <= maxbitlen);
+         vn = (vn->vn_bit < maxbitlen) ?
+              *RTN_VIEW_LINK(vn, (u_int8_t *) addr) : NULL) {
+        if (!vn->vn_info) {
+            continue;
+        }
+        rinfo = vn->vn_info->vi_info;
+        if (!rtn_key_cmp(rinfo->rninfo_key, (u_int8_t *) addr, vn->vn_bit)) {
+            break;
+        }
+        best = rinfo;
+    }
+
+    return (best);
+}
+
+/*
+ * rtn_view_walk_node
+ *
+ * Pre-order, as rtn_walktree(). The depth is at most the key length.
+ */
+static int8_t
+rtn_view_walk_node (rtn_vnode_t *vn, rtn_walk_func f, va_list ap)
+{
+    va_list aq;
+    int rc;
+
+    for (; vn; vn = vn->vn_right) {
+        if (vn->vn_info) {
+            va_copy(aq, ap);
+            rc = (*f)(vn->vn_info->vi_info, aq);
+            va_end(aq);
+            if (rc == RTWALK_ABORT) {
+                return (-1);
+            }
+        }
+        if (rtn_view_walk_node(vn->vn_left, f, ap)) {
+            return (-1);
+        }
+    }
+
+    return (0);
+}
+
+/*
+ * rtn_view_walk
+ */
+int8_t
+rtn_view_walk (rtn_view_t *view, rtn_walk_func f, ...)
+{
+    va_list ap;
+    int8_t rc;
+
+    va_start(ap, f);
+    rc = rtn_view_walk_node(view->vv_root, f, ap);
+    va_end(ap);
+
+    return (rc);
+}
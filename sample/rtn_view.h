@@ -0,0 +1,194 @@
+/**
+ *  @name rtn_view.h, Point in time views of radix trees
+ *
+ *  API for rtn_view.c.
+ *
+ *  A view is an immutable copy of the set of infos of a tree, taken in
+ *  O(1) by rtn_view_take(). A reader can hold it as long as it likes,
+ *  e.g. for a show command or a long export, while rtn_add() and
+ *  rtn_delete() go on with the tree, and without any walk lock.
+ *
+ *  The views of a tree share a persistent trie, kept next to the tree
+ *  while a view is held. A change copies the path from the root to the
+ *  node it changes, when a view still holds that path, and updates it in
+ *  place otherwise. When no view is held, the first change drops the
+ *  trie, and the next rtn_view_take() builds it again from the tree, in
+ *  O(n). So rtn_view_init() alone costs the changes nothing, and a
+ *  change made while a view is held pays for the trie, about twice the
+ *  time of the change itself.
+ *
+ *  Since it may walk the tree, a take with no other view held must not
+ *  run alongside a change of the tree: it is done by the thread that
+ *  changes the tree, or under the lock of the changes. A take while
+ *  another view is held can run in any thread. A user that takes views
+ *  from other threads at any time, such as the compile thread of
+ *  rtn_lctrie.h, calls rtn_view_keep(), which keeps the trie up to date
+ *  even with no view held, at the cost above for every change.
+ *
+ *  An info deleted from the tree while a view holds it is not freed
+ *  until the last view holding it is released. It is then freed as the
+ *  tree would have done, i.e., by ri_free, or free() without
+ *  RTN_BIT_KEEP_INFO, possibly in the thread that releases the view.
+ *  The view keeps the info, and not its content: the fields of an info
+ *  changed in place by the owner of the tree, such as its version, are
+ *  seen as they are now.
+ *
+ *  The infos of a subtree detached by rtn_detach_subtree() belong to
+ *  the caller, who must keep them until the views taken before are
+ *  released.
+ *
+ *  The tree is changed by a single thread, as usual. Views can be read
+ *  and released by any thread, and taken as said above.
+ *
+ *     Copyright (c) 2016 Ericsson AB.
+ *
+ *     All rights reserved.
+ */
+
+#ifndef __RTN_VIEW_H__
+#define __RTN_VIEW_H__
+
+#include <pthread.h>
+#include "corelibs/rtn_radix.h"
+
+/*
+ * An info in the persistent trie, shared by all the nodes that hold it.
+ */
+typedef struct _rtn_vinfo_t
+{
+    rt_info_t   *vi_info;             /* the info */
+    struct _rtn_vinfo_t *vi_next;     /* chain in vw_held */
+    u_int32_t   vi_refs;              /* count of nodes holding it */
+    u_int8_t    vi_held;              /* on vw_held, deleted from tree */
+    u_int8_t    vi_gone;              /* to be freed by the last node */
+    u_int8_t    pad[2];
+} rtn_vinfo_t;
+
+/*
+ * A node of the persistent trie. There is no parent: a node can be in
+ * many versions, under different parents.
+ */
+typedef struct _rtn_vnode_t
+{
+    struct _rtn_vnode_t *vn_left;     /* child when bit clear */
+    struct _rtn_vnode_t *vn_right;    /* child when bit set */
+    rtn_vinfo_t *vn_info;             /* NULL for a split node */
+    u_int32_t   vn_refs;              /* count of parents and views */
+    u_int16_t   vn_bit;               /* bit number for node */
+    u_int8_t    pad[2];
+} rtn_vnode_t;
+
+/*
+ * The persistent trie of a tree.
+ */
+typedef struct _rtn_views_t
+{
+    rtn_vnode_t *vw_root;             /* current version, or NULL */
+    pthread_mutex_t vw_mutex;         /* vw_root, vw_held, vw_keep */
+    u_int32_t   vw_refs;              /* the tree, and each view */
+    u_int32_t   vw_keep;              /* count of rtn_view_keep() */
+    u_int8_t    vw_built;             /* vw_root is set, for the hooks */
+
+    rt_info_free vw_ri_free;          /* as the tree */
+    u_int8_t    vw_flags;             /* ... */
+    u_int8_t    vw_invalid;           /* out of memory, no more views */
+
+    rtn_vinfo_t **vw_held;            /* infos deleted but held, by address */
+    u_int32_t   vw_held_mask;         /* buckets - 1 */
+    u_int32_t   vw_held_count;        /* count of infos on vw_held */
+
+    u_int64_t   vw_taken;             /* count of views taken */
+    u_int64_t   vw_copies;            /* count of nodes copied */
+    u_int64_t   vw_builds;            /* count of builds of the trie */
+} rtn_views_t;
+
+/*
+ * A view.
+ */
+typedef struct _rtn_view_t
+{
+    rtn_views_t *vv_views;            /* the trie */
+    rtn_vnode_t *vv_root;             /* the version */
+    u_int64_t   vv_generation;        /* rt_generation when taken */
+} rtn_view_t;
+
+
+/**
+ * Allow views of a tree. The trie of the views is built by the first
+ * rtn_view_take().
+ *
+ * @param rt_head  head structure. Must not be NULL.
+ *
+ * @return
+ *     TRUE: succeed; FALSE: out of memory.
+ */
+extern int8_t rtn_view_init(rt_head_t *rt_head);
+
+/**
+ * Keep the trie of the views up to date even when no view is held, so
+ * that views can be taken by any thread at any time. Called by the
+ * thread that changes the tree, after rtn_view_init(); builds the trie
+ * when there is none. Undone by rtn_view_unkeep(); the calls nest.
+ *
+ * @return
+ *     TRUE: succeed; FALSE: no rtn_view_init(), or out of memory.
+ */
+extern int8_t rtn_view_keep(rt_head_t *rt_head);
+extern void rtn_view_unkeep(rt_head_t *rt_head);
+
+/**
+ * Stop keeping versions of a tree. Called by rtn_root_free(), once the
+ * tree has released its infos. The views already taken remain valid
+ * until released.
+ */
+extern void rtn_view_free(rt_head_t *rt_head);
+
+/**
+ * Take a view of the current content of a tree.
+ *
+ * @return
+ *     the view, or NULL when rtn_view_init() has not been called, or
+ *     when out of memory, now or during a change since the trie was
+ *     built.
+ */
+extern rtn_view_t *rtn_view_take(rt_head_t *rt_head);
+
+/**
+ * Release a view, and free what only it was holding.
+ */
+extern void rtn_view_release(rtn_view_t *view);
+
+/**
+ * Exact match in a view, as rtn_search().
+ */
+extern rt_info_t *rtn_view_search(rtn_view_t *view, char *addr,
+                                  u_int16_t bitlen);
+
+/**
+ * Best match in a view, as rtn_lookup().
+ */
+extern rt_info_t *rtn_view_lookup(rtn_view_t *view, char *addr,
+                                  u_int16_t maxbitlen);
+
+/**
+ * Walk the infos of a view in the order of rtn_walktree(), without
+ * lock or yield.
+ *
+ * @param view  the view.
+ * @param f     function to process an info.
+ * @param ...   arguments passed to f.
+ *
+ * @return
+ *      0: successful.
+ *     -1: aborted by f.
+ */
+extern int8_t rtn_view_walk(rtn_view_t *view, rtn_walk_func f, ...);
+
+/*
+ * Hooks, called by rtn_radix.c.
+ */
+extern void rtn_view_add(rtn_views_t *vw, rt_info_t *rinfo);
+extern void rtn_view_delete(rtn_views_t *vw, rt_info_t *rinfo);
+extern int8_t rtn_view_hold(rtn_views_t *vw, rt_info_t *rinfo);
+
+#endif  /* __RTN_VIEW_H__ */
@@ -0,0 +1,656 @@
+/***
+ *   rtn_wire.c
+ *
+ *   Streaming wire format of the radix trie.
+ *
+ *    Copyright (c) 2016 Ericsson AB.
+ *    All rights reserved.
+ *
+ ***
+ * Description:
+ *
+ * Both ends go through a buffer of RTN_WIRE_CHUNK bytes, and hash the
+ * bytes as they go in or out of it, so the checksum needs no second
+ * pass.
+ *
+ * The export keeps the key before, with the bits past its length
+ * cleared, to count the shared bytes. The payload is made in a scratch
+ * buffer first, since its length comes before it.
+ *
+ * The import hands rtn_bulk_load_iter() an iterator that reads the next
+ * info. A key already in the tree is skipped before decode is called:
+ * with rtn_search() when the tree was not empty at the start, else when
+ * it is the key before, the only place a duplicate can be in the order
+ * of the walk.
+ *
+ * The iterator does not know whether the info it returned before was
+ * inserted: it checks it on the next call, and when the import is over,
+ * and releases it when it is not linked in the tree. That is why the
+ * radix node part of an info is cleared before it is returned.
+ *
+ ***/
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <stdarg.h>
+#include <sys/types.h>
+
+#include "corelibs/rtn_radix.h"
+#include "corelibs/rtn_wire.h"
+#include "corelibs/rtn_snapshot.h"
+#include "rtn_private.h"
+
+#define RTN_WIRE_MAGIC          "RTNW"
+#define RTN_WIRE_HEADER         8
+#define RTN_WIRE_FNV_OFFSET     0xcbf29ce484222325ULL
+#define RTN_WIRE_FNV_PRIME      0x100000001b3ULL
+#define RTN_WIRE_VARINT_MAX     10      /* bytes of a 64 bit varint */
+
+typedef struct _rtn_wire_enc_t
+{
+    rtn_wire_encode_func we_encode;
+    void        *we_ectx;
+    rtn_wire_write_func we_write;
+    void        *we_wctx;
+    u_int64_t   we_hash;              /* of the bytes so far */
+    u_int32_t   we_used;              /* bytes in we_buf */
+    u_int32_t   we_count;             /* infos written */
+    u_int8_t    *we_scratch;          /* payload */
+    u_int32_t   we_scratch_size;
+    u_int32_t   we_prev_len;          /* bytes in we_prev */
+    int8_t      we_error;             /* write failed, errno set */
+    u_int8_t    pad[7];
+    u_int8_t    we_prev[RTN_WIRE_KEY_MAX]; /* key before, cleared */
+    u_int8_t    we_buf[RTN_WIRE_CHUNK];
+} rtn_wire_enc_t;
+
+typedef struct _rtn_wire_dec_t
+{
+    rt_head_t   *wd_head;
+    rtn_wire_decode_func wd_decode;
+    void        *wd_dctx;
+    rtn_wire_read_func wd_read;
+    void        *wd_rctx;
+    rt_info_t   *wd_prev;             /* info returned before */
+    u_int32_t   wd_tag;               /* bit length + 1 of wd_key, or 0 */
+    int8_t      wd_search;            /* tree not empty at the start */
+    u_int8_t    pad0[3];
+    u_int64_t   wd_hash;              /* of the bytes so far */
+    u_int32_t   wd_pos;               /* next byte in wd_buf */
+    u_int32_t   wd_end;               /* bytes in wd_buf */
+    u_int32_t   wd_count;             /* infos read */
+    u_int32_t   wd_key_len;           /* bytes in wd_key */
+    u_int8_t    *wd_payload;
+    u_int32_t   wd_payload_size;
+    int         wd_errno;             /* 0, or why it stopped */
+    int8_t      wd_done;              /* end of the stream seen */
+    u_int8_t    pad[7];
+    u_int8_t    wd_key[RTN_WIRE_KEY_MAX];
+    u_int8_t    wd_buf[RTN_WIRE_CHUNK];
+} rtn_wire_dec_t;
+
+/*
+ * rtn_wire_hash
+ */
+static inline u_int64_t
+rtn_wire_hash (u_int64_t hash, const u_int8_t *buf, u_int32_t len)
+{
+    u_int32_t i;
+
+    for (i = 0; i < len; i++) {
+        hash = (hash ^ buf[i]) * RTN_WIRE_FNV_PRIME;
+    }
+
+    return (hash);
+}
+
+/*
+ * rtn_wire_flush
+ */
+static int8_t
+rtn_wire_flush (rtn_wire_enc_t *we)
+{
+    if (we->we_used && !we->we_error &&
+        !(*we->we_write)(we->we_wctx, we->we_buf, we->we_used)) {
+        we->we_error = TRUE;
+    }
+    we->we_used = 0;
+
+    return (!we->we_error);
+}
+
+/*
+ * rtn_wire_put
+ *
+ * Add bytes to the stream. The hash is left to the caller, for the
+ * bytes that are not hashed.
+ */
+static int8_t
+rtn_wire_put (rtn_wire_enc_t *we, const u_int8_t *buf, u_int32_t len)
+{
+    u_int32_t n;
+
+    while (len) {
+        if (we->we_used == RTN_WIRE_CHUNK && !rtn_wire_flush(we)) {
+            return (FALSE);
+        }
+        n = MIN(len, RTN_WIRE_CHUNK - we->we_used);
+        memcpy(we->we_buf + we->we_used, buf, n);
+        we->we_used += n;
+        buf += n;
+        len -= n;
+    }
+
+    return (TRUE);
+}
+
+/*
+ * rtn_wire_put_hashed
+ */
+static inline int8_t
+rtn_wire_put_hashed (rtn_wire_enc_t *we, const u_int8_t *buf, u_int32_t len)
+{
+    we->we_hash = rtn_wire_hash(we->we_hash, buf, len);
+    return (rtn_wire_put(we, buf, len));
+}
+
+/*
+ * rtn_wire_put_varint
+ */
+static int8_t
+rtn_wire_put_varint (rtn_wire_enc_t *we, u_int64_t value)
+{
+    u_int8_t buf[RTN_WIRE_VARINT_MAX];
+    u_int32_t len = 0;
+
+    while (value >= 0x80) {
+        buf[len++] = (value & 0x7f) | 0x80;
+        value >>= 7;
+    }
+    buf[len++] = value;
+
+    return (rtn_wire_put_hashed(we, buf, len));
+}
+
+/*
+ * rtn_wire_export_info
+ *
+ * Walk function of the export: write an info.
+ */
+static int
+rtn_wire_export_info (rt_info_t *rinfo, va_list ap)
+{
+    rtn_wire_enc_t *we = va_arg(ap, rtn_wire_enc_t *);
+    u_int8_t *key = rinfo->rninfo_key;
+    u_int32_t len, shared, payload, size;
+    u_int16_t bitlen = rinfo->rnode_bit;
+
+    len = RNBYTE(bitlen + RNBBY - 1);
+    for (shared = 0; (shared < MIN(len, we->we_prev_len)) &&
+         (key[shared] == we->we_prev[shared]); shared++) {
+        ;
+    }
+    memcpy(we->we_prev + shared, key + shared, len - shared);
+    if (bitlen & 0x7) {
+        we->we_prev[len - 1] &= ~(0xff >> (bitlen & 0x7));
+    }
+    we->we_prev_len = len;
+
+    /*
+     * The payload, in the scratch buffer, grown if it is too small.
+     */
+    payload = 0;
+    if (we->we_encode) {
+        payload = (*we->we_encode)(we->we_ectx, rinfo, we->we_scratch,
+                                   we->we_scratch_size);
+        if (payload > we->we_scratch_size) {
+            size = MAX(payload, we->we_scratch_size * 2);
+            free(we->we_scratch);
+            we->we_scratch = malloc(size);
+            if (!we->we_scratch) {
+                we->we_scratch_size = 0;
+                errno = ENOMEM;
+                we->we_error = TRUE;
+                return (RTWALK_ABORT);
+            }
+            we->we_scratch_size = size;
+            payload = (*we->we_encode)(we->we_ectx, rinfo, we->we_scratch,
+                                       we->we_scratch_size);
+            payload = MIN(payload, we->we_scratch_size);
+        }
+    }
+
+    if (!rtn_wire_put_varint(we, (u_int64_t) bitlen + 1) ||
+        !rtn_wire_put_varint(we, shared) ||
+        !rtn_wire_put_hashed(we, we->we_prev + shared, len - shared) ||
+        !rtn_wire_put_varint(we, payload) ||
+        !rtn_wire_put_hashed(we, we->we_scratch, payload)) {
+        return (RTWALK_ABORT);
+    }
+    we->we_count++;
+
+    return (RTWALK_CONTINUE);
+}
+
+/*
+ * rtn_wire_export
+ */
+int8_t
+rtn_wire_export (rt_head_t *rt_head, rtn_wire_encode_func encode, void *ectx,
+                 rtn_wire_write_func write, void *wctx, u_int32_t *count)
+{
+    rtn_wire_enc_t *we;
+    u_int8_t header[RTN_WIRE_HEADER], trailer[8];
+    u_int64_t hash;
+    int8_t ok;
+    int err = 0;
+    u_int32_t i;
+
+    if (rt_head->rt_snapshot && !rtn_snapshot_promote(rt_head, NULL)) {
+        errno = ENOMEM;
+        return (FALSE);
+    }
+
+    we = calloc(1, sizeof(rtn_wire_enc_t));
+    if (!we) {
+        errno = ENOMEM;
+        return (FALSE);
+    }
+    we->we_encode = encode;
+    we->we_ectx   = ectx;
+    we->we_write  = write;
+    we->we_wctx   = wctx;
+    we->we_hash   = RTN_WIRE_FNV_OFFSET;
+
+    memset(header, 0, sizeof(header));
+    memcpy(header, RTN_WIRE_MAGIC, 4);
+    header[4] = RTN_WIRE_VERSION;
+
+    ok = rtn_wire_put_hashed(we, header, sizeof(header)) &&
+         (rtn_walktree(NULL, rtn_wire_export_info, rt_head, 0, FALSE, we) !=
+          RTWALK_ABORT) &&
+         !we->we_error &&
+         rtn_wire_put_varint(we, 0) &&
+         rtn_wire_put_varint(we, we->we_count);
+
+    if (ok) {
+        hash = we->we_hash;
+        for (i = 0; i < sizeof(trailer); i++) {
+            trailer[i] = hash >> (i * 8);
+        }
+        ok = rtn_wire_put(we, trailer, sizeof(trailer)) && rtn_wire_flush(we);
+    }
+    if (!ok) {
+        err = errno;
+    }
+
+    if (count) {
+        *count = we->we_count;
+    }
+    free(we->we_scratch);
+    free(we);
+
+    if (!ok) {
+        errno = err;
+    }
+    return (ok);
+}
+
+/*
+ * rtn_wire_fill
+ *
+ * Read the next chunk of the stream.
+ */
+static int8_t
+rtn_wire_fill (rtn_wire_dec_t *wd)
+{
+    int32_t len;
+
+    len = (*wd->wd_read)(wd->wd_rctx, wd->wd_buf, RTN_WIRE_CHUNK);
+    if (len <= 0) {
+        wd->wd_errno = (len < 0) ? errno : EINVAL;
+        return (FALSE);
+    }
+    wd->wd_pos = 0;
+    wd->wd_end = len;
+
+    return (TRUE);
+}
+
+/*
+ * rtn_wire_get
+ *
+ * Take bytes from the stream, and hash them when asked.
+ */
+static int8_t
+rtn_wire_get (rtn_wire_dec_t *wd, u_int8_t *buf, u_int32_t len, int8_t hash)
+{
+    u_int32_t n;
+
+    while (len) {
+        if ((wd->wd_pos == wd->wd_end) && !rtn_wire_fill(wd)) {
+            return (FALSE);
+        }
+        n = MIN(len, wd->wd_end - wd->wd_pos);
+        memcpy(buf, wd->wd_buf + wd->wd_pos, n);
+        if (hash) {
+            wd->wd_hash = rtn_wire_hash(wd->wd_hash, buf, n);
+        }
+        wd->wd_pos += n;
+        buf += n;
+        len -= n;
+    }
+
+    return (TRUE);
+}
+
+/*
+ * rtn_wire_get_varint
+ */
+static int8_t
+rtn_wire_get_varint (rtn_wire_dec_t *wd, u_int64_t *value)
+{
+    u_int8_t byte;
+    u_int32_t shift;
+
+    *value = 0;
+    for (shift = 0; shift < RTN_WIRE_VARINT_MAX * 7; shift += 7) {
+        if ((wd->wd_pos == wd->wd_end) && !rtn_wire_fill(wd)) {
+            return (FALSE);
+        }
+        byte = wd->wd_buf[wd->wd_pos++];
+        wd->wd_hash = (wd->wd_hash ^ byte) * RTN_WIRE_FNV_PRIME;
+        *value |= (u_int64_t) (byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            return (TRUE);
+        }
+    }
+
+    wd->wd_errno = EINVAL;
+    return (FALSE);
+}
+
+/*
+ * rtn_wire_trailer
+ *
+ * Check the end of the stream.
+ */
+static void
+rtn_wire_trailer (rtn_wire_dec_t *wd)
+{
+    u_int8_t trailer[8];
+    u_int64_t count, hash = 0;
+    u_int32_t i;
+
+    if (!rtn_wire_get_varint(wd, &count)) {
+        return;
+    }
+    if (!rtn_wire_get(wd, trailer, sizeof(trailer), FALSE)) {
+        return;
+    }
+    for (i = 0; i < sizeof(trailer); i++) {
+        hash |= (u_int64_t) trailer[i] << (i * 8);
+    }
+
+    if ((count != wd->wd_count) || (hash != wd->wd_hash)) {
+        wd->wd_errno = EINVAL;
+        return;
+    }
+    wd->wd_done = TRUE;
+}
+
+/*
+ * rtn_wire_drop
+ *
+ * Release the info returned before when the tree did not take it, as
+ * the tree releases a deleted one. A duplicate the checks of
+ * rtn_wire_next() let through (in a stream out of order) is skipped;
+ * anything else is out of memory, and stops the import.
+ */
+static void
+rtn_wire_drop (rtn_wire_dec_t *wd)
+{
+    rt_head_t *rt_head = wd->wd_head;
+    rt_info_t *rinfo = wd->wd_prev;
+
+    wd->wd_prev = NULL;
+    if (!rinfo || rinfo->rnode_parent ||
+        (rt_head->root == (rt_node_t *) rinfo)) {
+        return;
+    }
+
+    if (!rtn_search(rt_head, (char *) rinfo->rninfo_key, wd->wd_tag - 1) &&
+        !wd->wd_errno) {
+        wd->wd_errno = ENOMEM;
+    }
+    if (rt_head->ri_free) {
+        (*rt_head->ri_free)(rinfo);
+    } else if (!(rt_head->flags & RTN_BIT_KEEP_INFO)) {
+        free(rinfo);
+    }
+}
+
+/*
+ * rtn_wire_read_info
+ *
+ * Read the key of the next info to wd_key, and its payload. FALSE at
+ * the end of the stream, or on an error.
+ */
+static int8_t
+rtn_wire_read_info (rtn_wire_dec_t *wd, u_int16_t *bitlen, u_int32_t *len,
+                    int8_t *dup)
+{
+    u_int64_t tag, shared, size;
+    u_int32_t key_len;
+
+    if (wd->wd_done || wd->wd_errno || !rtn_wire_get_varint(wd, &tag)) {
+        return (FALSE);
+    }
+    if (!tag) {
+        rtn_wire_trailer(wd);
+        return (FALSE);
+    }
+
+    if ((tag > 0x10000) || !rtn_wire_get_varint(wd, &shared)) {
+        wd->wd_errno = wd->wd_errno ? wd->wd_errno : EINVAL;
+        return (FALSE);
+    }
+    *bitlen = tag - 1;
+    key_len = RNBYTE(*bitlen + RNBBY - 1);
+    if ((shared > key_len) || (shared > wd->wd_key_len)) {
+        wd->wd_errno = EINVAL;
+        return (FALSE);
+    }
+    *dup = (tag == wd->wd_tag) && (shared == key_len);
+    if (!rtn_wire_get(wd, wd->wd_key + shared, key_len - shared, TRUE)) {
+        return (FALSE);
+    }
+    wd->wd_key_len = key_len;
+    wd->wd_tag = tag;
+
+    if (!rtn_wire_get_varint(wd, &size)) {
+        return (FALSE);
+    }
+    if (size > RTN_WIRE_PAYLOAD_MAX) {
+        wd->wd_errno = EINVAL;
+        return (FALSE);
+    }
+    *len = size;
+    if (*len > wd->wd_payload_size) {
+        free(wd->wd_payload);
+        wd->wd_payload = malloc(MAX(*len, wd->wd_payload_size * 2));
+        if (!wd->wd_payload) {
+            wd->wd_payload_size = 0;
+            wd->wd_errno = ENOMEM;
+            return (FALSE);
+        }
+        wd->wd_payload_size = MAX(*len, wd->wd_payload_size * 2);
+    }
+    if (!rtn_wire_get(wd, wd->wd_payload, *len, TRUE)) {
+        return (FALSE);
+    }
+    wd->wd_count++;
+
+    return (TRUE);
+}
+
+/*
+ * rtn_wire_next
+ *
+ * Iterator of rtn_bulk_load_iter(): read the next info that is not in
+ * the tree.
+ */
+static rt_info_t *
+rtn_wire_next (void *arg, u_int16_t *bitlen)
+{
+    rtn_wire_dec_t *wd = arg;
+    rt_info_t *rinfo;
+    u_int32_t len;
+    int8_t dup;
+
+    rtn_wire_drop(wd);
+
+    while (rtn_wire_read_info(wd, bitlen, &len, &dup)) {
+        if (wd->wd_search) {
+            dup = (rtn_search(wd->wd_head, (char *) wd->wd_key, *bitlen) !=
+                   NULL);
+        }
+        if (dup) {
+            continue;
+        }
+
+        rinfo = (*wd->wd_decode)(wd->wd_dctx, wd->wd_key, *bitlen,
+                                 wd->wd_payload, len);
+        if (!rinfo) {
+            wd->wd_errno = ENOMEM;
+            return (NULL);
+        }
+        memset(rinfo, 0, sizeof(rt_node_t));
+        wd->wd_prev = rinfo;
+
+        return (rinfo);
+    }
+
+    return (NULL);
+}
+
+/*
+ * rtn_wire_import
+ */
+int8_t
+rtn_wire_import (rt_head_t *rt_head, rtn_wire_decode_func decode, void *dctx,
+                 rtn_wire_read_func read, void *rctx, u_int32_t *count)
+{
+    rtn_wire_dec_t *wd;
+    u_int8_t header[RTN_WIRE_HEADER];
+    u_int32_t added = 0;
+    int err;
+
+    if (count) {
+        *count = 0;
+    }
+    if (rt_head->rt_snapshot && !rtn_snapshot_promote(rt_head, NULL)) {
+        errno = ENOMEM;
+        return (FALSE);
+    }
+
+    wd = calloc(1, sizeof(rtn_wire_dec_t));
+    if (!wd) {
+        errno = ENOMEM;
+        return (FALSE);
+    }
+    wd->wd_head   = rt_head;
+    wd->wd_decode = decode;
+    wd->wd_dctx   = dctx;
+    wd->wd_read   = read;
+    wd->wd_rctx   = rctx;
+    wd->wd_hash   = RTN_WIRE_FNV_OFFSET;
+    wd->wd_search = (rt_head->ri_count != 0);
+
+    if (rtn_wire_get(wd, header, sizeof(header), TRUE)) {
+        if (memcmp(header, RTN_WIRE_MAGIC, 4) ||
+            (header[4] != RTN_WIRE_VERSION)) {
+            wd->wd_errno = EINVAL;
+        } else {
+            added = rtn_bulk_load_iter(rt_head, rtn_wire_next, wd);
+            rtn_wire_drop(wd);
+        }
+    }
+
+    if (count) {
+        *count = added;
+    }
+    err = wd->wd_errno ? wd->wd_errno : (wd->wd_done ? 0 : EINVAL);
+    free(wd->wd_payload);
+    free(wd);
+
+    if (err) {
+        errno = err;
+        return (FALSE);
+    }
+    return (TRUE);
+}
+
+/*
+ * rtn_wire_write_fd
+ */
+static int8_t
+rtn_wire_write_fd (void *ctx, const u_int8_t *buf, u_int32_t len)
+{
+    int fd = *(int *) ctx;
+    ssize_t n;
+
+    while (len) {
+        n = write(fd, buf, len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return (FALSE);
+        }
+        buf += n;
+        len -= n;
+    }
+
+    return (TRUE);
+}
+
+/*
+ * rtn_wire_read_fd
+ */
+static int32_t
+rtn_wire_read_fd (void *ctx, u_int8_t *buf, u_int32_t size)
+{
+    int fd = *(int *) ctx;
+    ssize_t n;
+
+    do {
+        n = read(fd, buf, size);
+    } while ((n < 0) && (errno == EINTR));
+
+    return (n);
+}
+
+/*
+ * rtn_wire_export_fd
+ */
+int8_t
+rtn_wire_export_fd (rt_head_t *rt_head, int fd, rtn_wire_encode_func encode,
+                    void *ectx, u_int32_t *count)
+{
+    return (rtn_wire_export(rt_head, encode, ectx, rtn_wire_write_fd, &fd,
+                            count));
+}
+
+/*
+ * rtn_wire_import_fd
+ */
+int8_t
+rtn_wire_import_fd (rt_head_t *rt_head, int fd, rtn_wire_decode_func decode,
+                    void *dctx, u_int32_t *count)
+{
+    return (rtn_wire_import(rt_head, decode, dctx, rtn_wire_read_fd, &fd,
+                            count));
+}
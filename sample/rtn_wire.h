@@ -0,0 +1,156 @@
+/**
+ *  @name rtn_wire.h, Streaming wire format of radix trees
+ *
+ *  API for rtn_wire.c.
+ *
+ *  rtn_wire_export() writes the infos of a tree as a stream, in chunks
+ *  of RTN_WIRE_CHUNK bytes, e.g. to a pipe or a socket to a standby, or
+ *  to a file. rtn_wire_import() reads such a stream and inserts the
+ *  infos with rtn_bulk_load_iter() as they come, so the two ends work at
+ *  the same time and neither holds the whole table in a buffer.
+ *
+ *  The infos come in the order of rtn_walktree(), the one that
+ *  rtn_bulk_load() wants. A key is sent as the count of leading bytes it
+ *  shares with the key before it and the bytes that differ, and the
+ *  payload of an info is a blob of its own length, made and read by the
+ *  owner of the tree. All the numbers are varints (7 bits a byte, low
+ *  bits first):
+ *
+ *     header:   "RTNW", version, 3 zero bytes
+ *     info:     bit length + 1, shared key bytes, the other key bytes,
+ *               payload length, payload
+ *     end:      0, count of infos, FNV-1a 64 of all the bytes before,
+ *               8 bytes, little endian
+ *
+ *  The bits of a key past its bit length are sent as 0.
+ *
+ *  The export walks the tree in the calling thread with no yield: no
+ *  other thread may change the tree meanwhile. A mapped snapshot is
+ *  promoted first, on both sides.
+ *
+ *     Copyright (c) 2016 Ericsson AB.
+ *
+ *     All rights reserved.
+ */
+
+#ifndef __RTN_WIRE_H__
+#define __RTN_WIRE_H__
+
+#include "corelibs/rtn_radix.h"
+
+#define RTN_WIRE_VERSION        1
+#define RTN_WIRE_CHUNK          65536       /* bytes written or read at once */
+#define RTN_WIRE_KEY_MAX        8192        /* bytes of a 65535 bit key */
+#define RTN_WIRE_PAYLOAD_MAX    (1 << 24)   /* largest payload read */
+
+/**
+ * Make the payload of an info.
+ *
+ * @param ctx    as passed to rtn_wire_export().
+ * @param rinfo  the info.
+ * @param buf    where to write the payload.
+ * @param size   room in buf.
+ *
+ * @return
+ *     the length of the payload. When more than size, nothing needs to
+ *     be written, and the function is called again with enough room.
+ */
+typedef u_int32_t (*rtn_wire_encode_func)(void *ctx, rt_info_t *rinfo,
+                                          u_int8_t *buf, u_int32_t size);
+
+/**
+ * Make an info from a key and a payload. The info is allocated so that
+ * the ri_free of the tree, or free() without one, can free it, and its
+ * rninfo_key is set to a copy of the key. Its radix node part is
+ * cleared by the caller.
+ *
+ * @param ctx      as passed to rtn_wire_import().
+ * @param key      the key, (bitlen + 7) / 8 bytes, only valid in the call.
+ * @param bitlen   the bit length.
+ * @param payload  the payload, only valid in the call.
+ * @param len      the length of the payload.
+ *
+ * @return
+ *     the info, or NULL to stop the import.
+ */
+typedef rt_info_t *(*rtn_wire_decode_func)(void *ctx, const u_int8_t *key,
+                                           u_int16_t bitlen,
+                                           const u_int8_t *payload,
+                                           u_int32_t len);
+
+/**
+ * Write a chunk of the stream.
+ *
+ * @return
+ *     TRUE: succeed; FALSE: fail, with errno set.
+ */
+typedef int8_t (*rtn_wire_write_func)(void *ctx, const u_int8_t *buf,
+                                      u_int32_t len);
+
+/**
+ * Read up to size bytes of the stream.
+ *
+ * @return
+ *     the count of bytes read, 0 at the end of the stream, or -1 on an
+ *     error, with errno set.
+ */
+typedef int32_t (*rtn_wire_read_func)(void *ctx, u_int8_t *buf,
+                                      u_int32_t size);
+
+
+/**
+ * Write the infos of a tree as a stream.
+ *
+ * @param rt_head  head structure. Must not be NULL.
+ * @param encode   makes the payload of an info, or NULL for none.
+ * @param ectx     passed to encode.
+ * @param write    writes a chunk.
+ * @param wctx     passed to write.
+ * @param count    set to the count of infos written, could be NULL.
+ *
+ * @return
+ *     TRUE: succeed; FALSE: fail, with errno set.
+ */
+extern int8_t rtn_wire_export(rt_head_t *rt_head, rtn_wire_encode_func encode,
+                              void *ectx, rtn_wire_write_func write,
+                              void *wctx, u_int32_t *count);
+
+/**
+ * Read a stream, and insert its infos in a tree. An info already in the
+ * tree is skipped, and decode is not called for it.
+ *
+ * When the tree cannot take an info, out of memory, the import stops,
+ * and the info is given to ri_free, or to free() without
+ * RTN_BIT_KEEP_INFO. With it, the info is left to the owner of the tree,
+ * as a deleted one is.
+ *
+ * @param rt_head  head structure. Must not be NULL.
+ * @param decode   makes an info.
+ * @param dctx     passed to decode.
+ * @param read     reads the stream.
+ * @param rctx     passed to read.
+ * @param count    set to the count of infos inserted, could be NULL.
+ *
+ * @return
+ *     TRUE: succeed; FALSE: fail, with errno set: EINVAL for a bad
+ *     stream, ENOMEM when decode returned NULL or the tree is out of
+ *     memory, or the errno of read.
+ *     The infos read before the failure are left in the tree.
+ */
+extern int8_t rtn_wire_import(rt_head_t *rt_head, rtn_wire_decode_func decode,
+                              void *dctx, rtn_wire_read_func read,
+                              void *rctx, u_int32_t *count);
+
+/**
+ * rtn_wire_export() and rtn_wire_import() to and from a file
+ * descriptor, e.g. of a pipe, a socket or a file. The export uses write():
+ * SIGPIPE should be ignored when the reader could go away first.
+ */
+extern int8_t rtn_wire_export_fd(rt_head_t *rt_head, int fd,
+                                 rtn_wire_encode_func encode, void *ectx,
+                                 u_int32_t *count);
+extern int8_t rtn_wire_import_fd(rt_head_t *rt_head, int fd,
+                                 rtn_wire_decode_func decode, void *dctx,
+                                 u_int32_t *count);
+
+#endif  /* __RTN_WIRE_H__ */
@@ -7,11 +7,18 @@
  * The xtimer is a tree-based timer facility derived from the ptimer
  * but is simpler and scales better due to its use of the absolute
  * system timestamp, and a balanced binary tree for the timers.
+ *
+ * A pool made by xtimer_pool_create_hugepage() takes its buckets from
+ * an arena of 2 MB huge pages (rtn_arena.h) instead of the chunk, so a
+ * walk down a large timer tree takes fewer TLB misses. The buckets are
+ * allocated and freed under the same lock as the tree, so the arena
+ * needs none.
  */
 
 #include "corelibs/rbtree.h"
 #include "corelibs/chunk.h"
 #include "corelibs/xtimers.h"
+#include "corelibs/rtn_arena.h"
 
 /*
  * Flags for a timer.
@@ -39,6 +46,7 @@ typedef struct xtimer_pool
     dbl_qhead_t     xtimer_expiredQ;      /* all the expired timers */
     rbtree_t        xtimer_tree;          /* tree for running timers */
     chunk_header_t  *xtimer_chunk;        /* for tree node */
+    rtn_arena_t     xtimer_arena;         /* for tree node, no chunk */
     u_int32_t       xtimer_unit;          /* timer resolution */
     u_int32_t       xtimer_bits;          /* bits to be shifted */
 
@@ -112,11 +120,30 @@ static void
 xtimer_node_free_func (rbnode_t *bucket, void *ctx)
 {
     xtimer_pool_t* xtp = (xtimer_pool_t*) ctx;
-    if (xtp != NULL) {
+    if (xtp == NULL) {
+        return;
+    }
+    if (xtp->xtimer_chunk != NULL) {
         chunk_free(xtp->xtimer_chunk, bucket);
+    } else {
+        rtn_arena_free(&xtp->xtimer_arena, bucket);
     }
 }
 
+/*
+ * xtimer_bucket_alloc
+ *
+ * Allocate a zero'ed bucket, from the chunk or the huge page arena.
+ */
+static inline xtimer_bucket_t *
+xtimer_bucket_alloc (xtimer_pool_t* xtp)
+{
+    if (xtp->xtimer_chunk != NULL) {
+        return (chunk_alloc(xtp->xtimer_chunk, TRUE));
+    }
+    return (rtn_arena_alloc(&xtp->xtimer_arena));
+}
+
 /*
  * find_max_bits
  *
@@ -152,7 +179,8 @@ xtimer_tstamp_us (const xtimer_pool_t* xtp)
 static int
 xtimer_pool_init_internal (xtimer_pool_t* xtp,
                            u_int32_t time_unit_ms,
-                           xtimer_clock_type_t clock_type)
+                           xtimer_clock_type_t clock_type,
+                           u_int8_t hugepage)
 {
     int32_t ret;
     pthread_condattr_t xtimer_w_condattr;
@@ -175,14 +203,20 @@ xtimer_pool_init_internal (xtimer_pool_t* xtp,
     xtp->xtimer_bits = find_max_bits(xtp->xtimer_unit);
 
     /*
-     * Init the bucket chunk.
+     * Init the bucket chunk, or the huge page arena.
      */
-    xtp->xtimer_chunk =
-        chunk_header_init(sizeof(xtimer_bucket_t), 1,
-                          CHUNK_FLAGS_MALLOC | CHUNK_FLAGS_ALIGN_64,
-                          "xtimer bucket");
-    if (xtp->xtimer_chunk == NULL) {
-        return (-EINVAL);
+    if (hugepage) {
+        xtp->xtimer_chunk = NULL;
+        rtn_arena_init(&xtp->xtimer_arena, sizeof(xtimer_bucket_t),
+                       RTN_ARENA_F_ALIGN | RTN_ARENA_F_HUGEPAGE);
+    } else {
+        xtp->xtimer_chunk =
+            chunk_header_init(sizeof(xtimer_bucket_t), 1,
+                              CHUNK_FLAGS_MALLOC | CHUNK_FLAGS_ALIGN_64,
+                              "xtimer bucket");
+        if (xtp->xtimer_chunk == NULL) {
+            return (-EINVAL);
+        }
     }
 
     switch(clock_type){
@@ -264,7 +298,8 @@ xtimer_glob_init_v2 (const xtimer_init_info_t *info_p)
     }
     return (xtimer_pool_init_internal(&xtimer_default_pool,
                                       info_p->time_unit_ms,
-                                      info_p->clock_type));
+                                      info_p->clock_type,
+                                      FALSE));
 }
 
 /*
@@ -293,13 +328,15 @@ void* xtimer_pool_create (u_int32_t time_unit_ms)
 }
 
 /*
- * xtimer_pool_create_v2
- *
- * Create and initialize the variables for a new xtimer pool.
+ * xtimer_pool_create_internal
  *
+ * Create and initialize the variables for a new xtimer pool, with its
+ * buckets in the chunk or in a huge page arena.
  */
-int xtimer_pool_create_v2 (const xtimer_init_info_t *info_p,
-                           void  **pool_p)
+static int
+xtimer_pool_create_internal (const xtimer_init_info_t *info_p,
+                             void **pool_p,
+                             u_int8_t hugepage)
 {
     int ret = 0;
 
@@ -315,7 +352,8 @@ int xtimer_pool_create_v2 (const xtimer_init_info_t *info_p,
     }
     ret = xtimer_pool_init_internal(xtp,
                                     info_p->time_unit_ms,
-                                    info_p->clock_type);
+                                    info_p->clock_type,
+                                    hugepage);
     if (ret < 0) {
         free(xtp);
     } else {
@@ -325,10 +363,38 @@ int xtimer_pool_create_v2 (const xtimer_init_info_t *info_p,
     return (ret);
 }
 
+/*
+ * xtimer_pool_create_v2
+ *
+ * Create and initialize the variables for a new xtimer pool.
+ *
+ */
+int xtimer_pool_create_v2 (const xtimer_init_info_t *info_p,
+                           void  **pool_p)
+{
+    return (xtimer_pool_create_internal(info_p, pool_p, FALSE));
+}
+
+/*
+ * xtimer_pool_create_hugepage
+ *
+ * Create and initialize the variables for a new xtimer pool, as
+ * xtimer_pool_create_v2() does, with the buckets on huge pages. Meant
+ * for pools of many timers: the first slab of buckets is 2 MB.
+ */
+int xtimer_pool_create_hugepage (const xtimer_init_info_t *info_p,
+                                 void  **pool_p)
+{
+    return (xtimer_pool_create_internal(info_p, pool_p, TRUE));
+}
+
 void xtimer_pool_destroy (void** pool)
 {
     xtimer_pool_t* xtp = (pool != NULL) ? *((xtimer_pool_t**) pool) : NULL;
     if (xtp != NULL) {
+        if (xtp->xtimer_chunk == NULL) {
+            rtn_arena_destroy(&xtp->xtimer_arena);
+        }
         free(xtp);
         *pool = NULL;
     }
@@ -440,7 +506,7 @@ xtimer_start_internal (xtimer_pool_t* xtp, xtimer_t *tm, u_int64_t ms)
         return;
     }
 
-    new = chunk_alloc(xtp->xtimer_chunk, TRUE);
+    new = xtimer_bucket_alloc(xtp);
     if (!new) {
         return;
     }